@@ -9,6 +9,7 @@
 #define _LUSTRE_H_
 
 #include <asm/types.h>
+#include <linux/stat.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -97,6 +98,7 @@ struct obd_uuid {
 #define LLAPI_LAYOUT_WIDE       (LLAPI_LAYOUT_INVALID + 2)
 
 #define LLAPI_LAYOUT_RAID0    0
+#define LLAPI_LAYOUT_MDT      2
 
 #define LLAPI_LAYOUT_RELEASED 0x0100
 
@@ -129,9 +131,12 @@ void lus_log_set_callback(lus_log_callback_t cb);
 struct lus_fs_handle;
 void lus_close_fs(struct lus_fs_handle *lfsh);
 int lus_open_fs(const char *mount_path, struct lus_fs_handle **lfsh);
+int lus_open_fs_for_path(const char *path, struct lus_fs_handle **lfsh);
+int lus_open_fs_fd(int fd, struct lus_fs_handle **lfsh);
 const char *lus_get_fsname(const struct lus_fs_handle *lfsh);
 const char *lus_get_mountpoint(const struct lus_fs_handle *lfsh);
 unsigned int lus_get_client_version(const struct lus_fs_handle *lfsh);
+int lus_set_thread_count(struct lus_fs_handle *lfsh, unsigned int count);
 
 /*
  * LOV
@@ -171,9 +176,19 @@ struct lus_layout;
 int lus_layout_get_by_path(const char *path, uint32_t flags,
 			   struct lus_layout **layout);
 int lus_layout_get_by_fd(int fd, struct lus_layout **layout);
+int lus_layout_get_by_name(int dir_fd, const char *name,
+			   struct lus_layout **layout);
 int lus_layout_get_by_fid(const struct lus_fs_handle *lfsh,
 			  const lustre_fid *fid,
 			  struct lus_layout **layout);
+int lus_layout_get_expected(const struct lus_fs_handle *lfsh,
+			    const char *path, struct lus_layout **layout);
+ssize_t lus_layout_expected_many(const struct lus_fs_handle *lfsh,
+				 const char * const *paths, size_t count,
+				 struct lus_layout **layouts, int *errors);
+int lus_getfileinfo_by_fid(const struct lus_fs_handle *lfsh,
+			   const lustre_fid *fid, struct stat *st,
+			   struct lus_layout **layout);
 int lus_layout_alloc(unsigned int num_stripes, struct lus_layout **layout);
 void lus_layout_free(struct lus_layout *layout);
 uint64_t lus_layout_stripe_get_count(const struct lus_layout *layout);
@@ -193,6 +208,8 @@ int lus_layout_get_pool_name(const struct lus_layout *layout,
 			     char *pool_name, size_t pool_name_len);
 int lus_layout_set_pool_name(struct lus_layout *layout,
 			     const char *pool_name);
+int lus_layout_check_osts(const struct lus_fs_handle *lfsh,
+			  const struct lus_layout *layout);
 int lus_set_lov_layout(int fd, const struct lov_user_md *lum);
 int lus_layout_file_open(const char *path, int open_flags, mode_t mode,
 			 const struct lus_layout *layout);
@@ -200,19 +217,182 @@ int lus_layout_file_openat(int dir_fd, const char *path, int open_flags,
 			   mode_t mode, const struct lus_layout *layout);
 int lus_layout_file_create(const char *path, int open_flags, int mode,
 			   const struct lus_layout *layout);
+
+/* A layout encoded once, to create many files with. */
+struct lus_layout_prepared;
+
+int lus_layout_prepare(const struct lus_layout *layout,
+		       struct lus_layout_prepared **prepared);
+void lus_layout_prepared_free(struct lus_layout_prepared *prepared);
+ssize_t lus_layout_create_many(const struct lus_fs_handle *lfsh, int dir_fd,
+			       const char * const *names, size_t count,
+			       const struct lus_layout_prepared *prepared,
+			       mode_t mode, int *errors);
+
 int lus_fswap_layouts(int fd1, int fd2, uint64_t dv1, uint64_t dv2,
 		      uint64_t flags);
 int lus_lovxattr_to_layout(struct lov_user_md *lum, size_t lum_len,
 			   struct lus_layout **layout);
 
+/* A part of a file range that is on a single stripe, as returned by
+ * lus_layout_map_extent(). */
+struct lus_layout_extent {
+	uint64_t offset;	/* offset in the file */
+	uint64_t length;	/* up to the end of the stripe unit */
+	uint64_t stripe;	/* stripe number */
+	uint64_t ost_index;	/* or LLAPI_LAYOUT_DEFAULT if unknown */
+	uint64_t object_offset;	/* offset in the OST object */
+};
+
+/* Iterator over the extents of a file range. The fields are
+ * private. */
+struct lus_layout_extent_iter {
+	const struct lus_layout *lei_layout;
+	uint64_t lei_stripe_size;
+	uint64_t lei_stripe_count;
+	uint64_t lei_offset;
+	uint64_t lei_end;
+};
+
+int lus_layout_map_extent(const struct lus_layout *layout, uint64_t offset,
+			  uint64_t length, struct lus_layout_extent *extent);
+int lus_layout_extent_iter_init(struct lus_layout_extent_iter *iter,
+				const struct lus_layout *layout,
+				uint64_t offset, uint64_t length);
+bool lus_layout_extent_iter_next(struct lus_layout_extent_iter *iter,
+				 struct lus_layout_extent *extent);
+int lus_layout_map_offsets(const struct lus_layout *layout,
+			   const uint64_t *offsets, size_t count,
+			   struct lus_layout_extent *extents);
+
+/* A read-only view of a lustre.lov extended attribute, decoded in
+ * place. The fields are private. */
+struct lus_layout_view {
+	const struct lov_user_md *lv_lum;	/* NULL if no layout */
+	const struct lov_user_ost_data_v1 *lv_objects;
+	unsigned int lv_object_count;
+	bool lv_swab;
+};
+
+int lus_layout_view_init(struct lus_layout_view *view, const void *lum,
+			 size_t lum_len);
+int lus_layout_view_get_by_fd(int fd, void *buf, size_t buf_len,
+			      struct lus_layout_view *view);
+uint64_t lus_layout_view_pattern_get(const struct lus_layout_view *view);
+uint64_t lus_layout_view_pattern_get_flags(const struct lus_layout_view *view);
+uint64_t lus_layout_view_stripe_get_size(const struct lus_layout_view *view);
+uint64_t lus_layout_view_stripe_get_count(const struct lus_layout_view *view);
+int lus_layout_view_get_ost_index(const struct lus_layout_view *view,
+				  uint64_t stripe_number, uint64_t *idx);
+int lus_layout_view_get_pool_name(const struct lus_layout_view *view,
+				  char *pool_name, size_t pool_name_len);
+int lus_layout_view_to_layout(const struct lus_layout_view *view,
+			      struct lus_layout **layout);
+
+/* Flag for lus_layout_hash(), lus_layout_equal() and
+ * lus_layout_table_create(): also compare the OST of every stripe. */
+#define LUS_LAYOUT_CMP_OSTS (1 << 0)
+
+uint64_t lus_layout_hash(const struct lus_layout *layout, unsigned int flags);
+bool lus_layout_equal(const struct lus_layout *a, const struct lus_layout *b,
+		      unsigned int flags);
+
+/* Interning of layouts. */
+struct lus_layout_table;
+
+struct lus_layout_table_stats {
+	size_t lts_layouts;	/* distinct layouts held */
+	size_t lts_refs;	/* references on them */
+	size_t lts_bytes;	/* memory used by the table */
+};
+
+int lus_layout_table_create(unsigned int flags,
+			    struct lus_layout_table **table);
+void lus_layout_table_destroy(struct lus_layout_table *table);
+int lus_layout_intern(struct lus_layout_table *table,
+		      const struct lus_layout *layout,
+		      const struct lus_layout **shared);
+void lus_layout_release(struct lus_layout_table *table,
+			const struct lus_layout *shared);
+void lus_layout_table_get_stats(struct lus_layout_table *table,
+				struct lus_layout_table_stats *stats);
+
+/* Composite layouts: a layout for each extent of a file, such as a
+ * progressive file layout (PFL), whose first extent can be stored on
+ * the MDT (DoM). */
+#define LUS_LAYOUT_EOF 0xffffffffffffffffULL
+
+/* Component flags */
+#define LCME_FL_STALE	0x00000001	/* the mirror is out of date */
+#define LCME_FL_PREF_RD	0x00000002	/* the mirror is preferred for reads */
+#define LCME_FL_PREF_WR	0x00000004	/* and for writes */
+#define LCME_FL_OFFLINE	0x00000008	/* the mirror is unavailable */
+#define LCME_FL_INIT	0x00000010	/* the component has objects */
+#define LCME_FL_NOSYNC	0x00000020	/* the mirror is not resynced */
+
+struct lus_layout_composite;
+
+struct lus_layout_component {
+	uint64_t lc_start;	/* first byte of the extent */
+	uint64_t lc_end;	/* end of the extent, or LUS_LAYOUT_EOF */
+	uint32_t lc_id;		/* ID given by the MDT, or 0 */
+	uint32_t lc_flags;	/* LCME_FL_* */
+	uint16_t lc_mirror_id;	/* mirror of the component, or 0 */
+	const struct lus_layout *lc_layout; /* owned by the composite */
+};
+
+/* Hints to choose the mirror to read from. */
+struct lus_mirror_hint {
+	const uint64_t *mh_ost_loads;	/* load of each OST, or NULL */
+	size_t mh_ost_count;		/* number of loads */
+	uint16_t mh_preferred;		/* mirror to use if possible, or 0 */
+};
+
+int lus_layout_composite_alloc(struct lus_layout_composite **composite);
+void lus_layout_composite_free(struct lus_layout_composite *composite);
+int lus_layout_composite_add(struct lus_layout_composite *composite,
+			     uint64_t end, const struct lus_layout *layout);
+unsigned int
+lus_layout_composite_count(const struct lus_layout_composite *composite);
+int lus_layout_composite_get(const struct lus_layout_composite *composite,
+			     unsigned int index,
+			     struct lus_layout_component *component);
+int lus_layout_composite_find(const struct lus_layout_composite *composite,
+			      uint64_t offset,
+			      struct lus_layout_component *component);
+int lus_layout_composite_prepare(const struct lus_layout_composite *composite,
+				 struct lus_layout_prepared **prepared);
+int lus_layout_composite_get_by_fd(int fd,
+				   struct lus_layout_composite **composite);
+int lus_lovxattr_to_composite(struct lov_user_md *lum, size_t lum_len,
+			      struct lus_layout_composite **composite);
+unsigned int
+lus_layout_composite_mirror_count(const struct lus_layout_composite *composite);
+int lus_layout_composite_mirror_id(const struct lus_layout_composite *composite,
+				   unsigned int index, uint16_t *mirror_id);
+int
+lus_layout_composite_pick_mirror(const struct lus_layout_composite *composite,
+				 uint64_t offset, uint64_t length,
+				 const struct lus_mirror_hint *hint,
+				 uint16_t *mirror_id);
+
 /*
  * Misc
  */
 int lus_fid2path(const struct lus_fs_handle *lfsh, const struct lu_fid *fid,
 		 char *path, size_t path_len, long long *recno,
 		 unsigned int *linkno);
+ssize_t lus_fid2path_batch(const struct lus_fs_handle *lfsh,
+			   const lustre_fid *fids, size_t count,
+			   char *arena, size_t arena_len,
+			   size_t *offsets, int *errors);
 int lus_fd2fid(int fd, lustre_fid *fid);
 int lus_path2fid(const char *path, lustre_fid *fid);
+int lus_fid_format(const lustre_fid *fid, char *buf, size_t buf_len);
+int lus_fid_parse(const char *str, lustre_fid *fid, const char **end);
+ssize_t lus_fid_parse_list(const char *buf, size_t buf_len,
+			   lustre_fid *fids, size_t max_fids,
+			   size_t *consumed);
 int lus_open_by_fid(const struct lus_fs_handle *lfsh,
 		    const lustre_fid *fid, int open_flags);
 int lus_stat_by_fid(const struct lus_fs_handle *lfsh,
@@ -233,13 +413,143 @@ int lus_fid2parent(const struct lus_fs_handle *lfsh,
 int lus_path2parent(const char *path, unsigned int linkno,
 		      lustre_fid *parent_fid,
 		      char *parent_name, size_t parent_name_len);
+
+/* A hard link of a file, as returned by lus_fid_links(). The records
+ * are packed one after the other in the caller's buffer. */
+struct lus_fid_link {
+	lustre_fid lfl_parent_fid;	/* directory containing the link */
+	__u32 lfl_linkno;
+	__u32 lfl_reclen;		/* size of the record, with the name */
+	char lfl_name[0];		/* NUL terminated name of the link */
+} __attribute__((packed));
+
+static inline const struct lus_fid_link *
+lus_fid_link_next(const struct lus_fid_link *link)
+{
+	return (const void *)((const char *)link + link->lfl_reclen);
+}
+
+ssize_t lus_fd_links(int fd, void *buf, size_t buf_len);
+ssize_t lus_fid_links(const struct lus_fs_handle *lfsh,
+		      const lustre_fid *fid, void *buf, size_t buf_len);
+
 int lus_data_version_by_fd(int fd, uint64_t flags, uint64_t *dv);
+
+/* A request for lus_data_version_by_fid_many(). */
+struct lus_data_version_req {
+	lustre_fid fid;		/* in: the file */
+	uint64_t flags;		/* in: 0, LL_DV_RD_FLUSH or LL_DV_WR_FLUSH */
+	uint64_t dv;		/* out: its data version, if rc is 0 */
+	int rc;			/* out: 0 or a negative errno */
+};
+
+ssize_t lus_data_version_by_fid_many(const struct lus_fs_handle *lfsh,
+				     struct lus_data_version_req *reqs,
+				     size_t count);
 int lus_group_lock(int fd, uint64_t gid);
 int lus_group_unlock(int fd, uint64_t gid);
+int lus_mirror_set_read(int fd, uint16_t mirror_id);
+int lus_group_lock_gid(int fd, uint64_t *gid);
+ssize_t lus_parallel_write(int fd, const struct lus_layout *layout,
+			   const void *buf, size_t count, off_t offset,
+			   unsigned int threads, uint64_t gid);
+ssize_t lus_parallel_read(int fd, const struct lus_layout *layout,
+			  void *buf, size_t count, off_t offset,
+			  unsigned int threads, uint64_t gid);
+
+/* Flags for lus_migrate_file() */
+#define LUS_MIGRATE_RETRY (1 << 0)	/* copy again if the file changed */
+
+int lus_migrate_file(const struct lus_fs_handle *lfsh,
+		     const lustre_fid *fid,
+		     const struct lus_layout *layout, uint64_t flags);
 int lus_mdt_stat_by_fid(const struct lus_fs_handle *lfsh,
 			const struct lu_fid *fid,
 			struct stat *st);
 
+/* statx attributes that the MDT knows without querying the OSTs. */
+#define LUS_STATX_MDT_MASK (STATX_TYPE | STATX_MODE | STATX_NLINK |	\
+			    STATX_UID | STATX_GID | STATX_INO |		\
+			    STATX_ATIME | STATX_MTIME | STATX_CTIME)
+
+int lus_statx_by_fid(const struct lus_fs_handle *lfsh,
+		     const lustre_fid *fid, unsigned int mask,
+		     struct statx *stx);
+ssize_t lus_statx_by_fid_batch(const struct lus_fs_handle *lfsh,
+			       const lustre_fid *fids, size_t count,
+			       unsigned int mask, struct statx *stxs,
+			       int *errors);
+
+/*
+ * Asynchronous requests
+ */
+struct lus_async_ctx;
+
+enum lus_async_op {
+	LUS_ASYNC_OPEN,
+	LUS_ASYNC_STATX,
+	LUS_ASYNC_GETXATTR,
+	LUS_ASYNC_CLOSE,
+};
+
+/* Flags for lus_async_ctx_create() */
+#define LUS_ASYNC_THREADS	0x0001	/* don't use io_uring */
+
+/* Completion callback. result is the return value of the operation,
+ * or a negative errno. */
+typedef void (*lus_async_cb_t)(void *cb_arg, int result);
+
+int lus_async_ctx_create(const struct lus_fs_handle *lfsh,
+			 unsigned int depth, unsigned int flags,
+			 struct lus_async_ctx **ctx);
+void lus_async_ctx_destroy(struct lus_async_ctx *ctx);
+const char *lus_async_backend(const struct lus_async_ctx *ctx);
+unsigned int lus_async_inflight(const struct lus_async_ctx *ctx);
+int lus_async_poll(struct lus_async_ctx *ctx, unsigned int min_complete);
+int lus_async_open_by_fid(struct lus_async_ctx *ctx, const lustre_fid *fid,
+			  int open_flags, lus_async_cb_t cb, void *cb_arg);
+int lus_async_statx_by_fid(struct lus_async_ctx *ctx, const lustre_fid *fid,
+			   unsigned int mask, struct statx *stx,
+			   lus_async_cb_t cb, void *cb_arg);
+int lus_async_fgetxattr(struct lus_async_ctx *ctx, int fd, const char *name,
+			void *value, size_t size,
+			lus_async_cb_t cb, void *cb_arg);
+int lus_async_close(struct lus_async_ctx *ctx, int fd,
+		    lus_async_cb_t cb, void *cb_arg);
+
+/*
+ * FID attribute cache
+ */
+struct lus_fid_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t invalidations;
+	size_t entries;		/* FIDs currently cached */
+	size_t capacity;	/* maximum number of FIDs */
+};
+
+int lus_fid_cache_enable(struct lus_fs_handle *lfsh, size_t capacity,
+			 unsigned int ttl_ms);
+void lus_fid_cache_disable(struct lus_fs_handle *lfsh);
+void lus_fid_cache_invalidate(const struct lus_fs_handle *lfsh,
+			      const lustre_fid *fid);
+void lus_fid_cache_flush(const struct lus_fs_handle *lfsh);
+int lus_fid_cache_revalidate(const struct lus_fs_handle *lfsh,
+			     const lustre_fid *fid, int fd);
+void lus_fid_cache_get_stats(const struct lus_fs_handle *lfsh,
+			     struct lus_fid_cache_stats *stats);
+
+/*
+ * Directory default layout cache
+ */
+int lus_dir_layout_cache_enable(struct lus_fs_handle *lfsh,
+				size_t capacity, unsigned int ttl_ms);
+void lus_dir_layout_cache_disable(struct lus_fs_handle *lfsh);
+void lus_dir_layout_cache_invalidate(const struct lus_fs_handle *lfsh,
+				     const lustre_fid *fid);
+void lus_dir_layout_cache_flush(const struct lus_fs_handle *lfsh);
+
 /* Library initialization */
 bool lus_initialized;
 void lus_init(void);
@@ -358,6 +668,9 @@ int lus_hsm_current_action(const char *path,
 			   struct hsm_current_action *hca);
 int lus_hsm_state_get_fd(int fd, struct hsm_user_state *hus);
 int lus_hsm_state_get(const char *path, struct hsm_user_state *hus);
+int lus_hsm_state_get_by_fid(const struct lus_fs_handle *lfsh,
+			     const lustre_fid *fid,
+			     struct hsm_user_state *hus);
 int lus_hsm_state_set_fd(int fd, uint64_t setmask, uint64_t clearmask,
 			 unsigned int archive_id);
 int lus_hsm_state_set(const char *path, uint64_t setmask, uint64_t clearmask,
@@ -415,4 +728,195 @@ lus_hsm_hai_first(const struct hsm_action_list *hal);
 const struct hsm_action_item *
 lus_hsm_hai_next(const struct hsm_action_item *hai);
 
+/* Pre-created volatile files for the restores */
+struct lus_volatile_pool_stats {
+	uint64_t hits;		/* restores that used a pooled file */
+	uint64_t misses;	/* restores that had to create one */
+	size_t available;	/* files currently in the pools */
+	size_t capacity;	/* sum of the pool sizes */
+};
+
+int lus_hsm_volatile_pool_enable(struct lus_hsm_ct_handle *ct,
+				 unsigned int mdt_index, unsigned int size,
+				 int open_flags);
+void lus_hsm_volatile_pool_get_stats(const struct lus_hsm_ct_handle *ct,
+				     struct lus_volatile_pool_stats *stats);
+
+/*
+ * Namespace scanner
+ */
+
+/* Information requested from lus_scan(). */
+#define LUS_SCAN_FID	0x0001
+#define LUS_SCAN_STAT	0x0002
+#define LUS_SCAN_LAYOUT	0x0004
+#define LUS_SCAN_HSM	0x0008
+#define LUS_SCAN_ALL	(LUS_SCAN_FID | LUS_SCAN_STAT | LUS_SCAN_LAYOUT | \
+			 LUS_SCAN_HSM)
+
+/* Returned by the callback to not descend into a directory. */
+#define LUS_SCAN_SKIP	1
+
+struct lus_scan_entry {
+	const char *path;	/* root/.../name */
+	const char *name;
+	int dir_fd;		/* opened parent directory */
+	unsigned int depth;	/* 0 for the entries of root */
+	unsigned char type;	/* DT_* */
+	unsigned int valid;	/* LUS_SCAN_* fields set below */
+	lustre_fid fid;
+	struct stat st;
+	struct lus_layout *layout;
+	struct hsm_user_state hsm;	/* must be last */
+};
+
+typedef int (*lus_scan_cb_t)(const struct lus_scan_entry *entry,
+			     void *cb_arg);
+
+int lus_scan(const struct lus_fs_handle *lfsh, const char *root,
+	     unsigned int flags, unsigned int threads,
+	     lus_scan_cb_t cb, void *cb_arg);
+
+/*
+ * Changelogs
+ */
+enum changelog_rec_type {
+	CL_MARK     = 0,
+	CL_CREATE   = 1,
+	CL_MKDIR    = 2,
+	CL_HARDLINK = 3,
+	CL_SOFTLINK = 4,
+	CL_MKNOD    = 5,
+	CL_UNLINK   = 6,
+	CL_RMDIR    = 7,
+	CL_RENAME   = 8,
+	CL_EXT      = 9,
+	CL_OPEN     = 10,
+	CL_CLOSE    = 11,
+	CL_LAYOUT   = 12,
+	CL_TRUNC    = 13,
+	CL_SETATTR  = 14,
+	CL_XATTR    = 15,
+	CL_HSM      = 16,
+	CL_MTIME    = 17,
+	CL_CTIME    = 18,
+	CL_ATIME    = 19,
+	CL_LAST
+};
+
+/* Flags for lus_changelog_open() */
+enum changelog_send_flag {
+	CHANGELOG_FLAG_FOLLOW = 0x01,	/* wait for new records */
+	CHANGELOG_FLAG_BLOCK  = 0x02,	/* blocking reads */
+	CHANGELOG_FLAG_JOBID  = 0x04,	/* add the job IDs */
+};
+
+/* cr_flags. The low bits are specific to the record type. */
+#define CLF_FLAGMASK		0x0fff
+#define CLF_VERSION		0x1000
+#define CLF_RENAME		0x2000
+#define CLF_JOBID		0x4000
+#define CLF_SUPPORTED		(CLF_VERSION | CLF_RENAME | CLF_JOBID)
+
+#define CLF_UNLINK_LAST		0x0001	/* last link of the file */
+#define CLF_UNLINK_HSM_EXISTS	0x0002	/* file has an archive copy */
+#define CLF_RENAME_LAST		0x0001	/* rename replaced a file */
+#define CLF_RENAME_LAST_EXISTS	0x0002	/* ... which had an archive copy */
+
+#define LUSTRE_JOBID_SIZE 32
+
+struct changelog_rec {
+	__u16		cr_namelen;
+	__u16		cr_flags;
+	__u32		cr_type;	/* enum changelog_rec_type */
+	__u64		cr_index;	/* record number */
+	__u64		cr_prev;
+	__u64		cr_time;
+	union {
+		lustre_fid cr_tfid;	/* target FID */
+		__u32	   cr_markerflags;
+	};
+	lustre_fid	cr_pfid;	/* parent FID */
+} __attribute__((packed));
+
+/* Present if CLF_RENAME is set. */
+struct changelog_ext_rename {
+	lustre_fid	cr_sfid;	/* source FID */
+	lustre_fid	cr_spfid;	/* source parent FID */
+} __attribute__((packed));
+
+/* Present if CLF_JOBID is set. */
+struct changelog_ext_jobid {
+	char		cr_jobid[LUSTRE_JOBID_SIZE];
+} __attribute__((packed));
+
+/**
+ * Size of a record header with the extensions indicated by cr_flags,
+ * i.e. the offset of the name.
+ */
+static inline size_t changelog_rec_offset(unsigned int cr_flags)
+{
+	size_t size = sizeof(struct changelog_rec);
+
+	if (cr_flags & CLF_RENAME)
+		size += sizeof(struct changelog_ext_rename);
+
+	if (cr_flags & CLF_JOBID)
+		size += sizeof(struct changelog_ext_jobid);
+
+	return size;
+}
+
+/** Total size of a record, including its name. */
+static inline size_t changelog_rec_size(const struct changelog_rec *rec)
+{
+	return changelog_rec_offset(rec->cr_flags) + rec->cr_namelen;
+}
+
+static inline struct changelog_ext_rename *
+changelog_rec_rename(const struct changelog_rec *rec)
+{
+	return (struct changelog_ext_rename *)(rec + 1);
+}
+
+static inline struct changelog_ext_jobid *
+changelog_rec_jobid(const struct changelog_rec *rec)
+{
+	size_t offset = sizeof(*rec);
+
+	if (rec->cr_flags & CLF_RENAME)
+		offset += sizeof(struct changelog_ext_rename);
+
+	return (struct changelog_ext_jobid *)((char *)rec + offset);
+}
+
+/**
+ * Name of the entry, not NUL terminated; its length is
+ * cr_namelen. For a rename, the target name is followed by a NUL and
+ * the source name.
+ */
+static inline char *changelog_rec_name(const struct changelog_rec *rec)
+{
+	return (char *)rec + changelog_rec_offset(rec->cr_flags);
+}
+
+struct lus_changelog;
+
+int lus_changelog_open(const struct lus_fs_handle *lfsh,
+		       unsigned int mdt_index, const char *user,
+		       unsigned long long startrec, unsigned int flags,
+		       struct lus_changelog **cl);
+int lus_changelog_open_fd(int fd, struct lus_changelog **cl);
+int lus_changelog_recv(struct lus_changelog *cl,
+		       const struct changelog_rec **rec);
+int lus_changelog_clear(struct lus_changelog *cl, unsigned long long endrec);
+int lus_changelog_get_fd(const struct lus_changelog *cl);
+
+typedef int (*lus_changelog_cb_t)(const struct changelog_rec *rec,
+				  void *cb_arg);
+
+int lus_changelog_dispatch(struct lus_changelog *cl, unsigned int workers,
+			   lus_changelog_cb_t cb, void *cb_arg);
+int lus_changelog_close(struct lus_changelog *cl);
+
 #endif
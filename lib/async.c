@@ -0,0 +1,1023 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Asynchronous metadata requests
+ *
+ * An asynchronous context lets a single thread have many open, statx,
+ * getxattr and close requests in flight. The requests are submitted
+ * through an io_uring when the kernel supports it. Otherwise a set of
+ * threads executes them.
+ *
+ * A context has a fixed number of request slots. A request keeps its
+ * slot until its completion callback is called by lus_async_poll().
+ *
+ * There is no liburing dependency. The ring is set up and driven
+ * directly with the system calls.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <attr/xattr.h>
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* End of a request list. */
+#define NO_REQ UINT32_MAX
+
+struct async_req {
+	enum lus_async_op op;
+	int fd;
+	int flags;
+	unsigned int mask;
+	char path[FID_NOBRACE_LEN + 1];
+	struct statx *stx;
+	const char *name;
+	void *value;
+	size_t size;
+
+	lus_async_cb_t cb;
+	void *cb_arg;
+	int result;
+
+	/* Next request in the free list, or in a queue. */
+	uint32_t next;
+};
+
+/* A FIFO of requests, linked through their next field. */
+struct req_queue {
+	uint32_t head;
+	uint32_t tail;
+};
+
+#ifdef HAVE_IO_URING
+struct uring {
+	int fd;
+
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	uint32_t sq_entries;
+	struct io_uring_sqe *sqes;
+
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_ptr;
+	size_t sq_len;
+	void *cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+
+	/* SQEs filled but not yet given to the kernel. */
+	unsigned int to_submit;
+
+	/* Whether the ring can do getxattr. */
+	bool has_fgetxattr;
+};
+#endif
+
+/* Thread backend. The workers take the requests from the pending
+ * queue, and put them in the done queue once executed. */
+struct async_threads {
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	struct req_queue pending;
+	struct req_queue done;
+	bool stopping;
+	unsigned int num_threads;
+	pthread_t threads[];
+};
+
+struct lus_async_ctx {
+	const struct lus_fs_handle *lfsh;
+
+	unsigned int depth;
+	struct async_req *reqs;
+	uint32_t free_list;
+	unsigned int inflight;
+
+	/* Requests executed at submission time, because the backend
+	 * can't do them. */
+	struct req_queue inline_done;
+
+#ifdef HAVE_IO_URING
+	struct uring *ring;
+#endif
+	struct async_threads *thr;
+};
+
+static void queue_init(struct req_queue *q)
+{
+	q->head = NO_REQ;
+	q->tail = NO_REQ;
+}
+
+static void queue_push(struct lus_async_ctx *ctx, struct req_queue *q,
+		       uint32_t idx)
+{
+	ctx->reqs[idx].next = NO_REQ;
+	if (q->tail == NO_REQ)
+		q->head = idx;
+	else
+		ctx->reqs[q->tail].next = idx;
+	q->tail = idx;
+}
+
+static uint32_t queue_pop(struct lus_async_ctx *ctx, struct req_queue *q)
+{
+	uint32_t idx = q->head;
+
+	if (idx != NO_REQ) {
+		q->head = ctx->reqs[idx].next;
+		if (q->head == NO_REQ)
+			q->tail = NO_REQ;
+	}
+
+	return idx;
+}
+
+/* Execute a request in the calling thread. */
+static int async_execute(const struct lus_async_ctx *ctx,
+			 const struct async_req *req)
+{
+	struct stat st;
+	ssize_t sz;
+	int rc;
+
+	switch (req->op) {
+	case LUS_ASYNC_OPEN:
+		rc = openat(ctx->lfsh->fid_fd, req->path, req->flags);
+		return rc == -1 ? -errno : rc;
+
+	case LUS_ASYNC_STATX:
+#ifdef __NR_statx
+		rc = syscall(__NR_statx, ctx->lfsh->fid_fd, req->path,
+			     AT_SYMLINK_NOFOLLOW, req->mask, req->stx);
+		if (rc == 0)
+			return 0;
+		if (errno != ENOSYS)
+			return -errno;
+#endif
+		rc = fstatat(ctx->lfsh->fid_fd, req->path, &st,
+			     AT_SYMLINK_NOFOLLOW);
+		if (rc == -1)
+			return -errno;
+		stat_to_statx(&st, STATX_BASIC_STATS, req->stx);
+		return 0;
+
+	case LUS_ASYNC_GETXATTR:
+		sz = fgetxattr(req->fd, req->name, req->value, req->size);
+		return sz == -1 ? -errno : sz;
+
+	case LUS_ASYNC_CLOSE:
+		rc = close(req->fd);
+		return rc == -1 ? -errno : 0;
+	}
+
+	return -EINVAL;
+}
+
+static void *async_worker(void *arg)
+{
+	struct lus_async_ctx *ctx = arg;
+	struct async_threads *thr = ctx->thr;
+	uint32_t idx;
+
+	pthread_mutex_lock(&thr->lock);
+
+	while (1) {
+		while (!thr->stopping && thr->pending.head == NO_REQ)
+			pthread_cond_wait(&thr->work_cv, &thr->lock);
+
+		if (thr->stopping)
+			break;
+
+		idx = queue_pop(ctx, &thr->pending);
+		pthread_mutex_unlock(&thr->lock);
+
+		ctx->reqs[idx].result = async_execute(ctx, &ctx->reqs[idx]);
+
+		pthread_mutex_lock(&thr->lock);
+		queue_push(ctx, &thr->done, idx);
+		pthread_cond_signal(&thr->done_cv);
+	}
+
+	pthread_mutex_unlock(&thr->lock);
+
+	return NULL;
+}
+
+static void threads_destroy(struct lus_async_ctx *ctx)
+{
+	struct async_threads *thr = ctx->thr;
+	unsigned int i;
+
+	if (thr == NULL)
+		return;
+
+	pthread_mutex_lock(&thr->lock);
+	thr->stopping = true;
+	pthread_cond_broadcast(&thr->work_cv);
+	pthread_mutex_unlock(&thr->lock);
+
+	for (i = 0; i < thr->num_threads; i++)
+		pthread_join(thr->threads[i], NULL);
+
+	pthread_cond_destroy(&thr->done_cv);
+	pthread_cond_destroy(&thr->work_cv);
+	pthread_mutex_destroy(&thr->lock);
+	free(thr);
+	ctx->thr = NULL;
+}
+
+static int threads_create(struct lus_async_ctx *ctx, unsigned int count)
+{
+	struct async_threads *thr;
+	int rc;
+
+	thr = calloc(1, sizeof(*thr) + count * sizeof(pthread_t));
+	if (thr == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_init(&thr->lock, NULL);
+	pthread_cond_init(&thr->work_cv, NULL);
+	pthread_cond_init(&thr->done_cv, NULL);
+	queue_init(&thr->pending);
+	queue_init(&thr->done);
+	ctx->thr = thr;
+
+	while (thr->num_threads < count) {
+		rc = pthread_create(&thr->threads[thr->num_threads], NULL,
+				    async_worker, ctx);
+		if (rc) {
+			threads_destroy(ctx);
+			return -rc;
+		}
+		thr->num_threads++;
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_IO_URING
+static void uring_destroy(struct lus_async_ctx *ctx)
+{
+	struct uring *ring = ctx->ring;
+
+	if (ring == NULL)
+		return;
+
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED &&
+	    ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_len);
+	if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED)
+		munmap(ring->sq_ptr, ring->sq_len);
+	if (ring->fd != -1)
+		close(ring->fd);
+
+	free(ring);
+	ctx->ring = NULL;
+}
+
+/* Check that the kernel supports the operations we need. */
+static int uring_probe(struct uring *ring)
+{
+	struct io_uring_probe *probe;
+	size_t len;
+	int rc;
+
+	len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	probe = calloc(1, len);
+	if (probe == NULL)
+		return -ENOMEM;
+
+	rc = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE,
+		     probe, 256);
+	if (rc == -1) {
+		rc = -errno;
+		goto out;
+	}
+
+#define OP_SUPPORTED(op)						\
+	((op) <= probe->last_op &&					\
+	 (probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+
+	if (!OP_SUPPORTED(IORING_OP_OPENAT) ||
+	    !OP_SUPPORTED(IORING_OP_STATX) ||
+	    !OP_SUPPORTED(IORING_OP_CLOSE)) {
+		rc = -EOPNOTSUPP;
+		goto out;
+	}
+
+	/* Only from Linux 5.19, and possibly missing from an older
+	 * io_uring.h. Without it, getxattr is done synchronously. */
+#if HAVE_DECL_IORING_OP_FGETXATTR
+	ring->has_fgetxattr = OP_SUPPORTED(IORING_OP_FGETXATTR);
+#endif
+
+#undef OP_SUPPORTED
+
+	rc = 0;
+
+out:
+	free(probe);
+	return rc;
+}
+
+/* Address of a field of a mapped ring, given its offset. */
+static void *ring_field(void *ring_ptr, uint32_t offset)
+{
+	return (char *)ring_ptr + offset;
+}
+
+static int uring_create(struct lus_async_ctx *ctx)
+{
+	struct io_uring_params p;
+	struct uring *ring;
+	int rc;
+
+	ring = calloc(1, sizeof(*ring));
+	if (ring == NULL)
+		return -ENOMEM;
+
+	ring->fd = -1;
+	ctx->ring = ring;
+
+	memset(&p, 0, sizeof(p));
+	ring->fd = syscall(__NR_io_uring_setup, ctx->depth, &p);
+	if (ring->fd == -1) {
+		rc = -errno;
+		goto fail;
+	}
+
+	rc = uring_probe(ring);
+	if (rc)
+		goto fail;
+
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	ring->cq_len = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len)
+			ring->sq_len = ring->cq_len;
+		ring->cq_len = ring->sq_len;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, ring->fd,
+			    IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED) {
+		rc = -errno;
+		goto fail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_len,
+				    PROT_READ | PROT_WRITE,
+				    MAP_SHARED | MAP_POPULATE, ring->fd,
+				    IORING_OFF_CQ_RING);
+		if (ring->cq_ptr == MAP_FAILED) {
+			rc = -errno;
+			goto fail;
+		}
+	}
+
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd,
+			  IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		rc = -errno;
+		goto fail;
+	}
+
+	ring->sq_head = ring_field(ring->sq_ptr, p.sq_off.head);
+	ring->sq_tail = ring_field(ring->sq_ptr, p.sq_off.tail);
+	ring->sq_mask = ring_field(ring->sq_ptr, p.sq_off.ring_mask);
+	ring->sq_array = ring_field(ring->sq_ptr, p.sq_off.array);
+	ring->sq_entries = p.sq_entries;
+
+	ring->cq_head = ring_field(ring->cq_ptr, p.cq_off.head);
+	ring->cq_tail = ring_field(ring->cq_ptr, p.cq_off.tail);
+	ring->cq_mask = ring_field(ring->cq_ptr, p.cq_off.ring_mask);
+	ring->cqes = ring_field(ring->cq_ptr, p.cq_off.cqes);
+
+	return 0;
+
+fail:
+	uring_destroy(ctx);
+	return rc;
+}
+
+/* Give the queued SQEs to the kernel, and wait for min_complete
+ * completions. */
+static int uring_enter(struct uring *ring, unsigned int min_complete)
+{
+	int rc;
+
+	do {
+		rc = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit,
+			     min_complete,
+			     min_complete ? IORING_ENTER_GETEVENTS : 0,
+			     NULL, 0);
+	} while (rc == -1 && errno == EINTR);
+
+	if (rc == -1)
+		return -errno;
+
+	ring->to_submit -= rc;
+
+	return 0;
+}
+
+/* Queue a request in the submission ring. The number of slots is never
+ * more than the number of SQEs, so there is always room once the
+ * previous SQEs have been consumed by the kernel. */
+static int uring_queue(struct lus_async_ctx *ctx, uint32_t idx)
+{
+	struct uring *ring = ctx->ring;
+	const struct async_req *req = &ctx->reqs[idx];
+	struct io_uring_sqe *sqe;
+	uint32_t tail;
+	uint32_t head;
+	int rc;
+
+	tail = *ring->sq_tail;
+	head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	if (tail - head >= ring->sq_entries) {
+		rc = uring_enter(ring, 0);
+		if (rc)
+			return rc;
+	}
+
+	sqe = &ring->sqes[tail & *ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = idx;
+
+	switch (req->op) {
+	case LUS_ASYNC_OPEN:
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = ctx->lfsh->fid_fd;
+		sqe->addr = (uintptr_t)req->path;
+		sqe->open_flags = req->flags;
+		break;
+
+	case LUS_ASYNC_STATX:
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = ctx->lfsh->fid_fd;
+		sqe->addr = (uintptr_t)req->path;
+		sqe->len = req->mask;
+		sqe->off = (uintptr_t)req->stx;
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+		break;
+
+	case LUS_ASYNC_GETXATTR:
+#if HAVE_DECL_IORING_OP_FGETXATTR
+		sqe->opcode = IORING_OP_FGETXATTR;
+		sqe->fd = req->fd;
+		sqe->addr = (uintptr_t)req->name;
+		sqe->addr2 = (uintptr_t)req->value;
+		sqe->len = req->size;
+#endif
+		break;
+
+	case LUS_ASYNC_CLOSE:
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = req->fd;
+		break;
+	}
+
+	ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+
+	return 0;
+}
+
+/* Retrieve one completion from the ring, if there is one. */
+static uint32_t uring_reap(struct lus_async_ctx *ctx)
+{
+	struct uring *ring = ctx->ring;
+	struct io_uring_cqe *cqe;
+	uint32_t head;
+	uint32_t idx;
+
+	head = *ring->cq_head;
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return NO_REQ;
+
+	cqe = &ring->cqes[head & *ring->cq_mask];
+	idx = cqe->user_data;
+	ctx->reqs[idx].result = cqe->res;
+
+	/* A kernel that doesn't know the opcode after all rejects it.
+	 * Do it synchronously, now and from then on. */
+	if (ctx->reqs[idx].op == LUS_ASYNC_GETXATTR && cqe->res == -EINVAL) {
+		ring->has_fgetxattr = false;
+		ctx->reqs[idx].result = async_execute(ctx, &ctx->reqs[idx]);
+	}
+
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return idx;
+}
+#endif
+
+/* Get a free request slot. If there is none, process some
+ * completions first. */
+static int get_slot(struct lus_async_ctx *ctx, uint32_t *idx)
+{
+	int rc;
+
+	while (ctx->free_list == NO_REQ) {
+		rc = lus_async_poll(ctx, 1);
+		if (rc < 0)
+			return rc;
+	}
+
+	*idx = ctx->free_list;
+	ctx->free_list = ctx->reqs[*idx].next;
+
+	return 0;
+}
+
+static void put_slot(struct lus_async_ctx *ctx, uint32_t idx)
+{
+	ctx->reqs[idx].next = ctx->free_list;
+	ctx->free_list = idx;
+}
+
+/* Hand a filled request to the backend. */
+static int submit(struct lus_async_ctx *ctx, uint32_t idx)
+{
+	struct async_req *req = &ctx->reqs[idx];
+	int rc;
+
+#ifdef HAVE_IO_URING
+	if (ctx->ring != NULL &&
+	    (req->op != LUS_ASYNC_GETXATTR || ctx->ring->has_fgetxattr)) {
+		rc = uring_queue(ctx, idx);
+		if (rc) {
+			put_slot(ctx, idx);
+			return rc;
+		}
+
+		ctx->inflight++;
+		return 0;
+	}
+#endif
+
+	ctx->inflight++;
+
+	if (ctx->thr != NULL) {
+		pthread_mutex_lock(&ctx->thr->lock);
+		queue_push(ctx, &ctx->thr->pending, idx);
+		pthread_cond_signal(&ctx->thr->work_cv);
+		pthread_mutex_unlock(&ctx->thr->lock);
+	} else {
+		req->result = async_execute(ctx, req);
+		queue_push(ctx, &ctx->inline_done, idx);
+	}
+
+	return 0;
+}
+
+/* Release the slot of a completed request and call its callback. */
+static void complete(struct lus_async_ctx *ctx, uint32_t idx)
+{
+	struct async_req *req = &ctx->reqs[idx];
+	lus_async_cb_t cb = req->cb;
+	void *cb_arg = req->cb_arg;
+	int result = req->result;
+
+	ctx->inflight--;
+	put_slot(ctx, idx);
+
+	/* The callback may submit new requests. */
+	if (cb != NULL)
+		cb(cb_arg, result);
+}
+
+/* Release the slot of a completed request without calling its
+ * callback. A descriptor it opened would be lost, so it is closed. */
+static void discard(struct lus_async_ctx *ctx, uint32_t idx)
+{
+	struct async_req *req = &ctx->reqs[idx];
+
+	if (req->op == LUS_ASYNC_OPEN && req->result >= 0)
+		close(req->result);
+
+	ctx->inflight--;
+	put_slot(ctx, idx);
+}
+
+/**
+ * Create an asynchronous context for a filesystem.
+ *
+ * A context must only be used by one thread at a time. It uses an
+ * io_uring if the kernel supports one, or else a set of worker
+ * threads, as many as set by lus_set_thread_count().
+ *
+ * \param[in]   lfsh     an opened Lustre fs opaque handle
+ * \param[in]   depth    maximum number of requests in flight, from 1
+ *                       to 4096
+ * \param[in]   flags    0, or LUS_ASYNC_THREADS to not use io_uring
+ * \param[out]  ctx      the new context
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int lus_async_ctx_create(const struct lus_fs_handle *lfsh,
+			 unsigned int depth, unsigned int flags,
+			 struct lus_async_ctx **ctx)
+{
+	struct lus_async_ctx *myctx;
+	unsigned int i;
+	int rc;
+
+	if (depth == 0 || depth > 4096 || (flags & ~LUS_ASYNC_THREADS))
+		return -EINVAL;
+
+	myctx = calloc(1, sizeof(*myctx));
+	if (myctx == NULL)
+		return -ENOMEM;
+
+	myctx->lfsh = lfsh;
+	myctx->depth = depth;
+	queue_init(&myctx->inline_done);
+
+	myctx->reqs = calloc(depth, sizeof(*myctx->reqs));
+	if (myctx->reqs == NULL) {
+		rc = -ENOMEM;
+		goto fail;
+	}
+
+	for (i = 0; i < depth; i++)
+		myctx->reqs[i].next = i + 1 < depth ? i + 1 : NO_REQ;
+	myctx->free_list = 0;
+
+#ifdef HAVE_IO_URING
+	if (!(flags & LUS_ASYNC_THREADS)) {
+		rc = uring_create(myctx);
+		if (rc == 0) {
+			*ctx = myctx;
+			return 0;
+		}
+
+		log_msg(LUS_LOG_INFO, rc,
+			"io_uring not available, using threads");
+	}
+#endif
+
+	rc = threads_create(myctx, thread_pool_width(lfsh->pool));
+	if (rc)
+		goto fail;
+
+	*ctx = myctx;
+
+	return 0;
+
+fail:
+	free(myctx->reqs);
+	free(myctx);
+
+	return rc;
+}
+
+/**
+ * Destroy an asynchronous context. The requests still in flight are
+ * executed and waited for, but their callbacks are not called. The
+ * files opened by these requests are closed.
+ *
+ * \param[in]  ctx    the context to destroy. Can be NULL.
+ */
+void lus_async_ctx_destroy(struct lus_async_ctx *ctx)
+{
+	struct async_threads *thr;
+	uint32_t idx;
+
+	if (ctx == NULL)
+		return;
+
+	while ((idx = queue_pop(ctx, &ctx->inline_done)) != NO_REQ)
+		discard(ctx, idx);
+
+#ifdef HAVE_IO_URING
+	if (ctx->ring != NULL) {
+		/* Also submits the SQEs not yet given to the kernel. */
+		while (ctx->inflight > 0) {
+			idx = uring_reap(ctx);
+			if (idx != NO_REQ)
+				discard(ctx, idx);
+			else if (uring_enter(ctx->ring, 1))
+				break;
+		}
+		uring_destroy(ctx);
+	}
+#endif
+
+	/* Let the workers execute the pending requests. */
+	thr = ctx->thr;
+	if (thr != NULL) {
+		pthread_mutex_lock(&thr->lock);
+		while (ctx->inflight > 0) {
+			idx = queue_pop(ctx, &thr->done);
+			if (idx != NO_REQ)
+				discard(ctx, idx);
+			else
+				pthread_cond_wait(&thr->done_cv, &thr->lock);
+		}
+		pthread_mutex_unlock(&thr->lock);
+	}
+
+	threads_destroy(ctx);
+
+	free(ctx->reqs);
+	free(ctx);
+}
+
+/**
+ * Return the name of the backend used by a context: "io_uring" or
+ * "threads".
+ */
+const char *lus_async_backend(const struct lus_async_ctx *ctx)
+{
+#ifdef HAVE_IO_URING
+	if (ctx->ring != NULL)
+		return "io_uring";
+#endif
+
+	return "threads";
+}
+
+/**
+ * Return the number of requests submitted whose callback has not
+ * been called yet.
+ */
+unsigned int lus_async_inflight(const struct lus_async_ctx *ctx)
+{
+	return ctx->inflight;
+}
+
+/**
+ * Submit the queued requests, wait for some of them to complete, and
+ * call their callbacks.
+ *
+ * \param[in]  ctx            an asynchronous context
+ * \param[in]  min_complete   number of completions to wait for. It is
+ *                            capped to the number of requests in
+ *                            flight. 0 only processes the requests
+ *                            already completed.
+ *
+ * \retval   the number of callbacks called
+ * \retval   a negative errno on error
+ */
+int lus_async_poll(struct lus_async_ctx *ctx, unsigned int min_complete)
+{
+	unsigned int done = 0;
+	uint32_t idx;
+	int rc;
+
+	if (min_complete > ctx->inflight)
+		min_complete = ctx->inflight;
+
+	while ((idx = queue_pop(ctx, &ctx->inline_done)) != NO_REQ) {
+		complete(ctx, idx);
+		done++;
+	}
+
+#ifdef HAVE_IO_URING
+	if (ctx->ring != NULL) {
+		if (ctx->ring->to_submit > 0 || done < min_complete) {
+			rc = uring_enter(ctx->ring,
+					 done < min_complete ?
+					 min_complete - done : 0);
+			if (rc)
+				return rc;
+		}
+
+		while ((idx = uring_reap(ctx)) != NO_REQ) {
+			complete(ctx, idx);
+			done++;
+		}
+
+		return done;
+	}
+#endif
+
+	if (ctx->thr != NULL) {
+		struct req_queue ready;
+
+		pthread_mutex_lock(&ctx->thr->lock);
+
+		while (done < min_complete && ctx->thr->done.head == NO_REQ)
+			pthread_cond_wait(&ctx->thr->done_cv, &ctx->thr->lock);
+
+		ready = ctx->thr->done;
+		queue_init(&ctx->thr->done);
+
+		pthread_mutex_unlock(&ctx->thr->lock);
+
+		/* Callbacks are called without the lock, so they can
+		 * submit more requests. */
+		while ((idx = queue_pop(ctx, &ready)) != NO_REQ) {
+			complete(ctx, idx);
+			done++;
+		}
+
+		/* More may have completed while waiting for the
+		 * first one. */
+		if (done < min_complete) {
+			rc = lus_async_poll(ctx, min_complete - done);
+			if (rc < 0)
+				return rc;
+			done += rc;
+		}
+	}
+
+	return done;
+}
+
+/**
+ * Submit an open of a file given its FID. The result passed to the
+ * callback is the new file descriptor, or a negative errno.
+ *
+ * If all the request slots are in use, this first processes some
+ * completions, calling their callbacks.
+ *
+ * \param[in]  ctx          an asynchronous context
+ * \param[in]  fid          the file to open
+ * \param[in]  open_flags   the open flags. See open(2)
+ * \param[in]  cb           function called on completion
+ * \param[in]  cb_arg       argument given to cb
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error. The callback will not be called.
+ */
+int lus_async_open_by_fid(struct lus_async_ctx *ctx, const lustre_fid *fid,
+			  int open_flags, lus_async_cb_t cb, void *cb_arg)
+{
+	struct async_req *req;
+	uint32_t idx;
+	int rc;
+
+	rc = get_slot(ctx, &idx);
+	if (rc)
+		return rc;
+
+	req = &ctx->reqs[idx];
+	req->op = LUS_ASYNC_OPEN;
+	req->flags = open_flags;
+	req->cb = cb;
+	req->cb_arg = cb_arg;
+	lus_fid_format(fid, req->path, sizeof(req->path));
+
+	return submit(ctx, idx);
+}
+
+/**
+ * Submit a statx(2) of a file given its FID. The result passed to the
+ * callback is 0 or a negative errno. stx must remain valid until
+ * then.
+ *
+ * \param[in]  ctx      an asynchronous context
+ * \param[in]  fid      the file to stat
+ * \param[in]  mask     or'ed STATX_* attributes needed
+ * \param[out] stx      the result
+ * \param[in]  cb       function called on completion
+ * \param[in]  cb_arg   argument given to cb
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error. The callback will not be called.
+ */
+int lus_async_statx_by_fid(struct lus_async_ctx *ctx, const lustre_fid *fid,
+			   unsigned int mask, struct statx *stx,
+			   lus_async_cb_t cb, void *cb_arg)
+{
+	struct async_req *req;
+	uint32_t idx;
+	int rc;
+
+	rc = get_slot(ctx, &idx);
+	if (rc)
+		return rc;
+
+	req = &ctx->reqs[idx];
+	req->op = LUS_ASYNC_STATX;
+	req->mask = mask;
+	req->stx = stx;
+	req->cb = cb;
+	req->cb_arg = cb_arg;
+	lus_fid_format(fid, req->path, sizeof(req->path));
+
+	return submit(ctx, idx);
+}
+
+/**
+ * Submit an fgetxattr(2). The result passed to the callback is the
+ * size of the attribute, or a negative errno. name and value must
+ * remain valid until then.
+ *
+ * \param[in]  ctx      an asynchronous context
+ * \param[in]  fd       an opened file descriptor
+ * \param[in]  name     the attribute name, such as XATTR_LUSTRE_LOV
+ * \param[out] value    buffer receiving the attribute
+ * \param[in]  size     size of value
+ * \param[in]  cb       function called on completion
+ * \param[in]  cb_arg   argument given to cb
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error. The callback will not be called.
+ */
+int lus_async_fgetxattr(struct lus_async_ctx *ctx, int fd, const char *name,
+			void *value, size_t size,
+			lus_async_cb_t cb, void *cb_arg)
+{
+	struct async_req *req;
+	uint32_t idx;
+	int rc;
+
+	rc = get_slot(ctx, &idx);
+	if (rc)
+		return rc;
+
+	req = &ctx->reqs[idx];
+	req->op = LUS_ASYNC_GETXATTR;
+	req->fd = fd;
+	req->name = name;
+	req->value = value;
+	req->size = size;
+	req->cb = cb;
+	req->cb_arg = cb_arg;
+
+	return submit(ctx, idx);
+}
+
+/**
+ * Submit a close of a file descriptor. The result passed to the
+ * callback is 0 or a negative errno.
+ *
+ * \param[in]  ctx      an asynchronous context
+ * \param[in]  fd       the file descriptor to close
+ * \param[in]  cb       function called on completion. Can be NULL.
+ * \param[in]  cb_arg   argument given to cb
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error. The callback will not be called.
+ */
+int lus_async_close(struct lus_async_ctx *ctx, int fd,
+		    lus_async_cb_t cb, void *cb_arg)
+{
+	struct async_req *req;
+	uint32_t idx;
+	int rc;
+
+	rc = get_slot(ctx, &idx);
+	if (rc)
+		return rc;
+
+	req = &ctx->reqs[idx];
+	req->op = LUS_ASYNC_CLOSE;
+	req->fd = fd;
+	req->cb = cb;
+	req->cb_arg = cb_arg;
+
+	return submit(ctx, idx);
+}
@@ -0,0 +1,801 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Changelog reader
+ *
+ * The MDT sends the records through a pipe, each one behind a
+ * kernelcomm header. The pipe is read in large chunks into a buffer,
+ * and the records are returned in place. When an incomplete message
+ * is left at the end of the buffer, it is moved to the start before
+ * the next read, which is the only copy made.
+ *
+ * Clearing records is deferred: the highest record to clear is
+ * remembered, and the ioctl is only issued once CL_CLEAR_INTERVAL
+ * records can be cleared, when the buffer has been consumed, or when
+ * the reader is closed.
+ *
+ * lus_changelog_dispatch() spreads the records over worker threads,
+ * each with its own queue. The queue is chosen from the target FID,
+ * so the records of a file are processed in order by the same
+ * worker. The records are dispatched in order, and each queue is in
+ * order, so every record before the oldest one still queued on any
+ * worker has been processed, and can be cleared.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* Size of the read buffer. It must hold at least 2 messages. */
+#define CL_BUF_SIZE (1024 * 1024)
+
+/* Number of records after which a clear is sent. */
+#define CL_CLEAR_INTERVAL 4096
+
+struct lus_changelog {
+	/* NULL when reading a stream given to lus_changelog_open_fd(). */
+	const struct lus_fs_handle *lfsh;
+	unsigned int mdt_index;
+	int user_id;			/* N in clN, or -1 */
+
+	int fd;
+	bool eof;
+
+	/* Data read and not consumed is buf[start..end). */
+	char *buf;
+	size_t start;
+	size_t end;
+
+	/* Deferred clear. Records up to clear_pending must be cleared,
+	 * and records up to cleared are. */
+	__u64 clear_pending;
+	__u64 cleared;
+	unsigned long clear_count;	/* number of ioctls issued */
+};
+
+/* Send the pending clear, if any. */
+static int flush_clear(struct lus_changelog *cl)
+{
+	struct ioc_changelog icc = {
+		.icc_recno = cl->clear_pending,
+		.icc_mdtindex = cl->mdt_index,
+		.icc_id = cl->user_id,
+	};
+	int rc;
+
+	if (cl->clear_pending <= cl->cleared)
+		return 0;
+
+	if (cl->lfsh != NULL) {
+		rc = ioctl(cl->lfsh->mount_fd, OBD_IOC_CHANGELOG_CLEAR, &icc);
+		if (rc == -1) {
+			rc = -errno;
+			log_msg(LUS_LOG_ERROR, rc,
+				"cannot clear changelog records up to %llu",
+				(unsigned long long)cl->clear_pending);
+			return rc;
+		}
+	}
+
+	cl->cleared = cl->clear_pending;
+	cl->clear_count++;
+
+	return 0;
+}
+
+static int alloc_changelog(struct lus_changelog **cl)
+{
+	struct lus_changelog *mycl;
+
+	mycl = calloc(1, sizeof(*mycl));
+	if (mycl == NULL)
+		return -ENOMEM;
+
+	mycl->buf = malloc(CL_BUF_SIZE);
+	if (mycl->buf == NULL) {
+		free(mycl);
+		return -ENOMEM;
+	}
+
+	mycl->fd = -1;
+	mycl->user_id = -1;
+	*cl = mycl;
+
+	return 0;
+}
+
+/**
+ * Start reading the changelog of an MDT.
+ *
+ * The records are sent by the MDT through a pipe. Unless
+ * CHANGELOG_FLAG_BLOCK is given, the pipe is non-blocking and can be
+ * polled through the descriptor returned by lus_changelog_get_fd().
+ *
+ * \param[in]   lfsh       An opened Lustre fs opaque handle
+ * \param[in]   mdt_index  the MDT to read the changelog from
+ * \param[in]   user       the changelog user, e.g. "cl1", needed to
+ *                         clear records. Can be NULL.
+ * \param[in]   startrec   first record to read
+ * \param[in]   flags      or'ed CHANGELOG_FLAG_*
+ * \param[out]  cl         the new changelog reader
+ *
+ * \retval 0 on success
+ * \retval a negative errno on failure
+ */
+int lus_changelog_open(const struct lus_fs_handle *lfsh,
+		       unsigned int mdt_index, const char *user,
+		       unsigned long long startrec, unsigned int flags,
+		       struct lus_changelog **cl)
+{
+	struct ioc_changelog icc = {
+		.icc_recno = startrec,
+		.icc_mdtindex = mdt_index,
+		.icc_flags = flags,
+	};
+	struct lus_changelog *mycl;
+	int pipefd[2];
+	char *end;
+	long id;
+	int rc;
+
+	*cl = NULL;
+
+	if (flags & ~(CHANGELOG_FLAG_FOLLOW | CHANGELOG_FLAG_BLOCK |
+		      CHANGELOG_FLAG_JOBID))
+		return -EINVAL;
+
+	rc = alloc_changelog(&mycl);
+	if (rc)
+		return rc;
+
+	mycl->lfsh = lfsh;
+	mycl->mdt_index = mdt_index;
+
+	if (user != NULL) {
+		if (strncmp(user, "cl", 2) != 0) {
+			rc = -EINVAL;
+			goto out_free;
+		}
+
+		errno = 0;
+		id = strtol(user + 2, &end, 10);
+		if (errno != 0 || end == user + 2 || *end != '\0' ||
+		    id < 0 || id > INT32_MAX) {
+			rc = -EINVAL;
+			goto out_free;
+		}
+		mycl->user_id = id;
+	}
+
+	rc = pipe(pipefd);
+	if (rc == -1) {
+		rc = -errno;
+		goto out_free;
+	}
+
+	if (!(flags & CHANGELOG_FLAG_BLOCK)) {
+		rc = fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+		if (rc == -1) {
+			rc = -errno;
+			goto out_close;
+		}
+	}
+
+	/* The kernel gets its own reference to the writer. */
+	icc.icc_id = pipefd[1];
+	rc = ioctl(lfsh->mount_fd, OBD_IOC_CHANGELOG_SEND, &icc);
+	if (rc == -1) {
+		rc = -errno;
+		log_msg(LUS_LOG_ERROR, rc,
+			"cannot start reading the changelog of MDT %u on '%s'",
+			mdt_index, lfsh->mount_path);
+		goto out_close;
+	}
+
+	close(pipefd[1]);
+	mycl->fd = pipefd[0];
+	*cl = mycl;
+
+	return 0;
+
+out_close:
+	close(pipefd[0]);
+	close(pipefd[1]);
+
+out_free:
+	free(mycl->buf);
+	free(mycl);
+
+	return rc;
+}
+
+/**
+ * Read changelog records from a file descriptor instead of an MDT.
+ *
+ * The stream has the format sent by the MDT: each record is preceded
+ * by a kernelcomm header. This allows replaying a recorded
+ * changelog. The descriptor is not closed by lus_changelog_close(),
+ * and lus_changelog_clear() doesn't clear anything.
+ *
+ * \param[in]   fd   a readable file descriptor
+ * \param[out]  cl   the new changelog reader
+ *
+ * \retval 0 on success
+ * \retval a negative errno on failure
+ */
+int lus_changelog_open_fd(int fd, struct lus_changelog **cl)
+{
+	int rc;
+
+	*cl = NULL;
+
+	if (fd < 0)
+		return -EBADF;
+
+	rc = alloc_changelog(cl);
+	if (rc)
+		return rc;
+
+	(*cl)->fd = fd;
+
+	return 0;
+}
+
+/*
+ * Look for a complete message in the buffer. Return 1 and set hdr
+ * and data if one is found, 0 if more data is needed, or a negative
+ * errno if the stream is corrupted. The data is aligned on 8 bytes.
+ */
+static int next_message(struct lus_changelog *cl, struct kuc_hdr *hdr,
+			const char **data)
+{
+	size_t avail = cl->end - cl->start;
+	size_t pos;
+
+	if (avail < sizeof(*hdr))
+		return 0;
+
+	/* Messages are not aligned in the buffer. */
+	memcpy(hdr, &cl->buf[cl->start], sizeof(*hdr));
+
+	if (hdr->kuc_magic != KUC_MAGIC) {
+		log_msg(LUS_LOG_ERROR, 0,
+			"Bad magic received from kernel (%08x instead of %08x)",
+			hdr->kuc_magic, KUC_MAGIC);
+		return -EPROTO;
+	}
+
+	if (hdr->kuc_msglen < sizeof(*hdr)) {
+		log_msg(LUS_LOG_ERROR, 0, "Invalid data length (%08x < %08zx)",
+			hdr->kuc_msglen, sizeof(*hdr));
+		return -EPROTO;
+	}
+
+	if (avail < hdr->kuc_msglen)
+		return 0;
+
+	/* The header was copied, so misaligned data can be moved
+	 * back over it. The buffer itself is aligned. */
+	pos = cl->start + sizeof(*hdr);
+	if (pos % sizeof(__u64)) {
+		memmove(&cl->buf[pos & ~(sizeof(__u64) - 1)], &cl->buf[pos],
+			hdr->kuc_msglen - sizeof(*hdr));
+		pos &= ~(sizeof(__u64) - 1);
+	}
+
+	*data = &cl->buf[pos];
+	cl->start += hdr->kuc_msglen;
+
+	return 1;
+}
+
+/* Read more data from the stream. Returns 0 on success, or a negative
+ * errno. */
+static int fill_buffer(struct lus_changelog *cl)
+{
+	ssize_t len;
+
+	/* Move the partial message left, if there isn't room for a
+	 * full one after it. */
+	if (cl->start == cl->end) {
+		cl->start = 0;
+		cl->end = 0;
+	} else if (CL_BUF_SIZE - cl->start < KUC_MAX_MSG_LEN) {
+		memmove(cl->buf, &cl->buf[cl->start], cl->end - cl->start);
+		cl->end -= cl->start;
+		cl->start = 0;
+	}
+
+	do {
+		len = read(cl->fd, &cl->buf[cl->end], CL_BUF_SIZE - cl->end);
+	} while (len == -1 && errno == EINTR);
+
+	if (len == -1)
+		return -errno;
+
+	if (len == 0)
+		cl->eof = true;
+
+	cl->end += len;
+
+	return 0;
+}
+
+/**
+ * Get the next changelog record.
+ *
+ * The record points inside the reader's buffer, aligned on 8
+ * bytes. It is valid until the next call to lus_changelog_recv() or
+ * lus_changelog_close().
+ *
+ * \param[in]   cl    a changelog reader
+ * \param[out]  rec   the next record
+ *
+ * \retval 0 on success
+ * \retval 1 at the end of the changelog
+ * \retval -EAGAIN if no record is available on a non-blocking reader
+ * \retval a negative errno on failure
+ */
+int lus_changelog_recv(struct lus_changelog *cl,
+		       const struct changelog_rec **rec)
+{
+	const struct changelog_rec *myrec;
+	struct kuc_hdr hdr;
+	const char *data;
+	size_t len;
+	int rc;
+
+	while (1) {
+		rc = next_message(cl, &hdr, &data);
+		if (rc < 0)
+			return rc;
+
+		if (rc == 0) {
+			if (cl->eof) {
+				flush_clear(cl);
+				return cl->start == cl->end ? 1 : -EPROTO;
+			}
+
+			/* Nothing left to process. It's a good time
+			 * to clear the consumed records. */
+			flush_clear(cl);
+
+			rc = fill_buffer(cl);
+			if (rc)
+				return rc;
+
+			continue;
+		}
+
+		if (hdr.kuc_transport != KUC_TRANSPORT_CHANGELOG)
+			continue;
+
+		if (hdr.kuc_msgtype == CL_EOF) {
+			cl->eof = true;
+			cl->start = cl->end;
+			continue;
+		}
+
+		if (hdr.kuc_msgtype != CL_RECORD)
+			continue;
+
+		len = hdr.kuc_msglen - sizeof(hdr);
+		myrec = (const struct changelog_rec *)data;
+		if (len < sizeof(*myrec) || len < changelog_rec_size(myrec)) {
+			log_msg(LUS_LOG_ERROR, 0,
+				"Invalid changelog record length %zu", len);
+			return -EPROTO;
+		}
+
+		*rec = myrec;
+
+		return 0;
+	}
+}
+
+/**
+ * Clear the changelog records up to endrec, included, for the user
+ * given to lus_changelog_open().
+ *
+ * The request is deferred and coalesced with the following ones. It
+ * is sent to the MDT once enough records can be cleared, when
+ * lus_changelog_recv() has consumed the records already read, or when
+ * the reader is closed.
+ *
+ * \param[in]  cl       a changelog reader
+ * \param[in]  endrec   last record to clear
+ *
+ * \retval 0 on success
+ * \retval a negative errno on failure
+ */
+int lus_changelog_clear(struct lus_changelog *cl, unsigned long long endrec)
+{
+	if (cl->lfsh != NULL && cl->user_id == -1)
+		return -EINVAL;
+
+	if (endrec <= cl->clear_pending)
+		return 0;
+
+	cl->clear_pending = endrec;
+
+	if (cl->clear_pending - cl->cleared >= CL_CLEAR_INTERVAL)
+		return flush_clear(cl);
+
+	return 0;
+}
+
+/* Number of records per worker queue */
+#define CL_QUEUE_DEPTH 256
+
+/* The clear point is recomputed every that many records. */
+#define CL_DISPATCH_CLEAR 64
+
+/* A copy of a record, in a worker queue. The buffer is kept and
+ * reused for the next records. */
+struct cl_slot {
+	__u64 index;
+	size_t buf_size;
+	struct changelog_rec *rec;
+};
+
+struct cl_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+
+	/* The worker processes slots[head], and only increments head
+	 * once it's done with it. */
+	size_t head;
+	size_t tail;
+	bool done;
+
+	struct cl_dispatch *dispatch;
+	pthread_t thread;
+	struct cl_slot slots[CL_QUEUE_DEPTH];
+};
+
+struct cl_dispatch {
+	lus_changelog_cb_t cb;
+	void *cb_arg;
+	int error;
+	unsigned int num_queues;
+	struct cl_queue *queues;
+};
+
+/* Wake up everybody after an error. */
+static void dispatch_stop(struct cl_dispatch *dispatch, int error)
+{
+	struct cl_queue *queue;
+	unsigned int i;
+	int none = 0;
+
+	__atomic_compare_exchange_n(&dispatch->error, &none, error, false,
+				    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	for (i = 0; i < dispatch->num_queues; i++) {
+		queue = &dispatch->queues[i];
+		pthread_mutex_lock(&queue->lock);
+		pthread_cond_broadcast(&queue->not_empty);
+		pthread_cond_broadcast(&queue->not_full);
+		pthread_mutex_unlock(&queue->lock);
+	}
+}
+
+static bool dispatch_stopped(const struct cl_dispatch *dispatch)
+{
+	return __atomic_load_n(&dispatch->error, __ATOMIC_RELAXED) != 0;
+}
+
+static void *dispatch_worker(void *arg)
+{
+	struct cl_queue *queue = arg;
+	struct cl_dispatch *dispatch = queue->dispatch;
+	struct cl_slot *slot;
+	int rc;
+
+	pthread_mutex_lock(&queue->lock);
+
+	while (1) {
+		while (queue->head == queue->tail && !queue->done &&
+		       !dispatch_stopped(dispatch))
+			pthread_cond_wait(&queue->not_empty, &queue->lock);
+
+		if (queue->head == queue->tail || dispatch_stopped(dispatch))
+			break;
+
+		slot = &queue->slots[queue->head % CL_QUEUE_DEPTH];
+		pthread_mutex_unlock(&queue->lock);
+
+		rc = dispatch->cb(slot->rec, dispatch->cb_arg);
+		if (rc < 0) {
+			/* The record stays at the head of the queue,
+			 * so it won't be cleared. */
+			dispatch_stop(dispatch, rc);
+			return NULL;
+		}
+
+		pthread_mutex_lock(&queue->lock);
+		queue->head++;
+		pthread_cond_signal(&queue->not_full);
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return NULL;
+}
+
+/* Copy a record to the queue of its FID. */
+static int dispatch_record(struct cl_dispatch *dispatch,
+			   const struct changelog_rec *rec)
+{
+	struct cl_queue *queue;
+	struct cl_slot *slot;
+	size_t len = changelog_rec_size(rec);
+	lustre_fid fid;
+	void *buf;
+
+	/* The record is a packed structure. */
+	fid = rec->cr_tfid;
+	queue = &dispatch->queues[fid_hash(&fid) % dispatch->num_queues];
+
+	pthread_mutex_lock(&queue->lock);
+	while (queue->tail - queue->head == CL_QUEUE_DEPTH &&
+	       !dispatch_stopped(dispatch))
+		pthread_cond_wait(&queue->not_full, &queue->lock);
+	pthread_mutex_unlock(&queue->lock);
+
+	if (dispatch_stopped(dispatch))
+		return dispatch->error;
+
+	/* The slot at the tail is not used by the worker. */
+	slot = &queue->slots[queue->tail % CL_QUEUE_DEPTH];
+	if (slot->buf_size < len) {
+		buf = realloc(slot->rec, len);
+		if (buf == NULL)
+			return -ENOMEM;
+		slot->rec = buf;
+		slot->buf_size = len;
+	}
+
+	memcpy(slot->rec, rec, len);
+	slot->index = rec->cr_index;
+
+	pthread_mutex_lock(&queue->lock);
+	queue->tail++;
+	pthread_cond_signal(&queue->not_empty);
+	pthread_mutex_unlock(&queue->lock);
+
+	return 0;
+}
+
+/* Return the last record processed, such that all the records before
+ * it were processed too. */
+static __u64 dispatch_completed(struct cl_dispatch *dispatch, __u64 last)
+{
+	struct cl_queue *queue;
+	struct cl_slot *slot;
+	unsigned int i;
+
+	for (i = 0; i < dispatch->num_queues; i++) {
+		queue = &dispatch->queues[i];
+
+		pthread_mutex_lock(&queue->lock);
+		if (queue->head != queue->tail) {
+			slot = &queue->slots[queue->head % CL_QUEUE_DEPTH];
+			if (slot->index <= last)
+				last = slot->index - 1;
+		}
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	return last;
+}
+
+/* Clear the records that all the workers are done with, if there is
+ * a user to clear them for. */
+static void dispatch_clear(struct lus_changelog *cl,
+			   struct cl_dispatch *dispatch, __u64 last)
+{
+	if (cl->lfsh != NULL && cl->user_id == -1)
+		return;
+
+	last = dispatch_completed(dispatch, last);
+	if (last > 0)
+		lus_changelog_clear(cl, last);
+}
+
+/**
+ * Read the changelog and process its records in parallel.
+ *
+ * The records are handed to \a workers threads, which call \a cb for
+ * each of them. All the records with the same target FID go to the
+ * same thread, in the order of the changelog, while records for
+ * different FIDs are processed in parallel. The record passed to \a cb
+ * is a copy, valid until \a cb returns.
+ *
+ * If the reader has a user, the records are cleared as they are
+ * processed, but never past a record that is still being processed
+ * or waiting in a queue.
+ *
+ * On a non-blocking reader, the changelog descriptor is polled when
+ * no record is available.
+ *
+ * \param[in]  cl        a changelog reader
+ * \param[in]  workers   number of worker threads, from 1 to 256
+ * \param[in]  cb        function called for every record
+ * \param[in]  cb_arg    argument passed to cb
+ *
+ * \retval 0 at the end of the changelog
+ * \retval the negative value returned by cb, which stops the dispatch
+ * \retval a negative errno on other errors
+ */
+int lus_changelog_dispatch(struct lus_changelog *cl, unsigned int workers,
+			   lus_changelog_cb_t cb, void *cb_arg)
+{
+	struct cl_dispatch dispatch = {
+		.cb = cb,
+		.cb_arg = cb_arg,
+	};
+	const struct changelog_rec *rec;
+	struct cl_queue *queue;
+	struct pollfd pfd;
+	unsigned long count = 0;
+	__u64 last = 0;
+	unsigned int i;
+	unsigned int j;
+	int rc;
+
+	if (workers == 0 || workers > 256)
+		return -EINVAL;
+
+	dispatch.queues = calloc(workers, sizeof(*dispatch.queues));
+	if (dispatch.queues == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < workers; i++) {
+		queue = &dispatch.queues[i];
+		queue->dispatch = &dispatch;
+		pthread_mutex_init(&queue->lock, NULL);
+		pthread_cond_init(&queue->not_empty, NULL);
+		pthread_cond_init(&queue->not_full, NULL);
+	}
+
+	for (i = 0; i < workers; i++) {
+		rc = pthread_create(&dispatch.queues[i].thread, NULL,
+				    dispatch_worker, &dispatch.queues[i]);
+		if (rc) {
+			rc = -rc;
+			dispatch_stop(&dispatch, rc);
+			goto out;
+		}
+		dispatch.num_queues++;
+	}
+
+	while (1) {
+		rc = lus_changelog_recv(cl, &rec);
+		if (rc == -EAGAIN) {
+			dispatch_clear(cl, &dispatch, last);
+			flush_clear(cl);
+
+			pfd.fd = cl->fd;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+				rc = -errno;
+				break;
+			}
+			continue;
+		}
+
+		if (rc)
+			break;
+
+		rc = dispatch_record(&dispatch, rec);
+		if (rc)
+			break;
+
+		last = rec->cr_index;
+		if (++count % CL_DISPATCH_CLEAR == 0)
+			dispatch_clear(cl, &dispatch, last);
+	}
+
+	/* End of changelog */
+	if (rc == 1)
+		rc = 0;
+
+	if (rc)
+		dispatch_stop(&dispatch, rc);
+
+out:
+	/* Let the workers finish their queues. */
+	for (i = 0; i < dispatch.num_queues; i++) {
+		queue = &dispatch.queues[i];
+		pthread_mutex_lock(&queue->lock);
+		queue->done = true;
+		pthread_cond_signal(&queue->not_empty);
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	for (i = 0; i < dispatch.num_queues; i++)
+		pthread_join(dispatch.queues[i].thread, NULL);
+
+	dispatch_clear(cl, &dispatch, last);
+
+	if (dispatch.error)
+		rc = dispatch.error;
+
+	for (i = 0; i < workers; i++) {
+		queue = &dispatch.queues[i];
+		pthread_cond_destroy(&queue->not_full);
+		pthread_cond_destroy(&queue->not_empty);
+		pthread_mutex_destroy(&queue->lock);
+		for (j = 0; j < CL_QUEUE_DEPTH; j++)
+			free(queue->slots[j].rec);
+	}
+	free(dispatch.queues);
+
+	return rc;
+}
+
+/**
+ * Return the file descriptor of the changelog stream, which can be
+ * polled.
+ *
+ * \param[in]  cl   a changelog reader
+ *
+ * \retval the file descriptor
+ */
+int lus_changelog_get_fd(const struct lus_changelog *cl)
+{
+	return cl->fd;
+}
+
+/**
+ * Close a changelog reader, after sending its pending clear.
+ *
+ * \param[in]  cl   the changelog reader to close. Can be NULL.
+ *
+ * \retval 0 on success
+ * \retval a negative errno if the pending clear failed
+ */
+int lus_changelog_close(struct lus_changelog *cl)
+{
+	int rc;
+
+	if (cl == NULL)
+		return 0;
+
+	rc = flush_clear(cl);
+
+	/* The MDT stops sending when the pipe is closed. */
+	if (cl->lfsh != NULL)
+		close(cl->fd);
+
+	free(cl->buf);
+	free(cl);
+
+	return rc;
+}
@@ -0,0 +1,327 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Per filesystem cache of the default layouts of directories
+ *
+ * Finding the layout a new file will get needs the default layout of
+ * its directory, completed with the default layout of the
+ * filesystem root. The cache keeps that result for each directory,
+ * keyed by its FID, so files created in the same directories don't
+ * need to look them up again.
+ *
+ * The cache is direct mapped: a FID can only go in one slot, and
+ * replaces whatever was there. Flushing the cache only increments
+ * its generation; the entries of an older generation are ignored,
+ * and freed when their slot is reused.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+struct dir_layout_entry {
+	lustre_fid fid;
+
+	/* Generation of the cache when the entry was added. 0 if the
+	 * slot was never used. */
+	uint64_t generation;
+
+	/* Monotonic time, in ms, after which the entry is stale. */
+	uint64_t expires;
+
+	struct lus_layout *layout;
+};
+
+struct dir_layout_cache {
+	/* Protects everything below. */
+	pthread_mutex_t lock;
+
+	unsigned int ttl_ms;
+	uint64_t generation;
+	size_t mask;
+
+	struct dir_layout_entry *table;
+};
+
+/* Return the current monotonic time in milliseconds. */
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static struct dir_layout_entry *
+dir_layout_slot(struct dir_layout_cache *cache, const lustre_fid *fid)
+{
+	return &cache->table[fid_hash(fid) & cache->mask];
+}
+
+/**
+ * Create a cache of directory layouts.
+ *
+ * \param[in]  capacity   number of directories to cache. It is
+ *                        rounded up to a power of 2.
+ * \param[in]  ttl_ms     lifetime of an entry, in milliseconds. 0
+ *                        means the entries never expire.
+ * \param[out] cache      the new cache
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int dir_layout_cache_create(size_t capacity, unsigned int ttl_ms,
+			    struct dir_layout_cache **cache)
+{
+	struct dir_layout_cache *mycache;
+	size_t slots = 1;
+
+	if (capacity == 0 || capacity > (1UL << 20))
+		return -EINVAL;
+
+	while (slots < capacity)
+		slots *= 2;
+
+	mycache = calloc(1, sizeof(*mycache));
+	if (mycache == NULL)
+		return -ENOMEM;
+
+	mycache->table = calloc(slots, sizeof(struct dir_layout_entry));
+	if (mycache->table == NULL) {
+		free(mycache);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&mycache->lock, NULL);
+	mycache->ttl_ms = ttl_ms;
+	mycache->generation = 1;
+	mycache->mask = slots - 1;
+
+	*cache = mycache;
+
+	return 0;
+}
+
+/**
+ * Free a cache. No other thread may be using it.
+ *
+ * \param[in]  cache   the cache to free. Can be NULL.
+ */
+void dir_layout_cache_destroy(struct dir_layout_cache *cache)
+{
+	size_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i <= cache->mask; i++)
+		lus_layout_free(cache->table[i].layout);
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->table);
+	free(cache);
+}
+
+/**
+ * Get a copy of the cached layout of a directory.
+ *
+ * \param[in]  cache   a cache, or NULL
+ * \param[in]  fid     the FID of the directory
+ *
+ * \retval   a newly allocated layout, to free with lus_layout_free()
+ * \retval   NULL if the directory is not cached, or its entry is stale
+ */
+struct lus_layout *dir_layout_cache_get(struct dir_layout_cache *cache,
+					const lustre_fid *fid)
+{
+	struct lus_layout *layout = NULL;
+	struct dir_layout_entry *e;
+
+	if (cache == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&cache->lock);
+
+	e = dir_layout_slot(cache, fid);
+	if (e->generation == cache->generation &&
+	    (cache->ttl_ms == 0 || now_ms() < e->expires) &&
+	    fid_equal(&e->fid, fid))
+		layout_dup_shared(e->layout, 0, &layout);
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return layout;
+}
+
+/**
+ * Cache the layout of a directory. The layout is copied, without
+ * its objects.
+ *
+ * \param[in]  cache    a cache, or NULL
+ * \param[in]  fid      the FID of the directory
+ * \param[in]  layout   its layout, completed by the root's
+ */
+void dir_layout_cache_put(struct dir_layout_cache *cache,
+			  const lustre_fid *fid,
+			  const struct lus_layout *layout)
+{
+	struct dir_layout_entry *e;
+	struct lus_layout *copy;
+
+	if (cache == NULL)
+		return;
+
+	if (layout_dup_shared(layout, 0, &copy))
+		return;
+
+	pthread_mutex_lock(&cache->lock);
+
+	e = dir_layout_slot(cache, fid);
+	lus_layout_free(e->layout);
+	e->fid = *fid;
+	e->generation = cache->generation;
+	e->expires = now_ms() + cache->ttl_ms;
+	e->layout = copy;
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Install a new cache on a handle, or none. The current one is freed
+ * once the lookups that may still be using it are over. */
+static void fs_replace_dir_layout_cache(struct lus_fs_handle *lfsh,
+				       struct dir_layout_cache *cache)
+{
+	struct dir_layout_cache *old;
+
+	pthread_mutex_lock(&lfsh->lock);
+
+	old = __atomic_exchange_n(&lfsh->dir_layout_cache, cache,
+				  __ATOMIC_SEQ_CST);
+	if (old != NULL) {
+		fs_cache_sync(lfsh);
+		dir_layout_cache_destroy(old);
+	}
+
+	pthread_mutex_unlock(&lfsh->lock);
+}
+
+/**
+ * Enable the cache of the default layouts of directories on a
+ * filesystem handle. Once enabled, lus_layout_get_expected() and
+ * lus_layout_expected_many() only look up a directory's default
+ * layout and the root's once, until the entry expires or is
+ * invalidated.
+ *
+ * Default layouts set afterwards on a cached directory, or on the
+ * root, are not seen until then. The cache is shared by all the
+ * users of the handle. If it was already enabled, its content is
+ * discarded, and the previous cache is freed once the lookups in
+ * progress on other threads complete.
+ *
+ * \param[in]  lfsh       An opaque handle returned by lus_open_fs()
+ * \param[in]  capacity   maximum number of directories to cache
+ * \param[in]  ttl_ms     lifetime of an entry, in milliseconds. 0
+ *                        means the entries never expire.
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int lus_dir_layout_cache_enable(struct lus_fs_handle *lfsh,
+				size_t capacity, unsigned int ttl_ms)
+{
+	struct dir_layout_cache *cache;
+	int rc;
+
+	rc = dir_layout_cache_create(capacity, ttl_ms, &cache);
+	if (rc)
+		return rc;
+
+	fs_replace_dir_layout_cache(lfsh, cache);
+
+	return 0;
+}
+
+/**
+ * Disable and free the directory layout cache of a filesystem
+ * handle. This waits for the lookups in progress on other threads.
+ *
+ * \param[in]  lfsh       An opaque handle returned by lus_open_fs()
+ */
+void lus_dir_layout_cache_disable(struct lus_fs_handle *lfsh)
+{
+	fs_replace_dir_layout_cache(lfsh, NULL);
+}
+
+/**
+ * Forget the cached layout of a directory, after its default layout
+ * was changed.
+ *
+ * \param[in]  lfsh    An opaque handle returned by lus_open_fs()
+ * \param[in]  fid     the FID of the directory
+ */
+void lus_dir_layout_cache_invalidate(const struct lus_fs_handle *lfsh,
+				     const lustre_fid *fid)
+{
+	struct dir_layout_cache *cache;
+	struct dir_layout_entry *e;
+	unsigned int idx;
+
+	idx = fs_cache_enter(lfsh);
+
+	cache = fs_dir_layout_cache(lfsh);
+	if (cache != NULL) {
+		pthread_mutex_lock(&cache->lock);
+
+		e = dir_layout_slot(cache, fid);
+		if (fid_equal(&e->fid, fid))
+			e->generation = 0;
+
+		pthread_mutex_unlock(&cache->lock);
+	}
+
+	fs_cache_exit(lfsh, idx);
+}
+
+/**
+ * Forget all the cached layouts, for instance after the default
+ * layout of the root was changed. This only starts a new generation
+ * of the cache, and takes constant time.
+ *
+ * \param[in]  lfsh    An opaque handle returned by lus_open_fs()
+ */
+void lus_dir_layout_cache_flush(const struct lus_fs_handle *lfsh)
+{
+	struct dir_layout_cache *cache;
+	unsigned int idx;
+
+	idx = fs_cache_enter(lfsh);
+
+	cache = fs_dir_layout_cache(lfsh);
+	if (cache != NULL) {
+		pthread_mutex_lock(&cache->lock);
+		cache->generation++;
+		pthread_mutex_unlock(&cache->lock);
+	}
+
+	fs_cache_exit(lfsh, idx);
+}
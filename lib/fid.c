@@ -0,0 +1,364 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief FID to text conversions
+ *
+ * These functions replace snprintf(DFID_NOBRACE) and sscanf(SFID),
+ * which are slow for something done for every changelog record or
+ * every file opened by FID. The hexadecimal conversions work on 8
+ * digits at a time inside a 64 bits word instead of one character at
+ * a time.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+#define ONES 0x0101010101010101ULL
+#define HIGHS (ONES * 0x80)
+
+/* Number of hexadecimal digits needed to print a non-zero value. */
+static inline unsigned int hex_digits(uint64_t value)
+{
+	return (64 - __builtin_clzll(value | 1) + 3) / 4;
+}
+
+/* Convert a 32 bits value into 8 hexadecimal characters, most
+ * significant first, stored in a 64 bits word in memory order. */
+static inline uint64_t hex8(uint32_t value)
+{
+	uint64_t x = value;
+
+	/* Spread one nibble per byte, least significant nibble in the
+	 * least significant byte. */
+	x = ((x & 0xffff0000ULL) << 16) | (x & 0x0000ffffULL);
+	x = ((x & 0x0000ff000000ff00ULL) << 8) | (x & 0x000000ff000000ffULL);
+	x = ((x & 0x00f000f000f000f0ULL) << 4) | (x & 0x000f000f000f000fULL);
+
+	/* '0' to '9', then add 0x27 to get 'a' to 'f'. */
+	x += ONES * '0' + (((x + ONES * 6) >> 4) & ONES) * 0x27;
+
+	/* Most significant digit first in memory. */
+	return htobe64(x);
+}
+
+/* Write value in hexadecimal, without leading zeroes, and return the
+ * position after the last digit. There must be room for 16
+ * characters. */
+static char *put_hex(char *p, uint64_t value)
+{
+	unsigned int digits = hex_digits(value);
+	uint64_t text[2];
+
+	text[0] = hex8(value >> 32);
+	text[1] = hex8(value);
+
+	memcpy(p, (char *)text + 16 - digits, digits);
+
+	return p + digits;
+}
+
+/**
+ * Format a FID as text, without the brackets. The result is
+ * identical to the one from snprintf() with DFID_NOBRACE.
+ *
+ * \param[in]   fid       the FID to format
+ * \param[out]  buf       the result, NUL terminated
+ * \param[in]   buf_len   size of buf. FID_NOBRACE_LEN + 1 is always
+ *                        enough.
+ *
+ * \retval   the length of the string, not counting the NUL terminator
+ * \retval   -ENOSPC if buf is too small. buf is not modified.
+ */
+int lus_fid_format(const lustre_fid *fid, char *buf, size_t buf_len)
+{
+	size_t len;
+	char *p;
+
+	/* %#llx prints 0 as "0", and the other values with a 0x
+	 * prefix. */
+	len = (fid->f_seq ? 2 + hex_digits(fid->f_seq) : 1) +
+		3 + hex_digits(fid->f_oid) +
+		3 + hex_digits(fid->f_ver);
+	if (len >= buf_len)
+		return -ENOSPC;
+
+	p = buf;
+	if (fid->f_seq) {
+		*p++ = '0';
+		*p++ = 'x';
+		p = put_hex(p, fid->f_seq);
+	} else {
+		*p++ = '0';
+	}
+
+	*p++ = ':';
+	*p++ = '0';
+	*p++ = 'x';
+	p = put_hex(p, fid->f_oid);
+
+	*p++ = ':';
+	*p++ = '0';
+	*p++ = 'x';
+	p = put_hex(p, fid->f_ver);
+
+	*p = '\0';
+
+	return len;
+}
+
+/* Value of each character as an hexadecimal digit, or 0xff. */
+static const unsigned char hex_values[256] = {
+	[0 ... 255] = 0xff,
+	['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+	['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+	['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+	['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
+
+/* Set the high bit of every byte of x that is strictly between m and
+ * n. Both m and n must be at most 128. */
+#define BYTES_BETWEEN(x, m, n)						\
+	(((ONES * (127 + (n)) - ((x) & ONES * 127)) & ~(x) &		\
+	  (((x) & ONES * 127) + ONES * (127 - (m)))) & HIGHS)
+
+/* Decode up to 8 hexadecimal digits from the 8 bytes at p. Return
+ * the number of digits found, and their value in *value. */
+static unsigned int get_hex8(const char *p, uint32_t *value)
+{
+	uint64_t x;
+	uint64_t valid;
+	unsigned int digits;
+
+	memcpy(&x, p, sizeof(x));
+	x = le64toh(x);
+
+	/* '0'-'9', 'A'-'F' and 'a'-'f' */
+	valid = BYTES_BETWEEN(x, '0' - 1, '9' + 1) |
+		BYTES_BETWEEN(x, 'A' - 1, 'F' + 1) |
+		BYTES_BETWEEN(x, 'a' - 1, 'f' + 1);
+
+	/* Count the leading valid bytes. */
+	valid = ~valid & HIGHS;
+	digits = valid ? __builtin_ctzll(valid) / 8 : 8;
+	if (digits == 0)
+		return 0;
+
+	/* Nibble value of each byte. Letters have bit 6 set. */
+	x = (x & (ONES * 0x0f)) + ((x >> 6) & ONES) * 9;
+
+	/* Put the first digit in the most significant byte, and drop
+	 * the bytes that are not part of the number. */
+	x = __builtin_bswap64(x);
+	if (digits < 8)
+		x &= ~0ULL << (8 * (8 - digits));
+
+	/* Pack the nibbles. */
+	x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+	x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+	x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+
+	*value = x >> (4 * (8 - digits));
+
+	return digits;
+}
+
+/* Parse an hexadecimal number of at most max_digits digits, with an
+ * optional 0x prefix, from the string between p and end. Return the
+ * position after the number, or NULL if it is invalid. */
+static const char *get_hex(const char *p, const char *end,
+			   unsigned int max_digits, uint64_t *value)
+{
+	unsigned int digits = 0;
+	unsigned int n;
+	uint64_t result = 0;
+	uint32_t part;
+
+	if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+		p += 2;
+
+	/* 8 digits at a time while there is enough data. */
+	while (end - p >= 8) {
+		n = get_hex8(p, &part);
+		if (n == 0)
+			break;
+
+		digits += n;
+		if (digits > max_digits)
+			return NULL;
+
+		result = (n == 8 ? result << 32 : result << (4 * n)) | part;
+		p += n;
+
+		if (n < 8)
+			goto done;
+	}
+
+	while (p < end && hex_values[(unsigned char)*p] != 0xff) {
+		if (++digits > max_digits)
+			return NULL;
+
+		result = (result << 4) | hex_values[(unsigned char)*p];
+		p++;
+	}
+
+done:
+	if (digits == 0)
+		return NULL;
+
+	*value = result;
+
+	return p;
+}
+
+/* Parse a FID in the string between p and end. The brackets are
+ * optional. Return the position after the FID, or NULL if there is
+ * no valid FID. */
+static const char *parse_fid(const char *p, const char *end, lustre_fid *fid)
+{
+	bool bracket = false;
+	uint64_t seq;
+	uint64_t oid;
+	uint64_t ver;
+
+	if (p < end && *p == '[') {
+		bracket = true;
+		p++;
+	}
+
+	p = get_hex(p, end, 16, &seq);
+	if (p == NULL || p == end || *p != ':')
+		return NULL;
+
+	p = get_hex(p + 1, end, 8, &oid);
+	if (p == NULL || p == end || *p != ':')
+		return NULL;
+
+	p = get_hex(p + 1, end, 8, &ver);
+	if (p == NULL)
+		return NULL;
+
+	if (bracket) {
+		if (p == end || *p != ']')
+			return NULL;
+		p++;
+	}
+
+	fid->f_seq = seq;
+	fid->f_oid = oid;
+	fid->f_ver = ver;
+
+	return p;
+}
+
+/**
+ * Parse a FID from a string. The FID may be enclosed in brackets, and
+ * each of its components may have a 0x prefix, so the output of
+ * DFID, DFID_NOBRACE and lus_fid_format() are all accepted.
+ *
+ * Parsing stops at the first character after the FID.
+ *
+ * \param[in]   str   a NUL terminated string starting with a FID
+ * \param[out]  fid   the parsed FID
+ * \param[out]  end   if not NULL, set to the first character after
+ *                    the FID
+ *
+ * \retval   0 on success
+ * \retval   -EINVAL if str doesn't start with a valid FID
+ */
+int lus_fid_parse(const char *str, lustre_fid *fid, const char **end)
+{
+	const char *p;
+
+	/* Longest FID is "[0x" 16 digits ":0x" 8 digits ":0x" 8
+	 * digits "]". Allow for some leading zeroes. */
+	p = parse_fid(str, str + strnlen(str, 2 * FID_LEN), fid);
+	if (p == NULL)
+		return -EINVAL;
+
+	if (end != NULL)
+		*end = p;
+
+	return 0;
+}
+
+/**
+ * Parse a list of FIDs, one per line, such as the content of a file
+ * read in memory. Blank lines, and spaces and tabs around the FIDs
+ * are ignored.
+ *
+ * \param[in]   buf        the list. It doesn't have to be NUL
+ *                         terminated.
+ * \param[in]   buf_len    length of the list
+ * \param[out]  fids       array receiving the FIDs
+ * \param[in]   max_fids   size of the fids array
+ * \param[out]  consumed   if not NULL, set to the number of bytes
+ *                         processed. On error, it is the offset of
+ *                         the invalid line.
+ *
+ * \retval   the number of FIDs parsed. It is less than max_fids only if
+ *           the whole list was processed.
+ * \retval   -EINVAL if a line doesn't contain a valid FID
+ */
+ssize_t lus_fid_parse_list(const char *buf, size_t buf_len,
+			   lustre_fid *fids, size_t max_fids,
+			   size_t *consumed)
+{
+	const char *end = buf + buf_len;
+	const char *line = buf;
+	const char *p;
+	size_t count = 0;
+
+	while (line < end && count < max_fids) {
+		p = line;
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+
+		if (p < end && *p != '\n') {
+			p = parse_fid(p, end, &fids[count]);
+			if (p == NULL)
+				goto invalid;
+
+			while (p < end &&
+			       (*p == ' ' || *p == '\t' || *p == '\r'))
+				p++;
+
+			if (p < end && *p != '\n')
+				goto invalid;
+
+			count++;
+		}
+
+		/* Skip the newline */
+		line = p < end ? p + 1 : end;
+	}
+
+	if (consumed != NULL)
+		*consumed = line - buf;
+
+	return count;
+
+invalid:
+	if (consumed != NULL)
+		*consumed = line - buf;
+
+	return -EINVAL;
+}
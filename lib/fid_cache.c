@@ -0,0 +1,765 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Per filesystem cache of file attributes, keyed by FID
+ *
+ * The cache is a set associative table of fixed size entries. Each
+ * entry holds the stat, layout and HSM state of a FID, any of which
+ * may be missing.
+ *
+ * Readers don't take any lock. Every entry has a sequence counter,
+ * which is odd while the entry is being modified. A reader copies
+ * what it needs, then checks that the counter didn't change,
+ * otherwise it tries again. The data is copied one 64 bits word at a
+ * time with atomic loads and stores, so the readers never see a torn
+ * word. The writers are serialized by a mutex.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* Entries per set. */
+#define FID_CACHE_WAYS 4
+
+/* Room for a layout with up to 8 stripes. Larger layouts are not
+ * cached. */
+#define FID_CACHE_LAYOUT_SIZE 256
+
+enum fid_cache_item {
+	FID_CACHE_STAT		= 0x01,
+	FID_CACHE_LAYOUT	= 0x02,
+	FID_CACHE_HSM		= 0x04,
+	FID_CACHE_DV		= 0x08,
+};
+
+struct fid_cache_entry {
+	/* Odd while a writer modifies the entry. */
+	uint32_t seq;
+
+	/* Or'ed FID_CACHE_*. 0 if the entry is free. */
+	uint32_t valid;
+
+	lustre_fid fid;
+
+	/* Monotonic time, in ms, after which the entry is stale. Also
+	 * used to find the oldest entry when there is no TTL. */
+	uint64_t expires;
+
+	uint64_t dv;
+	struct stat st;
+	struct hsm_user_state hus;
+	uint64_t layout_len;
+	uint64_t layout[FID_CACHE_LAYOUT_SIZE / sizeof(uint64_t)];
+};
+
+struct fid_cache {
+	/* Serializes the writers. */
+	pthread_mutex_t lock;
+
+	/* Time to live of an entry, in ms. 0 for no limit. */
+	unsigned int ttl_ms;
+
+	/* Number of sets - 1. The number of sets is a power of 2. */
+	size_t set_mask;
+
+	size_t entries;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t invalidations;
+
+	struct fid_cache_entry *table;
+};
+
+/* Return the current monotonic time in milliseconds. */
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/* Copy len bytes, a multiple of 8, from an entry that may be
+ * concurrently modified. */
+static void load_words(void *dst, const void *src, size_t len)
+{
+	const uint64_t *s = src;
+	uint64_t *d = dst;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(uint64_t); i++)
+		d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+}
+
+/* Copy len bytes, a multiple of 8, into an entry that may be
+ * concurrently read. */
+static void store_words(void *dst, const void *src, size_t len)
+{
+	const uint64_t *s = src;
+	uint64_t *d = dst;
+	size_t i;
+
+	for (i = 0; i < len / sizeof(uint64_t); i++)
+		__atomic_store_n(&d[i], s[i], __ATOMIC_RELAXED);
+}
+
+static void entry_write_begin(struct fid_cache_entry *e)
+{
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void entry_write_end(struct fid_cache_entry *e)
+{
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+}
+
+static void entry_set_valid(struct fid_cache_entry *e, uint32_t valid)
+{
+	__atomic_store_n(&e->valid, valid, __ATOMIC_RELAXED);
+}
+
+static struct fid_cache_entry *fid_cache_set(const struct fid_cache *cache,
+					     const lustre_fid *fid)
+{
+	return &cache->table[(fid_hash(fid) & cache->set_mask) *
+			     FID_CACHE_WAYS];
+}
+
+/**
+ * Allocate a cache.
+ *
+ * \param[in]   capacity   maximum number of FIDs to cache. Rounded
+ *                         up to a power of 2, with a minimum of 4.
+ * \param[in]   ttl_ms     lifetime of the entries, in ms. 0 for no
+ *                         limit.
+ * \param[out]  cache      the new cache
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int fid_cache_create(size_t capacity, unsigned int ttl_ms,
+		     struct fid_cache **cache)
+{
+	struct fid_cache *mycache;
+	size_t sets = 1;
+
+	if (capacity == 0 || capacity > (1UL << 32))
+		return -EINVAL;
+
+	while (sets * FID_CACHE_WAYS < capacity)
+		sets *= 2;
+
+	mycache = calloc(1, sizeof(*mycache));
+	if (mycache == NULL)
+		return -ENOMEM;
+
+	mycache->table = calloc(sets * FID_CACHE_WAYS,
+				sizeof(struct fid_cache_entry));
+	if (mycache->table == NULL) {
+		free(mycache);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&mycache->lock, NULL);
+	mycache->ttl_ms = ttl_ms;
+	mycache->set_mask = sets - 1;
+
+	*cache = mycache;
+
+	return 0;
+}
+
+/**
+ * Free a cache. No other thread may be using it.
+ *
+ * \param[in]  cache   the cache to free. Can be NULL.
+ */
+void fid_cache_destroy(struct fid_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->table);
+	free(cache);
+}
+
+/* Look for the FID in the cache, and if the item is present, copy it
+ * in dst, which must have room for len bytes. For the layout, len is
+ * updated with the actual size. Return whether the item was found. */
+static bool fid_cache_lookup(struct fid_cache *cache,
+			     const lustre_fid *fid,
+			     enum fid_cache_item item, void *dst, size_t *len)
+{
+	struct fid_cache_entry *set;
+	struct fid_cache_entry *e;
+	lustre_fid efid;
+	uint32_t valid;
+	uint64_t expires;
+	uint64_t now = 0;
+	uint32_t seq;
+	size_t copied = 0;
+	bool found;
+	int i;
+
+	if (cache == NULL)
+		return false;
+
+	if (cache->ttl_ms)
+		now = now_ms();
+
+	set = fid_cache_set(cache, fid);
+
+	for (i = 0; i < FID_CACHE_WAYS; i++) {
+		e = &set[i];
+
+retry:
+		seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			goto retry;
+		}
+
+		valid = __atomic_load_n(&e->valid, __ATOMIC_RELAXED);
+		if (!(valid & item))
+			found = false;
+		else {
+			load_words(&efid, &e->fid, sizeof(efid));
+			expires = __atomic_load_n(&e->expires,
+						  __ATOMIC_RELAXED);
+			found = fid_equal(&efid, fid) &&
+				(cache->ttl_ms == 0 || expires > now);
+		}
+
+		if (found) {
+			switch (item) {
+			case FID_CACHE_STAT:
+				load_words(dst, &e->st, sizeof(e->st));
+				break;
+
+			case FID_CACHE_HSM:
+				load_words(dst, &e->hus, sizeof(e->hus));
+				break;
+
+			case FID_CACHE_LAYOUT:
+				copied = __atomic_load_n(&e->layout_len,
+							 __ATOMIC_RELAXED);
+				if (copied > *len)
+					copied = *len;
+				load_words(dst, e->layout, copied);
+				break;
+
+			case FID_CACHE_DV:
+				*(uint64_t *)dst =
+					__atomic_load_n(&e->dv,
+							__ATOMIC_RELAXED);
+				break;
+			}
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq)
+			goto retry;
+
+		if (found) {
+			if (item == FID_CACHE_LAYOUT)
+				*len = copied;
+			__atomic_fetch_add(&cache->hits, 1, __ATOMIC_RELAXED);
+			return true;
+		}
+	}
+
+	__atomic_fetch_add(&cache->misses, 1, __ATOMIC_RELAXED);
+
+	return false;
+}
+
+/* Find the entry for a FID, or allocate one, and start modifying
+ * it. Called with the cache lock held. */
+static struct fid_cache_entry *
+fid_cache_get_entry(struct fid_cache *cache, const lustre_fid *fid,
+		    uint64_t now)
+{
+	struct fid_cache_entry *set;
+	struct fid_cache_entry *e;
+	struct fid_cache_entry *victim = NULL;
+	int i;
+
+	set = fid_cache_set(cache, fid);
+
+	for (i = 0; i < FID_CACHE_WAYS; i++) {
+		e = &set[i];
+
+		if (e->valid && fid_equal(&e->fid, fid)) {
+			entry_write_begin(e);
+
+			if (cache->ttl_ms == 0 || e->expires > now)
+				return e;
+
+			/* Drop what is stale, and reuse the slot. */
+			entry_set_valid(e, 0);
+			entry_write_end(e);
+			cache->entries--;
+			victim = e;
+			break;
+		}
+
+		/* Prefer a free slot, then the oldest one. */
+		if (victim == NULL ||
+		    (victim->valid &&
+		     (e->valid == 0 || e->expires < victim->expires)))
+			victim = e;
+	}
+
+	entry_write_begin(victim);
+
+	if (victim->valid)
+		cache->evictions++;
+	else
+		cache->entries++;
+
+	entry_set_valid(victim, 0);
+	store_words(&victim->fid, fid, sizeof(*fid));
+	__atomic_store_n(&victim->expires, now + cache->ttl_ms,
+			 __ATOMIC_RELAXED);
+
+	return victim;
+}
+
+/* Store an item for a FID. */
+static void fid_cache_store(struct fid_cache *cache, const lustre_fid *fid,
+			    enum fid_cache_item item,
+			    const void *src, size_t len)
+{
+	struct fid_cache_entry *e;
+	uint64_t now;
+
+	if (cache == NULL)
+		return;
+
+	if (item == FID_CACHE_LAYOUT && len > FID_CACHE_LAYOUT_SIZE)
+		return;
+
+	now = now_ms();
+
+	pthread_mutex_lock(&cache->lock);
+
+	e = fid_cache_get_entry(cache, fid, now);
+
+	switch (item) {
+	case FID_CACHE_STAT:
+		store_words(&e->st, src, sizeof(e->st));
+		break;
+
+	case FID_CACHE_HSM:
+		store_words(&e->hus, src, sizeof(e->hus));
+		break;
+
+	case FID_CACHE_LAYOUT:
+		/* A layout is a multiple of 8 bytes, as it contains
+		 * 64 bits fields. */
+		store_words(e->layout, src, len);
+		__atomic_store_n(&e->layout_len, len, __ATOMIC_RELAXED);
+		break;
+
+	case FID_CACHE_DV:
+		__atomic_store_n(&e->dv, *(const uint64_t *)src,
+				 __ATOMIC_RELAXED);
+		break;
+	}
+
+	entry_set_valid(e, e->valid | item);
+	entry_write_end(e);
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* Remove a FID from the cache. Called with the cache lock held. */
+static void fid_cache_drop(struct fid_cache *cache, const lustre_fid *fid)
+{
+	struct fid_cache_entry *set;
+	struct fid_cache_entry *e;
+	int i;
+
+	set = fid_cache_set(cache, fid);
+
+	for (i = 0; i < FID_CACHE_WAYS; i++) {
+		e = &set[i];
+
+		if (e->valid && fid_equal(&e->fid, fid)) {
+			entry_write_begin(e);
+			entry_set_valid(e, 0);
+			entry_write_end(e);
+
+			cache->entries--;
+			cache->invalidations++;
+		}
+	}
+}
+
+/* Look for an item in the cache of a handle, if it has one. */
+static bool fid_cache_get(const struct lus_fs_handle *lfsh,
+			  const lustre_fid *fid, enum fid_cache_item item,
+			  void *dst, size_t *len)
+{
+	unsigned int idx;
+	bool found;
+
+	idx = fs_cache_enter(lfsh);
+	found = fid_cache_lookup(fs_fid_cache(lfsh), fid, item, dst, len);
+	fs_cache_exit(lfsh, idx);
+
+	return found;
+}
+
+/* Store an item in the cache of a handle, if it has one. */
+static void fid_cache_put(const struct lus_fs_handle *lfsh,
+			  const lustre_fid *fid, enum fid_cache_item item,
+			  const void *src, size_t len)
+{
+	unsigned int idx;
+
+	idx = fs_cache_enter(lfsh);
+	fid_cache_store(fs_fid_cache(lfsh), fid, item, src, len);
+	fs_cache_exit(lfsh, idx);
+}
+
+bool fid_cache_get_stat(const struct lus_fs_handle *lfsh,
+			const lustre_fid *fid, struct stat *st)
+{
+	return fid_cache_get(lfsh, fid, FID_CACHE_STAT, st, NULL);
+}
+
+void fid_cache_put_stat(const struct lus_fs_handle *lfsh,
+			const lustre_fid *fid, const struct stat *st)
+{
+	fid_cache_put(lfsh, fid, FID_CACHE_STAT, st, sizeof(*st));
+}
+
+bool fid_cache_get_hsm(const struct lus_fs_handle *lfsh,
+		       const lustre_fid *fid, struct hsm_user_state *hus)
+{
+	return fid_cache_get(lfsh, fid, FID_CACHE_HSM, hus, NULL);
+}
+
+void fid_cache_put_hsm(const struct lus_fs_handle *lfsh,
+		       const lustre_fid *fid,
+		       const struct hsm_user_state *hus)
+{
+	fid_cache_put(lfsh, fid, FID_CACHE_HSM, hus, sizeof(*hus));
+}
+
+/* Return a copy of the cached layout, or NULL if it is not cached. */
+struct lus_layout *fid_cache_get_layout(const struct lus_fs_handle *lfsh,
+					const lustre_fid *fid)
+{
+	uint64_t buf[FID_CACHE_LAYOUT_SIZE / sizeof(uint64_t)];
+	size_t len = sizeof(buf);
+	struct lus_layout *layout;
+
+	if (!fid_cache_get(lfsh, fid, FID_CACHE_LAYOUT, buf, &len))
+		return NULL;
+
+	layout = malloc(len);
+	if (layout != NULL)
+		memcpy(layout, buf, len);
+
+	return layout;
+}
+
+void fid_cache_put_layout(const struct lus_fs_handle *lfsh,
+			  const lustre_fid *fid,
+			  const struct lus_layout *layout)
+{
+	fid_cache_put(lfsh, fid, FID_CACHE_LAYOUT, layout,
+		      layout_size(layout));
+}
+
+/* Compare the data version of a FID with the cached one. If they are
+ * the same, the entry is given a new lifetime and true is returned.
+ * Otherwise the attributes are dropped and the new data version is
+ * stored for the next check. */
+static bool fid_cache_check_dv(struct fid_cache *cache,
+			       const lustre_fid *fid, uint64_t dv)
+{
+	struct fid_cache_entry *e;
+	uint64_t now;
+	bool same;
+
+	now = now_ms();
+
+	pthread_mutex_lock(&cache->lock);
+
+	e = fid_cache_get_entry(cache, fid, now);
+
+	same = (e->valid & FID_CACHE_DV) && e->dv == dv;
+	if (same) {
+		__atomic_store_n(&e->expires, now + cache->ttl_ms,
+				 __ATOMIC_RELAXED);
+	} else {
+		if (e->valid & ~FID_CACHE_DV)
+			cache->invalidations++;
+		__atomic_store_n(&e->dv, dv, __ATOMIC_RELAXED);
+		entry_set_valid(e, FID_CACHE_DV);
+	}
+
+	entry_write_end(e);
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return same;
+}
+
+/* Install a new cache on a handle, or none. The current one is freed
+ * once the lookups that may still be reading it are over. */
+static void fs_replace_fid_cache(struct lus_fs_handle *lfsh,
+				 struct fid_cache *cache)
+{
+	struct fid_cache *old;
+
+	pthread_mutex_lock(&lfsh->lock);
+
+	old = __atomic_exchange_n(&lfsh->fid_cache, cache, __ATOMIC_SEQ_CST);
+	if (old != NULL) {
+		fs_cache_sync(lfsh);
+		fid_cache_destroy(old);
+	}
+
+	pthread_mutex_unlock(&lfsh->lock);
+}
+
+/**
+ * Enable the attribute cache on a filesystem handle. Once enabled,
+ * lus_stat_by_fid(), lus_layout_get_by_fid() and
+ * lus_hsm_state_get_by_fid() first look into the cache, and fill it
+ * on a miss.
+ *
+ * Changes made by other clients, or through a file descriptor, are
+ * not seen until the entry expires, is revalidated with
+ * lus_fid_cache_revalidate(), or is invalidated.
+ *
+ * Each entry uses about 500 bytes. The cache is shared by all the
+ * users of the handle. If it was already enabled, its content is
+ * discarded, and the previous cache is freed once the lookups in
+ * progress on other threads complete.
+ *
+ * \param[in]  lfsh       An opaque handle returned by lus_open_fs()
+ * \param[in]  capacity   maximum number of FIDs to cache
+ * \param[in]  ttl_ms     lifetime of an entry, in milliseconds. 0
+ *                        means the entries never expire.
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int lus_fid_cache_enable(struct lus_fs_handle *lfsh, size_t capacity,
+			 unsigned int ttl_ms)
+{
+	struct fid_cache *cache;
+	int rc;
+
+	rc = fid_cache_create(capacity, ttl_ms, &cache);
+	if (rc)
+		return rc;
+
+	fs_replace_fid_cache(lfsh, cache);
+
+	return 0;
+}
+
+/**
+ * Disable and free the attribute cache of a filesystem handle. This
+ * waits for the lookups in progress on other threads.
+ *
+ * \param[in]  lfsh       An opaque handle returned by lus_open_fs()
+ */
+void lus_fid_cache_disable(struct lus_fs_handle *lfsh)
+{
+	fs_replace_fid_cache(lfsh, NULL);
+}
+
+/**
+ * Remove a FID from the attribute cache.
+ *
+ * \param[in]  lfsh    An opaque handle returned by lus_open_fs()
+ * \param[in]  fid     the FID to forget
+ */
+void lus_fid_cache_invalidate(const struct lus_fs_handle *lfsh,
+			      const lustre_fid *fid)
+{
+	struct fid_cache *cache;
+	unsigned int idx;
+
+	idx = fs_cache_enter(lfsh);
+
+	cache = fs_fid_cache(lfsh);
+	if (cache != NULL) {
+		pthread_mutex_lock(&cache->lock);
+		fid_cache_drop(cache, fid);
+		pthread_mutex_unlock(&cache->lock);
+	}
+
+	fs_cache_exit(lfsh, idx);
+}
+
+/**
+ * Empty the attribute cache. The statistics are kept.
+ *
+ * \param[in]  lfsh    An opaque handle returned by lus_open_fs()
+ */
+void lus_fid_cache_flush(const struct lus_fs_handle *lfsh)
+{
+	struct fid_cache *cache;
+	struct fid_cache_entry *e;
+	unsigned int idx;
+	size_t i;
+
+	idx = fs_cache_enter(lfsh);
+
+	cache = fs_fid_cache(lfsh);
+	if (cache == NULL)
+		goto out;
+
+	pthread_mutex_lock(&cache->lock);
+
+	for (i = 0; i < (cache->set_mask + 1) * FID_CACHE_WAYS; i++) {
+		e = &cache->table[i];
+		if (e->valid) {
+			entry_write_begin(e);
+			entry_set_valid(e, 0);
+			entry_write_end(e);
+		}
+	}
+
+	cache->invalidations += cache->entries;
+	cache->entries = 0;
+
+	pthread_mutex_unlock(&cache->lock);
+
+out:
+	fs_cache_exit(lfsh, idx);
+}
+
+/**
+ * Revalidate the cached attributes of a FID with its data
+ * version. If the data version changed since the last call, the
+ * cached attributes are dropped. Otherwise the entry gets a new
+ * lifetime.
+ *
+ * The data version only tracks the file content. Metadata-only
+ * changes, such as a chmod, are not detected.
+ *
+ * \param[in]  lfsh    An opaque handle returned by lus_open_fs()
+ * \param[in]  fid     the FID to revalidate
+ * \param[in]  fd      an opened file descriptor for that FID, or -1
+ *                     to open it by FID
+ *
+ * \retval   1 if the cached attributes are still valid
+ * \retval   0 if they were dropped, or if the FID was not known
+ * \retval   a negative errno on error
+ */
+int lus_fid_cache_revalidate(const struct lus_fs_handle *lfsh,
+			     const lustre_fid *fid, int fd)
+{
+	struct fid_cache *cache;
+	unsigned int idx;
+	uint64_t dv;
+	int myfd = -1;
+	int rc;
+
+	idx = fs_cache_enter(lfsh);
+	cache = fs_fid_cache(lfsh);
+	fs_cache_exit(lfsh, idx);
+
+	if (cache == NULL)
+		return 0;
+
+	if (fd == -1) {
+		myfd = lus_open_by_fid(lfsh, fid, O_RDONLY | O_NONBLOCK);
+		if (myfd < 0)
+			return myfd;
+		fd = myfd;
+	}
+
+	rc = lus_data_version_by_fd(fd, 0, &dv);
+
+	if (myfd != -1)
+		close(myfd);
+
+	if (rc) {
+		lus_fid_cache_invalidate(lfsh, fid);
+		return rc;
+	}
+
+	/* The cache may have been replaced in the meantime. */
+	idx = fs_cache_enter(lfsh);
+
+	cache = fs_fid_cache(lfsh);
+	if (cache != NULL)
+		rc = fid_cache_check_dv(cache, fid, dv) ? 1 : 0;
+
+	fs_cache_exit(lfsh, idx);
+
+	return rc;
+}
+
+/**
+ * Return the attribute cache statistics. All the values are 0 if the
+ * cache is not enabled.
+ *
+ * \param[in]   lfsh    An opaque handle returned by lus_open_fs()
+ * \param[out]  stats   the statistics
+ */
+void lus_fid_cache_get_stats(const struct lus_fs_handle *lfsh,
+			     struct lus_fid_cache_stats *stats)
+{
+	struct fid_cache *cache;
+	unsigned int idx;
+
+	memset(stats, 0, sizeof(*stats));
+
+	idx = fs_cache_enter(lfsh);
+
+	cache = fs_fid_cache(lfsh);
+	if (cache == NULL)
+		goto out;
+
+	pthread_mutex_lock(&cache->lock);
+
+	stats->hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+	stats->evictions = cache->evictions;
+	stats->invalidations = cache->invalidations;
+	stats->entries = cache->entries;
+	stats->capacity = (cache->set_mask + 1) * FID_CACHE_WAYS;
+
+	pthread_mutex_unlock(&cache->lock);
+
+out:
+	fs_cache_exit(lfsh, idx);
+}
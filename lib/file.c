@@ -21,7 +21,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <attr/xattr.h>
 
@@ -45,20 +47,21 @@ int lus_open_by_fid(const struct lus_fs_handle *lfsh,
 	char fidstr[FID_NOBRACE_LEN + 1];
 	int rc;
 
-	snprintf(fidstr, sizeof(fidstr), DFID_NOBRACE, PFID(fid));
+	lus_fid_format(fid, fidstr, sizeof(fidstr));
 
 	rc = openat(lfsh->fid_fd, fidstr, open_flags);
 	return rc == -1 ? -errno : rc;
 }
 
 /**
- * Stat a file given its FID.
+ * Stat a file given its FID. The result comes from the attribute
+ * cache if it is enabled and has it.
  *
  * \param[in]   lfsh   an opened Lustre fs opaque handle
  * \param[in]   fid    the request fid, contained in the above Lustre fs
  * \param[out]  stbuf  the stat result. See stat(2)
  *
- * \retval   a 0 or positive file descriptor on success
+ * \retval   0 on success
  * \retval   a negative errno on error
  */
 int lus_stat_by_fid(const struct lus_fs_handle *lfsh,
@@ -67,9 +70,17 @@ int lus_stat_by_fid(const struct lus_fs_handle *lfsh,
 	char fidstr[FID_NOBRACE_LEN + 1];
 	int rc;
 
-	snprintf(fidstr, sizeof(fidstr), DFID_NOBRACE, PFID(fid));
+	if (fid_cache_get_stat(lfsh, fid, stbuf))
+		return 0;
+
+	lus_fid_format(fid, fidstr, sizeof(fidstr));
 	rc = fstatat(lfsh->fid_fd, fidstr, stbuf, AT_SYMLINK_NOFOLLOW);
-	return rc == -1 ? -errno : rc;
+	if (rc == -1)
+		return -errno;
+
+	fid_cache_put_stat(lfsh, fid, stbuf);
+
+	return 0;
 }
 
 /**
@@ -90,10 +101,10 @@ int lus_stat_by_fid(const struct lus_fs_handle *lfsh,
 int lus_fd2parent(int fd, unsigned int linkno, lustre_fid *parent_fid,
 		  char *parent_name, size_t parent_name_len)
 {
-	/* Avoid allocating gp by adding PATH_MAX after it. */
+	/* Avoid allocating gp by adding room for a name after it. */
 	struct {
 		struct getparent gp;
-		char filler[PATH_MAX];
+		char filler[NAME_MAX + 1];
 	} x;
 	int rc;
 
@@ -117,55 +128,100 @@ int lus_fd2parent(int fd, unsigned int linkno, lustre_fid *parent_fid,
 	return rc;
 }
 
-/**
- * Minimal compatibility function for lus_fid2parent() on Lustre 2.5
- * so that create_restore_volatile() is happy.
+/* Buffer for OBD_IOC_FID2PATH. The path is returned in gf_path,
+ * which has a size of 0, so it is accessed through buf. */
+union fid2path_buf {
+	struct getinfo_fid2path gf;
+	char buf[sizeof(struct getinfo_fid2path) + PATH_MAX];
+};
+
+static char *fid2path_path(union fid2path_buf *x)
+{
+	return x->buf + offsetof(struct getinfo_fid2path, gf_path);
+}
+
+/*
+ * Emulate LL_IOC_GETPARENT for clients older than 2.7: get the path
+ * of a link with OBD_IOC_FID2PATH, and the FID of the directory it is
+ * in. The directory is opened relative to the mountpoint, or not at
+ * all if it is the mountpoint itself.
+ *
+ * On success, *name points to the last component of the path, inside
+ * x, and *linkno is set to the next link number, as returned by the
+ * MDS.
  */
-static int lus_fid2parent_25(const struct lus_fs_handle *lfsh,
-			     const lustre_fid *fid,
-			     lustre_fid *parent_fid,
-			     char *parent_name, size_t parent_name_len)
+static int fid2path_parent(const struct lus_fs_handle *lfsh,
+			   const lustre_fid *fid, unsigned int *linkno,
+			   union fid2path_buf *x, lustre_fid *parent_fid,
+			   char **name)
 {
-	char path_[2 * PATH_MAX];
-	size_t ret_path_len = PATH_MAX;
-	char *path = path_;
-	char *ret_path;
+	char *path = fid2path_path(x);
 	char *p;
+	int fd;
 	int rc;
 
-	/* Add the mountpoint to the path. */
-	rc = snprintf(path, ret_path_len, "%s/", lfsh->mount_path);
-	if (rc < 0 || rc >= ret_path_len)
-		return -ENOSPC;
-
-	ret_path = path + rc;
+	x->gf.gf_fid = *fid;
+	x->gf.gf_recno = -1;
+	x->gf.gf_linkno = *linkno;
+	x->gf.gf_pathlen = PATH_MAX;
 
-	/* Get the relative path. */
-	rc = lus_fid2path(lfsh, fid, ret_path, ret_path_len, NULL, NULL);
-	if (rc)
-		return rc;
+	rc = ioctl(lfsh->mount_fd, OBD_IOC_FID2PATH, &x->gf);
+	if (rc == -1)
+		return -errno;
 
-	if (ret_path[0] == 0) {
+	if (path[0] == 0) {
 		/* Was called on the mountpoint */
 		return -ENODATA;
 	}
 
-	/* Remove last component. p can't be NULL since we added a
-	 * slash. */
+	*linkno = x->gf.gf_linkno;
+
 	p = strrchr(path, '/');
-	*p = 0;
+	if (p == NULL) {
+		*name = path;
+		if (parent_fid == NULL)
+			return 0;
 
-	if (parent_fid) {
-		rc = lus_path2fid(path, parent_fid);
-		if (rc)
-			return rc;
+		return lus_fd2fid(lfsh->mount_fd, parent_fid);
 	}
 
-	if (parent_name) {
-		if (strlen(ret_path) >= parent_name_len)
-			return -ENOSPC;
+	*p = 0;
+	*name = p + 1;
+	if (parent_fid == NULL)
+		return 0;
+
+	fd = openat(lfsh->mount_fd, path,
+		    O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_DIRECTORY);
+	if (fd == -1)
+		return -errno;
+
+	rc = lus_fd2fid(fd, parent_fid);
+	close(fd);
+
+	return rc;
+}
+
+/**
+ * Minimal compatibility function for lus_fid2parent() on Lustre 2.5
+ * so that create_restore_volatile() is happy.
+ */
+static int lus_fid2parent_25(const struct lus_fs_handle *lfsh,
+			     const lustre_fid *fid, unsigned int linkno,
+			     lustre_fid *parent_fid,
+			     char *parent_name, size_t parent_name_len)
+{
+	union fid2path_buf x;
+	char *name;
+	int rc;
 
-		strcpy(parent_name, ret_path);
+	rc = fid2path_parent(lfsh, fid, &linkno, &x, parent_fid, &name);
+	if (rc)
+		return rc;
+
+	if (parent_name) {
+		rc = strscpy(parent_name, name, parent_name_len);
+		if (rc < 0)
+			return rc;
 	}
 
 	return 0;
@@ -198,7 +254,7 @@ int lus_fid2parent(const struct lus_fs_handle *lfsh,
 
 	/* Older Lustre don't have LL_IOC_GETPARENT. */
 	if (lfsh->client_version < 20700)
-		return lus_fid2parent_25(lfsh, fid, parent_fid,
+		return lus_fid2parent_25(lfsh, fid, linkno, parent_fid,
 					 parent_name, parent_name_len);
 
 	fd = lus_open_by_fid(lfsh, fid, O_RDONLY | O_NONBLOCK | O_NOFOLLOW);
@@ -245,6 +301,177 @@ int lus_path2parent(const char *path, unsigned int linkno,
 	return rc;
 }
 
+/* The records returned by lus_fid_links() are filled in place by
+ * LL_IOC_GETPARENT. */
+_Static_assert(sizeof(struct lus_fid_link) == sizeof(struct getparent),
+	       "struct lus_fid_link must match struct getparent");
+
+/* Size of a link record holding a name of name_len bytes. The records
+ * are 8 bytes aligned. */
+static size_t link_reclen(size_t name_len)
+{
+	return (sizeof(struct lus_fid_link) + name_len + 1 + 7) & ~7;
+}
+
+/* Return 0 if the file has no link numbered linkno, -ENOSPC if it
+ * has one, or a negative errno. */
+static int fd_has_no_link(int fd, unsigned int linkno)
+{
+	struct {
+		struct getparent gp;
+		char filler[NAME_MAX + 1];
+	} x;
+
+	x.gp.gp_linkno = linkno;
+	x.gp.gp_name_size = sizeof(x.filler);
+
+	if (ioctl(fd, LL_IOC_GETPARENT, &x.gp) == 0)
+		return -ENOSPC;
+
+	return errno == ENODATA ? 0 : -errno;
+}
+
+/**
+ * Return all the hard links of an opened file, as (parent FID, name)
+ * pairs.
+ *
+ * The links are stored in buf as a sequence of struct lus_fid_link
+ * records, each followed by its NUL terminated name. The first record
+ * is at the start of buf, and lus_fid_link_next() returns the one
+ * after. The ioctl writes each record directly into buf.
+ *
+ * \param[in]   fd        an opened file descriptor for a file in a
+ *                        Lustre filesystem
+ * \param[out]  buf       the links
+ * \param[in]   buf_len   size of buf
+ *
+ * \retval   the number of links stored in buf
+ * \retval   -ENOSPC if buf is too small to hold all the links
+ * \retval   a negative errno on other errors
+ */
+ssize_t lus_fd_links(int fd, void *buf, size_t buf_len)
+{
+	struct lus_fid_link *link;
+	unsigned int linkno;
+	size_t name_size;
+	size_t used = 0;
+	size_t avail;
+	int rc;
+
+	for (linkno = 0; ; linkno++) {
+		link = (void *)((char *)buf + used);
+		avail = buf_len - used;
+
+		if (avail < sizeof(*link) + 2) {
+			rc = fd_has_no_link(fd, linkno);
+			return rc ? rc : linkno;
+		}
+
+		/* Lustre rejects names larger than PATH_MAX. */
+		name_size = avail - sizeof(*link);
+		if (name_size > PATH_MAX)
+			name_size = PATH_MAX;
+		link->lfl_linkno = linkno;
+		link->lfl_reclen = name_size;
+
+		rc = ioctl(fd, LL_IOC_GETPARENT, link);
+		if (rc == -1) {
+			if (errno == ENODATA)
+				return linkno;
+			if (errno == EOVERFLOW)
+				return -ENOSPC;
+			return -errno;
+		}
+
+		/* gp_name_size was the input size. Replace it with the
+		 * size of the record. */
+		link->lfl_reclen = link_reclen(strlen(link->lfl_name));
+		if (link->lfl_reclen > avail)
+			link->lfl_reclen = avail;
+		used += link->lfl_reclen;
+	}
+}
+
+/* Version of lus_fid_links() for clients older than 2.7, without
+ * LL_IOC_GETPARENT. */
+static ssize_t fid_links_25(const struct lus_fs_handle *lfsh,
+			    const lustre_fid *fid, void *buf, size_t buf_len)
+{
+	struct lus_fid_link *link;
+	union fid2path_buf x;
+	lustre_fid parent_fid;
+	unsigned int linkno = 0;
+	unsigned int next;
+	size_t count = 0;
+	size_t used = 0;
+	size_t name_len;
+	char *name;
+	int rc;
+
+	while (1) {
+		next = linkno;
+		rc = fid2path_parent(lfsh, fid, &next, &x, &parent_fid, &name);
+		if (rc)
+			return rc;
+
+		name_len = strlen(name);
+		if (sizeof(*link) + name_len + 1 > buf_len - used)
+			return -ENOSPC;
+
+		link = (void *)((char *)buf + used);
+		link->lfl_parent_fid = parent_fid;
+		link->lfl_linkno = linkno;
+		link->lfl_reclen = link_reclen(name_len);
+		if (link->lfl_reclen > buf_len - used)
+			link->lfl_reclen = buf_len - used;
+		memcpy(link->lfl_name, name, name_len + 1);
+		used += link->lfl_reclen;
+		count++;
+
+		/* The MDS returns the next link number, or doesn't
+		 * move forward after the last link. */
+		if (next <= linkno)
+			break;
+		linkno = next;
+	}
+
+	return count;
+}
+
+/**
+ * Return all the hard links of a file given its FID. The file is
+ * opened once. See lus_fd_links() for the content of buf.
+ *
+ * \param[in]   lfsh      an opened Lustre fs opaque handle
+ * \param[in]   fid       the FID of the file
+ * \param[out]  buf       the links
+ * \param[in]   buf_len   size of buf
+ *
+ * \retval   the number of links stored in buf
+ * \retval   -ENOSPC if buf is too small to hold all the links
+ * \retval   a negative errno on other errors
+ */
+ssize_t lus_fid_links(const struct lus_fs_handle *lfsh,
+		      const lustre_fid *fid, void *buf, size_t buf_len)
+{
+	ssize_t rc;
+	int fd;
+
+	/* Older Lustre don't have LL_IOC_GETPARENT. */
+	if (lfsh->client_version < 20700)
+		return fid_links_25(lfsh, fid, buf, buf_len);
+
+	fd = lus_open_by_fid(lfsh, fid, O_RDONLY | O_NONBLOCK | O_NOFOLLOW);
+	if (fd < 0)
+		return fd;
+
+	rc = lus_fd_links(fd, buf, buf_len);
+
+	close(fd);
+
+	return rc;
+}
+
 /* Get the FID from an extended attribute */
 static int get_fid_from_xattr(const char *path, int fd, lustre_fid *fid)
 {
@@ -384,6 +611,111 @@ int lus_fid2path(const struct lus_fs_handle *lfsh, const lustre_fid *fid,
 	return rc;
 }
 
+/* State shared by the workers of lus_fid2path_batch(). */
+struct fid2path_batch {
+	const struct lus_fs_handle *lfsh;
+	const lustre_fid *fids;
+	char *arena;
+	size_t arena_len;
+	size_t arena_used;
+	size_t *offsets;
+	int *errors;
+};
+
+/* Resolve one FID of a batch and copy its path into the arena. */
+static void fid2path_batch_one(void *arg, size_t idx)
+{
+	struct fid2path_batch *batch = arg;
+	char buf[sizeof(struct getinfo_fid2path) + PATH_MAX]
+		__attribute__((aligned(8)));
+	struct getinfo_fid2path *gf = (struct getinfo_fid2path *)buf;
+	size_t len;
+	size_t offset;
+	int rc;
+
+	gf->gf_fid = batch->fids[idx];
+	gf->gf_recno = -1;
+	gf->gf_linkno = 0;
+	gf->gf_pathlen = PATH_MAX;
+
+	rc = ioctl(batch->lfsh->mount_fd, OBD_IOC_FID2PATH, gf);
+	if (rc == -1) {
+		batch->errors[idx] = -errno;
+		return;
+	}
+
+	len = strlen(gf->gf_path) + 1;
+
+	/* Reserve some space in the arena. */
+	offset = __atomic_load_n(&batch->arena_used, __ATOMIC_RELAXED);
+	do {
+		if (len > batch->arena_len - offset) {
+			batch->errors[idx] = -ENOSPC;
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&batch->arena_used, &offset,
+					      offset + len, true,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	memcpy(&batch->arena[offset], gf->gf_path, len);
+	batch->offsets[idx] = offset;
+	batch->errors[idx] = 0;
+}
+
+/**
+ * Return the paths of many FIDs at once. The requests are spread
+ * over the worker threads of the handle (see lus_set_thread_count()).
+ *
+ * The paths, relative to the filesystem mountpoint, are stored one
+ * after the other in \a arena, in no particular order. Each path is
+ * NUL terminated. The path for fids[i] starts at arena + offsets[i]
+ * if errors[i] is 0. Otherwise errors[i] is a negative errno, and
+ * offsets[i] is undefined. -ENOSPC indicates that the arena was too
+ * small.
+ *
+ * \param[in]   lfsh          an opened Lustre fs opaque handle
+ * \param[in]   fids          the FIDs to resolve
+ * \param[in]   count         number of FIDs in \a fids
+ * \param[out]  arena         buffer receiving all the paths
+ * \param[in]   arena_len     size of arena
+ * \param[out]  offsets       array of count offsets into the arena
+ * \param[out]  errors        array of count status codes
+ *
+ * \retval    the number of paths stored in the arena
+ * \retval    a negative errno on error
+ */
+ssize_t lus_fid2path_batch(const struct lus_fs_handle *lfsh,
+			   const lustre_fid *fids, size_t count,
+			   char *arena, size_t arena_len,
+			   size_t *offsets, int *errors)
+{
+	struct fid2path_batch batch = {
+		.lfsh = lfsh,
+		.fids = fids,
+		.arena = arena,
+		.arena_len = arena_len,
+		.arena_used = 0,
+		.offsets = offsets,
+		.errors = errors,
+	};
+	ssize_t found = 0;
+	size_t i;
+
+	if (count > 0 && (fids == NULL || arena == NULL ||
+			  offsets == NULL || errors == NULL))
+		return -EINVAL;
+
+	thread_pool_run(lfsh->pool, count, fid2path_batch_one, &batch);
+
+	for (i = 0; i < count; i++) {
+		if (errors[i] == 0)
+			found++;
+	}
+
+	return found;
+}
+
 /**
  * Open an anonymous file. That file will be destroyed by Lustre when
  * the last reference to it is closed.
@@ -428,16 +760,21 @@ int lus_create_volatile_by_fid(const struct lus_fs_handle *lfsh,
 					    open_flags | O_RDWR | O_CREAT,
 					    mode, layout);
 	} else {
+		int len;
+
+		len = lus_fid_format(parent_fid, path, sizeof(path));
+		if (len < 0)
+			return -ENAMETOOLONG;
 
 		if (mdt_idx == -1)
-			rc = snprintf(path, sizeof(path),
-				      DFID_NOBRACE "/" LUSTRE_VOLATILE_HDR "::%.4X",
-				      PFID(parent_fid), rnumber);
+			rc = snprintf(path + len, sizeof(path) - len,
+				      "/" LUSTRE_VOLATILE_HDR "::%.4X",
+				      rnumber);
 		else
-			rc = snprintf(path, sizeof(path),
-				      DFID_NOBRACE "/" LUSTRE_VOLATILE_HDR ":%.4X:%.4X",
-				      PFID(parent_fid), mdt_idx, rnumber);
-		if (rc == -1 || rc >= sizeof(path))
+			rc = snprintf(path + len, sizeof(path) - len,
+				      "/" LUSTRE_VOLATILE_HDR ":%.4X:%.4X",
+				      mdt_idx, rnumber);
+		if (rc == -1 || rc >= sizeof(path) - len)
 			return -ENAMETOOLONG;
 
 		fd = lus_layout_file_openat(lfsh->fid_fd, path,
@@ -497,6 +834,74 @@ int lus_data_version_by_fd(int fd, uint64_t flags, uint64_t *dv)
 	return 0;
 }
 
+/* State shared by the workers of lus_data_version_by_fid_many(). */
+struct dv_batch {
+	const struct lus_fs_handle *lfsh;
+	struct lus_data_version_req *reqs;
+};
+
+static void dv_batch_one(void *arg, size_t idx)
+{
+	struct dv_batch *batch = arg;
+	struct lus_data_version_req *req = &batch->reqs[idx];
+	int fd;
+
+	if (req->flags & ~(LL_DV_RD_FLUSH | LL_DV_WR_FLUSH)) {
+		req->rc = -EINVAL;
+		return;
+	}
+
+	fd = lus_open_by_fid(batch->lfsh, &req->fid, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		req->rc = fd;
+		return;
+	}
+
+	req->rc = lus_data_version_by_fd(fd, req->flags, &req->dv);
+
+	close(fd);
+}
+
+/**
+ * Return the data version of many files, given their FIDs. Each file
+ * is opened by FID and queried with its own flush policy. The
+ * requests are spread over the worker threads of the handle (see
+ * lus_set_thread_count()), which bounds the number of files opened
+ * and requests in flight.
+ *
+ * \param[in]      lfsh    an opened Lustre fs opaque handle
+ * \param[in,out]  reqs    array of count requests. fid and flags are
+ *                         set by the caller. On return, dv is valid
+ *                         only if rc is 0.
+ * \param[in]      count   number of requests in \a reqs
+ *
+ * \retval    the number of data versions successfully returned
+ * \retval    a negative errno on error
+ */
+ssize_t lus_data_version_by_fid_many(const struct lus_fs_handle *lfsh,
+				     struct lus_data_version_req *reqs,
+				     size_t count)
+{
+	struct dv_batch batch = {
+		.lfsh = lfsh,
+		.reqs = reqs,
+	};
+	ssize_t found = 0;
+	size_t i;
+
+	if (count > 0 && reqs == NULL)
+		return -EINVAL;
+
+	thread_pool_run(lfsh->pool, count, dv_batch_one, &batch);
+
+	for (i = 0; i < count; i++) {
+		if (reqs[i].rc == 0)
+			found++;
+	}
+
+	return found;
+}
+
 /**
  * Swap the layout (ie. the data) of two opened files. Both files must
  * have been opened in writing mode.
@@ -578,6 +983,30 @@ int lus_group_unlock(int fd, uint64_t gid)
 	return 0;
 }
 
+/**
+ * Direct the reads of a mirrored file to one of its mirrors. Lustre
+ * only allows it for direct I/O, so the file must have been opened
+ * with O_DIRECT. This only applies to that file descriptor.
+ *
+ * \param[in]  fd          an opened file descriptor for a file on Lustre
+ * \param[in]  mirror_id   the mirror to read from, or 0 to let Lustre
+ *                         choose again
+ *
+ * \retval  0 on success
+ * \retval  -EINVAL if the file was not opened with O_DIRECT
+ * \retval  a negative errno on other errors
+ */
+int lus_mirror_set_read(int fd, uint16_t mirror_id)
+{
+	int rc;
+
+	rc = ioctl(fd, LL_IOC_FLR_SET_MIRROR, (long)mirror_id);
+	if (rc == -1)
+		return -errno;
+
+	return 0;
+}
+
 /**
  * Query the MDT to get some file information, given a file's FID. The
  * data is returned in a structure similar to that of stat(2). The
@@ -606,7 +1035,7 @@ int lus_mdt_stat_by_fid(const struct lus_fs_handle *lfsh,
 	} x;
 	int rc;
 
-	snprintf(x.fidstr, FID_NOBRACE_LEN + 1, DFID_NOBRACE, PFID(fid));
+	lus_fid_format(fid, x.fidstr, sizeof(x.fidstr));
 
 	rc = ioctl(lfsh->fid_fd, IOC_MDC_GETFILEINFO, &x);
 	if (rc == 0)
@@ -616,3 +1045,160 @@ int lus_mdt_stat_by_fid(const struct lus_fs_handle *lfsh,
 
 	return rc;
 }
+
+/* Convert a stat result to a statx one. Only the fields in mask are
+ * set. */
+void stat_to_statx(const struct stat *st, unsigned int mask,
+		   struct statx *stx)
+{
+	memset(stx, 0, sizeof(*stx));
+
+	stx->stx_mask = mask;
+	stx->stx_blksize = st->st_blksize;
+	stx->stx_dev_major = major(st->st_dev);
+	stx->stx_dev_minor = minor(st->st_dev);
+	stx->stx_rdev_major = major(st->st_rdev);
+	stx->stx_rdev_minor = minor(st->st_rdev);
+
+	if (mask & STATX_TYPE)
+		stx->stx_mode |= st->st_mode & S_IFMT;
+	if (mask & STATX_MODE)
+		stx->stx_mode |= st->st_mode & ~S_IFMT;
+	if (mask & STATX_NLINK)
+		stx->stx_nlink = st->st_nlink;
+	if (mask & STATX_UID)
+		stx->stx_uid = st->st_uid;
+	if (mask & STATX_GID)
+		stx->stx_gid = st->st_gid;
+	if (mask & STATX_INO)
+		stx->stx_ino = st->st_ino;
+	if (mask & STATX_SIZE)
+		stx->stx_size = st->st_size;
+	if (mask & STATX_BLOCKS)
+		stx->stx_blocks = st->st_blocks;
+	if (mask & STATX_ATIME) {
+		stx->stx_atime.tv_sec = st->st_atim.tv_sec;
+		stx->stx_atime.tv_nsec = st->st_atim.tv_nsec;
+	}
+	if (mask & STATX_MTIME) {
+		stx->stx_mtime.tv_sec = st->st_mtim.tv_sec;
+		stx->stx_mtime.tv_nsec = st->st_mtim.tv_nsec;
+	}
+	if (mask & STATX_CTIME) {
+		stx->stx_ctime.tv_sec = st->st_ctim.tv_sec;
+		stx->stx_ctime.tv_nsec = st->st_ctim.tv_nsec;
+	}
+}
+
+/**
+ * Get some attributes of a file given its FID, like statx(2).
+ *
+ * If all the attributes requested are in LUS_STATX_MDT_MASK, only the
+ * MDT is queried, like lus_mdt_stat_by_fid() does. That avoids
+ * getting the size from every OST the file is striped on. The times
+ * are then the ones known by the MDT, which may lag behind for a
+ * file being written. Otherwise a full stat is done.
+ *
+ * The attributes actually returned are indicated in stx->stx_mask,
+ * and may include more than requested.
+ *
+ * \param[in]   lfsh   an opened Lustre fs opaque handle
+ * \param[in]   fid    the FID of the file
+ * \param[in]   mask   or'ed STATX_* attributes needed
+ * \param[out]  stx    the result
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int lus_statx_by_fid(const struct lus_fs_handle *lfsh,
+		     const lustre_fid *fid, unsigned int mask,
+		     struct statx *stx)
+{
+	struct stat st;
+	int rc;
+
+	/* A cached entry has everything. */
+	if (fid_cache_get_stat(lfsh, fid, &st)) {
+		stat_to_statx(&st, STATX_BASIC_STATS, stx);
+		return 0;
+	}
+
+	if ((mask & ~LUS_STATX_MDT_MASK) == 0) {
+		rc = lus_mdt_stat_by_fid(lfsh, fid, &st);
+		if (rc)
+			return rc;
+
+		stat_to_statx(&st, LUS_STATX_MDT_MASK, stx);
+		return 0;
+	}
+
+	rc = lus_stat_by_fid(lfsh, fid, &st);
+	if (rc)
+		return rc;
+
+	stat_to_statx(&st, STATX_BASIC_STATS, stx);
+
+	return 0;
+}
+
+/* State shared by the workers of lus_statx_by_fid_batch(). */
+struct statx_batch {
+	const struct lus_fs_handle *lfsh;
+	const lustre_fid *fids;
+	unsigned int mask;
+	struct statx *stxs;
+	int *errors;
+};
+
+static void statx_batch_one(void *arg, size_t idx)
+{
+	struct statx_batch *batch = arg;
+
+	batch->errors[idx] = lus_statx_by_fid(batch->lfsh, &batch->fids[idx],
+					      batch->mask, &batch->stxs[idx]);
+}
+
+/**
+ * Call lus_statx_by_fid() on many FIDs at once. The requests are
+ * spread over the worker threads of the handle (see
+ * lus_set_thread_count()), which bounds the number of requests in
+ * flight.
+ *
+ * \param[in]   lfsh     an opened Lustre fs opaque handle
+ * \param[in]   fids     the FIDs to stat
+ * \param[in]   count    number of FIDs in \a fids
+ * \param[in]   mask     or'ed STATX_* attributes needed
+ * \param[out]  stxs     array of count results
+ * \param[out]  errors   array of count status codes. stxs[i] is valid
+ *                       only if errors[i] is 0.
+ *
+ * \retval    the number of FIDs successfully stat'ed
+ * \retval    a negative errno on error
+ */
+ssize_t lus_statx_by_fid_batch(const struct lus_fs_handle *lfsh,
+			       const lustre_fid *fids, size_t count,
+			       unsigned int mask, struct statx *stxs,
+			       int *errors)
+{
+	struct statx_batch batch = {
+		.lfsh = lfsh,
+		.fids = fids,
+		.mask = mask,
+		.stxs = stxs,
+		.errors = errors,
+	};
+	ssize_t found = 0;
+	size_t i;
+
+	if (count > 0 && (fids == NULL || stxs == NULL || errors == NULL))
+		return -EINVAL;
+
+	thread_pool_run(lfsh->pool, count, statx_batch_one, &batch);
+
+	for (i = 0; i < count; i++) {
+		if (errors[i] == 0)
+			found++;
+	}
+
+	return found;
+}
@@ -6,6 +6,7 @@
 #ifndef _LIBLUSTRE_INTERNAL_H_
 #define _LIBLUSTRE_INTERNAL_H_
 
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
 
@@ -31,6 +32,18 @@ log_msg_internal(enum lus_log_level level, int err, const char *fmt, ...)
  */
 #define LLAPI_LAYOUT_MAGIC 0x11AD1107
 
+size_t layout_size(const struct lus_layout *layout);
+int layout_raid0_geometry(const struct lus_layout *layout,
+			  uint64_t *stripe_size, uint64_t *stripe_count);
+int layout_dup_shared(const struct lus_layout *layout, unsigned int flags,
+		      struct lus_layout **copy);
+
+/* A layout encoded by lus_layout_prepare(). */
+struct lus_layout_prepared {
+	struct lov_user_md *lp_lum;
+	size_t lp_lum_size;
+};
+
 /* Layout swap */
 struct lustre_swap_layouts {
         __u64   sl_flags;
@@ -54,6 +67,8 @@ struct lustre_ost_info {
 void free_ost_info(struct lustre_ost_info **info);
 int open_pool_info(const struct lus_fs_handle *lfsh, const char *poolname,
 		   struct lustre_ost_info **info);
+bool ost_info_has_index(const struct lustre_ost_info *info,
+			unsigned int ost_idx);
 
 /*
  * LOV
@@ -65,6 +80,7 @@ int open_pool_info(const struct lus_fs_handle *lfsh, const char *poolname,
 #define LOV_PATTERN_RAID0	0x001
 #define LOV_PATTERN_RAID1	0x002
 #define LOV_PATTERN_FIRST	0x100
+#define LOV_PATTERN_MDT		0x100	/* Data on MDT */
 #define LOV_PATTERN_CMOBD	0x200
 
 #define LOV_PATTERN_F_MASK	0xffff0000
@@ -97,6 +113,42 @@ struct lov_user_md_v3 {
         struct lov_user_ost_data_v1 lmm_objects[0];
 } __attribute__((packed));
 
+/* Composite layout. Each entry describes an extent of the file, whose
+ * layout is a lov_user_md at lcme_offset bytes from the start of the
+ * lov_comp_md_v1. */
+#define LOV_USER_MAGIC_COMP_V1	0x0BD60BD0
+
+/* The mirror of a component is in the upper bits of its ID. */
+#define MIRROR_ID_SHIFT		16
+
+struct lu_extent {
+	__u64 e_start;
+	__u64 e_end;
+} __attribute__((packed));
+
+struct lov_comp_md_entry_v1 {
+	__u32 lcme_id;
+	__u32 lcme_flags;
+	struct lu_extent lcme_extent;
+	__u32 lcme_offset;
+	__u32 lcme_size;
+	__u32 lcme_layout_gen;
+	__u64 lcme_timestamp;
+	__u32 lcme_padding_1;
+} __attribute__((packed));
+
+struct lov_comp_md_v1 {
+	__u32 lcm_magic;
+	__u32 lcm_size;		/* size of the whole layout */
+	__u32 lcm_layout_gen;
+	__u16 lcm_flags;
+	__u16 lcm_entry_count;
+	__u16 lcm_mirror_count;
+	__u16 lcm_padding1[3];
+	__u64 lcm_padding2;
+	struct lov_comp_md_entry_v1 lcm_entries[0];
+} __attribute__((packed));
+
 static inline __u32 lov_user_md_size(__u16 stripes, __u32 lmm_magic)
 {
 	if (lmm_magic == LOV_USER_MAGIC_V1)
@@ -116,6 +168,98 @@ static inline __u32 lov_user_md_size(__u16 stripes, __u32 lmm_magic)
 #define LUSTRE_VOLATILE_HDR ".\x0c\x13\x14\x12:VOLATILE"
 #define LUSTRE_VOLATILE_HDR_LEN     14
 
+/*
+ * Worker threads
+ */
+struct thread_pool;
+typedef void (*thread_pool_fn_t)(void *arg, size_t idx);
+
+int thread_pool_create(unsigned int max_threads, struct thread_pool **pool);
+void thread_pool_destroy(struct thread_pool *pool);
+int thread_pool_resize(struct thread_pool *pool, unsigned int max_threads);
+unsigned int thread_pool_width(const struct thread_pool *pool);
+void thread_pool_run(struct thread_pool *pool, size_t count,
+		     thread_pool_fn_t fn, void *arg);
+
+/* Default number of threads working on a batch, including the
+ * caller. Most of the time is spent waiting for the MDS, so this can
+ * be larger than the number of CPUs. */
+#define FS_DEFAULT_THREAD_COUNT 8
+
+/*
+ * Parallel I/O
+ */
+ssize_t pario_copy(struct thread_pool *pool, int src_fd, int dst_fd,
+		   const struct lus_layout *layout, uint64_t size);
+
+/*
+ * Mount table index
+ */
+int mount_index_get(const char *mount_dir, char *fs_name);
+int mount_index_lookup(const char *path, char *mount_dir,
+		       size_t mount_dir_len, char *fs_name);
+
+/*
+ * FID attribute cache
+ */
+struct fid_cache;
+
+int fid_cache_create(size_t capacity, unsigned int ttl_ms,
+		     struct fid_cache **cache);
+void fid_cache_destroy(struct fid_cache *cache);
+bool fid_cache_get_stat(const struct lus_fs_handle *lfsh,
+			const lustre_fid *fid, struct stat *st);
+void fid_cache_put_stat(const struct lus_fs_handle *lfsh,
+			const lustre_fid *fid, const struct stat *st);
+bool fid_cache_get_hsm(const struct lus_fs_handle *lfsh,
+		       const lustre_fid *fid, struct hsm_user_state *hus);
+void fid_cache_put_hsm(const struct lus_fs_handle *lfsh,
+		       const lustre_fid *fid,
+		       const struct hsm_user_state *hus);
+struct lus_layout *fid_cache_get_layout(const struct lus_fs_handle *lfsh,
+					const lustre_fid *fid);
+void fid_cache_put_layout(const struct lus_fs_handle *lfsh,
+			  const lustre_fid *fid,
+			  const struct lus_layout *layout);
+
+/*
+ * Directory default layout cache
+ */
+struct dir_layout_cache;
+
+int dir_layout_cache_create(size_t capacity, unsigned int ttl_ms,
+			    struct dir_layout_cache **cache);
+void dir_layout_cache_destroy(struct dir_layout_cache *cache);
+struct lus_layout *dir_layout_cache_get(struct dir_layout_cache *cache,
+					const lustre_fid *fid);
+void dir_layout_cache_put(struct dir_layout_cache *cache,
+			  const lustre_fid *fid,
+			  const struct lus_layout *layout);
+
+/*
+ * Pools of pre-created volatile files
+ */
+struct volatile_pool;
+
+/* Maximum number of volatile files kept for one MDT. */
+#define VOLATILE_POOL_MAX_SIZE 1024
+
+int volatile_pool_create(const struct lus_fs_handle *lfsh,
+			 struct volatile_pool **pool);
+int volatile_pool_add_mdt(struct volatile_pool *pool, unsigned int mdt_index,
+			  unsigned int size, int open_flags);
+int volatile_pool_get(struct volatile_pool *pool, unsigned int mdt_index,
+		      int open_flags, lustre_fid *fid);
+void volatile_pool_get_stats(struct volatile_pool *pool,
+			     struct lus_volatile_pool_stats *stats);
+void volatile_pool_destroy(struct volatile_pool *pool);
+
+/*
+ * statx
+ */
+void stat_to_statx(const struct stat *st, unsigned int mask,
+		   struct statx *stx);
+
 struct lus_fs_handle {
 	/* Lustre mountpoint, as given to lus_open_fs. */
 	char *mount_path;
@@ -127,8 +271,49 @@ struct lus_fs_handle {
 	 * /proc/fs/lustre/version, and converted to a single
 	 * number. e.g. Lustre 2.5.3 is 20503. */
 	unsigned int client_version;
+
+	/* Workers for the batched requests. */
+	struct thread_pool *pool;
+
+	/* Optional attribute cache. NULL when disabled. Read with
+	 * fs_fid_cache(). */
+	struct fid_cache *fid_cache;
+
+	/* Optional cache of the directories' default layouts. NULL
+	 * when disabled. Read with fs_dir_layout_cache(). */
+	struct dir_layout_cache *dir_layout_cache;
+
+	/* Serializes the replacement of the caches. The users of a
+	 * cache are counted by fs_cache_enter(), in one of two
+	 * counters picked by the epoch, so a replaced cache can be
+	 * freed once fs_cache_sync() drained them. */
+	pthread_mutex_t lock;
+	unsigned int cache_epoch;
+	unsigned long cache_users[2];
+
+	/* A handle is shared by all the users of a mountpoint. */
+	unsigned int refcount;
+	struct lus_fs_handle *next;
 };
 
+unsigned int fs_cache_enter(const struct lus_fs_handle *lfsh);
+void fs_cache_exit(const struct lus_fs_handle *lfsh, unsigned int idx);
+void fs_cache_sync(struct lus_fs_handle *lfsh);
+
+/* Current caches of a handle. Only valid between fs_cache_enter()
+ * and fs_cache_exit(). */
+static inline struct fid_cache *
+fs_fid_cache(const struct lus_fs_handle *lfsh)
+{
+	return __atomic_load_n(&lfsh->fid_cache, __ATOMIC_ACQUIRE);
+}
+
+static inline struct dir_layout_cache *
+fs_dir_layout_cache(const struct lus_fs_handle *lfsh)
+{
+	return __atomic_load_n(&lfsh->dir_layout_cache, __ATOMIC_ACQUIRE);
+}
+
 /* File data version */
 struct ioc_data_version {
         __u64 idv_version;
@@ -156,6 +341,26 @@ struct getparent {
         char            gp_name[0];
 } __attribute__((packed));
 
+/* Hash a FID. The sequence changes rarely, and the OIDs are mostly
+ * consecutive. Mix both. */
+static inline uint64_t fid_hash(const lustre_fid *fid)
+{
+	uint64_t hash;
+
+	hash = (fid->f_seq * 0x9e3779b97f4a7c15ULL) ^ fid->f_oid;
+	hash ^= hash >> 29;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+static inline bool fid_equal(const lustre_fid *a, const lustre_fid *b)
+{
+	return a->f_seq == b->f_seq && a->f_oid == b->f_oid &&
+		a->f_ver == b->f_ver;
+}
+
 /*
  * HSM
  */
@@ -240,15 +445,33 @@ enum kuc_generic_message_type {
 	KUC_MSG_SHUTDOWN = 1,
 };
 
+enum changelog_message_type {
+	CL_RECORD = 10,
+	CL_EOF	  = 11,
+};
+
+/* Largest message sent through a kernelcomm pipe. */
+#define KUC_MAX_MSG_LEN 65535
+
+struct ioc_changelog {
+	__u64 icc_recno;
+	__u32 icc_mdtindex;
+	__u32 icc_id;
+	__u32 icc_flags;
+};
+
 /*
  * IOCTLs
  */
+#define OBD_IOC_CHANGELOG_SEND	_IOW ('f', 108, long)
 #define OBD_IOC_GETMDNAME	_IOR ('f', 131, char[MAX_OBD_NAME])
 #define OBD_IOC_FID2PATH	_IOWR('f', 150, long)
+#define OBD_IOC_CHANGELOG_CLEAR	_IOW ('f', 153, long)
 #define LL_IOC_LOV_SETSTRIPE    _IOW ('f', 154, long)
 #define LL_IOC_GROUP_LOCK	_IOW ('f', 158, long)
 #define LL_IOC_GROUP_UNLOCK	_IOW ('f', 159, long)
 #define LL_IOC_PATH2FID         _IOR ('f', 173, long)
+#define LL_IOC_FLR_SET_MIRROR	_IOW ('f', 177, long)
 #define LL_IOC_HSM_STATE_GET	_IOR ('f', 211, struct hsm_user_state)
 #define LL_IOC_HSM_STATE_SET    _IOW ('f', 212, struct hsm_state_set)
 #define LL_IOC_HSM_CT_START	_IOW ('f', 213, struct lustre_kernelcomm)
@@ -263,6 +486,7 @@ enum kuc_generic_message_type {
 #define LL_IOC_FID2MDTIDX	_IOWR('f', 248, struct lu_fid)
 #define LL_IOC_GETPARENT	_IOWR('f', 249, struct getparent)
 
+#define IOC_MDC_GETFILESTRIPE   _IOWR('i', 21, struct lov_user_md *)
 #define IOC_MDC_GETFILEINFO     _IOWR('i', 22, struct lov_user_mds_data *)
 
 /* String helpers. */
@@ -274,6 +498,7 @@ ssize_t strscat(char *dst, const char *src, size_t dst_size);
  */
 void unittest_ost1(void);
 void unittest_ost2(void);
+void unittest_ost3(void);
 void unittest_fid1(void);
 void unittest_fid2(void);
 void unittest_chomp(void);
@@ -283,7 +508,43 @@ void unittest_read_procfs_value(void);
 void unittest_strscpy(void);
 void unittest_strscat(void);
 void unittest_lus_fid2path(void);
+void unittest_lus_fid2path_batch(void);
+void unittest_fid_format(void);
+void unittest_fid_parse(void);
+void unittest_fid_parse_list(void);
+void unittest_fid_cache(void);
+void unittest_fid_cache_ttl(void);
+void unittest_fid_cache_concurrent(void);
+void unittest_fid_cache_toggle(void);
 void unittest_lus_data_version_by_fd(void);
+void unittest_lus_data_version_by_fid_many(void);
 void unittest_lus_mdt_stat_by_fid(void);
+void unittest_stat_to_statx(void);
+void unittest_lus_statx_by_fid(void);
+void unittest_async_threads(void);
+void unittest_async_uring(void);
+void unittest_mount_index(void);
+void unittest_open_fs_for_path(void);
+void unittest_open_fs_fd(void);
+void unittest_scan(void);
+void unittest_scan_lustre(void);
+void unittest_changelog_pipe(void);
+void unittest_changelog_file(void);
+void unittest_changelog_dispatch(void);
+void unittest_volatile_pool(void);
+void unittest_pario(void);
+void unittest_pario_lustre(void);
+void unittest_pario_copy(void);
+void unittest_migrate_lustre(void);
+void unittest_layout_map(void);
+void unittest_layout_view(void);
+void unittest_layout_table(void);
+void unittest_dir_layout_cache(void);
+void unittest_expected_lustre(void);
+void unittest_layout_prepare(void);
+void unittest_create_many_lustre(void);
+void unittest_layout_specific(void);
+void unittest_layout_composite(void);
+void unittest_layout_mirror(void);
 
 #endif /* _LIBLUSTRE_INTERNAL_H_ */
@@ -0,0 +1,305 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Interning of layouts
+ *
+ * A scan of a filesystem finds millions of files but usually only a
+ * few dozen distinct layouts. A layout table keeps a single copy of
+ * each distinct layout, and hands out references to it. The copies
+ * are immutable, and freed when their last reference is released.
+ *
+ * The table is a hash table with chaining, keyed by lus_layout_hash(),
+ * which doubles its number of buckets when it holds more layouts than
+ * buckets. A mutex serializes all the accesses.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* Initial number of buckets. Must be a power of 2. */
+#define LAYOUT_TABLE_MIN_BUCKETS 64
+
+struct layout_entry {
+	struct layout_entry *next;
+	uint64_t hash;
+	size_t refs;
+	struct lus_layout *layout;
+};
+
+struct lus_layout_table {
+	/* Protects everything below. */
+	pthread_mutex_t lock;
+
+	/* LUS_LAYOUT_CMP_OSTS or 0. */
+	unsigned int flags;
+
+	size_t num_buckets;
+	struct layout_entry **buckets;
+
+	size_t count;
+	size_t refs;
+	size_t bytes;
+};
+
+static struct layout_entry **
+layout_bucket(struct layout_entry **buckets, size_t num_buckets,
+	      uint64_t hash)
+{
+	return &buckets[(hash ^ (hash >> 32)) & (num_buckets - 1)];
+}
+
+/* Double the number of buckets. On allocation failure, the table is
+ * left as is; it is only slower. */
+static void layout_table_grow(struct lus_layout_table *table)
+{
+	size_t num_buckets = table->num_buckets * 2;
+	struct layout_entry **buckets;
+	struct layout_entry **bucket;
+	struct layout_entry *entry;
+	size_t i;
+
+	buckets = calloc(num_buckets, sizeof(*buckets));
+	if (buckets == NULL)
+		return;
+
+	for (i = 0; i < table->num_buckets; i++) {
+		while ((entry = table->buckets[i]) != NULL) {
+			table->buckets[i] = entry->next;
+			bucket = layout_bucket(buckets, num_buckets,
+					       entry->hash);
+			entry->next = *bucket;
+			*bucket = entry;
+		}
+	}
+
+	free(table->buckets);
+	table->bytes += (num_buckets - table->num_buckets) * sizeof(*buckets);
+	table->buckets = buckets;
+	table->num_buckets = num_buckets;
+}
+
+/**
+ * Create a table of interned layouts.
+ *
+ * \param[in]  flags   0 to share a layout between all the files with
+ *                     the same pattern, stripe size, stripe count,
+ *                     stripe offset and pool, or LUS_LAYOUT_CMP_OSTS
+ *                     to also require the same OST for every stripe.
+ * \param[out] table   the new table
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on failure
+ */
+int lus_layout_table_create(unsigned int flags,
+			    struct lus_layout_table **table)
+{
+	struct lus_layout_table *tbl;
+
+	if (flags & ~LUS_LAYOUT_CMP_OSTS)
+		return -EINVAL;
+
+	tbl = calloc(1, sizeof(*tbl));
+	if (tbl == NULL)
+		return -ENOMEM;
+
+	tbl->num_buckets = LAYOUT_TABLE_MIN_BUCKETS;
+	tbl->buckets = calloc(tbl->num_buckets, sizeof(*tbl->buckets));
+	if (tbl->buckets == NULL) {
+		free(tbl);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&tbl->lock, NULL);
+	tbl->flags = flags;
+	tbl->bytes = sizeof(*tbl) + tbl->num_buckets * sizeof(*tbl->buckets);
+
+	*table = tbl;
+
+	return 0;
+}
+
+/**
+ * Destroy a table of interned layouts. All its layouts are freed,
+ * including the ones still referenced.
+ *
+ * \param[in] table   the table to destroy, or NULL
+ */
+void lus_layout_table_destroy(struct lus_layout_table *table)
+{
+	struct layout_entry *entry;
+	size_t i;
+
+	if (table == NULL)
+		return;
+
+	for (i = 0; i < table->num_buckets; i++) {
+		while ((entry = table->buckets[i]) != NULL) {
+			table->buckets[i] = entry->next;
+			lus_layout_free(entry->layout);
+			free(entry);
+		}
+	}
+
+	pthread_mutex_destroy(&table->lock);
+	free(table->buckets);
+	free(table);
+}
+
+/**
+ * Get a reference on the interned copy of a layout, creating it if
+ * the table doesn't have it yet.
+ *
+ * The copy only holds the attributes compared by lus_layout_equal()
+ * with the flags of the table. In particular, it never has the
+ * object IDs, and only has the OST indexes with
+ * LUS_LAYOUT_CMP_OSTS. It must not be modified, and must be released
+ * with lus_layout_release() rather than freed.
+ *
+ * An interned layout can be passed again, to get another reference
+ * on it.
+ *
+ * \param[in]  table    a layout table
+ * \param[in]  layout   the layout to intern
+ * \param[out] shared   the interned copy
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on failure
+ */
+int lus_layout_intern(struct lus_layout_table *table,
+		      const struct lus_layout *layout,
+		      const struct lus_layout **shared)
+{
+	struct layout_entry **bucket;
+	struct layout_entry *entry;
+	uint64_t hash;
+	int rc = 0;
+
+	hash = lus_layout_hash(layout, table->flags);
+
+	pthread_mutex_lock(&table->lock);
+
+	bucket = layout_bucket(table->buckets, table->num_buckets, hash);
+	for (entry = *bucket; entry != NULL; entry = entry->next) {
+		if (entry->hash == hash &&
+		    lus_layout_equal(entry->layout, layout, table->flags))
+			break;
+	}
+
+	if (entry == NULL) {
+		entry = calloc(1, sizeof(*entry));
+		if (entry == NULL) {
+			rc = -ENOMEM;
+			goto out;
+		}
+
+		rc = layout_dup_shared(layout, table->flags, &entry->layout);
+		if (rc) {
+			free(entry);
+			goto out;
+		}
+
+		entry->hash = hash;
+		entry->next = *bucket;
+		*bucket = entry;
+
+		table->count++;
+		table->bytes += sizeof(*entry) + layout_size(entry->layout);
+
+		if (table->count > table->num_buckets)
+			layout_table_grow(table);
+	}
+
+	entry->refs++;
+	table->refs++;
+	*shared = entry->layout;
+
+out:
+	pthread_mutex_unlock(&table->lock);
+
+	return rc;
+}
+
+/**
+ * Release a reference on an interned layout. The layout is freed
+ * when its last reference is released.
+ *
+ * \param[in] table    the table the layout comes from
+ * \param[in] shared   an interned layout, or NULL
+ */
+void lus_layout_release(struct lus_layout_table *table,
+			const struct lus_layout *shared)
+{
+	struct layout_entry **prev;
+	struct layout_entry *entry;
+	uint64_t hash;
+
+	if (shared == NULL)
+		return;
+
+	hash = lus_layout_hash(shared, table->flags);
+
+	pthread_mutex_lock(&table->lock);
+
+	prev = layout_bucket(table->buckets, table->num_buckets, hash);
+	for (entry = *prev; entry != NULL; entry = entry->next) {
+		if (entry->layout == shared)
+			break;
+		prev = &entry->next;
+	}
+
+	if (entry == NULL) {
+		log_msg(LUS_LOG_ERROR, -EINVAL,
+			"releasing a layout that is not interned");
+		goto out;
+	}
+
+	table->refs--;
+	if (--entry->refs > 0)
+		goto out;
+
+	*prev = entry->next;
+	table->count--;
+	table->bytes -= sizeof(*entry) + layout_size(entry->layout);
+	lus_layout_free(entry->layout);
+	free(entry);
+
+out:
+	pthread_mutex_unlock(&table->lock);
+}
+
+/**
+ * Get the number of layouts in a table, and the memory they use.
+ *
+ * \param[in]  table   a layout table
+ * \param[out] stats   the statistics
+ */
+void lus_layout_table_get_stats(struct lus_layout_table *table,
+				struct lus_layout_table_stats *stats)
+{
+	pthread_mutex_lock(&table->lock);
+
+	stats->lts_layouts = table->count;
+	stats->lts_refs = table->refs;
+	stats->lts_bytes = table->bytes;
+
+	pthread_mutex_unlock(&table->lock);
+}
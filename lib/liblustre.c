@@ -21,7 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
-#include <mntent.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -33,29 +33,113 @@
 
 #include "internal.h"
 
+/* Opened filesystems. There is only one handle per mountpoint,
+ * shared by all its users. */
+static pthread_mutex_t handles_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct lus_fs_handle *handles;
+
+/* Lustre client version. It is only read once. */
+static pthread_once_t client_version_once = PTHREAD_ONCE_INIT;
+static unsigned int client_version;
+static int client_version_rc;
+
+/* Release the resources of a handle. */
+static void free_fs_handle(struct lus_fs_handle *lfsh)
+{
+	free(lfsh->mount_path);
+
+	if (lfsh->mount_fd != -1)
+		close(lfsh->mount_fd);
+
+	if (lfsh->fid_fd != -1)
+		close(lfsh->fid_fd);
+
+	thread_pool_destroy(lfsh->pool);
+	fid_cache_destroy(lfsh->fid_cache);
+	dir_layout_cache_destroy(lfsh->dir_layout_cache);
+	pthread_mutex_destroy(&lfsh->lock);
+	free(lfsh);
+}
+
+/* Start using the caches of a handle. Returns the counter the caller
+ * was added to, to give to fs_cache_exit(). The counters change even
+ * on a const handle. */
+unsigned int fs_cache_enter(const struct lus_fs_handle *lfsh)
+{
+	struct lus_fs_handle *mylfsh = (struct lus_fs_handle *)lfsh;
+	unsigned int idx;
+
+	idx = __atomic_load_n(&mylfsh->cache_epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_fetch_add(&mylfsh->cache_users[idx], 1, __ATOMIC_SEQ_CST);
+
+	return idx;
+}
+
+/* Stop using the caches of a handle. */
+void fs_cache_exit(const struct lus_fs_handle *lfsh, unsigned int idx)
+{
+	struct lus_fs_handle *mylfsh = (struct lus_fs_handle *)lfsh;
+
+	__atomic_fetch_sub(&mylfsh->cache_users[idx], 1, __ATOMIC_RELEASE);
+}
+
+/* Wait until no user can still see a cache replaced before the
+ * call. Each round moves the new users to the other counter, and
+ * waits for the current one to drain. Two rounds are needed, as a
+ * user may have read the epoch just before the previous replacement
+ * and be counted in the new counter. Called with the handle lock
+ * held. */
+void fs_cache_sync(struct lus_fs_handle *lfsh)
+{
+	unsigned int idx;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		idx = __atomic_fetch_add(&lfsh->cache_epoch, 1,
+					 __ATOMIC_SEQ_CST) & 1;
+
+		/* Some users hold a cache over system calls, so
+		 * sleep rather than spin. */
+		while (__atomic_load_n(&lfsh->cache_users[idx],
+				       __ATOMIC_ACQUIRE) != 0)
+			usleep(100);
+	}
+}
+
 /**
- * Closes a Lustre filesystem opened with lus_open_fs()
+ * Closes a Lustre filesystem opened with lus_open_fs(),
+ * lus_open_fs_fd() or lus_open_fs_for_path(). The handle is only
+ * released once its last user closes it.
  *
  * \param lfsh	An opaque handle returned by lus_open_fs()
  */
 void lus_close_fs(struct lus_fs_handle *lfsh)
 {
+	struct lus_fs_handle **prev;
+
 	if (lfsh == NULL)
 		return;
 
-	free(lfsh->mount_path);
+	pthread_mutex_lock(&handles_lock);
 
-	if (lfsh->mount_fd != -1)
-		close(lfsh->mount_fd);
+	lfsh->refcount--;
+	if (lfsh->refcount > 0) {
+		pthread_mutex_unlock(&handles_lock);
+		return;
+	}
 
-	if (lfsh->fid_fd != -1)
-		close(lfsh->fid_fd);
-	free(lfsh);
+	for (prev = &handles; *prev != lfsh; prev = &(*prev)->next)
+		;
+	*prev = lfsh->next;
+
+	pthread_mutex_unlock(&handles_lock);
+
+	free_fs_handle(lfsh);
 }
 
-/* Retrieve the Lustre client version from /proc/fs/lustre/version,
- * and store the result in the handle. */
-static int get_client_version(struct lus_fs_handle *lfsh)
+/* Retrieve the Lustre client version from /proc/fs/lustre/version.
+ * Called once through pthread_once(). */
+static void read_client_version(void)
 {
 	FILE *fp = NULL;
 	char *line = NULL;
@@ -83,7 +167,7 @@ static int get_client_version(struct lus_fs_handle *lfsh)
 		goto out;
 	}
 
-	lfsh->client_version = major * 10000 + minor * 100 + build;
+	client_version = major * 10000 + minor * 100 + build;
 
 	rc = 0;
 
@@ -93,12 +177,105 @@ out:
 	if (fp != NULL)
 		fclose(fp);
 
-	return rc;
+	client_version_rc = rc;
+}
+
+/* Find the opened handle of a mountpoint, given as the first len
+ * characters of mount_path. Must be called with handles_lock held. */
+static struct lus_fs_handle *find_fs_handle(const char *mount_path,
+					    size_t len)
+{
+	struct lus_fs_handle *lfsh;
+
+	for (lfsh = handles; lfsh != NULL; lfsh = lfsh->next) {
+		if (strncmp(lfsh->mount_path, mount_path, len) == 0 &&
+		    lfsh->mount_path[len] == '\0')
+			return lfsh;
+	}
+
+	return NULL;
+}
+
+/* Allocate a new handle for a mountpoint. Its file descriptors are
+ * not opened yet. */
+static int alloc_fs_handle(const char *mount_path, size_t len,
+			   struct lus_fs_handle **lfsh)
+{
+	struct lus_fs_handle *mylfsh;
+	int rc;
+
+	*lfsh = NULL;
+
+	pthread_once(&client_version_once, read_client_version);
+	if (client_version_rc)
+		return client_version_rc;
+
+	/* Refuse to run on old versions of Lustre. Must be at least
+	 * 2.5. */
+	if (client_version < 20500)
+		return -EINVAL;
+
+	mylfsh = calloc(1, sizeof(*mylfsh));
+	if (mylfsh == NULL)
+		return -errno;
+
+	mylfsh->client_version = client_version;
+	mylfsh->mount_fd = -1;
+	mylfsh->fid_fd = -1;
+	mylfsh->refcount = 1;
+	pthread_mutex_init(&mylfsh->lock, NULL);
+
+	mylfsh->mount_path = strndup(mount_path, len);
+	if (mylfsh->mount_path == NULL) {
+		rc = -errno;
+		free_fs_handle(mylfsh);
+		return rc;
+	}
+
+	*lfsh = mylfsh;
+
+	return 0;
+}
+
+/* Complete a new handle once its mountpoint is opened, and register
+ * it. Must be called with handles_lock held. */
+static int setup_fs_handle(struct lus_fs_handle *lfsh)
+{
+	struct statfs stfsbuf;
+	int rc;
+
+	/* Check it's indeed on Lustre */
+	rc = fstatfs(lfsh->mount_fd, &stfsbuf);
+	if (rc == -1)
+		return -errno;
+
+	if (stfsbuf.f_type != 0xbd00bd0)
+		return -EINVAL;
+
+	/* Open the fid directory of the Lustre filesystem */
+	lfsh->fid_fd = openat(lfsh->mount_fd, ".lustre/fid",
+			      O_RDONLY | O_DIRECTORY);
+	if (lfsh->fid_fd == -1)
+		return -errno;
+
+	rc = thread_pool_create(FS_DEFAULT_THREAD_COUNT - 1, &lfsh->pool);
+	if (rc)
+		return rc;
+
+	lfsh->next = handles;
+	handles = lfsh;
+
+	return 0;
 }
 
 /**
  * Register a new Lustre filesystem
  *
+ * If the filesystem is already opened, its handle is returned again,
+ * and must be closed one more time. The settings of a handle, such as
+ * its number of threads or its attribute cache, are common to all its
+ * users.
+ *
  * \param[in]  mount_path   Lustre filesystem mountpoint
  * \param[out] lfsh	    An opaque handle
  *
@@ -106,121 +283,200 @@ out:
  */
 int lus_open_fs(const char *mount_path, struct lus_fs_handle **lfsh)
 {
+	char real_path[PATH_MAX];
 	struct lus_fs_handle *mylfsh;
+	size_t len;
 	int rc;
-	FILE *f = NULL;
-	struct mntent *ent;
-	char *p;
-	struct statfs stfsbuf;
 
 	*lfsh = NULL;
 
-	mylfsh = calloc(1, sizeof(*mylfsh));
-	if (mylfsh == NULL) {
-		rc = -errno;
-		goto fail;
+	/* Use the canonical path, so the same mountpoint always gets
+	 * the same handle. /mnt//lustre/ --> /mnt/lustre */
+	if (realpath(mount_path, real_path) == NULL)
+		return -errno;
+
+	len = strlen(real_path);
+
+	pthread_mutex_lock(&handles_lock);
+
+	mylfsh = find_fs_handle(real_path, len);
+	if (mylfsh != NULL) {
+		mylfsh->refcount++;
+		rc = 0;
+		goto out;
 	}
 
-	rc = get_client_version(mylfsh);
+	rc = alloc_fs_handle(real_path, len, &mylfsh);
 	if (rc)
-		goto fail;
+		goto out;
 
-	/* Refuse to run on old versions of Lustre. Must be at least
-	 * 2.5. */
-	if (mylfsh->client_version < 20500) {
-		rc = -EINVAL;
+	/* Retrieve the lustre filesystem name from the mount table. */
+	rc = mount_index_get(mylfsh->mount_path, mylfsh->fs_name);
+	if (rc)
 		goto fail;
-	}
-
-	mylfsh->mount_fd = -1;
-	mylfsh->fid_fd = -1;
 
-	mylfsh->mount_path = strdup(mount_path);
-	if (mylfsh->mount_path == NULL) {
+	/* Open the mount point */
+	mylfsh->mount_fd = open(mylfsh->mount_path, O_RDONLY | O_DIRECTORY);
+	if (mylfsh->mount_fd == -1) {
 		rc = -errno;
 		goto fail;
 	}
 
-	/* Remove extra slashes at the end of the mountpoint.
-	 * /mnt/lustre/ --> /mnt/lustre */
-	p = &mylfsh->mount_path[strlen(mylfsh->mount_path)-1];
-	while (p != mylfsh->mount_path && *p == '/') {
-		*p = '\0';
-		p--;
-	}
+	rc = setup_fs_handle(mylfsh);
 
-	/* Retrieve the lustre filesystem name from /etc/mtab. */
-	f = setmntent(_PATH_MOUNTED, "r");
-	if (f == NULL) {
-		rc = -EINVAL;
-		goto fail;
+fail:
+	if (rc) {
+		free_fs_handle(mylfsh);
+		mylfsh = NULL;
 	}
 
-	while ((ent = getmntent(f))) {
-		size_t len;
+out:
+	pthread_mutex_unlock(&handles_lock);
 
-		if ((strcmp(ent->mnt_dir, mylfsh->mount_path) != 0) ||
-		    (strcmp(ent->mnt_type, "lustre") != 0))
-			continue;
+	*lfsh = mylfsh;
 
-		/* Found it. The Lustre fsname is part of the fsname
-		 * (ie. nodename@tcp:/lustre) so extract it. */
-		p = strstr(ent->mnt_fsname, ":/");
-		if (p == NULL)
-			break;
+	return rc;
+}
 
-		/* Skip :/ */
-		p += 2;
+/* Check that a directory is the root of a mount: its parent is on
+ * another filesystem, or is the directory itself for "/". */
+static int check_mount_root(int fd, const struct stat *st)
+{
+	struct stat parent;
 
-		len = strlen(p);
-		if (len >= 1 && len <= 8)
-			strcpy(mylfsh->fs_name, p);
+	if (fstatat(fd, "..", &parent, 0) == -1)
+		return -errno;
 
-		break;
-	}
+	if (parent.st_dev == st->st_dev && parent.st_ino != st->st_ino)
+		return -ENOENT;
 
-	endmntent(f);
+	return 0;
+}
 
-	if (mylfsh->fs_name[0] == '\0') {
-		rc = -ENOENT;
-		goto fail;
+/**
+ * Register a Lustre filesystem from an opened mountpoint
+ *
+ * Unlike lus_open_fs(), the mount table is not read. The filesystem
+ * name is derived from the name of its metadata client, and the
+ * mountpoint from the descriptor. The descriptor is duplicated, and
+ * can be closed by the caller afterwards. Handles are shared with
+ * lus_open_fs().
+ *
+ * \param[in]  fd     a directory descriptor on a Lustre mountpoint
+ * \param[out] lfsh   An opaque handle
+ *
+ * \retval   0 on success
+ * \retval   -ENOTDIR if fd is not a directory
+ * \retval   -EINVAL if fd is not on Lustre
+ * \retval   -ENOENT if fd is not the root of the filesystem
+ * \retval   a negative errno on other errors
+ */
+int lus_open_fs_fd(int fd, struct lus_fs_handle **lfsh)
+{
+	char mount_path[PATH_MAX];
+	char proc_path[32];
+	struct lus_fs_handle *mylfsh;
+	struct obd_uuid uuid;
+	struct stat st;
+	ssize_t len;
+	char *p;
+	int rc;
+
+	*lfsh = NULL;
+
+	if (fstat(fd, &st) == -1)
+		return -errno;
+
+	if (!S_ISDIR(st.st_mode))
+		return -ENOTDIR;
+
+	/* The metadata client is named <fsname>-clilmv-<instance>. */
+	rc = ioctl(fd, OBD_IOC_GETMDNAME, &uuid);
+	if (rc == -1)
+		return errno == ENOTTY ? -EINVAL : -errno;
+
+	uuid.uuid[sizeof(uuid.uuid) - 1] = '\0';
+	p = strstr(uuid.uuid, "-clilmv-");
+	if (p == NULL || p == uuid.uuid || p - uuid.uuid > 8)
+		return -EINVAL;
+
+	rc = check_mount_root(fd, &st);
+	if (rc)
+		return rc;
+
+	snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+	len = readlink(proc_path, mount_path, sizeof(mount_path));
+	if (len == -1)
+		return -errno;
+	if (len == sizeof(mount_path))
+		return -ENAMETOOLONG;
+
+	pthread_mutex_lock(&handles_lock);
+
+	mylfsh = find_fs_handle(mount_path, len);
+	if (mylfsh != NULL) {
+		mylfsh->refcount++;
+		rc = 0;
+		goto out;
 	}
 
-	/* Open the mount point */
-	mylfsh->mount_fd = open(mylfsh->mount_path, O_RDONLY | O_DIRECTORY);
+	rc = alloc_fs_handle(mount_path, len, &mylfsh);
+	if (rc)
+		goto out;
+
+	memcpy(mylfsh->fs_name, uuid.uuid, p - uuid.uuid);
+
+	mylfsh->mount_fd = dup(fd);
 	if (mylfsh->mount_fd == -1) {
 		rc = -errno;
 		goto fail;
 	}
 
-	/* Check it's indeed on Lustre */
-	rc = fstatfs(mylfsh->mount_fd, &stfsbuf);
-	if (rc == -1) {
-		rc = -errno;
-		goto fail;
-	}
-	if (stfsbuf.f_type != 0xbd00bd0) {
-		rc = -EINVAL;
-		goto fail;
-	}
+	rc = setup_fs_handle(mylfsh);
 
-	/* Open the fid directory of the Lustre filesystem */
-	mylfsh->fid_fd = openat(mylfsh->mount_fd, ".lustre/fid",
-				O_RDONLY | O_DIRECTORY);
-	if (mylfsh->fid_fd == -1) {
-		rc = -errno;
-		goto fail;
+fail:
+	if (rc) {
+		free_fs_handle(mylfsh);
+		mylfsh = NULL;
 	}
 
-	*lfsh = mylfsh;
+out:
+	pthread_mutex_unlock(&handles_lock);
 
-	return 0;
+	*lfsh = mylfsh;
 
-fail:
-	lus_close_fs(mylfsh);
 	return rc;
 }
 
+/**
+ * Open the Lustre filesystem containing a path.
+ *
+ * The mountpoint is found with the process wide mount table index,
+ * without scanning the mount table. The handle is the one
+ * lus_open_fs() returns for that mountpoint.
+ *
+ * \param[in]  path   any path in a Lustre filesystem. It doesn't have
+ *                    to exist, but its directory must.
+ * \param[out] lfsh   An opaque handle
+ *
+ * \retval   0 on success
+ * \retval   -ENOENT if the path is not on a Lustre filesystem
+ * \retval   a negative errno on other errors
+ */
+int lus_open_fs_for_path(const char *path, struct lus_fs_handle **lfsh)
+{
+	char mount_dir[PATH_MAX];
+	int rc;
+
+	*lfsh = NULL;
+
+	rc = mount_index_lookup(path, mount_dir, sizeof(mount_dir), NULL);
+	if (rc)
+		return rc;
+
+	return lus_open_fs(mount_dir, lfsh);
+}
+
 /**
  * Accessor to return the Lustre filesystem name of an opened Lustre
  * handle.
@@ -259,3 +515,27 @@ unsigned int lus_get_client_version(const struct lus_fs_handle *lfsh)
 {
 	return lfsh->client_version;
 }
+
+/**
+ * Set the number of threads used by the batched functions, such as
+ * lus_fid2path_batch(). The calling thread counts as one of them.
+ *
+ * The setting is shared by all the users of the handle. If a batch is
+ * being processed on that handle, this waits for it to complete.
+ *
+ * \param[in]  lfsh     An opaque handle returned by lus_open_fs()
+ * \param[in]  count    number of threads, from 1 to 256. 1 disables
+ *                      the worker threads.
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int lus_set_thread_count(struct lus_fs_handle *lfsh, unsigned int count)
+{
+	if (count == 0 || count > 256)
+		return -EINVAL;
+
+	/* The pool is resized in place, as another user of the handle
+	 * may be using it. */
+	return thread_pool_resize(lfsh->pool, count - 1);
+}
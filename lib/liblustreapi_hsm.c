@@ -74,6 +74,9 @@ struct lus_hsm_ct_handle {
 	int			 channel_rfd;
 	__u32			 archives;
 
+	/* Pre-created volatile files for the restores, or NULL. */
+	struct volatile_pool	*vpool;
+
 	/* HSM action list. The kernel comm (kuc_msglen) is limited to
 	 * 64k. It's small enough to reserve it here. */
 	unsigned char            hal[65536];
@@ -347,6 +350,7 @@ int lus_hsm_copytool_unregister(struct lus_hsm_ct_handle **priv)
 {
 	if (*priv) {
 		close_hsm_comm(*priv);
+		volatile_pool_destroy((*priv)->vpool);
 		free(*priv);
 		*priv = NULL;
 	}
@@ -415,6 +419,87 @@ out_err:
 	return rc;
 }
 
+/**
+ * Keep some volatile files ready on an MDT for the restores, so
+ * lus_hsm_action_begin() doesn't have to create one. A helper thread
+ * creates them in the background, and replaces those claimed. They
+ * are only used by restores on that MDT with the same open flags.
+ * Unused files are destroyed by lus_hsm_copytool_unregister().
+ *
+ * This must be called before the copytool starts processing actions.
+ *
+ * \param[in]  ct          Copytool handle acquired at registration.
+ * \param[in]  mdt_index   MDT index of the pool.
+ * \param[in]  size        Number of files to keep, up to 1024.
+ * \param[in]  open_flags  Volatile file creation flags, as given to
+ *                         lus_hsm_action_begin().
+ *
+ * \retval 0 on success.
+ * \retval -EEXIST if that MDT already has a pool.
+ * \retval a negative errno on other errors.
+ */
+int lus_hsm_volatile_pool_enable(struct lus_hsm_ct_handle *ct,
+				 unsigned int mdt_index, unsigned int size,
+				 int open_flags)
+{
+	int rc;
+
+	if (ct->vpool == NULL) {
+		rc = volatile_pool_create(ct->lfsh, &ct->vpool);
+		if (rc)
+			return rc;
+	}
+
+	return volatile_pool_add_mdt(ct->vpool, mdt_index, size, open_flags);
+}
+
+/**
+ * Return the statistics of the volatile file pools. All the values
+ * are 0 if no pool is enabled.
+ *
+ * \param[in]   ct      Copytool handle acquired at registration.
+ * \param[out]  stats   The statistics.
+ */
+void lus_hsm_volatile_pool_get_stats(const struct lus_hsm_ct_handle *ct,
+				     struct lus_volatile_pool_stats *stats)
+{
+	volatile_pool_get_stats(ct->vpool, stats);
+}
+
+/* Take the destination volatile file of a restore from the pool of
+ * the MDT. Without an explicit MDT, it's the MDT of the restored
+ * file. Return 0 on success, or a negative errno. */
+static int claim_restore_volatile(struct lus_hsm_action_handle *hcp,
+				  int mdt_index, int open_flags)
+{
+	const struct lus_fs_handle *lfsh = hcp->ct_priv->lfsh;
+	struct hsm_action_item *hai = &hcp->copy.hc_hai;
+	int fd;
+	int rc;
+
+	if (mdt_index == -1) {
+		mdt_index = lus_get_mdt_index_by_fid(lfsh, &hai->hai_fid);
+		if (mdt_index < 0)
+			return mdt_index;
+	}
+
+	fd = volatile_pool_get(hcp->ct_priv->vpool, mdt_index, open_flags,
+			       &hai->hai_dfid);
+	if (fd < 0)
+		return fd;
+
+	rc = fchown(fd, hcp->stat.st_uid, hcp->stat.st_gid);
+	if (rc < 0) {
+		rc = -errno;
+		close(fd);
+		return rc;
+	}
+
+	hcp->data_fd = fd;
+
+	return 0;
+}
+
 /**
  * Create the destination volatile file for a restore operation.
  *
@@ -434,6 +519,10 @@ static int create_restore_volatile(struct lus_hsm_action_handle *hcp,
 	struct hsm_action_item	*hai = &hcp->copy.hc_hai;
 	lustre_fid		parent_fid;
 
+	if (hcp->ct_priv->vpool != NULL &&
+	    claim_restore_volatile(hcp, mdt_index, open_flags) == 0)
+		return 0;
+
 	/* TODO: original version would create volatile in root fs if
 	 * that failed. Is it correct? We should fail because that is
 	 * not correct. */
@@ -796,6 +885,42 @@ int lus_hsm_state_get_fd(int fd, struct hsm_user_state *hus)
 	return rc ? -errno : 0;
 }
 
+/**
+ * Return the current HSM states and HSM requests related to a file,
+ * given its FID. The result comes from the attribute cache if it is
+ * enabled and has it.
+ *
+ * \param[in]   lfsh    an opened Lustre fs opaque handle
+ * \param[in]   fid     the file FID
+ * \param[out]  hus     Structure allocated by caller, which will be filled
+ *                      up with the current HSM file states.
+ *
+ * \retval 0 on success.
+ * \retval negative errno on error.
+ */
+int lus_hsm_state_get_by_fid(const struct lus_fs_handle *lfsh,
+			     const lustre_fid *fid,
+			     struct hsm_user_state *hus)
+{
+	int fd;
+	int rc;
+
+	if (fid_cache_get_hsm(lfsh, fid, hus))
+		return 0;
+
+	fd = lus_open_by_fid(lfsh, fid, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		return fd;
+
+	rc = lus_hsm_state_get_fd(fd, hus);
+	close(fd);
+
+	if (rc == 0)
+		fid_cache_put_hsm(lfsh, fid, hus);
+
+	return rc;
+}
+
 /**
  * Return the current HSM states and HSM requests related to the file
  * pointed by \a path.
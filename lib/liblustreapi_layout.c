@@ -31,12 +31,14 @@
  * @brief Interactions with the layout of Lustre files
  */
 
+#include <stddef.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <sys/xattr.h>
 #include <endian.h>
 
@@ -59,11 +61,37 @@ struct lus_layout {
 	uint64_t	llot_stripe_offset;
 	/** Indicates if llot_objects array has been initialized. */
 	bool		llot_objects_are_valid;
+	/** The OST of every stripe was set by lus_layout_set_ost_index(),
+	 * and is requested when the layout is set on a file. */
+	bool		llot_objects_are_specific;
 	/* Add 1 so user always gets back a null terminated string. */
 	char		llot_pool_name[LUS_POOL_NAME_LEN];
+	/** Number of entries allocated in llot_objects. */
+	unsigned int	llot_objects_count;
 	struct		lov_user_ost_data_v1 llot_objects[0];
 };
 
+/* A component of a composite layout. */
+struct lus_layout_comp_entry {
+	uint64_t	lce_start;
+	uint64_t	lce_end;
+	uint32_t	lce_id;
+	uint32_t	lce_flags;
+	struct lus_layout *lce_layout;
+};
+
+/**
+ * A composite layout: the layouts of consecutive extents of a file.
+ * A mirrored file has such a sequence for each mirror, one after the
+ * other.
+ */
+struct lus_layout_composite {
+	/** Number of components, and of entries allocated. */
+	unsigned int	llc_count;
+	unsigned int	llc_alloc;
+	struct lus_layout_comp_entry *llc_entries;
+};
+
 /* Helper functions for testing the validity of stripe attributes. */
 static bool stripe_size_is_aligned(uint64_t size)
 {
@@ -133,12 +161,31 @@ static int __layout_alloc(unsigned int num_stripes, struct lus_layout **layout)
 		rc = -EINVAL;
 	} else {
 		*layout = calloc(1, size);
-		rc = *layout ? 0 : -ENOMEM;
+		if (*layout == NULL) {
+			rc = -ENOMEM;
+		} else {
+			(*layout)->llot_objects_count = num_stripes;
+			rc = 0;
+		}
 	}
 
 	return rc;
 }
 
+/**
+ * Return the size of the memory used by a layout. A layout can be
+ * copied with memcpy().
+ *
+ * \param[in] layout	a layout
+ *
+ * \retval	the layout size, in bytes
+ */
+size_t layout_size(const struct lus_layout *layout)
+{
+	return sizeof(*layout) +
+		layout->llot_objects_count * sizeof(layout->llot_objects[0]);
+}
+
 /**
  * Copy the data from a lov_user_md to a newly allocated lus_layout.
  *
@@ -167,6 +214,8 @@ static int layout_from_lum(const struct lov_user_md *lum,
 
 	if (lum->lmm_pattern == LOV_PATTERN_RAID0)
 		layout->llot_pattern = LLAPI_LAYOUT_RAID0;
+	else if ((lum->lmm_pattern & ~LOV_PATTERN_F_MASK) == LOV_PATTERN_MDT)
+		layout->llot_pattern = LLAPI_LAYOUT_MDT;
 	else
 		/* Lustre only supports RAID0 for now. */
 		layout->llot_pattern = lum->lmm_pattern;
@@ -189,6 +238,9 @@ static int layout_from_lum(const struct lov_user_md *lum,
 	/* Don't copy lmm_stripe_offset: it is always zero
 	 * when reading attributes. */
 
+	if (lum->lmm_magic == LOV_USER_MAGIC_SPECIFIC && object_count > 0)
+		layout->llot_objects_are_specific = true;
+
 	if (lum->lmm_magic != LOV_USER_MAGIC_V1) {
 		const struct lov_user_md_v3 *lumv3;
 
@@ -210,82 +262,153 @@ static int layout_from_lum(const struct lov_user_md *lum,
 	return 0;
 }
 
+/**
+ * Get the number of stripes of a layout whose OSTs are all
+ * specified, and check that each of them has a distinct OST.
+ *
+ * \param[in]  layout	a layout with llot_objects_are_specific set
+ * \param[out] count	the number of stripes
+ *
+ * \retval	0 on success
+ * \retval	-EINVAL if a stripe has no OST, or shares it with another
+ */
+static int layout_specific_count(const struct lus_layout *layout,
+				 unsigned int *count)
+{
+	unsigned int mycount;
+	unsigned int i;
+	unsigned int j;
+
+	if (layout->llot_stripe_count == LLAPI_LAYOUT_DEFAULT)
+		mycount = layout->llot_objects_count;
+	else if (layout->llot_stripe_count == LLAPI_LAYOUT_WIDE ||
+		 layout->llot_stripe_count > layout->llot_objects_count)
+		return -EINVAL;
+	else
+		mycount = layout->llot_stripe_count;
+
+	for (i = 0; i < mycount; i++) {
+		uint32_t idx = layout->llot_objects[i].l_ost_idx;
+
+		if (idx == (uint32_t)-1)
+			return -EINVAL;
+
+		for (j = 0; j < i; j++) {
+			if (layout->llot_objects[j].l_ost_idx == idx)
+				return -EINVAL;
+		}
+	}
+
+	*count = mycount;
+
+	return 0;
+}
+
 /**
  * Copy the data from a lus_layout to a newly allocated lov_user_md.
  *
  * The caller is responsible for freeing the returned pointer.
  *
- * The current version of this API doesn't support specifying the OST
- * index of arbitrary stripes, only stripe 0 via lmm_stripe_offset.
- * There is therefore no need to copy the lmm_objects array.
+ * Unless the OST of every stripe was given, the lmm_objects array
+ * isn't sent to the kernel, and only the OST of stripe 0 can be set,
+ * through lmm_stripe_offset. Otherwise the OSTs are sent in the
+ * lmm_objects array of a LOV_USER_MAGIC_SPECIFIC lov_user_md.
  *
- * \param[in] layout	the layout to copy from
+ * \param[in]  layout	the layout to copy from
+ * \param[out] lum	a newly allocated lov_user_md
+ * \param[out] lum_size	its size, in bytes
  *
- * \retval	valid lov_user_md pointer on success
- * \retval	NULL if memory allocation fails
+ * \retval	0 on success
+ * \retval	-EINVAL if the OSTs of the stripes are not all given, or
+ *		not distinct
+ * \retval	-ENOMEM if memory allocation fails
  */
-static struct lov_user_md *layout_to_lum(const struct lus_layout *layout)
+static int layout_to_lum(const struct lus_layout *layout,
+			 struct lov_user_md **lum, size_t *lum_size)
 {
-	struct lov_user_md *lum;
-	size_t lum_size;
+	struct lov_user_ost_data_v1 *objects;
+	struct lov_user_md *mylum;
+	unsigned int ost_count = 0;
 	uint32_t magic = LOV_USER_MAGIC_V1;
+	size_t size;
+	unsigned int i;
+	int rc;
+
+	if (layout->llot_objects_are_specific) {
+		rc = layout_specific_count(layout, &ost_count);
+		if (rc)
+			return rc;
 
-	if (strlen(layout->llot_pool_name) != 0)
+		magic = LOV_USER_MAGIC_SPECIFIC;
+	} else if (strlen(layout->llot_pool_name) != 0) {
 		magic = LOV_USER_MAGIC_V3;
+	}
 
-	/* The lum->lmm_objects array won't be
-	 * sent to the kernel when we write the lum, so
-	 * we don't allocate storage for it.
-	 */
-	lum_size = lov_user_md_size(0, magic);
-	lum = malloc(lum_size);
-	if (lum == NULL)
-		return NULL;
+	size = lov_user_md_size(ost_count, magic);
+	mylum = malloc(size);
+	if (mylum == NULL)
+		return -ENOMEM;
 
-	lum->lmm_magic = magic;
+	mylum->lmm_magic = magic;
 
 	if (layout->llot_pattern == LLAPI_LAYOUT_DEFAULT)
-		lum->lmm_pattern = 0;
+		mylum->lmm_pattern = 0;
 	else if (layout->llot_pattern == LLAPI_LAYOUT_RAID0)
-		lum->lmm_pattern = 1;
+		mylum->lmm_pattern = 1;
+	else if (layout->llot_pattern == LLAPI_LAYOUT_MDT)
+		mylum->lmm_pattern = LOV_PATTERN_MDT;
 	else
-		lum->lmm_pattern = layout->llot_pattern;
+		mylum->lmm_pattern = layout->llot_pattern;
 
 	if (layout->llot_pattern_flags & LLAPI_LAYOUT_RELEASED)
-		lum->lmm_pattern |= LOV_PATTERN_F_RELEASED;
+		mylum->lmm_pattern |= LOV_PATTERN_F_RELEASED;
 
-	memset(&lum->lmm_oi, 0, sizeof(lum->lmm_oi));
+	memset(&mylum->lmm_oi, 0, sizeof(mylum->lmm_oi));
 
 	if (layout->llot_stripe_size == LLAPI_LAYOUT_DEFAULT)
-		lum->lmm_stripe_size = 0;
+		mylum->lmm_stripe_size = 0;
 	else
-		lum->lmm_stripe_size = layout->llot_stripe_size;
+		mylum->lmm_stripe_size = layout->llot_stripe_size;
 
-	if (layout->llot_stripe_count == LLAPI_LAYOUT_DEFAULT)
-		lum->lmm_stripe_count = 0;
+	if (ost_count != 0)
+		mylum->lmm_stripe_count = ost_count;
+	else if (layout->llot_stripe_count == LLAPI_LAYOUT_DEFAULT)
+		mylum->lmm_stripe_count = 0;
 	else if (layout->llot_stripe_count == LLAPI_LAYOUT_WIDE)
-		lum->lmm_stripe_count = -1;
+		mylum->lmm_stripe_count = -1;
 	else
-		lum->lmm_stripe_count = layout->llot_stripe_count;
+		mylum->lmm_stripe_count = layout->llot_stripe_count;
 
-	if (layout->llot_stripe_offset == LLAPI_LAYOUT_DEFAULT)
-		lum->lmm_stripe_offset = -1;
+	if (ost_count != 0)
+		mylum->lmm_stripe_offset = layout->llot_objects[0].l_ost_idx;
+	else if (layout->llot_stripe_offset == LLAPI_LAYOUT_DEFAULT)
+		mylum->lmm_stripe_offset = -1;
 	else
-		lum->lmm_stripe_offset = layout->llot_stripe_offset;
+		mylum->lmm_stripe_offset = layout->llot_stripe_offset;
 
-	if (lum->lmm_magic != LOV_USER_MAGIC_V1) {
-		struct lov_user_md_v3 *lumv3 = (struct lov_user_md_v3 *)lum;
-		int rc;
+	if (mylum->lmm_magic != LOV_USER_MAGIC_V1) {
+		struct lov_user_md_v3 *lumv3 = (struct lov_user_md_v3 *)mylum;
 
 		rc = strscpy(lumv3->lmm_pool_name, layout->llot_pool_name,
 			     sizeof(lumv3->lmm_pool_name));
 		if (rc < 0) {
-			free(lum);
-			return NULL;
+			free(mylum);
+			return -EINVAL;
+		}
+
+		objects = lumv3->lmm_objects;
+		for (i = 0; i < ost_count; i++) {
+			memset(&objects[i], 0, sizeof(objects[i]));
+			objects[i].l_ost_idx =
+				layout->llot_objects[i].l_ost_idx;
 		}
 	}
 
-	return lum;
+	*lum = mylum;
+	if (lum_size != NULL)
+		*lum_size = size;
+
+	return 0;
 }
 
 /**
@@ -361,6 +484,7 @@ static bool is_fully_specified(const struct lus_layout *layout)
 int lus_layout_alloc(unsigned int num_stripes, struct lus_layout **layout)
 {
 	struct lus_layout *lo;
+	unsigned int i;
 	int rc;
 
 	rc = __layout_alloc(num_stripes, &lo);
@@ -377,6 +501,8 @@ int lus_layout_alloc(unsigned int num_stripes, struct lus_layout **layout)
 		lo->llot_stripe_count = num_stripes;
 		lo->llot_objects_are_valid = true;
 	}
+	for (i = 0; i < num_stripes; i++)
+		lo->llot_objects[i].l_ost_idx = -1;
 	lo->llot_stripe_offset = LLAPI_LAYOUT_DEFAULT;
 	lo->llot_pool_name[0] = '\0';
 
@@ -412,6 +538,42 @@ static bool layout_lum_truncated(const struct lov_user_md *lum,
 	return lum_size < lov_user_md_size(0, magic);
 }
 
+/* Per-thread buffer to read a layout in, freed when the thread
+ * exits. It has room for the largest layout, after the stat that
+ * IOC_MDC_GETFILEINFO returns first. */
+#define LUM_BUF_SIZE (sizeof(struct lov_user_mds_data) + XATTR_SIZE_MAX)
+
+static pthread_key_t lum_buf_key;
+static pthread_once_t lum_buf_once = PTHREAD_ONCE_INIT;
+
+static void lum_buf_key_create(void)
+{
+	pthread_key_create(&lum_buf_key, free);
+}
+
+/* Return the buffer of the calling thread, of LUM_BUF_SIZE bytes. */
+static void *get_lum_buf(void)
+{
+	void *buf;
+
+	pthread_once(&lum_buf_once, lum_buf_key_create);
+
+	buf = pthread_getspecific(lum_buf_key);
+	if (buf != NULL)
+		return buf;
+
+	buf = malloc(LUM_BUF_SIZE);
+	if (buf == NULL)
+		return NULL;
+
+	if (pthread_setspecific(lum_buf_key, buf) != 0) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
 /**
  * Compute the number of elements in the lmm_objects array of \a lum
  * with size \a lum_size.
@@ -444,20 +606,203 @@ static int layout_objects_in_lum(const struct lov_user_md *lum,
 		return (lum_size - base_size) / sizeof(lum->lmm_objects[0]);
 }
 
+/* Tell whether a lustre.lov attribute is a composite layout. */
+static bool layout_lum_is_comp(const struct lov_user_md *lum,
+			       size_t lum_len)
+{
+	return lum_len >= sizeof(struct lov_comp_md_v1) &&
+		(lum->lmm_magic == LOV_USER_MAGIC_COMP_V1 ||
+		 lum->lmm_magic == __bswap_32(LOV_USER_MAGIC_COMP_V1));
+}
+
+/* Byte-swap the header of a composite layout, and then its
+ * entries, once their number is known to be valid. */
+static void layout_swab_comp_header(struct lov_comp_md_v1 *lcm)
+{
+	__swab32s(&lcm->lcm_magic);
+	__swab32s(&lcm->lcm_size);
+	__swab32s(&lcm->lcm_layout_gen);
+	__swab16s(&lcm->lcm_flags);
+	__swab16s(&lcm->lcm_entry_count);
+	__swab16s(&lcm->lcm_mirror_count);
+}
+
+static void layout_swab_comp_entries(struct lov_comp_md_v1 *lcm)
+{
+	struct lov_comp_md_entry_v1 *lcme;
+	unsigned int i;
+
+	for (i = 0; i < lcm->lcm_entry_count; i++) {
+		lcme = &lcm->lcm_entries[i];
+		__swab32s(&lcme->lcme_id);
+		__swab32s(&lcme->lcme_flags);
+		lcme->lcme_extent.e_start =
+			__bswap_64(lcme->lcme_extent.e_start);
+		lcme->lcme_extent.e_end = __bswap_64(lcme->lcme_extent.e_end);
+		__swab32s(&lcme->lcme_offset);
+		__swab32s(&lcme->lcme_size);
+		__swab32s(&lcme->lcme_layout_gen);
+		lcme->lcme_timestamp = __bswap_64(lcme->lcme_timestamp);
+	}
+}
+
+/* Add a component at the end of a composite layout, which takes
+ * ownership of its layout. */
+static int composite_append(struct lus_layout_composite *composite,
+			    uint64_t start, uint64_t end, uint32_t id,
+			    uint32_t flags, struct lus_layout *layout)
+{
+	struct lus_layout_comp_entry *entry;
+
+	if (composite->llc_count == composite->llc_alloc) {
+		unsigned int alloc = composite->llc_alloc ?
+			composite->llc_alloc * 2 : 4;
+
+		entry = realloc(composite->llc_entries,
+				alloc * sizeof(*entry));
+		if (entry == NULL)
+			return -ENOMEM;
+
+		composite->llc_entries = entry;
+		composite->llc_alloc = alloc;
+	}
+
+	entry = &composite->llc_entries[composite->llc_count];
+	entry->lce_start = start;
+	entry->lce_end = end;
+	entry->lce_id = id;
+	entry->lce_flags = flags;
+	entry->lce_layout = layout;
+	composite->llc_count++;
+
+	return 0;
+}
+
+/* Decode the layout of one component. */
+static int layout_from_comp_lum(struct lov_user_md *lum, size_t lum_len,
+				struct lus_layout **layout)
+{
+	uint32_t magic = lum->lmm_magic;
+	int object_count;
+
+	if (magic == __bswap_32(LOV_MAGIC_V1) ||
+	    magic == __bswap_32(LOV_MAGIC_V3))
+		magic = __bswap_32(magic);
+
+	if (magic != LOV_USER_MAGIC_V1 && magic != LOV_USER_MAGIC_V3 &&
+	    magic != LOV_USER_MAGIC_SPECIFIC)
+		return -EOPNOTSUPP;
+
+	if (lum_len < lov_user_md_size(0, magic))
+		return -EINVAL;
+
+	object_count = layout_objects_in_lum(lum, lum_len);
+
+	if (magic != lum->lmm_magic)
+		layout_swab_lov_user_md(lum, object_count);
+
+	return layout_from_lum(lum, object_count, layout);
+}
+
+/**
+ * Decode a composite layout. It is byte-swapped in place if needed.
+ *
+ * \param[in]  lum	   the extended lustre.lov attribute
+ * \param[in]  lum_len   its size
+ * \param[out] composite the decoded layout
+ *
+ * \retval    0 on success
+ * \retval    -EINVAL if the attribute is truncated or inconsistent
+ * \retval    a negative errno on other errors
+ */
+static int layout_comp_decode(struct lov_user_md *lum, size_t lum_len,
+			      struct lus_layout_composite **composite)
+{
+	struct lov_comp_md_v1 *lcm = (struct lov_comp_md_v1 *)lum;
+	struct lus_layout_composite *mycomposite;
+	struct lov_comp_md_entry_v1 *lcme;
+	struct lus_layout *layout;
+	size_t entries_end;
+	unsigned int i;
+	bool swab;
+	int rc;
+
+	swab = lcm->lcm_magic != LOV_USER_MAGIC_COMP_V1;
+	if (swab)
+		layout_swab_comp_header(lcm);
+
+	entries_end = sizeof(*lcm) +
+		lcm->lcm_entry_count * sizeof(lcm->lcm_entries[0]);
+	if (lcm->lcm_entry_count == 0 || lcm->lcm_size > lum_len ||
+	    entries_end > lcm->lcm_size)
+		return -EINVAL;
+
+	if (swab)
+		layout_swab_comp_entries(lcm);
+
+	rc = lus_layout_composite_alloc(&mycomposite);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < lcm->lcm_entry_count; i++) {
+		lcme = &lcm->lcm_entries[i];
+
+		if (lcme->lcme_offset < entries_end ||
+		    lcme->lcme_offset > lcm->lcm_size ||
+		    lcme->lcme_size > lcm->lcm_size - lcme->lcme_offset) {
+			rc = -EINVAL;
+			break;
+		}
+
+		rc = layout_from_comp_lum((struct lov_user_md *)
+					  ((char *)lcm + lcme->lcme_offset),
+					  lcme->lcme_size, &layout);
+		if (rc)
+			break;
+
+		rc = composite_append(mycomposite, lcme->lcme_extent.e_start,
+				      lcme->lcme_extent.e_end, lcme->lcme_id,
+				      lcme->lcme_flags, layout);
+		if (rc) {
+			lus_layout_free(layout);
+			break;
+		}
+	}
+
+	if (rc) {
+		lus_layout_composite_free(mycomposite);
+		return rc;
+	}
+
+	*composite = mycomposite;
+
+	return 0;
+}
+
 /**
  * Return a layout from a given lustre.lov extended attribute.
  *
+ * A composite layout (PFL, FLR) has no plain equivalent. Use
+ * lus_lovxattr_to_composite() for those.
+ *
  * \param[in]  lum	 the extended lustre.lov attribute
  * \param[in]  lum_len	 size of the lum
  * \param[out] layout    returned layout. Set to NULL on error.
  *
- * \retval    0 on success, or negative errno on error.
+ * \retval    0 on success
+ * \retval    -EOPNOTSUPP if the layout is composite
+ * \retval    a negative errno on other errors
  */
 int lus_lovxattr_to_layout(struct lov_user_md *lum, size_t lum_len,
 			   struct lus_layout **layout)
 {
 	int object_count;
 
+	if (layout_lum_is_comp(lum, lum_len)) {
+		*layout = NULL;
+		return -EOPNOTSUPP;
+	}
+
 	/* Return an error if we got a partial layout. */
 	if (layout_lum_truncated(lum, lum_len)) {
 		*layout = NULL;
@@ -473,6 +818,54 @@ int lus_lovxattr_to_layout(struct lov_user_md *lum, size_t lum_len,
 	return layout_from_lum(lum, object_count, layout);
 }
 
+/* Size of the first read of a layout. It holds a V3 layout of up to
+ * 168 stripes, and spares the kernel from allocating and zeroing
+ * XATTR_SIZE_MAX bytes for every file. */
+#define LUM_COMMON_SIZE 4096
+
+/* Read the layout of an opened file. Return the number of bytes read,
+ * or a negative errno. */
+static ssize_t read_lum(int fd, void *buf, size_t buf_len)
+{
+	ssize_t rc;
+
+	if (buf_len > LUM_COMMON_SIZE) {
+		rc = fgetxattr(fd, XATTR_LUSTRE_LOV, buf, LUM_COMMON_SIZE);
+		if (rc >= 0 || errno != ERANGE)
+			goto out;
+	}
+
+	rc = fgetxattr(fd, XATTR_LUSTRE_LOV, buf, buf_len);
+
+out:
+	if (rc < 0)
+		return errno == EOPNOTSUPP ? -ENOTTY : -errno;
+
+	return rc;
+}
+
+/* Directories may have a positive non-zero stripe count yet have an
+ * empty lmm_objects array. For non-directories the amount of data
+ * returned from the kernel must be consistent with the stripe
+ * count. The file is only stat'ed when they differ, so a regular file
+ * costs no extra system call. */
+static int check_lum_objects(int fd, unsigned int object_count,
+			     unsigned int stripe_count)
+{
+	struct stat st;
+
+	if (object_count == stripe_count)
+		return 0;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if (!S_ISDIR(st.st_mode))
+		return -EINTR;
+
+	return 0;
+}
+
 /**
  * Get the striping layout for the file referenced by file descriptor \a fd.
  *
@@ -484,134 +877,1087 @@ int lus_lovxattr_to_layout(struct lov_user_md *lum, size_t lum_len,
  * If the kernel gives us back less than the expected amount of data,
  * we fail with -EINTR.
  *
+ * lus_layout_view_get_by_fd() is cheaper when only a few attributes
+ * are needed. A composite layout (PFL, FLR) can only be read with
+ * lus_layout_composite_get_by_fd().
+ *
  * \param[in] fd	open file descriptor
  * \param[out]  layout  requested layout
  *
  * \retval 0 on success
+ * \retval -EOPNOTSUPP if the layout is composite
  * \retval a negative errno on failure, with layout set to NULL.
  */
 int lus_layout_get_by_fd(int fd, struct lus_layout **layout)
 {
-	size_t lum_len;
 	struct lov_user_md *lum;
 	ssize_t bytes_read;
 	int object_count;
-	struct stat st;
 	int rc;
 
 	*layout = NULL;
 
-	lum_len = XATTR_SIZE_MAX;
-	lum = malloc(lum_len);
+	lum = get_lum_buf();
 	if (lum == NULL)
 		return -ENOMEM;
 
-	bytes_read = fgetxattr(fd, XATTR_LUSTRE_LOV, lum, lum_len);
-	if (bytes_read < 0) {
-		if (errno == EOPNOTSUPP)
-			rc = -ENOTTY;
-		else if (errno == ENODATA)
-			rc = lus_layout_alloc(0, layout);
-		else
-			rc = -errno;
-		goto out;
-	}
+	bytes_read = read_lum(fd, lum, XATTR_SIZE_MAX);
+	if (bytes_read == -ENODATA)
+		return lus_layout_alloc(0, layout);
+	if (bytes_read < 0)
+		return bytes_read;
+
+	if (layout_lum_is_comp(lum, bytes_read))
+		return -EOPNOTSUPP;
 
 	/* Return an error if we got back a partial layout. */
-	if (layout_lum_truncated(lum, bytes_read)) {
-		rc = -EINTR;
-		goto out;
-	}
+	if (layout_lum_truncated(lum, bytes_read))
+		return -EINTR;
 
 	object_count = layout_objects_in_lum(lum, bytes_read);
 
-	/* Directories may have a positive non-zero lum->lmm_stripe_count
-	 * yet have an empty lum->lmm_objects array. For non-directories the
-	 * amount of data returned from the kernel must be consistent
-	 * with the stripe count. */
-	if (fstat(fd, &st) < 0) {
-		rc = -errno;
-		goto out;
-	}
-
-	if (!S_ISDIR(st.st_mode) && object_count != lum->lmm_stripe_count) {
-		rc = -EINTR;
-		goto out;
-	}
-
 	if (lum->lmm_magic == __bswap_32(LOV_MAGIC_V1) ||
 	    lum->lmm_magic == __bswap_32(LOV_MAGIC_V3))
 		layout_swab_lov_user_md(lum, object_count);
 
-	rc = layout_from_lum(lum, object_count, layout);
+	rc = check_lum_objects(fd, object_count, lum->lmm_stripe_count);
+	if (rc)
+		return rc;
 
-out:
-	free(lum);
-	return rc;
+	return layout_from_lum(lum, object_count, layout);
 }
 
+/*
+ * Composite layouts. Each component gives the layout of an extent of
+ * the file. The components built here are consecutive, and cover
+ * the file from offset 0.
+ */
+
 /**
- * Get the expected striping layout for a file at \a path.
- *
- * Substitute expected inherited attribute values for unspecified
- * attributes.  Unspecified attributes may belong to directories and
- * never-written-to files, and indicate that default values will be
- * assigned when files are created or first written to.  A default value
- * is inherited from the parent directory if the attribute is specified
- * there, otherwise it is inherited from the filesystem root.
- * Unspecified attributes normally have the value LLAPI_LAYOUT_DEFAULT.
+ * Allocate an empty composite layout.
  *
- * The complete \a path need not refer to an existing file or directory,
- * but some leading portion of it must reside within a lustre filesystem.
- * A use case for this interface would be to obtain the literal striping
- * values that would be assigned to a new file in a given directory.
+ * \param[out] composite	the new layout
  *
- * \param[in] path	path for which to get the expected layout
- * \param[out]  layout  requested layout
+ * \retval	0 on success
+ * \retval	-ENOMEM if memory allocation fails
+ */
+int lus_layout_composite_alloc(struct lus_layout_composite **composite)
+{
+	*composite = calloc(1, sizeof(**composite));
+	if (*composite == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * Free a composite layout and the layouts of its components.
  *
- * \retval 0 on success
- * \retval a negative errno on failure, with layout set to NULL.
+ * \param[in] composite	the layout to free. Can be NULL.
  */
-static int layout_expected(const char *path, struct lus_layout **layout)
+void lus_layout_composite_free(struct lus_layout_composite *composite)
 {
-	struct lus_layout	*path_layout = NULL;
-	struct lus_layout	*donor_layout;
-	char			donor_path[PATH_MAX];
-	struct stat st;
-	int fd;
-	int rc;
+	unsigned int i;
 
-	*layout = NULL;
+	if (composite == NULL)
+		return;
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		if (errno != ENOENT)
-			return -errno;
-		rc = -errno;
-	} else {
-		rc = lus_layout_get_by_fd(fd, &path_layout);
-		close(fd);
-	}
+	for (i = 0; i < composite->llc_count; i++)
+		lus_layout_free(composite->llc_entries[i].lce_layout);
 
-	if (path_layout == NULL) {
-		if (rc != -ENODATA && rc != -ENOENT)
-			return rc;
+	free(composite->llc_entries);
+	free(composite);
+}
 
-		rc = lus_layout_alloc(0, &path_layout);
-		if (rc != 0)
-			return rc;
-	}
+/**
+ * Add a component at the end of a composite layout. It starts where
+ * the previous one ends, or at offset 0, and ends at \a end. A copy
+ * of \a layout is added.
+ *
+ * The extent must be a multiple of 64 KiB, and of the stripe size of
+ * \a layout if given. Only the first component can store its data on
+ * the MDT (LLAPI_LAYOUT_MDT); its stripe size is then its end.
+ *
+ * \param[in] composite	the layout to add to
+ * \param[in] end	end of the extent, or LUS_LAYOUT_EOF
+ * \param[in] layout	the layout of the extent
+ *
+ * \retval	0 on success
+ * \retval	-EINVAL if the extent or the layout is invalid
+ * \retval	-ENOMEM if memory allocation fails
+ */
+int lus_layout_composite_add(struct lus_layout_composite *composite,
+			     uint64_t end, const struct lus_layout *layout)
+{
+	uint64_t stripe_size = layout->llot_stripe_size;
+	const struct lus_layout_comp_entry *last;
+	struct lus_layout *copy;
+	uint64_t start = 0;
+	int rc;
 
-	if (is_fully_specified(path_layout)) {
-		*layout = path_layout;
-		return 0;
+	if (composite->llc_count > 0) {
+		last = &composite->llc_entries[composite->llc_count - 1];
+		start = last->lce_end;
 	}
 
-	rc = stat(path, &st);
-	if (rc < 0 && errno != ENOENT) {
-		rc = -errno;
-		lus_layout_free(path_layout);
-		return rc;
+	if (start == LUS_LAYOUT_EOF || end <= start ||
+	    (end != LUS_LAYOUT_EOF && end % LOV_MIN_STRIPE_SIZE != 0) ||
+	    composite->llc_count == UINT16_MAX)
+		return -EINVAL;
+
+	if (layout->llot_pattern == LLAPI_LAYOUT_MDT) {
+		if (start != 0 || end == LUS_LAYOUT_EOF ||
+		    (stripe_size != LLAPI_LAYOUT_DEFAULT && stripe_size != end))
+			return -EINVAL;
+		stripe_size = end;
+	} else if (stripe_size != LLAPI_LAYOUT_DEFAULT) {
+		if (start % stripe_size != 0 ||
+		    (end != LUS_LAYOUT_EOF && end % stripe_size != 0))
+			return -EINVAL;
+	}
+
+	copy = malloc(layout_size(layout));
+	if (copy == NULL)
+		return -ENOMEM;
+
+	memcpy(copy, layout, layout_size(layout));
+	copy->llot_stripe_size = stripe_size;
+
+	rc = composite_append(composite, start, end, 0, 0, copy);
+	if (rc)
+		lus_layout_free(copy);
+
+	return rc;
+}
+
+/**
+ * Get the number of components of a composite layout.
+ *
+ * \param[in] composite	a composite layout
+ *
+ * \retval	the number of components
+ */
+unsigned int
+lus_layout_composite_count(const struct lus_layout_composite *composite)
+{
+	return composite->llc_count;
+}
+
+static uint16_t comp_entry_mirror_id(const struct lus_layout_comp_entry *entry)
+{
+	return entry->lce_id >> MIRROR_ID_SHIFT;
+}
+
+static void
+comp_entry_to_component(const struct lus_layout_comp_entry *entry,
+			struct lus_layout_component *component)
+{
+	component->lc_start = entry->lce_start;
+	component->lc_end = entry->lce_end;
+	component->lc_id = entry->lce_id;
+	component->lc_flags = entry->lce_flags;
+	component->lc_mirror_id = comp_entry_mirror_id(entry);
+	component->lc_layout = entry->lce_layout;
+}
+
+/**
+ * Get a component of a composite layout. The components are
+ * numbered from 0, in the order of their extents.
+ *
+ * \param[in]  composite	a composite layout
+ * \param[in]  index		the number of the component
+ * \param[out] component	the component. Its layout belongs to
+ *				\a composite.
+ *
+ * \retval	0 on success
+ * \retval	-ENOENT if there is no such component
+ */
+int lus_layout_composite_get(const struct lus_layout_composite *composite,
+			     unsigned int index,
+			     struct lus_layout_component *component)
+{
+	if (index >= composite->llc_count)
+		return -ENOENT;
+
+	comp_entry_to_component(&composite->llc_entries[index], component);
+
+	return 0;
+}
+
+/**
+ * Find the component of a composite layout whose extent contains an
+ * offset of the file. For a mirrored file, this is the component of
+ * the first mirror.
+ *
+ * \param[in]  composite	a composite layout
+ * \param[in]  offset		an offset in the file
+ * \param[out] component	the component. Its layout belongs to
+ *				\a composite.
+ *
+ * \retval	0 on success
+ * \retval	-ENOENT if no component contains the offset
+ */
+int lus_layout_composite_find(const struct lus_layout_composite *composite,
+			      uint64_t offset,
+			      struct lus_layout_component *component)
+{
+	const struct lus_layout_comp_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < composite->llc_count; i++) {
+		entry = &composite->llc_entries[i];
+		if (offset >= entry->lce_start && offset < entry->lce_end) {
+			comp_entry_to_component(entry, component);
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+/* Tell whether the component at index is the first of its mirror. */
+static bool
+comp_entry_first_of_mirror(const struct lus_layout_composite *composite,
+			   unsigned int index)
+{
+	const struct lus_layout_comp_entry *entries = composite->llc_entries;
+	uint16_t mirror_id = comp_entry_mirror_id(&entries[index]);
+	unsigned int i;
+
+	for (i = 0; i < index; i++) {
+		if (comp_entry_mirror_id(&entries[i]) == mirror_id)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Get the number of mirrors of a composite layout. A file that is not
+ * mirrored has one.
+ *
+ * \param[in] composite	a composite layout
+ *
+ * \retval	the number of mirrors
+ */
+unsigned int
+lus_layout_composite_mirror_count(const struct lus_layout_composite *composite)
+{
+	unsigned int count = 0;
+	unsigned int i;
+
+	for (i = 0; i < composite->llc_count; i++) {
+		if (comp_entry_first_of_mirror(composite, i))
+			count++;
+	}
+
+	return count;
+}
+
+/**
+ * Get the ID of a mirror of a composite layout. The mirrors are
+ * numbered from 0, in the order of their components. The components
+ * of a mirror are those whose lc_mirror_id is that ID.
+ *
+ * \param[in]  composite	a composite layout
+ * \param[in]  index		the number of the mirror
+ * \param[out] mirror_id	its ID
+ *
+ * \retval	0 on success
+ * \retval	-ENOENT if there is no such mirror
+ */
+int lus_layout_composite_mirror_id(const struct lus_layout_composite *composite,
+				   unsigned int index, uint16_t *mirror_id)
+{
+	unsigned int i;
+
+	for (i = 0; i < composite->llc_count; i++) {
+		if (!comp_entry_first_of_mirror(composite, i))
+			continue;
+
+		if (index == 0) {
+			*mirror_id = comp_entry_mirror_id(
+				&composite->llc_entries[i]);
+			return 0;
+		}
+		index--;
+	}
+
+	return -ENOENT;
+}
+
+/* Return the highest load of the OSTs storing the bytes from start to
+ * end of a component. Stripes are mapped from the start of the file,
+ * not of the component. */
+static uint64_t layout_range_load(const struct lus_layout *layout,
+				  uint64_t start, uint64_t end,
+				  const struct lus_mirror_hint *hint)
+{
+	uint64_t stripe_size = layout->llot_stripe_size;
+	unsigned int count = layout->llot_objects_count;
+	uint64_t first = 0;
+	uint64_t load = 0;
+	uint64_t units;
+	uint32_t ost_idx;
+	unsigned int i;
+
+	if (hint == NULL || hint->mh_ost_loads == NULL ||
+	    !layout->llot_objects_are_valid ||
+	    layout->llot_pattern == LLAPI_LAYOUT_MDT || count == 0)
+		return 0;
+
+	units = count;
+	if (stripe_size != 0 && stripe_size != LLAPI_LAYOUT_DEFAULT) {
+		first = start / stripe_size;
+		units = (end - 1) / stripe_size - first + 1;
+		if (units > count)
+			units = count;
+	}
+
+	for (i = 0; i < units; i++) {
+		ost_idx = layout->llot_objects[(first + i) % count].l_ost_idx;
+		if (ost_idx < hint->mh_ost_count &&
+		    hint->mh_ost_loads[ost_idx] > load)
+			load = hint->mh_ost_loads[ost_idx];
+	}
+
+	return load;
+}
+
+/* Find whether a mirror can be read from offset start to end, and
+ * how loaded and preferred it is. */
+static int mirror_read_cost(const struct lus_layout_composite *composite,
+			    uint16_t mirror_id, uint64_t start, uint64_t end,
+			    const struct lus_mirror_hint *hint,
+			    uint64_t *load, bool *pref_rd)
+{
+	const struct lus_layout_comp_entry *entry;
+	uint64_t comp_load;
+	unsigned int i;
+
+	*load = 0;
+	*pref_rd = false;
+
+	for (i = 0; i < composite->llc_count; i++) {
+		entry = &composite->llc_entries[i];
+		if (comp_entry_mirror_id(entry) != mirror_id ||
+		    entry->lce_end <= start || entry->lce_start >= end)
+			continue;
+
+		if (entry->lce_flags & (LCME_FL_STALE | LCME_FL_OFFLINE))
+			return -ESTALE;
+
+		/* Not written yet, in any mirror. */
+		if (!(entry->lce_flags & LCME_FL_INIT))
+			continue;
+
+		if (entry->lce_flags & LCME_FL_PREF_RD)
+			*pref_rd = true;
+
+		comp_load = layout_range_load(entry->lce_layout,
+			start > entry->lce_start ? start : entry->lce_start,
+			end < entry->lce_end ? end : entry->lce_end, hint);
+		if (comp_load > *load)
+			*load = comp_load;
+	}
+
+	return 0;
+}
+
+/**
+ * Choose the mirror of a file to read a range from. Mirrors with a
+ * stale or offline component in the range are never chosen. The
+ * mirror preferred by the caller is used if possible. Otherwise the
+ * chosen mirror is the one whose busiest OST in the range is the
+ * least loaded, then one the administrator marked as preferred for
+ * reads (LCME_FL_PREF_RD), then the first one.
+ *
+ * \param[in]  composite	the layout of the file
+ * \param[in]  offset		start of the range
+ * \param[in]  length		its length. It can extend beyond the
+ *				end of the file.
+ * \param[in]  hint		the load of the OSTs, indexed by OST
+ *				index, and the preferred mirror. Can be
+ *				NULL.
+ * \param[out] mirror_id	the chosen mirror, to pass to
+ *				lus_mirror_set_read()
+ *
+ * \retval	0 on success
+ * \retval	-EINVAL if length is 0
+ * \retval	-ENOENT if no mirror can be read
+ */
+int
+lus_layout_composite_pick_mirror(const struct lus_layout_composite *composite,
+				 uint64_t offset, uint64_t length,
+				 const struct lus_mirror_hint *hint,
+				 uint16_t *mirror_id)
+{
+	uint64_t end = offset + length;
+	bool best_pref_rd = false;
+	uint64_t best_load = 0;
+	bool found = false;
+	uint16_t id;
+	uint64_t load;
+	bool pref_rd;
+	unsigned int i;
+
+	if (length == 0)
+		return -EINVAL;
+
+	if (end < offset)
+		end = LUS_LAYOUT_EOF;
+
+	for (i = 0; i < composite->llc_count; i++) {
+		if (!comp_entry_first_of_mirror(composite, i))
+			continue;
+
+		id = comp_entry_mirror_id(&composite->llc_entries[i]);
+		if (mirror_read_cost(composite, id, offset, end, hint,
+				     &load, &pref_rd))
+			continue;
+
+		if (hint != NULL && hint->mh_preferred != 0 &&
+		    hint->mh_preferred == id) {
+			*mirror_id = id;
+			return 0;
+		}
+
+		if (!found || load < best_load ||
+		    (load == best_load && pref_rd && !best_pref_rd)) {
+			*mirror_id = id;
+			best_load = load;
+			best_pref_rd = pref_rd;
+			found = true;
+		}
+	}
+
+	return found ? 0 : -ENOENT;
+}
+
+/**
+ * Encode a composite layout once, to create files with
+ * lus_layout_create_many(). See lus_layout_prepare().
+ *
+ * \param[in]  composite	the layout to encode
+ * \param[out] prepared		the encoded layout, to free with
+ *				lus_layout_prepared_free()
+ *
+ * \retval	0 on success
+ * \retval	-EINVAL if the layout has no component, or a component
+ *		is invalid
+ * \retval	-ENOMEM if memory allocation fails
+ */
+int lus_layout_composite_prepare(const struct lus_layout_composite *composite,
+				 struct lus_layout_prepared **prepared)
+{
+	unsigned int count = composite->llc_count;
+	struct lus_layout_prepared *myprepared;
+	struct lov_comp_md_entry_v1 *lcme;
+	struct lov_comp_md_v1 *lcm;
+	struct lov_user_md **lums;
+	size_t *lum_sizes;
+	size_t offset;
+	size_t size;
+	unsigned int i;
+	int rc = 0;
+
+	if (count == 0)
+		return -EINVAL;
+
+	lums = calloc(count, sizeof(*lums));
+	lum_sizes = calloc(count, sizeof(*lum_sizes));
+	myprepared = malloc(sizeof(*myprepared));
+	if (lums == NULL || lum_sizes == NULL || myprepared == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	size = sizeof(*lcm) + count * sizeof(*lcme);
+	for (i = 0; i < count; i++) {
+		rc = layout_to_lum(composite->llc_entries[i].lce_layout,
+				   &lums[i], &lum_sizes[i]);
+		if (rc)
+			goto out;
+		size += lum_sizes[i];
+	}
+
+	lcm = calloc(1, size);
+	if (lcm == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	lcm->lcm_magic = LOV_USER_MAGIC_COMP_V1;
+	lcm->lcm_size = size;
+	lcm->lcm_entry_count = count;
+
+	offset = sizeof(*lcm) + count * sizeof(*lcme);
+	for (i = 0; i < count; i++) {
+		lcme = &lcm->lcm_entries[i];
+		lcme->lcme_extent.e_start = composite->llc_entries[i].lce_start;
+		lcme->lcme_extent.e_end = composite->llc_entries[i].lce_end;
+		lcme->lcme_offset = offset;
+		lcme->lcme_size = lum_sizes[i];
+		memcpy((char *)lcm + offset, lums[i], lum_sizes[i]);
+		offset += lum_sizes[i];
+	}
+
+	myprepared->lp_lum = (struct lov_user_md *)lcm;
+	myprepared->lp_lum_size = size;
+	*prepared = myprepared;
+	myprepared = NULL;
+
+out:
+	for (i = 0; lums != NULL && i < count; i++)
+		free(lums[i]);
+	free(lums);
+	free(lum_sizes);
+	free(myprepared);
+
+	return rc;
+}
+
+/* Make a composite layout of a single component covering the whole
+ * file, which takes ownership of \a layout. */
+static int composite_from_layout(struct lus_layout *layout,
+				 struct lus_layout_composite **composite)
+{
+	struct lus_layout_composite *mycomposite;
+	uint32_t flags = layout->llot_objects_are_valid ? LCME_FL_INIT : 0;
+	int rc;
+
+	rc = lus_layout_composite_alloc(&mycomposite);
+	if (rc == 0)
+		rc = composite_append(mycomposite, 0, LUS_LAYOUT_EOF, 0, flags,
+				      layout);
+	if (rc) {
+		lus_layout_free(layout);
+		lus_layout_composite_free(mycomposite);
+		return rc;
+	}
+
+	*composite = mycomposite;
+
+	return 0;
+}
+
+/**
+ * Return a composite layout from a given lustre.lov extended
+ * attribute. A plain layout gives a single component covering the
+ * whole file. The attribute is byte-swapped in place if needed.
+ *
+ * \param[in]  lum		the extended lustre.lov attribute
+ * \param[in]  lum_len		size of the lum
+ * \param[out] composite	the layout
+ *
+ * \retval	0 on success
+ * \retval	a negative errno on error
+ */
+int lus_lovxattr_to_composite(struct lov_user_md *lum, size_t lum_len,
+			      struct lus_layout_composite **composite)
+{
+	struct lus_layout *layout;
+	int rc;
+
+	if (layout_lum_is_comp(lum, lum_len))
+		return layout_comp_decode(lum, lum_len, composite);
+
+	rc = lus_lovxattr_to_layout(lum, lum_len, &layout);
+	if (rc)
+		return rc;
+
+	return composite_from_layout(layout, composite);
+}
+
+/**
+ * Get the composite layout of an open file. A file without a layout
+ * gets a single component with a default layout, as with
+ * lus_layout_get_by_fd().
+ *
+ * \param[in]  fd		open file descriptor
+ * \param[out] composite	the layout
+ *
+ * \retval	0 on success
+ * \retval	a negative errno on failure
+ */
+int lus_layout_composite_get_by_fd(int fd,
+				   struct lus_layout_composite **composite)
+{
+	struct lov_user_md *lum;
+	struct lus_layout *layout;
+	ssize_t bytes_read;
+	int rc;
+
+	lum = get_lum_buf();
+	if (lum == NULL)
+		return -ENOMEM;
+
+	bytes_read = read_lum(fd, lum, XATTR_SIZE_MAX);
+	if (bytes_read == -ENODATA) {
+		rc = lus_layout_alloc(0, &layout);
+		if (rc)
+			return rc;
+
+		return composite_from_layout(layout, composite);
+	}
+	if (bytes_read < 0)
+		return bytes_read;
+
+	return lus_lovxattr_to_composite(lum, bytes_read, composite);
+}
+
+/*
+ * Layout views. A view decodes the fields of a lustre.lov extended
+ * attribute where they are, in whatever endianness they came in, so
+ * getting a few attributes of a file needs no allocation or copy.
+ */
+
+static uint32_t view_u32(const struct lus_layout_view *view, uint32_t x)
+{
+	return view->lv_swab ? __bswap_32(x) : x;
+}
+
+static uint16_t view_u16(const struct lus_layout_view *view, uint16_t x)
+{
+	return view->lv_swab ? __bswap_16(x) : x;
+}
+
+/**
+ * Make a view of a lustre.lov extended attribute. Nothing is copied,
+ * so the attribute must be kept unchanged while the view is used.
+ *
+ * \param[out]  view      the view, usually on the caller's stack
+ * \param[in]   lum       the attribute
+ * \param[in]   lum_len   its size in bytes
+ *
+ * \retval   0 on success
+ * \retval   -EINVAL if the attribute is truncated
+ * \retval   -EOPNOTSUPP if it is not a plain V1 or V3 layout
+ */
+int lus_layout_view_init(struct lus_layout_view *view, const void *lum,
+			 size_t lum_len)
+{
+	const struct lov_user_md *lumv1 = lum;
+	uint32_t magic;
+	size_t base_size;
+
+	if (lum_len < sizeof(lumv1->lmm_magic))
+		return -EINVAL;
+
+	magic = lumv1->lmm_magic;
+	view->lv_swab = magic == __bswap_32(LOV_USER_MAGIC_V1) ||
+		magic == __bswap_32(LOV_USER_MAGIC_V3);
+	magic = view_u32(view, magic);
+
+	if (magic != LOV_USER_MAGIC_V1 && magic != LOV_USER_MAGIC_V3)
+		return -EOPNOTSUPP;
+
+	base_size = lov_user_md_size(0, magic);
+	if (lum_len < base_size)
+		return -EINVAL;
+
+	view->lv_lum = lumv1;
+	view->lv_objects = (const void *)((const char *)lum + base_size);
+	view->lv_object_count = (lum_len - base_size) /
+		sizeof(view->lv_objects[0]);
+
+	return 0;
+}
+
+/**
+ * Get a view of the layout of an opened file. The layout is read in
+ * the caller's buffer, or in a buffer private to the calling thread
+ * if \a buf is NULL. That buffer is reused by the next call to
+ * lus_layout_view_get_by_fd(), lus_layout_get_by_fd(),
+ * lus_layout_get_by_name() or lus_getfileinfo_by_fid() from the same
+ * thread, which ends the view.
+ *
+ * A file without a layout gets an empty view, for which all the
+ * attributes are LLAPI_LAYOUT_DEFAULT.
+ *
+ * \param[in]   fd        an opened file descriptor
+ * \param[in]   buf       a buffer, or NULL
+ * \param[in]   buf_len   size of \a buf. XATTR_SIZE_MAX fits any layout.
+ * \param[out]  view      the view
+ *
+ * \retval   0 on success
+ * \retval   -ENOTTY if the file is not on Lustre
+ * \retval   -ERANGE if \a buf is too small
+ * \retval   a negative errno on other errors
+ */
+int lus_layout_view_get_by_fd(int fd, void *buf, size_t buf_len,
+			      struct lus_layout_view *view)
+{
+	ssize_t bytes_read;
+	uint16_t stripe_count;
+	int rc;
+
+	if (buf == NULL) {
+		buf = get_lum_buf();
+		if (buf == NULL)
+			return -ENOMEM;
+		buf_len = XATTR_SIZE_MAX;
+	}
+
+	bytes_read = read_lum(fd, buf, buf_len);
+	if (bytes_read == -ENODATA) {
+		memset(view, 0, sizeof(*view));
+		return 0;
+	}
+	if (bytes_read < 0)
+		return bytes_read;
+
+	rc = lus_layout_view_init(view, buf, bytes_read);
+	if (rc == -EINVAL)
+		return -EINTR;
+	if (rc)
+		return rc;
+
+	stripe_count = view_u16(view, view->lv_lum->lmm_stripe_count);
+
+	return check_lum_objects(fd, view->lv_object_count, stripe_count);
+}
+
+/**
+ * Get the RAID pattern of a layout view. Same as
+ * lus_layout_pattern_get().
+ *
+ * \param[in] view	the view
+ *
+ * \retval pattern type
+ */
+uint64_t lus_layout_view_pattern_get(const struct lus_layout_view *view)
+{
+	uint32_t pattern;
+
+	if (view->lv_lum == NULL)
+		return LLAPI_LAYOUT_DEFAULT;
+
+	pattern = view_u32(view, view->lv_lum->lmm_pattern);
+
+	if (pattern == LOV_PATTERN_RAID0)
+		return LLAPI_LAYOUT_RAID0;
+	if ((pattern & ~LOV_PATTERN_F_MASK) == LOV_PATTERN_MDT)
+		return LLAPI_LAYOUT_MDT;
+
+	return pattern;
+}
+
+/**
+ * Get the pattern flags of a layout view. Same as
+ * lus_layout_pattern_get_flags().
+ *
+ * \param[in] view	the view
+ *
+ * \retval pattern flags
+ */
+uint64_t lus_layout_view_pattern_get_flags(const struct lus_layout_view *view)
+{
+	if (view->lv_lum != NULL &&
+	    view_u32(view, view->lv_lum->lmm_pattern) & LOV_PATTERN_F_RELEASED)
+		return LLAPI_LAYOUT_RELEASED;
+
+	return 0;
+}
+
+/**
+ * Get the stripe size of a layout view. Same as
+ * lus_layout_stripe_get_size().
+ *
+ * \param[in] view	the view
+ *
+ * \retval stripe size
+ */
+uint64_t lus_layout_view_stripe_get_size(const struct lus_layout_view *view)
+{
+	uint32_t size;
+
+	if (view->lv_lum == NULL)
+		return LLAPI_LAYOUT_DEFAULT;
+
+	size = view_u32(view, view->lv_lum->lmm_stripe_size);
+
+	return size == 0 ? LLAPI_LAYOUT_DEFAULT : size;
+}
+
+/**
+ * Get the stripe count of a layout view. Same as
+ * lus_layout_stripe_get_count().
+ *
+ * \param[in] view	the view
+ *
+ * \retval stripe count
+ */
+uint64_t lus_layout_view_stripe_get_count(const struct lus_layout_view *view)
+{
+	uint16_t count;
+
+	if (view->lv_lum == NULL)
+		return LLAPI_LAYOUT_DEFAULT;
+
+	count = view_u16(view, view->lv_lum->lmm_stripe_count);
+	if (count == (uint16_t)-1)
+		return LLAPI_LAYOUT_WIDE;
+	if (count == 0)
+		return LLAPI_LAYOUT_DEFAULT;
+
+	return count;
+}
+
+/**
+ * Get the OST index of a stripe of a layout view. Same as
+ * lus_layout_get_ost_index().
+ *
+ * \param[in]   view           the view
+ * \param[in]   stripe_number  stripe number, starting from 0
+ * \param[out]  idx            the OST index, or LLAPI_LAYOUT_DEFAULT
+ *
+ * \retval	0 on success
+ * \retval	-EINVAL if the view has no such stripe object
+ */
+int lus_layout_view_get_ost_index(const struct lus_layout_view *view,
+				  uint64_t stripe_number, uint64_t *idx)
+{
+	uint32_t ost_idx;
+
+	if (view->lv_lum == NULL || stripe_number >= view->lv_object_count)
+		return -EINVAL;
+
+	ost_idx = view_u32(view, view->lv_objects[stripe_number].l_ost_idx);
+	if (ost_idx == (uint32_t)-1)
+		*idx = LLAPI_LAYOUT_DEFAULT;
+	else
+		*idx = ost_idx;
+
+	return 0;
+}
+
+/**
+ * Get the pool name of a layout view. Same as
+ * lus_layout_get_pool_name().
+ *
+ * \param[in]  view	      the view
+ * \param[out] pool_name      buffer to store pool name in
+ * \param[in]  pool_name_len  size in bytes of buffer \a pool_name
+ *
+ * \retval    0 on success
+ * \retval    a negative errno on failure
+ */
+int lus_layout_view_get_pool_name(const struct lus_layout_view *view,
+				  char *pool_name, size_t pool_name_len)
+{
+	const struct lov_user_md_v3 *lumv3;
+	size_t len = 0;
+
+	if (view->lv_lum != NULL &&
+	    view_u32(view, view->lv_lum->lmm_magic) == LOV_USER_MAGIC_V3) {
+		lumv3 = (const struct lov_user_md_v3 *)view->lv_lum;
+
+		/* The name fills the field when it has the maximum
+		 * length. */
+		len = strnlen(lumv3->lmm_pool_name,
+			      sizeof(lumv3->lmm_pool_name));
+		if (len >= pool_name_len)
+			return -ENOSPC;
+		memcpy(pool_name, lumv3->lmm_pool_name, len);
+	} else if (pool_name_len == 0) {
+		return -ENOSPC;
+	}
+
+	pool_name[len] = '\0';
+
+	return 0;
+}
+
+/**
+ * Make a layout out of a view, which can then outlive it.
+ *
+ * \param[in]   view     the view
+ * \param[out]  layout   a newly allocated layout
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on failure, with layout set to NULL
+ */
+int lus_layout_view_to_layout(const struct lus_layout_view *view,
+			      struct lus_layout **layout)
+{
+	struct lus_layout *lo;
+	unsigned int i;
+	int rc;
+
+	if (view->lv_lum == NULL)
+		return lus_layout_alloc(0, layout);
+
+	rc = __layout_alloc(view->lv_object_count, &lo);
+	if (rc)
+		return rc;
+
+	lo->llot_pattern = lus_layout_view_pattern_get(view);
+	lo->llot_pattern_flags = lus_layout_view_pattern_get_flags(view);
+	lo->llot_stripe_size = lus_layout_view_stripe_get_size(view);
+	lo->llot_stripe_count = lus_layout_view_stripe_get_count(view);
+	lus_layout_view_get_pool_name(view, lo->llot_pool_name,
+				      sizeof(lo->llot_pool_name));
+
+	for (i = 0; i < view->lv_object_count; i++) {
+		lo->llot_objects[i] = view->lv_objects[i];
+		lo->llot_objects[i].l_ost_idx =
+			view_u32(view, view->lv_objects[i].l_ost_idx);
+	}
+	lo->llot_objects_are_valid = view->lv_object_count > 0;
+
+	*layout = lo;
+
+	return 0;
+}
+
+/* OST indexes are 16 bits. */
+#define MAX_OST_IDX 0xffff
+
+/* Tell whether the first object of a layout reply was returned. See
+ * lus_layout_get_by_name(). */
+static bool lum_object_returned(const struct lov_user_ost_data_v1 *obj)
+{
+	return obj->l_ost_idx <= MAX_OST_IDX;
+}
+
+/**
+ * Get the striping layout of the entry \a name in the directory \a
+ * dir_fd, without opening it.
+ *
+ * The directory is asked for its child's layout with a single
+ * request to the MDT, which saves an open and a close compared to
+ * lus_layout_get_by_path(). Only plain layouts are supported.
+ *
+ * \param[in]  dir_fd	open directory descriptor
+ * \param[in]  name	name of an entry in that directory
+ * \param[out] layout	requested layout
+ *
+ * \retval 0 on success
+ * \retval -EINVAL if \a name is not a single path component
+ * \retval -EOPNOTSUPP if the layout is not a plain one
+ * \retval a negative errno on failure, with layout set to NULL.
+ */
+int lus_layout_get_by_name(int dir_fd, const char *name,
+			   struct lus_layout **layout)
+{
+	struct lov_user_md_v3 *lumv3;
+	struct lov_user_md *lum;
+	size_t name_len;
+	size_t lum_len;
+	int object_count;
+	bool has_objects;
+	int rc;
+
+	*layout = NULL;
+
+	name_len = strlen(name);
+	if (name_len == 0 || name_len > NAME_MAX || strchr(name, '/'))
+		return -EINVAL;
+
+	lum = get_lum_buf();
+	if (lum == NULL)
+		return -ENOMEM;
+
+	/* The reply doesn't tell its size, and a directory has no
+	 * object even with a stripe count. So set the OST index of the
+	 * first object of both layout versions to an invalid value
+	 * before the request. The name, given at the start of the
+	 * buffer, may then overwrite some of these bytes, but never
+	 * in a way that makes a valid index. */
+	lumv3 = (struct lov_user_md_v3 *)lum;
+	lum->lmm_objects[0].l_ost_idx = UINT32_MAX;
+	lumv3->lmm_objects[0].l_ost_idx = UINT32_MAX;
+	memcpy(lum, name, name_len + 1);
+
+	rc = ioctl(dir_fd, IOC_MDC_GETFILESTRIPE, lum);
+	if (rc == -1) {
+		if (errno == ENODATA)
+			return lus_layout_alloc(0, layout);
+		else
+			return -errno;
+	}
+
+	/* The kernel already converted the layout to the host
+	 * endianness. */
+	if (lum->lmm_magic == LOV_USER_MAGIC_V1)
+		has_objects = lum_object_returned(&lum->lmm_objects[0]);
+	else if (lum->lmm_magic == LOV_USER_MAGIC_V3)
+		has_objects = lum_object_returned(&lumv3->lmm_objects[0]);
+	else
+		return -EOPNOTSUPP;
+
+	object_count = has_objects ? lum->lmm_stripe_count : 0;
+
+	lum_len = lov_user_md_size(object_count, lum->lmm_magic);
+	if (lum_len > XATTR_SIZE_MAX)
+		return -EINTR;
+
+	return lus_lovxattr_to_layout(lum, lum_len, layout);
+}
+
+/**
+ * Get the expected striping layout for a file at \a path.
+ *
+ * Substitute expected inherited attribute values for unspecified
+ * attributes.  Unspecified attributes may belong to directories and
+ * never-written-to files, and indicate that default values will be
+ * assigned when files are created or first written to.  A default value
+ * is inherited from the parent directory if the attribute is specified
+ * there, otherwise it is inherited from the filesystem root.
+ * Unspecified attributes normally have the value LLAPI_LAYOUT_DEFAULT.
+ *
+ * The complete \a path need not refer to an existing file or directory,
+ * but some leading portion of it must reside within a lustre filesystem.
+ * A use case for this interface would be to obtain the literal striping
+ * values that would be assigned to a new file in a given directory.
+ *
+ * \param[in] path	path for which to get the expected layout
+ * \param[out]  layout  requested layout
+ *
+ * \retval 0 on success
+ * \retval a negative errno on failure, with layout set to NULL.
+ */
+static int layout_expected(const char *path, struct lus_layout **layout)
+{
+	struct lus_layout	*path_layout = NULL;
+	struct lus_layout	*donor_layout;
+	char			donor_path[PATH_MAX];
+	struct stat st;
+	int fd;
+	int rc;
+
+	*layout = NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			return -errno;
+		rc = -errno;
+	} else {
+		rc = lus_layout_get_by_fd(fd, &path_layout);
+		close(fd);
+	}
+
+	if (path_layout == NULL) {
+		if (rc != -ENODATA && rc != -ENOENT)
+			return rc;
+
+		rc = lus_layout_alloc(0, &path_layout);
+		if (rc != 0)
+			return rc;
+	}
+
+	if (is_fully_specified(path_layout)) {
+		*layout = path_layout;
+		return 0;
+	}
+
+	rc = stat(path, &st);
+	if (rc < 0 && errno != ENOENT) {
+		rc = -errno;
+		lus_layout_free(path_layout);
+		return rc;
 	}
 
 	/* If path is a not a directory or doesn't exist, inherit unspecified
@@ -631,10 +1977,7 @@ static int layout_expected(const char *path, struct lus_layout **layout)
 	}
 
 	/* Inherit remaining unspecified attributes from the filesystem root. */
-#if 0
-	//TODO llapi_search_mounts not there yet
-	rc = llapi_search_mounts(path, 0, donor_path, NULL);
-#endif
+	rc = mount_index_lookup(path, donor_path, sizeof(donor_path), NULL);
 	if (rc < 0) {
 		lus_layout_free(path_layout);
 		return rc;
@@ -687,6 +2030,235 @@ int lus_layout_get_by_path(const char *path, uint32_t flags,
 	return rc;
 }
 
+/* Get the default layout of an opened directory, with its unspecified
+ * attributes inherited from the filesystem root. The result is looked
+ * up in, and added to, \a cache if it is not NULL. */
+static int dir_layout_get(const struct lus_fs_handle *lfsh,
+			  struct dir_layout_cache *cache, int dir_fd,
+			  bool is_root, struct lus_layout **layout)
+{
+	struct lus_layout *root_layout;
+	lustre_fid fid;
+	int rc;
+
+	*layout = NULL;
+
+	rc = lus_fd2fid(dir_fd, &fid);
+	if (rc)
+		return rc;
+
+	*layout = dir_layout_cache_get(cache, &fid);
+	if (*layout != NULL)
+		return 0;
+
+	rc = lus_layout_get_by_fd(dir_fd, layout);
+	if (rc)
+		return rc;
+
+	if (!is_root && !is_fully_specified(*layout)) {
+		rc = dir_layout_get(lfsh, cache, lfsh->mount_fd, true,
+				    &root_layout);
+		if (rc) {
+			lus_layout_free(*layout);
+			*layout = NULL;
+			return rc;
+		}
+
+		inherit_layout_attributes(root_layout, *layout);
+		lus_layout_free(root_layout);
+	}
+
+	dir_layout_cache_put(cache, &fid, *layout);
+
+	return 0;
+}
+
+/* See lus_layout_get_expected(). */
+static int layout_get_expected(const struct lus_fs_handle *lfsh,
+			       struct dir_layout_cache *cache,
+			       const char *path, struct lus_layout **layout)
+{
+	struct lus_layout *dir_layout;
+	char parent[PATH_MAX];
+	struct stat st;
+	int fd;
+	int rc;
+
+	*layout = NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		if (fstat(fd, &st) == -1)
+			rc = -errno;
+		else if (S_ISDIR(st.st_mode))
+			rc = dir_layout_get(lfsh, cache, fd, false, layout);
+		else
+			rc = lus_layout_get_by_fd(fd, layout);
+		close(fd);
+
+		/* A directory only inherits from the root. */
+		if (rc || S_ISDIR(st.st_mode) || is_fully_specified(*layout))
+			return rc;
+	} else if (errno != ENOENT) {
+		return -errno;
+	} else {
+		rc = lus_layout_alloc(0, layout);
+		if (rc)
+			return rc;
+	}
+
+	/* Inherit from the parent directory, or from the root if the
+	 * parent can't be read. */
+	rc = get_parent_dir(path, parent, sizeof(parent));
+	if (rc == 0) {
+		fd = open(parent, O_RDONLY | O_DIRECTORY);
+		if (fd >= 0) {
+			rc = dir_layout_get(lfsh, cache, fd, false,
+					    &dir_layout);
+			close(fd);
+		} else {
+			rc = -errno;
+		}
+	}
+
+	if (rc)
+		rc = dir_layout_get(lfsh, cache, lfsh->mount_fd, true,
+				    &dir_layout);
+
+	if (rc) {
+		lus_layout_free(*layout);
+		*layout = NULL;
+		return rc;
+	}
+
+	inherit_layout_attributes(dir_layout, *layout);
+	lus_layout_free(dir_layout);
+
+	return 0;
+}
+
+/**
+ * Get the expected striping layout for a file at \a path, like
+ * lus_layout_get_by_path() with LAYOUT_GET_EXPECTED.
+ *
+ * The root of the filesystem is the one of \a lfsh, so \a path must
+ * be on that filesystem. The default layouts of the parent directory
+ * and of the root are taken from the directory layout cache of the
+ * handle, when enabled with lus_dir_layout_cache_enable(). A file
+ * that doesn't exist then only costs a failed open, and the opening
+ * of its parent.
+ *
+ * \param[in]  lfsh     An opaque handle returned by lus_open_fs()
+ * \param[in]  path     path for which to get the expected layout
+ * \param[out] layout   requested layout
+ *
+ * \retval 0 on success
+ * \retval a negative errno on failure, with layout set to NULL.
+ */
+int lus_layout_get_expected(const struct lus_fs_handle *lfsh,
+			    const char *path, struct lus_layout **layout)
+{
+	unsigned int idx;
+	int rc;
+
+	idx = fs_cache_enter(lfsh);
+	rc = layout_get_expected(lfsh, fs_dir_layout_cache(lfsh), path,
+				 layout);
+	fs_cache_exit(lfsh, idx);
+
+	return rc;
+}
+
+/* State shared by the workers of lus_layout_expected_many(). */
+struct layout_expected_batch {
+	const struct lus_fs_handle *lfsh;
+	struct dir_layout_cache *cache;
+	const char * const *paths;
+	struct lus_layout **layouts;
+	int *errors;
+};
+
+static void layout_expected_one(void *arg, size_t idx)
+{
+	struct layout_expected_batch *batch = arg;
+
+	batch->errors[idx] = layout_get_expected(batch->lfsh, batch->cache,
+						 batch->paths[idx],
+						 &batch->layouts[idx]);
+}
+
+/* Number of directories cached during a call to
+ * lus_layout_expected_many() when the handle has no cache. */
+#define LAYOUT_EXPECTED_BATCH_DIRS 64
+
+/**
+ * Get the expected layouts of many paths at once. See
+ * lus_layout_get_expected(). The requests are spread over the worker
+ * threads of the handle (see lus_set_thread_count()).
+ *
+ * If the handle has no directory layout cache, one is used for the
+ * duration of the call, so every directory is still only looked up
+ * about once.
+ *
+ * \param[in]  lfsh      An opaque handle returned by lus_open_fs()
+ * \param[in]  paths     the paths
+ * \param[in]  count     number of paths
+ * \param[out] layouts   array of count layouts. layouts[i] is NULL if
+ *                       errors[i] is not 0.
+ * \param[out] errors    array of count status codes
+ *
+ * \retval    the number of layouts found
+ * \retval    a negative errno on error
+ */
+ssize_t lus_layout_expected_many(const struct lus_fs_handle *lfsh,
+				 const char * const *paths, size_t count,
+				 struct lus_layout **layouts, int *errors)
+{
+	struct layout_expected_batch batch = {
+		.lfsh = lfsh,
+		.paths = paths,
+		.layouts = layouts,
+		.errors = errors,
+	};
+	struct dir_layout_cache *private_cache = NULL;
+	unsigned int idx;
+	ssize_t found = 0;
+	size_t i;
+	int rc;
+
+	if (count == 0)
+		return 0;
+
+	if (paths == NULL || layouts == NULL || errors == NULL)
+		return -EINVAL;
+
+	/* The handle's cache is used for the whole batch. */
+	idx = fs_cache_enter(lfsh);
+
+	batch.cache = fs_dir_layout_cache(lfsh);
+	if (batch.cache == NULL) {
+		rc = dir_layout_cache_create(LAYOUT_EXPECTED_BATCH_DIRS, 0,
+					     &private_cache);
+		if (rc) {
+			fs_cache_exit(lfsh, idx);
+			return rc;
+		}
+		batch.cache = private_cache;
+	}
+
+	thread_pool_run(lfsh->pool, count, layout_expected_one, &batch);
+
+	fs_cache_exit(lfsh, idx);
+	dir_layout_cache_destroy(private_cache);
+
+	for (i = 0; i < count; i++) {
+		if (errors[i] == 0)
+			found++;
+	}
+
+	return found;
+}
+
 /**
  * Get the layout for the file with FID \a fidstr in filesystem \a lustre_dir.
  *
@@ -695,23 +2267,105 @@ int lus_layout_get_by_path(const char *path, uint32_t flags,
  * \param[out]  layout    requested layout
  *
  * \retval 0 on success
+ * \retval -EOPNOTSUPP if the layout is composite
+ * \retval a negative errno on failure, with layout set to NULL.
+ */
+int lus_layout_get_by_fid(const struct lus_fs_handle *lfsh,
+			  const lustre_fid *fid,
+			  struct lus_layout **layout)
+{
+	int fd;
+	int rc;
+
+	*layout = fid_cache_get_layout(lfsh, fid);
+	if (*layout != NULL)
+		return 0;
+
+	fd = lus_open_by_fid(lfsh, fid, O_RDONLY);
+	if (fd < 0)
+		return fd;
+
+	rc = lus_layout_get_by_fd(fd, layout);
+	close(fd);
+
+	if (rc == 0)
+		fid_cache_put_layout(lfsh, fid, *layout);
+
+	return rc;
+}
+
+/**
+ * Get the attributes and the layout of a file given its FID.
+ *
+ * The MDT returns both with a single request, so this is cheaper than
+ * lus_mdt_stat_by_fid() followed by lus_layout_get_by_fid(), which
+ * has to open the file. As with lus_mdt_stat_by_fid(), the OSTs are
+ * not queried so times or file sizes may not be accurate.
+ *
+ * \param[in]  lfsh	  An opaque handle returned by lus_open_fs()
+ * \param[in]  fid	  Lustre identifier of the file
+ * \param[out] st	  Caller allocated stat structure
+ * \param[out] layout	  requested layout
+ *
+ * \retval 0 on success
+ * \retval -EOPNOTSUPP if the layout is not a plain one
  * \retval a negative errno on failure, with layout set to NULL.
  */
-int lus_layout_get_by_fid(const struct lus_fs_handle *lfsh,
-			  const lustre_fid *fid,
-			  struct lus_layout **layout)
+int lus_getfileinfo_by_fid(const struct lus_fs_handle *lfsh,
+			   const lustre_fid *fid, struct stat *st,
+			   struct lus_layout **layout)
 {
-	int fd;
+	struct lov_user_mds_data *lmd;
+	struct lov_user_md *lum;
+	size_t object_count;
+	char *buf;
 	int rc;
 
 	*layout = NULL;
 
-	fd = lus_open_by_fid(lfsh, fid, O_RDONLY);
-	if (fd < 0)
-		return fd;
+	/* The FID goes in, and the stat and layout come back in the
+	 * same buffer. */
+	buf = get_lum_buf();
+	if (buf == NULL)
+		return -ENOMEM;
 
-	rc = lus_layout_get_by_fd(fd, layout);
-	close(fd);
+	lus_fid_format(fid, buf, FID_NOBRACE_LEN + 1);
+
+	/* The layout is left untouched if the file has none. */
+	lmd = (struct lov_user_mds_data *)buf;
+	memset(&lmd->lmd_lmm, 0, sizeof(lmd->lmd_lmm));
+
+	rc = ioctl(lfsh->fid_fd, IOC_MDC_GETFILEINFO, buf);
+	if (rc == -1)
+		return -errno;
+
+	*st = lmd->lmd_st;
+	lum = &lmd->lmd_lmm;
+
+	/* The kernel already converted the layout to the host
+	 * endianness. */
+	if (lum->lmm_magic == 0)
+		return lus_layout_alloc(0, layout);
+
+	if (lum->lmm_magic != LOV_USER_MAGIC_V1 &&
+	    lum->lmm_magic != LOV_USER_MAGIC_V3)
+		return -EOPNOTSUPP;
+
+	/* Directories only have a default layout, and released files
+	 * have no object. */
+	if (S_ISDIR(st->st_mode) ||
+	    (lum->lmm_pattern & LOV_PATTERN_F_RELEASED))
+		object_count = 0;
+	else
+		object_count = lum->lmm_stripe_count;
+
+	if (lov_user_md_size(object_count, lum->lmm_magic) >
+	    LUM_BUF_SIZE - offsetof(struct lov_user_mds_data, lmd_lmm))
+		return -EINTR;
+
+	rc = layout_from_lum(lum, object_count, layout);
+	if (rc == 0)
+		fid_cache_put_layout(lfsh, fid, *layout);
 
 	return rc;
 }
@@ -834,9 +2488,12 @@ uint64_t lus_layout_pattern_get(const struct lus_layout *layout)
 /**
  * Set the RAID pattern of \a layout.
  *
+ * LLAPI_LAYOUT_MDT stores the data on the MDT. It is only valid for
+ * the first component of a composite layout.
+ *
  * \param[in] layout	layout to set pattern in
- * \param[in] pattern	value to be set (LLAPI_LAYOUT_DEFAULT or
- *                      LLAPI_LAYOUT_RAID0)
+ * \param[in] pattern	value to be set (LLAPI_LAYOUT_DEFAULT,
+ *                      LLAPI_LAYOUT_RAID0 or LLAPI_LAYOUT_MDT)
  *
  * \retval	0 on success
  * \retval	-EOPNOTSUPP if the RAID pattern is unsupported
@@ -844,7 +2501,8 @@ uint64_t lus_layout_pattern_get(const struct lus_layout *layout)
 int lus_layout_pattern_set(struct lus_layout *layout, uint64_t pattern)
 {
 	if (pattern != LLAPI_LAYOUT_DEFAULT &&
-	    pattern != LLAPI_LAYOUT_RAID0)
+	    pattern != LLAPI_LAYOUT_RAID0 &&
+	    pattern != LLAPI_LAYOUT_MDT)
 		return -EOPNOTSUPP;
 
 	layout->llot_pattern = pattern;
@@ -889,7 +2547,12 @@ uint64_t lus_layout_pattern_get_flags(const struct lus_layout *layout)
 /**
  * Set the OST index of stripe number \a stripe_number to \a ost_index.
  *
- * The index may only be set for stripe number 0 for now.
+ * Setting the index of stripe 0 only chooses the OST the striping
+ * starts from; the filesystem picks the others. Setting the index of
+ * any other stripe requests an OST for every stripe, which must then
+ * all be given, and be distinct. Such a layout must have room for
+ * its stripes, i.e. have been allocated with lus_layout_alloc() with
+ * at least as many stripes, or read from a file.
  *
  * \param[in] layout		layout to set OST index in
  * \param[in] stripe_number	stripe number to set index for
@@ -897,19 +2560,30 @@ uint64_t lus_layout_pattern_get_flags(const struct lus_layout *layout)
  *
  * \retval	0 on success
  * \retval	-EINVAL if an argument is invalid
- * \retval	-EOPNOTSUPP if an unsupported stripe number
- *		was specified
+ * \retval	-EOPNOTSUPP if the layout has no room for the stripe
  */
 int lus_layout_set_ost_index(struct lus_layout *layout, int stripe_number,
 			     uint64_t ost_index)
 {
-	if (!layout_stripe_index_is_valid(ost_index))
+	if (!layout_stripe_index_is_valid(ost_index) || stripe_number < 0)
 		return -EINVAL;
 
-	if (stripe_number != 0)
+	if (stripe_number != 0 &&
+	    stripe_number >= layout->llot_objects_count)
 		return -EOPNOTSUPP;
 
-	layout->llot_stripe_offset = ost_index;
+	if (stripe_number < layout->llot_objects_count) {
+		if (ost_index == LLAPI_LAYOUT_DEFAULT)
+			layout->llot_objects[stripe_number].l_ost_idx = -1;
+		else
+			layout->llot_objects[stripe_number].l_ost_idx =
+				ost_index;
+	}
+
+	if (stripe_number == 0)
+		layout->llot_stripe_offset = ost_index;
+	else
+		layout->llot_objects_are_specific = true;
 
 	return 0;
 }
@@ -941,6 +2615,235 @@ int lus_layout_get_ost_index(const struct lus_layout *layout,
 	return 0;
 }
 
+/*
+ * Mapping of file offsets to the OST objects. A RAID0 file is cut in
+ * stripe units of stripe_size bytes, dealt round robin to the
+ * stripes: unit u is on stripe u % stripe_count, at offset
+ * (u / stripe_count) * stripe_size in the object of that stripe.
+ */
+
+/**
+ * Get the striping of a RAID0 layout whose stripe size and count are
+ * known, such as the layout of an existing file.
+ *
+ * \param[in]   layout        the layout
+ * \param[out]  stripe_size   its stripe size
+ * \param[out]  stripe_count  its stripe count
+ *
+ * \retval   0 on success
+ * \retval   -EINVAL if the layout is not RAID0, or its stripe size or
+ *           count is a default value
+ */
+int layout_raid0_geometry(const struct lus_layout *layout,
+			  uint64_t *stripe_size, uint64_t *stripe_count)
+{
+	/* The default pattern is RAID0, the only one there is. */
+	if (layout->llot_pattern != LLAPI_LAYOUT_RAID0 &&
+	    layout->llot_pattern != LLAPI_LAYOUT_DEFAULT)
+		return -EINVAL;
+
+	if (layout->llot_stripe_size == 0 ||
+	    stripe_size_is_too_big(layout->llot_stripe_size) ||
+	    layout->llot_stripe_count == 0 ||
+	    layout->llot_stripe_count > LOV_MAX_STRIPE_COUNT)
+		return -EINVAL;
+
+	*stripe_size = layout->llot_stripe_size;
+	*stripe_count = layout->llot_stripe_count;
+
+	return 0;
+}
+
+/* Return the OST index of a stripe, or LLAPI_LAYOUT_DEFAULT if the
+ * layout doesn't have it. */
+static uint64_t stripe_ost_index(const struct lus_layout *layout,
+				 uint64_t stripe)
+{
+	if (!layout->llot_objects_are_valid ||
+	    stripe >= layout->llot_objects_count ||
+	    layout->llot_objects[stripe].l_ost_idx == (__u32)-1)
+		return LLAPI_LAYOUT_DEFAULT;
+
+	return layout->llot_objects[stripe].l_ost_idx;
+}
+
+/* Map the part of [offset, end) that is in the stripe unit containing
+ * offset. */
+static void map_offset(const struct lus_layout *layout, uint64_t stripe_size,
+		       uint64_t stripe_count, uint64_t offset, uint64_t end,
+		       struct lus_layout_extent *extent)
+{
+	uint64_t unit = offset / stripe_size;
+	uint64_t unit_offset = offset - unit * stripe_size;
+	uint64_t stripe = unit % stripe_count;
+
+	extent->offset = offset;
+	extent->length = stripe_size - unit_offset;
+	if (extent->length > end - offset)
+		extent->length = end - offset;
+	extent->stripe = stripe;
+	extent->ost_index = stripe_ost_index(layout, stripe);
+	extent->object_offset = unit / stripe_count * stripe_size +
+		unit_offset;
+}
+
+/**
+ * Map the start of a file range to the stripe it is on. The returned
+ * extent starts at \a offset, and stops at the end of the range or of
+ * the stripe unit, whichever comes first.
+ *
+ * \param[in]   layout   a RAID0 layout with a known stripe size and count
+ * \param[in]   offset   offset of the range in the file
+ * \param[in]   length   length of the range, not 0
+ * \param[out]  extent   the first extent of the range
+ *
+ * \retval   0 on success
+ * \retval   -EINVAL if the layout can't be mapped, or the range is
+ *           empty or wraps around
+ */
+int lus_layout_map_extent(const struct lus_layout *layout, uint64_t offset,
+			  uint64_t length, struct lus_layout_extent *extent)
+{
+	uint64_t stripe_size;
+	uint64_t stripe_count;
+	int rc;
+
+	if (length == 0 || length > UINT64_MAX - offset)
+		return -EINVAL;
+
+	rc = layout_raid0_geometry(layout, &stripe_size, &stripe_count);
+	if (rc)
+		return rc;
+
+	map_offset(layout, stripe_size, stripe_count, offset, offset + length,
+		   extent);
+
+	return 0;
+}
+
+/**
+ * Prepare to iterate over the extents of a file range with
+ * lus_layout_extent_iter_next(). The iterator keeps a reference to
+ * the layout, which must not be freed or changed until the iteration
+ * is over. Nothing is allocated.
+ *
+ * \param[out]  iter     the iterator, usually on the caller's stack
+ * \param[in]   layout   a RAID0 layout with a known stripe size and count
+ * \param[in]   offset   offset of the range in the file
+ * \param[in]   length   length of the range. The iteration is empty
+ *                       if it is 0.
+ *
+ * \retval   0 on success
+ * \retval   -EINVAL if the layout can't be mapped, or the range
+ *           wraps around
+ */
+int lus_layout_extent_iter_init(struct lus_layout_extent_iter *iter,
+				const struct lus_layout *layout,
+				uint64_t offset, uint64_t length)
+{
+	int rc;
+
+	if (length > UINT64_MAX - offset)
+		return -EINVAL;
+
+	rc = layout_raid0_geometry(layout, &iter->lei_stripe_size,
+				   &iter->lei_stripe_count);
+	if (rc)
+		return rc;
+
+	iter->lei_layout = layout;
+	iter->lei_offset = offset;
+	iter->lei_end = offset + length;
+
+	return 0;
+}
+
+/**
+ * Return the next extent of a file range. The extents are returned in
+ * file order, each covering the range up to the end of a stripe unit.
+ *
+ * \param[in]   iter     an iterator set up by lus_layout_extent_iter_init()
+ * \param[out]  extent   the next extent
+ *
+ * \retval   true if an extent was returned
+ * \retval   false at the end of the range
+ */
+bool lus_layout_extent_iter_next(struct lus_layout_extent_iter *iter,
+				 struct lus_layout_extent *extent)
+{
+	if (iter->lei_offset >= iter->lei_end)
+		return false;
+
+	map_offset(iter->lei_layout, iter->lei_stripe_size,
+		   iter->lei_stripe_count, iter->lei_offset, iter->lei_end,
+		   extent);
+	iter->lei_offset += extent->length;
+
+	return true;
+}
+
+/**
+ * Map many file offsets at once. Each extent starts at its offset and
+ * goes to the end of its stripe unit.
+ *
+ * The layout is checked once for the whole array. Stripe sizes and
+ * counts are usually powers of 2, in which case the divisions are
+ * replaced by shifts and masks.
+ *
+ * \param[in]   layout    a RAID0 layout with a known stripe size and
+ *                        count
+ * \param[in]   offsets   the file offsets
+ * \param[in]   count     number of offsets
+ * \param[out]  extents   the extents, one per offset
+ *
+ * \retval   0 on success
+ * \retval   -EINVAL if the layout can't be mapped
+ */
+int lus_layout_map_offsets(const struct lus_layout *layout,
+			   const uint64_t *offsets, size_t count,
+			   struct lus_layout_extent *extents)
+{
+	uint64_t stripe_size;
+	uint64_t stripe_count;
+	unsigned int size_shift;
+	unsigned int count_shift;
+	uint64_t unit;
+	uint64_t stripe;
+	size_t i;
+	int rc;
+
+	rc = layout_raid0_geometry(layout, &stripe_size, &stripe_count);
+	if (rc)
+		return rc;
+
+	if ((stripe_size & (stripe_size - 1)) != 0 ||
+	    (stripe_count & (stripe_count - 1)) != 0) {
+		for (i = 0; i < count; i++)
+			map_offset(layout, stripe_size, stripe_count,
+				   offsets[i], UINT64_MAX, &extents[i]);
+		return 0;
+	}
+
+	size_shift = __builtin_ctzll(stripe_size);
+	count_shift = __builtin_ctzll(stripe_count);
+
+	for (i = 0; i < count; i++) {
+		unit = offsets[i] >> size_shift;
+		stripe = unit & (stripe_count - 1);
+
+		extents[i].offset = offsets[i];
+		extents[i].length = stripe_size -
+			(offsets[i] & (stripe_size - 1));
+		extents[i].stripe = stripe;
+		extents[i].ost_index = stripe_ost_index(layout, stripe);
+		extents[i].object_offset =
+			(unit >> count_shift << size_shift) |
+			(offsets[i] & (stripe_size - 1));
+	}
+
+	return 0;
+}
+
 /**
  *
  * Get the pool name of layout \a layout.
@@ -988,6 +2891,213 @@ int lus_layout_set_pool_name(struct lus_layout *layout,
 	return rc >= 0 ? 0 : rc;
 }
 
+/**
+ * Check that the OSTs requested by \a layout can be used: the OSTs
+ * given for its stripes must all be given, be distinct, and, as well
+ * as the OST of stripe 0, belong to the pool of the layout if it has
+ * one.
+ *
+ * The kernel does the same checks when the layout is set on a file;
+ * this allows a tool to check a placement once before creating many
+ * files with it.
+ *
+ * \param[in] lfsh	An opaque handle returned by lus_open_fs()
+ * \param[in] layout	the layout to check
+ *
+ * \retval	0 if the OSTs can be used
+ * \retval	-EINVAL if they can't, or the pool doesn't exist
+ * \retval	a negative errno on other errors
+ */
+int lus_layout_check_osts(const struct lus_fs_handle *lfsh,
+			  const struct lus_layout *layout)
+{
+	struct lustre_ost_info *info;
+	unsigned int count = 0;
+	unsigned int i;
+	int rc;
+
+	if (layout->llot_objects_are_specific) {
+		rc = layout_specific_count(layout, &count);
+		if (rc)
+			return rc;
+	}
+
+	if (layout->llot_pool_name[0] == '\0' ||
+	    (count == 0 && layout->llot_stripe_offset == LLAPI_LAYOUT_DEFAULT))
+		return 0;
+
+	rc = open_pool_info(lfsh, layout->llot_pool_name, &info);
+	if (rc)
+		return rc;
+
+	if (count == 0 &&
+	    !ost_info_has_index(info, layout->llot_stripe_offset))
+		rc = -EINVAL;
+
+	for (i = 0; i < count && rc == 0; i++) {
+		if (!ost_info_has_index(info,
+					layout->llot_objects[i].l_ost_idx))
+			rc = -EINVAL;
+	}
+
+	free_ost_info(&info);
+
+	return rc;
+}
+
+/* FNV-1a, 64 bits. */
+#define FNV64_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+
+/* Hash the \a bytes low order bytes of \a val, least significant
+ * first, so the result doesn't depend on the host endianness. */
+static uint64_t fnv64_add(uint64_t hash, uint64_t val, unsigned int bytes)
+{
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++) {
+		hash ^= (val >> (8 * i)) & 0xff;
+		hash *= FNV64_PRIME;
+	}
+
+	return hash;
+}
+
+/* Number of OSTs that take part in the hash and the equality of a
+ * layout. */
+static unsigned int layout_ost_count(const struct lus_layout *layout,
+				     unsigned int flags)
+{
+	if (!(flags & LUS_LAYOUT_CMP_OSTS) || !layout->llot_objects_are_valid)
+		return 0;
+
+	return layout->llot_objects_count;
+}
+
+/**
+ * Hash a layout. Its pattern, pattern flags, stripe size, stripe
+ * count, stripe offset and pool name are hashed, and with
+ * LUS_LAYOUT_CMP_OSTS, the OST index of each stripe. The object IDs
+ * never are.
+ *
+ * The hash only depends on these values. It is the same in every
+ * process and on every architecture, so it can be stored.
+ *
+ * \param[in] layout	the layout to hash
+ * \param[in] flags	0 or LUS_LAYOUT_CMP_OSTS
+ *
+ * \retval	the 64 bits hash
+ */
+uint64_t lus_layout_hash(const struct lus_layout *layout, unsigned int flags)
+{
+	uint64_t hash = FNV64_OFFSET_BASIS;
+	unsigned int ost_count;
+	const char *p;
+	unsigned int i;
+
+	hash = fnv64_add(hash, layout->llot_pattern, 8);
+	hash = fnv64_add(hash, layout->llot_pattern_flags, 8);
+	hash = fnv64_add(hash, layout->llot_stripe_size, 8);
+	hash = fnv64_add(hash, layout->llot_stripe_count, 8);
+	hash = fnv64_add(hash, layout->llot_stripe_offset, 8);
+
+	for (p = layout->llot_pool_name;
+	     p < layout->llot_pool_name + sizeof(layout->llot_pool_name) &&
+		     *p != '\0'; p++)
+		hash = fnv64_add(hash, (unsigned char)*p, 1);
+	hash = fnv64_add(hash, 0, 1);
+
+	ost_count = layout_ost_count(layout, flags);
+	hash = fnv64_add(hash, ost_count, 4);
+	for (i = 0; i < ost_count; i++)
+		hash = fnv64_add(hash, layout->llot_objects[i].l_ost_idx, 4);
+
+	return hash;
+}
+
+/**
+ * Tell whether two layouts are the same, comparing the attributes
+ * that lus_layout_hash() hashes with the same \a flags. Equal layouts
+ * have the same hash.
+ *
+ * \param[in] a		a layout
+ * \param[in] b		another layout
+ * \param[in] flags	0 or LUS_LAYOUT_CMP_OSTS
+ *
+ * \retval	true if the layouts are the same
+ */
+bool lus_layout_equal(const struct lus_layout *a, const struct lus_layout *b,
+		      unsigned int flags)
+{
+	unsigned int ost_count;
+	unsigned int i;
+
+	if (a->llot_pattern != b->llot_pattern ||
+	    a->llot_pattern_flags != b->llot_pattern_flags ||
+	    a->llot_stripe_size != b->llot_stripe_size ||
+	    a->llot_stripe_count != b->llot_stripe_count ||
+	    a->llot_stripe_offset != b->llot_stripe_offset ||
+	    strncmp(a->llot_pool_name, b->llot_pool_name,
+		    sizeof(a->llot_pool_name)) != 0)
+		return false;
+
+	ost_count = layout_ost_count(a, flags);
+	if (ost_count != layout_ost_count(b, flags))
+		return false;
+
+	for (i = 0; i < ost_count; i++)
+		if (a->llot_objects[i].l_ost_idx !=
+		    b->llot_objects[i].l_ost_idx)
+			return false;
+
+	return true;
+}
+
+/**
+ * Copy the attributes of a layout that lus_layout_equal() compares,
+ * and nothing else. The object IDs are not copied, and neither are
+ * the OST indexes unless \a flags has LUS_LAYOUT_CMP_OSTS. Layouts
+ * equal to \a layout thus all give the same copy.
+ *
+ * \param[in]  layout	the layout to copy
+ * \param[in]  flags	0 or LUS_LAYOUT_CMP_OSTS
+ * \param[out] copy	a newly allocated layout
+ *
+ * \retval	0 on success
+ * \retval	a negative errno on failure
+ */
+int layout_dup_shared(const struct lus_layout *layout, unsigned int flags,
+		      struct lus_layout **copy)
+{
+	unsigned int ost_count = layout_ost_count(layout, flags);
+	struct lus_layout *lo;
+	unsigned int i;
+	int rc;
+
+	rc = __layout_alloc(ost_count, &lo);
+	if (rc)
+		return rc;
+
+	lo->llot_pattern = layout->llot_pattern;
+	lo->llot_pattern_flags = layout->llot_pattern_flags;
+	lo->llot_stripe_size = layout->llot_stripe_size;
+	lo->llot_stripe_count = layout->llot_stripe_count;
+	lo->llot_stripe_offset = layout->llot_stripe_offset;
+	memcpy(lo->llot_pool_name, layout->llot_pool_name,
+	       sizeof(lo->llot_pool_name));
+
+	for (i = 0; i < ost_count; i++)
+		lo->llot_objects[i].l_ost_idx =
+			layout->llot_objects[i].l_ost_idx;
+	lo->llot_objects_are_valid = ost_count > 0;
+	lo->llot_objects_are_specific = ost_count > 0 &&
+		layout->llot_objects_are_specific;
+
+	*copy = lo;
+
+	return 0;
+}
+
 /**
  * Set a layout given a struct lov_user_md
  *
@@ -1030,33 +3140,37 @@ static int file_open_internal(int dir_fd, const char *path,
 			      int open_flags, mode_t mode,
 			      const struct lus_layout *layout)
 {
+	struct lov_user_md *lum = NULL;
 	int fd;
 	int rc;
-	struct lov_user_md *lum;
 
-	/* Object creation must be postponed until after layout attributes
-	 * have been applied. */
-	if (layout != NULL && (open_flags & O_CREAT))
-		open_flags |= O_LOV_DELAY_CREATE;
+	if (layout != NULL) {
+		/* Object creation must be postponed until after
+		 * layout attributes have been applied. */
+		if (open_flags & O_CREAT)
+			open_flags |= O_LOV_DELAY_CREATE;
+
+		/* Encode the layout first, so an invalid layout
+		 * doesn't leave a new file behind. */
+		rc = layout_to_lum(layout, &lum, NULL);
+		if (rc)
+			return rc;
+	}
 
 	if (dir_fd == -1)
 		fd = open(path, open_flags, mode);
 	else
 		fd = openat(dir_fd, path, open_flags, mode);
 
-	if (fd < 0)
-		return -errno;
+	if (fd < 0) {
+		rc = -errno;
+		free(lum);
+		return rc;
+	}
 
 	if (layout == NULL)
 		return fd;
 
-	lum = layout_to_lum(layout);
-
-	if (lum == NULL) {
-		close(fd);
-		return -EINVAL;
-	}
-
 	rc = lus_set_lov_layout(fd, lum);
 	if (rc < 0) {
 		rc = errno;
@@ -1071,6 +3185,151 @@ static int file_open_internal(int dir_fd, const char *path,
 	return fd;
 }
 
+/**
+ * Encode a layout once, to create many files with
+ * lus_layout_create_many(). The prepared layout is not modified
+ * afterwards, and can be shared by several threads.
+ *
+ * \param[in]  layout     the layout to encode
+ * \param[out] prepared   the encoded layout, to free with
+ *                        lus_layout_prepared_free()
+ *
+ * \retval 0 on success
+ * \retval a negative errno on failure
+ */
+int lus_layout_prepare(const struct lus_layout *layout,
+		       struct lus_layout_prepared **prepared)
+{
+	struct lus_layout_prepared *myprepared;
+	int rc;
+
+	if (layout == NULL || prepared == NULL)
+		return -EINVAL;
+
+	myprepared = malloc(sizeof(*myprepared));
+	if (myprepared == NULL)
+		return -ENOMEM;
+
+	rc = layout_to_lum(layout, &myprepared->lp_lum,
+			   &myprepared->lp_lum_size);
+	if (rc) {
+		free(myprepared);
+		return rc;
+	}
+
+	*prepared = myprepared;
+
+	return 0;
+}
+
+/**
+ * Free a layout returned by lus_layout_prepare().
+ *
+ * \param[in] prepared	the layout to free. Can be NULL.
+ */
+void lus_layout_prepared_free(struct lus_layout_prepared *prepared)
+{
+	if (prepared == NULL)
+		return;
+
+	free(prepared->lp_lum);
+	free(prepared);
+}
+
+/* State shared by the workers of lus_layout_create_many(). */
+struct create_many_batch {
+	int dir_fd;
+	const char * const *names;
+	const struct lov_user_md *lum;
+	mode_t mode;
+	int *errors;
+};
+
+/* Create one file of a batch. A file whose layout can't be set is
+ * removed, since it was created by us and would get a default
+ * layout. */
+static void create_many_one(void *arg, size_t idx)
+{
+	struct create_many_batch *batch = arg;
+	const char *name = batch->names[idx];
+	int fd;
+	int rc;
+
+	fd = openat(batch->dir_fd, name,
+		    O_WRONLY | O_CREAT | O_EXCL | O_LOV_DELAY_CREATE,
+		    batch->mode);
+	if (fd < 0) {
+		batch->errors[idx] = -errno;
+		return;
+	}
+
+	rc = lus_set_lov_layout(fd, batch->lum);
+	if (rc < 0) {
+		rc = errno == EOPNOTSUPP ? -ENOTTY : -errno;
+		close(fd);
+		unlinkat(batch->dir_fd, name, 0);
+		batch->errors[idx] = rc;
+		return;
+	}
+
+	close(fd);
+	batch->errors[idx] = 0;
+}
+
+/**
+ * Create many files with the same layout. The files are created in
+ * parallel by the worker threads of the handle (see
+ * lus_set_thread_count()), and closed. The layout was encoded once
+ * by lus_layout_prepare(), so creating a file doesn't allocate any
+ * memory.
+ *
+ * The files must not exist. A file whose layout can't be set is
+ * removed.
+ *
+ * \param[in]  lfsh       An opaque handle returned by lus_open_fs()
+ * \param[in]  dir_fd     open descriptor for the directory, or
+ *                        AT_FDCWD
+ * \param[in]  names      names of the files, relative to \a dir_fd
+ * \param[in]  count      number of files
+ * \param[in]  prepared   the layout of the files
+ * \param[in]  mode       permissions of the files
+ * \param[out] errors     array of count status codes
+ *
+ * \retval    the number of files created
+ * \retval    a negative errno on error
+ */
+ssize_t lus_layout_create_many(const struct lus_fs_handle *lfsh, int dir_fd,
+			       const char * const *names, size_t count,
+			       const struct lus_layout_prepared *prepared,
+			       mode_t mode, int *errors)
+{
+	struct create_many_batch batch = {
+		.dir_fd = dir_fd,
+		.names = names,
+		.mode = mode,
+		.errors = errors,
+	};
+	ssize_t created = 0;
+	size_t i;
+
+	if (count == 0)
+		return 0;
+
+	if (names == NULL || prepared == NULL || errors == NULL)
+		return -EINVAL;
+
+	batch.lum = prepared->lp_lum;
+
+	thread_pool_run(lfsh->pool, count, create_many_one, &batch);
+
+	for (i = 0; i < count; i++) {
+		if (errors[i] == 0)
+			created++;
+	}
+
+	return created;
+}
+
 /**
  * Open and possibly create a file with a given \a layout.
  *
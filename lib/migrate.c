@@ -0,0 +1,174 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Migration of a file to a new layout
+ *
+ * The data is copied into a volatile file created with the new
+ * layout, and the layouts of the two files are then swapped. The file
+ * stays available during the copy. The swap only happens if the data
+ * version of the file is still the one from before the copy;
+ * otherwise the file was written to in the meantime, and the copy is
+ * either started again or abandoned. Either way, closing the volatile
+ * file destroys the objects it holds.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* Number of copies attempted with LUS_MIGRATE_RETRY. */
+#define MIGRATE_MAX_ATTEMPTS 3
+
+/* Copy the file into a new volatile file, and swap their layouts.
+ * Return -EAGAIN if the file was modified during the copy. */
+static int migrate_once(const struct lus_fs_handle *lfsh, int fd,
+			int mdt_index, const struct lus_layout *layout)
+{
+	struct lus_layout *new_layout = NULL;
+	struct stat st;
+	ssize_t copied;
+	uint64_t dv;
+	int vfd;
+	int rc;
+
+	/* Flush the data cached by the clients, so it gets copied. */
+	rc = lus_data_version_by_fd(fd, LL_DV_RD_FLUSH, &dv);
+	if (rc)
+		return rc;
+
+	if (fstat(fd, &st) == -1)
+		return -errno;
+
+	vfd = lus_create_volatile_by_fid(lfsh, NULL, mdt_index, 0,
+					 S_IRUSR | S_IWUSR, layout);
+	if (vfd < 0)
+		return vfd;
+
+	/* Charge the new objects to the owner of the file. */
+	if (fchown(vfd, st.st_uid, st.st_gid) == -1) {
+		rc = -errno;
+		goto out;
+	}
+
+	/* The striping of the new objects, with the defaults
+	 * resolved. */
+	rc = lus_layout_get_by_fd(vfd, &new_layout);
+	if (rc)
+		goto out;
+
+	copied = pario_copy(lfsh->pool, fd, vfd, new_layout, st.st_size);
+	if (copied < 0) {
+		rc = copied;
+		goto out;
+	}
+
+	/* The file was truncated. */
+	if (copied < st.st_size) {
+		rc = -EAGAIN;
+		goto out;
+	}
+
+	rc = lus_fswap_layouts(fd, vfd, dv, 0,
+			       SWAP_LAYOUTS_CHECK_DV1 |
+			       SWAP_LAYOUTS_KEEP_MTIME |
+			       SWAP_LAYOUTS_KEEP_ATIME);
+
+out:
+	lus_layout_free(new_layout);
+	close(vfd);
+
+	return rc;
+}
+
+/**
+ * Move the data of a file to new OST objects with a different
+ * layout, for instance to restripe it, or to move it off a full OST.
+ * The file can be used during the migration. Its FID, owner, access
+ * and modification times are unchanged.
+ *
+ * The data is copied in parallel, along the stripes of the new
+ * layout, by the threads of \a lfsh.
+ *
+ * \param[in]  lfsh     an opened Lustre fs opaque handle
+ * \param[in]  fid      the FID of a regular file
+ * \param[in]  layout   the new layout. Its unset attributes, or all
+ *                      of them if NULL, come from the default layout
+ *                      of the filesystem.
+ * \param[in]  flags    0, or LUS_MIGRATE_RETRY to start the copy again
+ *                      if the file is written to while it is copied
+ *
+ * \retval   0 on success
+ * \retval   -EAGAIN if the file was modified during the copy. The
+ *           file is left unchanged.
+ * \retval   -ENODATA if the file is released
+ * \retval   a negative errno on other errors
+ */
+int lus_migrate_file(const struct lus_fs_handle *lfsh,
+		     const lustre_fid *fid,
+		     const struct lus_layout *layout, uint64_t flags)
+{
+	struct lus_layout *old_layout;
+	unsigned int attempts;
+	int mdt_index;
+	int fd;
+	int rc;
+
+	if (flags & ~LUS_MIGRATE_RETRY)
+		return -EINVAL;
+
+	fd = lus_open_by_fid(lfsh, fid, O_RDWR);
+	if (fd < 0)
+		return fd;
+
+	/* Reading a released file would restore it. */
+	rc = lus_layout_get_by_fd(fd, &old_layout);
+	if (rc)
+		goto out;
+
+	if (lus_layout_pattern_get_flags(old_layout) & LLAPI_LAYOUT_RELEASED)
+		rc = -ENODATA;
+	lus_layout_free(old_layout);
+	if (rc)
+		goto out;
+
+	/* Create the volatile file on the MDT of the file. */
+	mdt_index = lus_get_mdt_index_by_fid(lfsh, fid);
+	if (mdt_index < 0)
+		mdt_index = -1;
+
+	attempts = flags & LUS_MIGRATE_RETRY ? MIGRATE_MAX_ATTEMPTS : 1;
+
+	do {
+		rc = migrate_once(lfsh, fd, mdt_index, layout);
+		attempts--;
+	} while (rc == -EAGAIN && attempts > 0);
+
+	if (rc == -EAGAIN)
+		log_msg(LUS_LOG_INFO, rc,
+			"file " DFID " kept changing during its migration",
+			PFID(fid));
+
+out:
+	close(fd);
+
+	return rc;
+}
@@ -0,0 +1,539 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Process wide index of the mount table
+ *
+ * The index is built from /proc/self/mountinfo the first time it is
+ * needed. That file is kept open, and the kernel flags it with
+ * POLLPRI when the mount table changes. The index is rebuilt only
+ * then.
+ *
+ * The mount directories are sorted with '/' ordered before any other
+ * character, so the mounts under a directory immediately follow
+ * it. Each entry also records the closest mount containing it. A path
+ * is resolved with a binary search followed by a walk up these
+ * parents, which is only as long as the mounts are nested.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+#define MOUNTINFO "/proc/self/mountinfo"
+
+/* No parent mount. */
+#define NO_MOUNT SIZE_MAX
+
+struct mount_entry {
+	char *dir;		/* points into the mountinfo buffer */
+	size_t dir_len;
+	unsigned int order;	/* line number in mountinfo */
+	size_t parent;		/* closest mount containing this one */
+	bool is_lustre;
+	char fs_name[8 + 1];	/* Lustre filesystem name */
+};
+
+static struct {
+	pthread_mutex_t lock;
+	int fd;
+	char *buf;
+	struct mount_entry *entries;
+	size_t count;
+} mounts = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fd = -1,
+};
+
+/* Compare 2 paths, with '/' sorting before any other character. */
+static int path_cmp(const char *a, const char *b)
+{
+	unsigned char ca;
+	unsigned char cb;
+
+	while (*a != '\0' && *a == *b) {
+		a++;
+		b++;
+	}
+
+	ca = *a == '/' ? 1 : *a;
+	cb = *b == '/' ? 1 : *b;
+
+	return ca - cb;
+}
+
+static int entry_cmp(const void *p1, const void *p2)
+{
+	const struct mount_entry *e1 = p1;
+	const struct mount_entry *e2 = p2;
+	int rc;
+
+	rc = path_cmp(e1->dir, e2->dir);
+	if (rc)
+		return rc;
+
+	return e1->order < e2->order ? -1 : e1->order > e2->order;
+}
+
+/* Whether a mount directory contains path. */
+static bool mount_contains(const struct mount_entry *entry,
+			   const char *path)
+{
+	if (entry->dir_len == 1 && entry->dir[0] == '/')
+		return path[0] == '/';
+
+	return strncmp(entry->dir, path, entry->dir_len) == 0 &&
+		(path[entry->dir_len] == '\0' || path[entry->dir_len] == '/');
+}
+
+/* Decode the octal escapes (e.g. \040 for a space) of a mountinfo
+ * field, in place. */
+static void unescape(char *str)
+{
+	char *dst = str;
+
+	while (*str != '\0') {
+		if (str[0] == '\\' &&
+		    str[1] >= '0' && str[1] <= '3' &&
+		    str[2] >= '0' && str[2] <= '7' &&
+		    str[3] >= '0' && str[3] <= '7') {
+			*dst++ = (str[1] - '0') << 6 | (str[2] - '0') << 3 |
+				(str[3] - '0');
+			str += 4;
+		} else {
+			*dst++ = *str++;
+		}
+	}
+
+	*dst = '\0';
+}
+
+/* Return the next space separated field of a line, and NUL terminate
+ * it. */
+static char *next_field(char **line)
+{
+	char *field = *line;
+	char *p;
+
+	if (field == NULL)
+		return NULL;
+
+	p = strchr(field, ' ');
+	if (p == NULL) {
+		*line = NULL;
+	} else {
+		*p = '\0';
+		*line = p + 1;
+	}
+
+	return field;
+}
+
+/* Parse one line of mountinfo, such as:
+ *   36 25 0:42 / /mnt/lustre rw,relatime shared:1 - lustre
+ *   10.0.0.1@tcp:/lustre rw,flock
+ * on a single line. Return false if the line is malformed. */
+static bool parse_line(char *line, struct mount_entry *entry)
+{
+	char *fs_type;
+	char *source;
+	char *field;
+	char *p;
+	int i;
+
+	/* mount ID, parent ID, major:minor, root */
+	for (i = 0; i < 4; i++)
+		if (next_field(&line) == NULL)
+			return false;
+
+	field = next_field(&line);
+	if (field == NULL || field[0] != '/')
+		return false;
+	unescape(field);
+	entry->dir = field;
+
+	/* Skip the options and optional fields, up to the separator. */
+	do {
+		field = next_field(&line);
+		if (field == NULL)
+			return false;
+	} while (strcmp(field, "-") != 0);
+
+	fs_type = next_field(&line);
+	source = next_field(&line);
+	if (fs_type == NULL || source == NULL)
+		return false;
+
+	/* Remove the trailing slashes, except for /. */
+	entry->dir_len = strlen(entry->dir);
+	while (entry->dir_len > 1 && entry->dir[entry->dir_len - 1] == '/')
+		entry->dir_len--;
+	entry->dir[entry->dir_len] = '\0';
+
+	entry->is_lustre = false;
+	entry->fs_name[0] = '\0';
+
+	if (strcmp(fs_type, "lustre") == 0) {
+		/* The Lustre fsname is part of the source
+		 * (ie. nodename@tcp:/lustre) so extract it. */
+		p = strstr(source, ":/");
+		if (p != NULL) {
+			p += 2;
+			if (strlen(p) >= 1 && strlen(p) <= 8) {
+				strcpy(entry->fs_name, p);
+				entry->is_lustre = true;
+			}
+		}
+	}
+
+	return true;
+}
+
+/* Sort the entries, keep only the last mount on a directory, and find
+ * the parent of each entry. */
+static size_t index_entries(struct mount_entry *entries, size_t count)
+{
+	size_t i;
+	size_t j;
+	size_t n;
+
+	qsort(entries, count, sizeof(*entries), entry_cmp);
+
+	/* A directory mounted several times is hidden by the most
+	 * recent mount, which sorts last. */
+	for (i = 0, n = 0; i < count; i++) {
+		if (i + 1 < count &&
+		    strcmp(entries[i].dir, entries[i + 1].dir) == 0)
+			continue;
+		entries[n++] = entries[i];
+	}
+
+	for (i = 0; i < n; i++) {
+		j = i == 0 ? NO_MOUNT : i - 1;
+		while (j != NO_MOUNT && !mount_contains(&entries[j],
+							entries[i].dir))
+			j = entries[j].parent;
+		entries[i].parent = j;
+	}
+
+	return n;
+}
+
+/* Build an index from the content of mountinfo. The entries point
+ * into buf, which is modified. */
+static int parse_mountinfo(char *buf, struct mount_entry **entries,
+			   size_t *count)
+{
+	struct mount_entry *myentries;
+	size_t max = 0;
+	size_t n = 0;
+	char *line;
+	char *eol;
+
+	for (line = buf; *line != '\0'; line++)
+		if (*line == '\n')
+			max++;
+
+	myentries = calloc(max + 1, sizeof(*myentries));
+	if (myentries == NULL)
+		return -ENOMEM;
+
+	for (line = buf; line != NULL && *line != '\0'; line = eol) {
+		eol = strchr(line, '\n');
+		if (eol != NULL)
+			*eol++ = '\0';
+
+		if (parse_line(line, &myentries[n])) {
+			myentries[n].order = n;
+			n++;
+		}
+	}
+
+	*count = index_entries(myentries, n);
+	*entries = myentries;
+
+	return 0;
+}
+
+/* Find the mount containing an absolute path. */
+static const struct mount_entry *
+search_mount(const struct mount_entry *entries, size_t count,
+	     const char *path)
+{
+	size_t lo = 0;
+	size_t hi = count;
+	size_t mid;
+	size_t i;
+
+	/* Find the last entry sorting before or equal to path. */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (path_cmp(entries[mid].dir, path) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0)
+		return NULL;
+
+	for (i = lo - 1; i != NO_MOUNT; i = entries[i].parent) {
+		if (mount_contains(&entries[i], path))
+			return &entries[i];
+	}
+
+	return NULL;
+}
+
+/* Read the whole mountinfo file. */
+static int read_mountinfo(int fd, char **content)
+{
+	size_t size = 16384;
+	size_t len = 0;
+	ssize_t rc;
+	char *buf;
+	char *newbuf;
+
+	if (lseek(fd, 0, SEEK_SET) == -1)
+		return -errno;
+
+	buf = malloc(size);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	while (1) {
+		if (len + 1 >= size) {
+			size *= 2;
+			newbuf = realloc(buf, size);
+			if (newbuf == NULL) {
+				free(buf);
+				return -ENOMEM;
+			}
+			buf = newbuf;
+		}
+
+		rc = read(fd, buf + len, size - len - 1);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+			rc = -errno;
+			free(buf);
+			return rc;
+		}
+
+		if (rc == 0)
+			break;
+
+		len += rc;
+	}
+
+	buf[len] = '\0';
+	*content = buf;
+
+	return 0;
+}
+
+/* Rebuild the index if the mount table changed since the last
+ * call. Must be called with the lock held. */
+static int refresh_mounts(void)
+{
+	struct mount_entry *entries;
+	struct pollfd pfd;
+	char *buf = NULL;
+	size_t count;
+	int rc;
+
+	if (mounts.fd == -1) {
+		mounts.fd = open(MOUNTINFO, O_RDONLY | O_CLOEXEC);
+		if (mounts.fd == -1)
+			return -errno;
+	} else if (mounts.entries != NULL) {
+		pfd.fd = mounts.fd;
+		pfd.events = POLLPRI;
+		pfd.revents = 0;
+
+		rc = poll(&pfd, 1, 0);
+		if (rc == 0 || !(pfd.revents & (POLLERR | POLLPRI)))
+			return 0;
+
+		log_msg(LUS_LOG_DEBUG, 0, "mount table changed");
+	}
+
+	/* Drop the old index first, so that it is rebuilt by the next
+	 * call if this one fails. */
+	free(mounts.entries);
+	free(mounts.buf);
+	mounts.entries = NULL;
+	mounts.buf = NULL;
+	mounts.count = 0;
+
+	rc = read_mountinfo(mounts.fd, &buf);
+	if (rc)
+		return rc;
+
+	rc = parse_mountinfo(buf, &entries, &count);
+	if (rc) {
+		free(buf);
+		return rc;
+	}
+
+	mounts.buf = buf;
+	mounts.entries = entries;
+	mounts.count = count;
+
+	return 0;
+}
+
+/* Make path absolute and resolve its symlinks. If it doesn't exist,
+ * its directory is resolved instead. */
+static int resolve_path(const char *path, char *resolved)
+{
+	char dir[PATH_MAX];
+	const char *name;
+	char *p;
+	int rc;
+
+	if (realpath(path, resolved) != NULL)
+		return 0;
+
+	if (errno != ENOENT)
+		return -errno;
+
+	rc = strscpy(dir, path, sizeof(dir));
+	if (rc < 0)
+		return rc;
+
+	p = strrchr(dir, '/');
+	if (p == NULL) {
+		name = path;
+		strcpy(dir, ".");
+	} else if (p == dir) {
+		name = path + 1;
+		dir[1] = '\0';
+	} else {
+		name = path + (p - dir) + 1;
+		*p = '\0';
+	}
+
+	if (realpath(dir, resolved) == NULL)
+		return -errno;
+
+	if (strcmp(resolved, "/") != 0) {
+		rc = strscat(resolved, "/", PATH_MAX);
+		if (rc < 0)
+			return rc;
+	}
+
+	rc = strscat(resolved, name, PATH_MAX);
+
+	return rc < 0 ? rc : 0;
+}
+
+/**
+ * Find the Lustre filesystem mounted on a directory.
+ *
+ * \param[in]   mount_dir   a mountpoint, without trailing slashes
+ * \param[out]  fs_name     the Lustre filesystem name. At least 9
+ *                          bytes long.
+ *
+ * \retval   0 on success
+ * \retval   -ENOENT if no Lustre filesystem is mounted there
+ * \retval   a negative errno on other errors
+ */
+int mount_index_get(const char *mount_dir, char *fs_name)
+{
+	const struct mount_entry *entry;
+	int rc;
+
+	pthread_mutex_lock(&mounts.lock);
+
+	rc = refresh_mounts();
+	if (rc)
+		goto out;
+
+	entry = search_mount(mounts.entries, mounts.count, mount_dir);
+	if (entry == NULL || !entry->is_lustre ||
+	    strcmp(entry->dir, mount_dir) != 0) {
+		rc = -ENOENT;
+		goto out;
+	}
+
+	strcpy(fs_name, entry->fs_name);
+
+out:
+	pthread_mutex_unlock(&mounts.lock);
+
+	return rc;
+}
+
+/**
+ * Find the Lustre filesystem a path is on. The path doesn't have to
+ * exist, but its directory must.
+ *
+ * \param[in]   path            any path
+ * \param[out]  mount_dir       the mountpoint of the filesystem
+ * \param[in]   mount_dir_len   size of mount_dir
+ * \param[out]  fs_name         the Lustre filesystem name. At least 9
+ *                              bytes long. Can be NULL.
+ *
+ * \retval   0 on success
+ * \retval   -ENOENT if the path is not on a Lustre filesystem
+ * \retval   a negative errno on other errors
+ */
+int mount_index_lookup(const char *path, char *mount_dir,
+		       size_t mount_dir_len, char *fs_name)
+{
+	const struct mount_entry *entry;
+	char resolved[PATH_MAX];
+	int rc;
+
+	rc = resolve_path(path, resolved);
+	if (rc)
+		return rc;
+
+	pthread_mutex_lock(&mounts.lock);
+
+	rc = refresh_mounts();
+	if (rc)
+		goto out;
+
+	entry = search_mount(mounts.entries, mounts.count, resolved);
+	if (entry == NULL || !entry->is_lustre) {
+		rc = -ENOENT;
+		goto out;
+	}
+
+	rc = strscpy(mount_dir, entry->dir, mount_dir_len);
+	if (rc < 0)
+		goto out;
+
+	if (fs_name != NULL)
+		strcpy(fs_name, entry->fs_name);
+
+	rc = 0;
+
+out:
+	pthread_mutex_unlock(&mounts.lock);
+
+	return rc;
+}
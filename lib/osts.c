@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <glob.h>
 #include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -156,3 +157,30 @@ done:
 
 	return rc;
 }
+
+/**
+ * Tell whether an OST is in a list of OSTs, such as the members of a
+ * pool. The OSTs are named after their index, as in
+ * lustre-OST000a_UUID.
+ *
+ * \param[in] info	a list of OSTs
+ * \param[in] ost_idx	the index of the OST to look for
+ *
+ * \retval	true if the OST is in the list
+ */
+bool ost_info_has_index(const struct lustre_ost_info *info,
+			unsigned int ost_idx)
+{
+	unsigned int idx;
+	const char *p;
+	size_t i;
+
+	for (i = 0; i < info->count; i++) {
+		p = strstr(info->osts[i], "-OST");
+		if (p != NULL && sscanf(p + 4, "%x", &idx) == 1 &&
+		    idx == ost_idx)
+			return true;
+	}
+
+	return false;
+}
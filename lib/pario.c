@@ -0,0 +1,439 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Parallel, stripe aligned, reads and writes
+ *
+ * A range of a RAID0 striped file is split along the stripes, so
+ * every I/O covers at most one stripe unit, and the stripes are
+ * handed to a pool of threads. A thread processes all the units of a
+ * stripe, in order, before taking the next stripe. Each thread thus
+ * streams to a single OST object at a time, and no two threads ever
+ * contend for the same object or its extent locks.
+ *
+ * Concurrent writers of the same file normally fight for the extent
+ * locks. With a group lock, all the holders of the same group ID
+ * share a single lock, and the writes don't need any further lock.
+ *
+ * The same engine copies a file into another, such as a volatile file
+ * being migrated, along the stripes of the destination.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* Size of the bounce buffer of a thread copying a stripe. */
+#define PARIO_COPY_BUF_SIZE (1024 * 1024)
+
+/* State shared by the workers. */
+struct pario {
+	int fd;
+	bool write;
+	char *buf;
+
+	/* Source of a copy, or -1. The data is written to fd at the
+	 * same offset. */
+	int src_fd;
+	uint64_t offset;
+	uint64_t end;
+	uint64_t stripe_size;
+	uint64_t stripe_count;
+
+	/* First error, or 0. */
+	int error;
+
+	/* Lowest offset at which a read hit the end of the file. */
+	uint64_t eof;
+};
+
+/* Return the index of the first stripe unit of \a stripe at or after
+ * \a offset. */
+static uint64_t first_unit(uint64_t offset, uint64_t stripe_size,
+			   uint64_t stripe_count, uint64_t stripe)
+{
+	uint64_t unit = offset / stripe_size;
+
+	return unit + (stripe + stripe_count - unit % stripe_count) %
+		stripe_count;
+}
+
+/* Read or write a whole buffer. Return the number of bytes done,
+ * which is only less than len if a read reached the end of the file,
+ * or a negative errno. */
+static ssize_t full_io(int fd, bool write, char *buf, size_t len,
+		       uint64_t start)
+{
+	size_t done = 0;
+	ssize_t rc;
+
+	while (done < len) {
+		if (write)
+			rc = pwrite(fd, buf + done, len - done, start + done);
+		else
+			rc = pread(fd, buf + done, len - done, start + done);
+
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		if (rc == 0) {
+			if (write)
+				return -EIO;
+			break;
+		}
+
+		done += rc;
+	}
+
+	return done;
+}
+
+/* Copy a chunk through a bounce buffer. Same return value as
+ * full_io(). */
+static ssize_t copy_chunk(struct pario *pio, char *bounce, uint64_t start,
+			  size_t len)
+{
+	size_t done = 0;
+	ssize_t rc;
+	ssize_t rc2;
+	size_t n;
+
+	while (done < len) {
+		n = len - done;
+		if (n > PARIO_COPY_BUF_SIZE)
+			n = PARIO_COPY_BUF_SIZE;
+
+		rc = full_io(pio->src_fd, false, bounce, n, start + done);
+		if (rc <= 0)
+			return rc < 0 ? rc : done;
+
+		rc2 = full_io(pio->fd, true, bounce, rc, start + done);
+		if (rc2 < 0)
+			return rc2;
+
+		done += rc;
+		if (rc < n)
+			break;
+	}
+
+	return done;
+}
+
+/* Process a chunk. Same return value as full_io(). */
+static ssize_t pario_chunk(struct pario *pio, char *bounce, uint64_t start,
+			   size_t len)
+{
+	if (pio->src_fd != -1)
+		return copy_chunk(pio, bounce, start, len);
+
+	return full_io(pio->fd, pio->write, pio->buf + (start - pio->offset),
+		       len, start);
+}
+
+/* Lower the end of the data read to the end of the file. */
+static void pario_set_eof(struct pario *pio, uint64_t eof)
+{
+	uint64_t cur = __atomic_load_n(&pio->eof, __ATOMIC_RELAXED);
+
+	while (eof < cur &&
+	       !__atomic_compare_exchange_n(&pio->eof, &cur, eof, false,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+/* Process the stripe units of one stripe that intersect the range. */
+static void pario_stripe(void *arg, size_t stripe)
+{
+	struct pario *pio = arg;
+	char *bounce = NULL;
+	uint64_t unit;
+	uint64_t start;
+	uint64_t end;
+	ssize_t rc;
+	int error;
+
+	unit = first_unit(pio->offset, pio->stripe_size, pio->stripe_count,
+			  stripe);
+
+	if (pio->src_fd != -1 && unit * pio->stripe_size < pio->end) {
+		bounce = malloc(PARIO_COPY_BUF_SIZE);
+		if (bounce == NULL) {
+			rc = -ENOMEM;
+			goto error;
+		}
+	}
+
+	for (; unit * pio->stripe_size < pio->end;
+	     unit += pio->stripe_count) {
+		if (__atomic_load_n(&pio->error, __ATOMIC_RELAXED))
+			break;
+
+		start = unit * pio->stripe_size;
+		if (start < pio->offset)
+			start = pio->offset;
+
+		end = (unit + 1) * pio->stripe_size;
+		if (end > pio->end)
+			end = pio->end;
+
+		rc = pario_chunk(pio, bounce, start, end - start);
+		if (rc < 0)
+			goto error;
+
+		/* End of file. There is no data after it on any
+		 * stripe. */
+		if (rc < end - start) {
+			pario_set_eof(pio, start + rc);
+			break;
+		}
+	}
+
+	free(bounce);
+	return;
+
+error:
+	error = 0;
+	__atomic_compare_exchange_n(&pio->error, &error, rc, false,
+				    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	free(bounce);
+}
+
+/* Run the stripes of an I/O on a pool of threads. Return the number
+ * of bytes done, or a negative errno. */
+static ssize_t pario_run(struct thread_pool *pool, struct pario *pio)
+{
+	thread_pool_run(pool, pio->stripe_count, pario_stripe, pio);
+
+	if (pio->error)
+		return pio->error;
+
+	return pio->eof - pio->offset;
+}
+
+static ssize_t parallel_io(int fd, const struct lus_layout *layout,
+			   void *buf, size_t count, off_t offset,
+			   unsigned int threads, uint64_t gid, bool write)
+{
+	struct lus_layout *file_layout = NULL;
+	struct thread_pool *pool = NULL;
+	struct pario pio = {
+		.fd = fd,
+		.write = write,
+		.buf = buf,
+		.src_fd = -1,
+		.offset = offset,
+		.end = offset + count,
+		.eof = offset + count,
+	};
+	uint64_t units;
+	ssize_t rc;
+	int rc2;
+
+	if (offset < 0 || count > SSIZE_MAX || threads > 256)
+		return -EINVAL;
+
+	if (count == 0)
+		return 0;
+
+	if (layout == NULL) {
+		rc = lus_layout_get_by_fd(fd, &file_layout);
+		if (rc)
+			return rc;
+		layout = file_layout;
+	}
+
+	rc = layout_raid0_geometry(layout, &pio.stripe_size,
+				   &pio.stripe_count);
+	if (rc)
+		goto out;
+
+	/* At most one thread per stripe touched by the I/O. More would
+	 * only fight over the OST objects, or have nothing to do. */
+	units = (pio.end - 1) / pio.stripe_size -
+		pio.offset / pio.stripe_size + 1;
+	if (units > pio.stripe_count)
+		units = pio.stripe_count;
+	if (threads == 0 || threads > units)
+		threads = units < 256 ? units : 256;
+
+	/* A single thread doesn't need a pool. */
+	if (threads > 1) {
+		rc = thread_pool_create(threads - 1, &pool);
+		if (rc)
+			goto out;
+	}
+
+	if (gid != 0) {
+		rc = lus_group_lock(fd, gid);
+		if (rc)
+			goto out;
+	}
+
+	rc = pario_run(pool, &pio);
+
+	if (gid != 0) {
+		rc2 = lus_group_unlock(fd, gid);
+		if (rc2 && rc >= 0)
+			rc = rc2;
+	}
+
+out:
+	thread_pool_destroy(pool);
+	lus_layout_free(file_layout);
+
+	return rc;
+}
+
+/**
+ * Copy the start of a file into another, in parallel, along the
+ * stripes of the destination. Each stripe is copied by a single
+ * thread, through its own bounce buffer.
+ *
+ * \param[in]  pool     the threads to use, or NULL to copy from the
+ *                      calling thread only
+ * \param[in]  src_fd   a file descriptor opened for reading
+ * \param[in]  dst_fd   a file descriptor opened for writing
+ * \param[in]  layout   the layout of the destination
+ * \param[in]  size     number of bytes to copy, from offset 0
+ *
+ * \retval   the number of bytes copied, which is less than size if the
+ *           source is shorter
+ * \retval   a negative errno on error
+ */
+ssize_t pario_copy(struct thread_pool *pool, int src_fd, int dst_fd,
+		   const struct lus_layout *layout, uint64_t size)
+{
+	struct pario pio = {
+		.fd = dst_fd,
+		.write = true,
+		.src_fd = src_fd,
+		.offset = 0,
+		.end = size,
+		.eof = size,
+	};
+	int rc;
+
+	if (src_fd < 0)
+		return -EBADF;
+
+	if (size > SSIZE_MAX)
+		return -EINVAL;
+
+	if (size == 0)
+		return 0;
+
+	rc = layout_raid0_geometry(layout, &pio.stripe_size,
+				   &pio.stripe_count);
+	if (rc)
+		return rc;
+
+	return pario_run(pool, &pio);
+}
+
+/**
+ * Write a buffer to a striped file in parallel. The range is split
+ * on the stripe boundaries, and each stripe is written by a single
+ * thread, so the threads stream to different OST objects.
+ *
+ * When \a gid is not 0, a group lock with that ID is held during the
+ * writes. All the processes writing to the same file, possibly from
+ * different nodes, must use the same ID; see lus_group_lock_gid().
+ * The caller may instead take the group lock itself, for instance to
+ * keep it over several calls, and pass 0.
+ *
+ * \param[in]  fd       a file descriptor opened for writing
+ * \param[in]  layout   the layout of the file, or NULL to get it
+ *                      from \a fd
+ * \param[in]  buf      the data to write
+ * \param[in]  count    number of bytes to write
+ * \param[in]  offset   offset in the file
+ * \param[in]  threads  number of threads, up to 256. 0 for one per
+ *                      stripe. There are never more threads than
+ *                      stripes in the range.
+ * \param[in]  gid      a group lock ID, or 0 to not take a group lock
+ *
+ * \retval   count on success
+ * \retval   a negative errno on error, in which case some of the data
+ *           may have been written
+ */
+ssize_t lus_parallel_write(int fd, const struct lus_layout *layout,
+			   const void *buf, size_t count, off_t offset,
+			   unsigned int threads, uint64_t gid)
+{
+	return parallel_io(fd, layout, (void *)buf, count, offset, threads,
+			   gid, true);
+}
+
+/**
+ * Read a range of a striped file in parallel. This is the reverse of
+ * lus_parallel_write().
+ *
+ * \param[in]  fd       a file descriptor opened for reading
+ * \param[in]  layout   the layout of the file, or NULL to get it
+ *                      from \a fd
+ * \param[out] buf      the buffer to read into
+ * \param[in]  count    number of bytes to read
+ * \param[in]  offset   offset in the file
+ * \param[in]  threads  number of threads, up to 256. 0 for one per
+ *                      stripe.
+ * \param[in]  gid      a group lock ID, or 0 to not take a group lock
+ *
+ * \retval   the number of bytes read, which is less than count if the
+ *           end of the file was reached
+ * \retval   a negative errno on error
+ */
+ssize_t lus_parallel_read(int fd, const struct lus_layout *layout,
+			  void *buf, size_t count, off_t offset,
+			  unsigned int threads, uint64_t gid)
+{
+	return parallel_io(fd, layout, buf, count, offset, threads, gid,
+			   false);
+}
+
+/**
+ * Return a group lock ID for a file. The ID is derived from the FID,
+ * so every process opening the same file gets the same ID without
+ * having to exchange it.
+ *
+ * \param[in]   fd    an opened file descriptor for a file on Lustre
+ * \param[out]  gid   the group lock ID, between 1 and INT_MAX
+ *
+ * \retval  0 on success
+ * \retval  a negative errno on error
+ */
+int lus_group_lock_gid(int fd, uint64_t *gid)
+{
+	lustre_fid fid;
+	int rc;
+
+	rc = lus_fd2fid(fd, &fid);
+	if (rc)
+		return rc;
+
+	/* Older clients take the ID as an int. */
+	*gid = fid_hash(&fid) % INT_MAX + 1;
+
+	return 0;
+}
@@ -0,0 +1,720 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Parallel namespace scanner
+ *
+ * Each worker owns a deque of work items. A worker pushes and pops
+ * at the tail of its own deque, so it goes depth first and keeps the
+ * number of queued items low, and steals from the head of the others
+ * when its deque is empty, taking the oldest items, which are likely
+ * to be the largest subtrees.
+ *
+ * There are two kinds of items. A directory item is read with
+ * getdents64, and each buffer of entries read becomes a batch
+ * item. The entries of a huge directory are thus processed by all
+ * the workers while it is still being read. Processing a batch pushes
+ * a directory item for every subdirectory.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* Size of a getdents64 buffer, which is also a batch. */
+#define SCAN_BUF_SIZE (32 * 1024)
+
+/* The directory reader processes a batch itself when there are more
+ * than that many items per worker queued. That limits the memory
+ * used by a huge directory. */
+#define SCAN_MAX_QUEUED 4
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/* An opened directory, shared by its batches. */
+struct scan_dir {
+	int fd;
+	unsigned int refcount;
+	unsigned int depth;	/* depth of its entries */
+	size_t path_len;
+	char path[];
+};
+
+enum scan_item_type {
+	SCAN_ITEM_DIR,
+	SCAN_ITEM_BATCH,
+};
+
+struct scan_item {
+	enum scan_item_type type;
+	union {
+		/* Directory to read */
+		struct {
+			unsigned int depth;
+			char *path;
+		};
+
+		/* Entries read from a directory */
+		struct {
+			struct scan_dir *dir;
+			size_t len;
+			char *buf;
+		};
+	};
+};
+
+struct scan_deque {
+	pthread_mutex_t lock;
+	struct scan_item **items;
+	size_t capacity;	/* a power of 2 */
+	size_t head;
+	size_t tail;
+};
+
+struct scan_worker {
+	struct scan_deque deque;
+	char path[PATH_MAX];
+};
+
+struct scan {
+	unsigned int flags;
+	lus_scan_cb_t cb;
+	void *cb_arg;
+
+	unsigned int num_workers;
+	struct scan_worker *workers;
+
+	/* Items pushed and not processed yet, and items in the
+	 * deques. */
+	size_t pending;
+	size_t queued;
+
+	/* First error. Stops the scan. */
+	int error;
+
+	/* Idle workers wait for new items. */
+	pthread_mutex_t idle_lock;
+	pthread_cond_t idle_cv;
+	unsigned int idle;
+};
+
+static void scan_dir_put(struct scan_dir *dir)
+{
+	if (__atomic_sub_fetch(&dir->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	close(dir->fd);
+	free(dir);
+}
+
+static void free_item(struct scan_item *item)
+{
+	if (item->type == SCAN_ITEM_DIR) {
+		free(item->path);
+	} else {
+		scan_dir_put(item->dir);
+		free(item->buf);
+	}
+
+	free(item);
+}
+
+/* Record an error, and stop the scan. Only the first one is kept. */
+static void scan_set_error(struct scan *scan, int error)
+{
+	int none = 0;
+
+	__atomic_compare_exchange_n(&scan->error, &none, error, false,
+				    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_lock(&scan->idle_lock);
+	pthread_cond_broadcast(&scan->idle_cv);
+	pthread_mutex_unlock(&scan->idle_lock);
+}
+
+static bool scan_stopped(const struct scan *scan)
+{
+	return __atomic_load_n(&scan->error, __ATOMIC_RELAXED) != 0;
+}
+
+static int deque_init(struct scan_deque *deque)
+{
+	deque->capacity = 64;
+	deque->items = malloc(deque->capacity * sizeof(*deque->items));
+	if (deque->items == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_init(&deque->lock, NULL);
+
+	return 0;
+}
+
+static void deque_fini(struct scan_deque *deque)
+{
+	while (deque->head != deque->tail) {
+		free_item(deque->items[deque->head & (deque->capacity - 1)]);
+		deque->head++;
+	}
+
+	pthread_mutex_destroy(&deque->lock);
+	free(deque->items);
+}
+
+static int deque_push(struct scan_deque *deque, struct scan_item *item)
+{
+	struct scan_item **items;
+	size_t count;
+	size_t i;
+
+	pthread_mutex_lock(&deque->lock);
+
+	count = deque->tail - deque->head;
+	if (count == deque->capacity) {
+		items = malloc(2 * deque->capacity * sizeof(*items));
+		if (items == NULL) {
+			pthread_mutex_unlock(&deque->lock);
+			return -ENOMEM;
+		}
+
+		for (i = 0; i < count; i++)
+			items[i] = deque->items[(deque->head + i) &
+						(deque->capacity - 1)];
+
+		free(deque->items);
+		deque->items = items;
+		deque->capacity *= 2;
+		deque->head = 0;
+		deque->tail = count;
+	}
+
+	deque->items[deque->tail & (deque->capacity - 1)] = item;
+	deque->tail++;
+
+	pthread_mutex_unlock(&deque->lock);
+
+	return 0;
+}
+
+/* Take an item from the tail (owner) or from the head (thief). */
+static struct scan_item *deque_pop(struct scan_deque *deque, bool steal)
+{
+	struct scan_item *item = NULL;
+
+	pthread_mutex_lock(&deque->lock);
+
+	if (deque->head != deque->tail) {
+		if (steal) {
+			item = deque->items[deque->head &
+					    (deque->capacity - 1)];
+			deque->head++;
+		} else {
+			deque->tail--;
+			item = deque->items[deque->tail &
+					    (deque->capacity - 1)];
+		}
+	}
+
+	pthread_mutex_unlock(&deque->lock);
+
+	return item;
+}
+
+/* Queue an item on a worker's deque, and wake up an idle worker. */
+static int scan_push(struct scan *scan, struct scan_worker *worker,
+		     struct scan_item *item)
+{
+	int rc;
+
+	__atomic_add_fetch(&scan->pending, 1, __ATOMIC_SEQ_CST);
+
+	rc = deque_push(&worker->deque, item);
+	if (rc) {
+		__atomic_sub_fetch(&scan->pending, 1, __ATOMIC_SEQ_CST);
+		return rc;
+	}
+
+	__atomic_add_fetch(&scan->queued, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&scan->idle, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&scan->idle_lock);
+		pthread_cond_signal(&scan->idle_cv);
+		pthread_mutex_unlock(&scan->idle_lock);
+	}
+
+	return 0;
+}
+
+/* Get an item from the worker's deque, or steal one. */
+static struct scan_item *scan_pop(struct scan *scan, unsigned int self)
+{
+	struct scan_item *item;
+	unsigned int i;
+
+	item = deque_pop(&scan->workers[self].deque, false);
+
+	for (i = 1; item == NULL && i < scan->num_workers; i++)
+		item = deque_pop(&scan->workers[(self + i) %
+						 scan->num_workers].deque,
+				 true);
+
+	if (item != NULL)
+		__atomic_sub_fetch(&scan->queued, 1, __ATOMIC_SEQ_CST);
+
+	return item;
+}
+
+/* An item has been processed. Wake up everybody if it was the last
+ * one. */
+static void scan_item_done(struct scan *scan, struct scan_item *item)
+{
+	free_item(item);
+
+	if (__atomic_sub_fetch(&scan->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+		pthread_mutex_lock(&scan->idle_lock);
+		pthread_cond_broadcast(&scan->idle_cv);
+		pthread_mutex_unlock(&scan->idle_lock);
+	}
+}
+
+/* Queue a directory to read. Takes ownership of path. */
+static int push_dir(struct scan *scan, struct scan_worker *worker,
+		    char *path, unsigned int depth)
+{
+	struct scan_item *item;
+	int rc;
+
+	item = malloc(sizeof(*item));
+	if (item == NULL) {
+		free(path);
+		return -ENOMEM;
+	}
+
+	item->type = SCAN_ITEM_DIR;
+	item->path = path;
+	item->depth = depth;
+
+	rc = scan_push(scan, worker, item);
+	if (rc)
+		free_item(item);
+
+	return rc;
+}
+
+/* Retrieve the information requested on an entry. Failures only
+ * leave the corresponding bit unset in entry->valid. */
+static void get_entry_info(struct scan *scan, int dir_fd,
+			   struct lus_scan_entry *entry)
+{
+	unsigned int flags = scan->flags;
+	bool has_fd_ops;
+	int fd = -1;
+
+	/* FIDs and HSM states can only be retrieved from an opened
+	 * file, and only regular files and directories can be opened
+	 * without side effects. */
+	has_fd_ops = (flags & (LUS_SCAN_FID | LUS_SCAN_HSM)) &&
+		(entry->type == DT_REG || entry->type == DT_DIR);
+
+	if (has_fd_ops)
+		fd = openat(dir_fd, entry->name,
+			    O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_NOCTTY |
+			    O_CLOEXEC);
+
+	if (flags & LUS_SCAN_STAT) {
+		if (fd != -1) {
+			if (fstat(fd, &entry->st) == 0)
+				entry->valid |= LUS_SCAN_STAT;
+		} else if (!(entry->valid & LUS_SCAN_STAT)) {
+			if (fstatat(dir_fd, entry->name, &entry->st,
+				    AT_SYMLINK_NOFOLLOW) == 0)
+				entry->valid |= LUS_SCAN_STAT;
+		}
+	}
+
+	if (flags & LUS_SCAN_FID) {
+		if (fd != -1) {
+			if (lus_fd2fid(fd, &entry->fid) == 0)
+				entry->valid |= LUS_SCAN_FID;
+		} else if (!has_fd_ops) {
+			if (lus_path2fid(entry->path, &entry->fid) == 0)
+				entry->valid |= LUS_SCAN_FID;
+		}
+	}
+
+	if ((flags & LUS_SCAN_HSM) && fd != -1) {
+		if (lus_hsm_state_get_fd(fd, &entry->hsm) == 0)
+			entry->valid |= LUS_SCAN_HSM;
+	}
+
+	if ((flags & LUS_SCAN_LAYOUT) &&
+	    (entry->type == DT_REG || entry->type == DT_DIR)) {
+		int rc;
+
+		if (fd != -1)
+			rc = lus_layout_get_by_fd(fd, &entry->layout);
+		else
+			rc = lus_layout_get_by_name(dir_fd, entry->name,
+						    &entry->layout);
+		if (rc == 0)
+			entry->valid |= LUS_SCAN_LAYOUT;
+	}
+
+	if (fd != -1)
+		close(fd);
+}
+
+/* Process one entry of a batch. */
+static void scan_entry(struct scan *scan, struct scan_worker *worker,
+		       struct scan_dir *dir,
+		       const struct linux_dirent64 *dirent)
+{
+	struct lus_scan_entry entry;
+	size_t name_len;
+	char *path;
+	int rc;
+
+	name_len = strlen(dirent->d_name);
+	if (dir->path_len + 1 + name_len >= sizeof(worker->path)) {
+		log_msg(LUS_LOG_WARN, ENAMETOOLONG,
+			"cannot scan '%s/%s'", dir->path, dirent->d_name);
+		return;
+	}
+
+	memcpy(worker->path, dir->path, dir->path_len);
+	worker->path[dir->path_len] = '/';
+	memcpy(&worker->path[dir->path_len + 1], dirent->d_name,
+	       name_len + 1);
+
+	memset(&entry, 0, sizeof(entry));
+	entry.path = worker->path;
+	entry.name = &worker->path[dir->path_len + 1];
+	entry.dir_fd = dir->fd;
+	entry.depth = dir->depth;
+	entry.type = dirent->d_type;
+
+	/* Some filesystems don't return the type. */
+	if (entry.type == DT_UNKNOWN) {
+		if (fstatat(dir->fd, entry.name, &entry.st,
+			    AT_SYMLINK_NOFOLLOW) == 0) {
+			entry.type = IFTODT(entry.st.st_mode);
+			entry.valid |= LUS_SCAN_STAT;
+		}
+	}
+
+	get_entry_info(scan, dir->fd, &entry);
+
+	rc = scan->cb(&entry, scan->cb_arg);
+
+	lus_layout_free(entry.layout);
+
+	if (rc < 0) {
+		scan_set_error(scan, rc);
+		return;
+	}
+
+	if (entry.type != DT_DIR || rc == LUS_SCAN_SKIP)
+		return;
+
+	path = strdup(worker->path);
+	if (path == NULL) {
+		scan_set_error(scan, -ENOMEM);
+		return;
+	}
+
+	rc = push_dir(scan, worker, path, dir->depth + 1);
+	if (rc)
+		scan_set_error(scan, rc);
+}
+
+static void scan_batch(struct scan *scan, struct scan_worker *worker,
+		       const struct scan_item *item)
+{
+	const struct linux_dirent64 *dirent;
+	size_t pos;
+
+	for (pos = 0; pos < item->len && !scan_stopped(scan);
+	     pos += dirent->d_reclen) {
+		dirent = (const struct linux_dirent64 *)&item->buf[pos];
+
+		if (strcmp(dirent->d_name, ".") == 0 ||
+		    strcmp(dirent->d_name, "..") == 0)
+			continue;
+
+		scan_entry(scan, worker, item->dir, dirent);
+	}
+}
+
+/* Read a directory, and queue its entries by batches. */
+static void scan_read_dir(struct scan *scan, struct scan_worker *worker,
+			  const struct scan_item *item)
+{
+	struct scan_item *batch;
+	int flags;
+	struct scan_dir *dir;
+	size_t path_len;
+	ssize_t len;
+	int rc;
+
+	path_len = strlen(item->path);
+	dir = malloc(sizeof(*dir) + path_len + 1);
+	if (dir == NULL) {
+		scan_set_error(scan, -ENOMEM);
+		return;
+	}
+
+	/* The root may be a symlink. Subdirectories are not followed,
+	 * since they were seen as directories. */
+	flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+	if (item->depth > 0)
+		flags |= O_NOFOLLOW;
+
+	dir->fd = open(item->path, flags);
+	if (dir->fd == -1) {
+		/* Directories can be removed or replaced while the
+		 * scan is running. */
+		if (errno != ENOENT)
+			log_msg(LUS_LOG_WARN, errno, "cannot open '%s'",
+				item->path);
+		free(dir);
+		return;
+	}
+
+	dir->refcount = 1;
+	dir->depth = item->depth;
+	memcpy(dir->path, item->path, path_len + 1);
+
+	/* Entries of / are /name, not //name. */
+	dir->path_len = strcmp(dir->path, "/") == 0 ? 0 : path_len;
+
+	while (!scan_stopped(scan)) {
+		batch = malloc(sizeof(*batch));
+		if (batch != NULL)
+			batch->buf = malloc(SCAN_BUF_SIZE);
+		if (batch == NULL || batch->buf == NULL) {
+			free(batch);
+			scan_set_error(scan, -ENOMEM);
+			break;
+		}
+
+		len = syscall(SYS_getdents64, dir->fd, batch->buf,
+			      SCAN_BUF_SIZE);
+		if (len <= 0) {
+			if (len == -1)
+				log_msg(LUS_LOG_WARN, errno,
+					"cannot read '%s'", dir->path);
+			free(batch->buf);
+			free(batch);
+			break;
+		}
+
+		batch->type = SCAN_ITEM_BATCH;
+		batch->len = len;
+		batch->dir = dir;
+		__atomic_add_fetch(&dir->refcount, 1, __ATOMIC_RELAXED);
+
+		/* Don't get too far ahead of the other workers. */
+		if (__atomic_load_n(&scan->queued, __ATOMIC_RELAXED) >
+		    SCAN_MAX_QUEUED * scan->num_workers) {
+			scan_batch(scan, worker, batch);
+			free_item(batch);
+			continue;
+		}
+
+		rc = scan_push(scan, worker, batch);
+		if (rc) {
+			free_item(batch);
+			scan_set_error(scan, rc);
+			break;
+		}
+	}
+
+	scan_dir_put(dir);
+}
+
+static void scan_item(struct scan *scan, unsigned int self,
+		      struct scan_item *item)
+{
+	if (!scan_stopped(scan)) {
+		if (item->type == SCAN_ITEM_DIR)
+			scan_read_dir(scan, &scan->workers[self], item);
+		else
+			scan_batch(scan, &scan->workers[self], item);
+	}
+
+	scan_item_done(scan, item);
+}
+
+/* Worker main loop, run by the thread pool once per worker. */
+static void scan_worker(void *arg, size_t idx)
+{
+	struct scan *scan = arg;
+	struct scan_item *item;
+
+	while (1) {
+		item = scan_pop(scan, idx);
+		if (item != NULL) {
+			scan_item(scan, idx, item);
+			continue;
+		}
+
+		pthread_mutex_lock(&scan->idle_lock);
+		__atomic_add_fetch(&scan->idle, 1, __ATOMIC_SEQ_CST);
+
+		while (__atomic_load_n(&scan->queued, __ATOMIC_SEQ_CST) == 0 &&
+		       __atomic_load_n(&scan->pending, __ATOMIC_SEQ_CST) > 0 &&
+		       !scan_stopped(scan))
+			pthread_cond_wait(&scan->idle_cv, &scan->idle_lock);
+
+		__atomic_sub_fetch(&scan->idle, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&scan->idle_lock);
+
+		/* Once stopped, the remaining items are dropped. */
+		if (__atomic_load_n(&scan->pending, __ATOMIC_SEQ_CST) == 0 ||
+		    scan_stopped(scan))
+			break;
+	}
+}
+
+/**
+ * Walk a directory tree in parallel.
+ *
+ * The callback is called once for every entry below root, but not for
+ * root itself, with the information requested by flags. Entries are
+ * reported in no particular order, from several threads at once. The
+ * entry and the strings it points to are only valid during the
+ * call. A directory is not descended into if the callback returns
+ * LUS_SCAN_SKIP for it, and the scan stops if it returns a negative
+ * errno.
+ *
+ * Failing to get some information about an entry is not an error; the
+ * information is then just missing from entry->valid. Directories that
+ * cannot be read are skipped.
+ *
+ * \param[in]  lfsh     An opaque handle returned by lus_open_fs(), or
+ *                      NULL to scan a non-Lustre tree
+ * \param[in]  root     the directory to scan
+ * \param[in]  flags    or'ed LUS_SCAN_* information needed
+ * \param[in]  threads  number of threads, including the caller's. If 0,
+ *                      the number set with lus_set_thread_count() is
+ *                      used.
+ * \param[in]  cb       function called for every entry
+ * \param[in]  cb_arg   argument passed to cb
+ *
+ * \retval   0 on success
+ * \retval   the negative value returned by the callback
+ * \retval   a negative errno on other errors
+ */
+int lus_scan(const struct lus_fs_handle *lfsh, const char *root,
+	     unsigned int flags, unsigned int threads,
+	     lus_scan_cb_t cb, void *cb_arg)
+{
+	struct thread_pool *pool = NULL;
+	struct scan scan = {
+		.flags = flags,
+		.cb = cb,
+		.cb_arg = cb_arg,
+		.idle_lock = PTHREAD_MUTEX_INITIALIZER,
+		.idle_cv = PTHREAD_COND_INITIALIZER,
+	};
+	struct stat st;
+	char *path;
+	size_t len;
+	unsigned int i;
+	int rc;
+
+	if (flags & ~LUS_SCAN_ALL)
+		return -EINVAL;
+
+	if (threads == 0)
+		threads = lfsh != NULL ? thread_pool_width(lfsh->pool) :
+			FS_DEFAULT_THREAD_COUNT;
+
+	if (threads > 256)
+		return -EINVAL;
+
+	if (stat(root, &st) == -1)
+		return -errno;
+
+	if (!S_ISDIR(st.st_mode))
+		return -ENOTDIR;
+
+	/* Entries are reported as root/name. */
+	path = strdup(root);
+	if (path == NULL)
+		return -ENOMEM;
+
+	len = strlen(path);
+	while (len > 1 && path[len - 1] == '/')
+		path[--len] = '\0';
+
+	scan.workers = calloc(threads, sizeof(*scan.workers));
+	if (scan.workers == NULL) {
+		free(path);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < threads; i++) {
+		rc = deque_init(&scan.workers[i].deque);
+		if (rc) {
+			free(path);
+			goto out;
+		}
+		scan.num_workers++;
+	}
+
+	rc = thread_pool_create(threads - 1, &pool);
+	if (rc) {
+		free(path);
+		goto out;
+	}
+
+	rc = push_dir(&scan, &scan.workers[0], path, 0);
+	if (rc)
+		goto out;
+
+	thread_pool_run(pool, threads, scan_worker, &scan);
+
+	rc = scan.error;
+
+out:
+	thread_pool_destroy(pool);
+
+	for (i = 0; i < scan.num_workers; i++)
+		deque_fini(&scan.workers[i].deque);
+	free(scan.workers);
+
+	pthread_cond_destroy(&scan.idle_cv);
+	pthread_mutex_destroy(&scan.idle_lock);
+
+	return rc;
+}
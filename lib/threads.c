@@ -0,0 +1,283 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Worker threads used by the batched interfaces
+ *
+ * A pool runs one job at a time. A job is a function applied to the
+ * indexes 0 to count-1. The items are handed out to the workers and
+ * to the calling thread through a shared counter, so a slow ioctl
+ * doesn't hold back the rest of the batch.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+struct thread_pool {
+	/* Serializes the jobs. */
+	pthread_mutex_t run_lock;
+
+	/* Protects the fields below. */
+	pthread_mutex_t lock;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+
+	/* Also read without the lock, atomically. */
+	unsigned int max_threads;
+	unsigned int num_threads;
+	pthread_t *threads;
+	bool stopping;
+
+	/* Incremented for every new job. */
+	unsigned long generation;
+
+	/* Current job */
+	thread_pool_fn_t fn;
+	void *arg;
+	size_t count;
+	size_t next;
+	unsigned int active;
+};
+
+/* Process items from the current job until there is none left. */
+static void run_items(struct thread_pool *pool)
+{
+	size_t idx;
+
+	while ((idx = __atomic_fetch_add(&pool->next, 1,
+					 __ATOMIC_RELAXED)) < pool->count)
+		pool->fn(pool->arg, idx);
+}
+
+static void *worker_thread(void *arg)
+{
+	struct thread_pool *pool = arg;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (1) {
+		while (!pool->stopping && pool->generation == seen)
+			pthread_cond_wait(&pool->work_cv, &pool->lock);
+
+		if (pool->stopping)
+			break;
+
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		run_items(pool);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->active--;
+		if (pool->active == 0)
+			pthread_cond_signal(&pool->done_cv);
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/**
+ * Allocate a pool of worker threads. The threads are only started
+ * when the first job is run, so an unused pool is cheap.
+ *
+ * \param[in]   max_threads   number of worker threads
+ * \param[out]  pool          the new pool
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int thread_pool_create(unsigned int max_threads, struct thread_pool **pool)
+{
+	struct thread_pool *mypool;
+
+	mypool = calloc(1, sizeof(*mypool));
+	if (mypool == NULL)
+		return -ENOMEM;
+
+	mypool->threads = calloc(max_threads, sizeof(pthread_t));
+	if (mypool->threads == NULL && max_threads != 0) {
+		free(mypool);
+		return -ENOMEM;
+	}
+
+	mypool->max_threads = max_threads;
+	pthread_mutex_init(&mypool->run_lock, NULL);
+	pthread_mutex_init(&mypool->lock, NULL);
+	pthread_cond_init(&mypool->work_cv, NULL);
+	pthread_cond_init(&mypool->done_cv, NULL);
+
+	*pool = mypool;
+
+	return 0;
+}
+
+/**
+ * Stop the worker threads and free the pool. No job may be running.
+ *
+ * \param[in]  pool     the pool to destroy. Can be NULL.
+ */
+void thread_pool_destroy(struct thread_pool *pool)
+{
+	unsigned int i;
+
+	if (pool == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cv);
+	pthread_cond_destroy(&pool->work_cv);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_mutex_destroy(&pool->run_lock);
+	free(pool->threads);
+	free(pool);
+}
+
+/**
+ * Change the number of worker threads of a pool. This waits for the
+ * current job, if any, to complete. The new workers are started on
+ * the next job.
+ *
+ * \param[in]  pool          the pool to resize
+ * \param[in]  max_threads   new number of worker threads
+ *
+ * \retval   0 on success
+ * \retval   a negative errno on error
+ */
+int thread_pool_resize(struct thread_pool *pool, unsigned int max_threads)
+{
+	pthread_t *threads;
+	unsigned int i;
+
+	threads = calloc(max_threads, sizeof(pthread_t));
+	if (threads == NULL && max_threads != 0)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&pool->run_lock);
+
+	/* Stop the current workers. */
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_lock(&pool->lock);
+	free(pool->threads);
+	pool->threads = threads;
+	pool->num_threads = 0;
+	pool->stopping = false;
+	pool->generation = 0;
+	__atomic_store_n(&pool->max_threads, max_threads, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_unlock(&pool->run_lock);
+
+	return 0;
+}
+
+/**
+ * Return the number of threads the pool will use, including the
+ * caller's.
+ */
+unsigned int thread_pool_width(const struct thread_pool *pool)
+{
+	if (pool == NULL)
+		return 1;
+
+	return __atomic_load_n(&pool->max_threads, __ATOMIC_RELAXED) + 1;
+}
+
+/**
+ * Call fn(arg, idx) for every idx in [0, count) and wait for all the
+ * calls to complete. The calling thread takes part in the work.
+ *
+ * If the pool is NULL, or if it is already busy with another job
+ * (e.g. a concurrent caller, or fn itself running a batch), the items
+ * are processed in the calling thread only.
+ *
+ * \param[in]  pool    a pool created by thread_pool_create(), or NULL
+ * \param[in]  count   number of items
+ * \param[in]  fn      function to call for each item
+ * \param[in]  arg     argument passed to fn
+ */
+void thread_pool_run(struct thread_pool *pool, size_t count,
+		     thread_pool_fn_t fn, void *arg)
+{
+	size_t i;
+
+	if (pool == NULL || count <= 1 ||
+	    __atomic_load_n(&pool->max_threads, __ATOMIC_RELAXED) == 0 ||
+	    pthread_mutex_trylock(&pool->run_lock) != 0) {
+		for (i = 0; i < count; i++)
+			fn(arg, i);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+
+	/* Start the workers on the first job. They will wait for the
+	 * generation to move from 0. */
+	if (pool->generation == 0) {
+		while (pool->num_threads < pool->max_threads) {
+			if (pthread_create(&pool->threads[pool->num_threads],
+					   NULL, worker_thread, pool) != 0) {
+				log_msg(LUS_LOG_WARN, 0,
+					"could only start %u worker threads",
+					pool->num_threads);
+				__atomic_store_n(&pool->max_threads,
+						 pool->num_threads,
+						 __ATOMIC_RELAXED);
+				break;
+			}
+			pool->num_threads++;
+		}
+	}
+
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->count = count;
+	pool->next = 0;
+	pool->active = pool->num_threads;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cv);
+	pthread_mutex_unlock(&pool->lock);
+
+	run_items(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->active > 0)
+		pthread_cond_wait(&pool->done_cv, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_unlock(&pool->run_lock);
+}
@@ -0,0 +1,410 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * @brief Pools of pre-created volatile files, one per MDT
+ *
+ * Creating a volatile file is an MDT round trip. A copytool pays it
+ * at the start of every restore, before any data can be copied. A
+ * pool keeps a few volatile files already opened on an MDT, and a
+ * helper thread creates new ones in the background as they are
+ * claimed.
+ *
+ * The volatile files are created at the root of the filesystem, so
+ * they get the default layout of the filesystem rather than the one
+ * of the restored file's directory.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "internal.h"
+
+/* Delay before trying again after a failed creation. */
+#define VOLATILE_POOL_RETRY_SEC 1
+
+struct volatile_entry {
+	int fd;
+	lustre_fid fid;
+};
+
+/* The volatile files of one MDT, used as a stack. */
+struct volatile_mdt {
+	unsigned int mdt_index;
+	int open_flags;
+	unsigned int size;
+	unsigned int count;
+	struct volatile_entry *entries;
+};
+
+typedef int (*volatile_create_fn_t)(const struct lus_fs_handle *lfsh,
+				    unsigned int mdt_index, int open_flags,
+				    lustre_fid *fid);
+
+struct volatile_pool {
+	const struct lus_fs_handle *lfsh;
+
+	/* Protects everything below. */
+	pthread_mutex_t lock;
+
+	/* Wakes the helper thread when a file is claimed. */
+	pthread_cond_t refill;
+
+	bool thread_started;
+	bool stop;
+	pthread_t thread;
+
+	unsigned int num_mdts;
+	struct volatile_mdt *mdts;
+
+	uint64_t hits;
+	uint64_t misses;
+
+	/* Creates a volatile file. Replaced by the unit tests. */
+	volatile_create_fn_t create;
+};
+
+static int volatile_create(const struct lus_fs_handle *lfsh,
+			   unsigned int mdt_index, int open_flags,
+			   lustre_fid *fid)
+{
+	int fd;
+	int rc;
+
+	fd = lus_create_volatile_by_fid(lfsh, NULL, mdt_index, open_flags,
+					S_IRUSR | S_IWUSR, NULL);
+	if (fd < 0)
+		return fd;
+
+	rc = lus_fd2fid(fd, fid);
+	if (rc < 0) {
+		close(fd);
+		return rc;
+	}
+
+	return fd;
+}
+
+/* Return the pool of an MDT, or NULL. Must be called with the lock
+ * held. */
+static struct volatile_mdt *find_mdt(struct volatile_pool *pool,
+				     unsigned int mdt_index, int open_flags)
+{
+	unsigned int i;
+
+	for (i = 0; i < pool->num_mdts; i++) {
+		if (pool->mdts[i].mdt_index == mdt_index &&
+		    pool->mdts[i].open_flags == open_flags)
+			return &pool->mdts[i];
+	}
+
+	return NULL;
+}
+
+/* Return the first MDT needing more files, or NULL. Must be called
+ * with the lock held. */
+static struct volatile_mdt *find_mdt_to_fill(struct volatile_pool *pool)
+{
+	unsigned int i;
+
+	for (i = 0; i < pool->num_mdts; i++) {
+		if (pool->mdts[i].count < pool->mdts[i].size)
+			return &pool->mdts[i];
+	}
+
+	return NULL;
+}
+
+/* The helper thread. It creates the volatile files one at a time,
+ * without holding the lock, so the restores are never delayed by a
+ * creation in progress. */
+static void *volatile_pool_thread(void *arg)
+{
+	struct volatile_pool *pool = arg;
+	struct volatile_mdt *mdt;
+	struct timespec ts;
+	unsigned int mdt_index;
+	lustre_fid fid;
+	int open_flags;
+	int fd;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (!pool->stop) {
+		mdt = find_mdt_to_fill(pool);
+		if (mdt == NULL) {
+			pthread_cond_wait(&pool->refill, &pool->lock);
+			continue;
+		}
+
+		/* The MDT array may be reallocated while unlocked. */
+		mdt_index = mdt->mdt_index;
+		open_flags = mdt->open_flags;
+
+		pthread_mutex_unlock(&pool->lock);
+		fd = pool->create(pool->lfsh, mdt_index, open_flags, &fid);
+		pthread_mutex_lock(&pool->lock);
+
+		if (fd < 0) {
+			log_msg(LUS_LOG_ERROR, fd,
+				"cannot create a volatile file on MDT %u",
+				mdt_index);
+
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += VOLATILE_POOL_RETRY_SEC;
+			if (!pool->stop)
+				pthread_cond_timedwait(&pool->refill,
+						       &pool->lock, &ts);
+			continue;
+		}
+
+		mdt = find_mdt(pool, mdt_index, open_flags);
+		if (pool->stop || mdt->count == mdt->size) {
+			close(fd);
+			continue;
+		}
+
+		mdt->entries[mdt->count].fd = fd;
+		mdt->entries[mdt->count].fid = fid;
+		mdt->count++;
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+/**
+ * Create an empty pool of volatile files. MDTs are added with
+ * volatile_pool_add_mdt().
+ *
+ * \param[in]   lfsh   an opened Lustre fs opaque handle
+ * \param[out]  pool   the new pool
+ *
+ * \retval   0 on success
+ * \retval   -ENOMEM
+ */
+int volatile_pool_create(const struct lus_fs_handle *lfsh,
+			 struct volatile_pool **pool)
+{
+	struct volatile_pool *p;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return -ENOMEM;
+
+	p->lfsh = lfsh;
+	p->create = volatile_create;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->refill, NULL);
+
+	*pool = p;
+
+	return 0;
+}
+
+/**
+ * Keep up to \a size volatile files opened on an MDT. The helper
+ * thread is started with the first MDT, and starts filling the pool
+ * right away.
+ *
+ * \param[in]  pool        the pool
+ * \param[in]  mdt_index   the MDT index
+ * \param[in]  size        number of files to keep, from 1 to
+ *                         VOLATILE_POOL_MAX_SIZE
+ * \param[in]  open_flags  extra open flags of the volatile files, such
+ *                         as O_LOV_DELAY_CREATE
+ *
+ * \retval   0 on success
+ * \retval   -EEXIST if the MDT already has a pool
+ * \retval   a negative errno on other errors
+ */
+int volatile_pool_add_mdt(struct volatile_pool *pool, unsigned int mdt_index,
+			  unsigned int size, int open_flags)
+{
+	struct volatile_entry *entries;
+	struct volatile_mdt *mdts;
+	unsigned int i;
+	int rc;
+
+	if (size == 0 || size > VOLATILE_POOL_MAX_SIZE)
+		return -EINVAL;
+
+	entries = calloc(size, sizeof(*entries));
+	if (entries == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_lock(&pool->lock);
+
+	for (i = 0; i < pool->num_mdts; i++) {
+		if (pool->mdts[i].mdt_index == mdt_index) {
+			rc = -EEXIST;
+			goto out_free;
+		}
+	}
+
+	mdts = realloc(pool->mdts, (pool->num_mdts + 1) * sizeof(*mdts));
+	if (mdts == NULL) {
+		rc = -ENOMEM;
+		goto out_free;
+	}
+	pool->mdts = mdts;
+
+	if (!pool->thread_started) {
+		rc = pthread_create(&pool->thread, NULL, volatile_pool_thread,
+				    pool);
+		if (rc) {
+			rc = -rc;
+			goto out_free;
+		}
+		pool->thread_started = true;
+	}
+
+	mdts[pool->num_mdts] = (struct volatile_mdt) {
+		.mdt_index = mdt_index,
+		.open_flags = open_flags,
+		.size = size,
+		.entries = entries,
+	};
+	pool->num_mdts++;
+
+	pthread_cond_signal(&pool->refill);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+
+out_free:
+	pthread_mutex_unlock(&pool->lock);
+	free(entries);
+
+	return rc;
+}
+
+/**
+ * Claim a volatile file of an MDT. The helper thread is woken up to
+ * replace it.
+ *
+ * \param[in]   pool        the pool, or NULL
+ * \param[in]   mdt_index   the MDT index
+ * \param[in]   open_flags  the extra open flags that the file must
+ *                          have been created with
+ * \param[out]  fid         the FID of the volatile file
+ *
+ * \retval   an opened file descriptor, now owned by the caller
+ * \retval   -ENOENT if no file is available
+ */
+int volatile_pool_get(struct volatile_pool *pool, unsigned int mdt_index,
+		      int open_flags, lustre_fid *fid)
+{
+	struct volatile_mdt *mdt;
+	int fd = -ENOENT;
+
+	if (pool == NULL)
+		return -ENOENT;
+
+	pthread_mutex_lock(&pool->lock);
+
+	mdt = find_mdt(pool, mdt_index, open_flags);
+	if (mdt != NULL && mdt->count > 0) {
+		mdt->count--;
+		fd = mdt->entries[mdt->count].fd;
+		*fid = mdt->entries[mdt->count].fid;
+		pthread_cond_signal(&pool->refill);
+	}
+
+	if (fd >= 0)
+		pool->hits++;
+	else
+		pool->misses++;
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return fd;
+}
+
+/**
+ * Return the pool statistics.
+ *
+ * \param[in]   pool    the pool, or NULL
+ * \param[out]  stats   the statistics
+ */
+void volatile_pool_get_stats(struct volatile_pool *pool,
+			     struct lus_volatile_pool_stats *stats)
+{
+	unsigned int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (pool == NULL)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+
+	stats->hits = pool->hits;
+	stats->misses = pool->misses;
+	for (i = 0; i < pool->num_mdts; i++) {
+		stats->available += pool->mdts[i].count;
+		stats->capacity += pool->mdts[i].size;
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Stop the helper thread, close the unused volatile files, which
+ * destroys them, and free the pool.
+ *
+ * \param[in]  pool   the pool, or NULL
+ */
+void volatile_pool_destroy(struct volatile_pool *pool)
+{
+	struct volatile_mdt *mdt;
+	unsigned int i;
+
+	if (pool == NULL)
+		return;
+
+	if (pool->thread_started) {
+		pthread_mutex_lock(&pool->lock);
+		pool->stop = true;
+		pthread_cond_signal(&pool->refill);
+		pthread_mutex_unlock(&pool->lock);
+
+		pthread_join(pool->thread, NULL);
+	}
+
+	for (i = 0; i < pool->num_mdts; i++) {
+		mdt = &pool->mdts[i];
+
+		while (mdt->count > 0) {
+			mdt->count--;
+			close(mdt->entries[mdt->count].fd);
+		}
+		free(mdt->entries);
+	}
+
+	free(pool->mdts);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->refill);
+	free(pool);
+}
@@ -0,0 +1,218 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Compare the synchronous statx and open by FID with the asynchronous
+ * requests, using both backends.
+ *
+ * Creates a directory with some files on Lustre, retrieves their
+ * FIDs, then stats them, and opens and closes them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+static struct lus_async_ctx *ctx;
+static unsigned int errors;
+
+static void count_error(void *cb_arg, int result)
+{
+	if (result < 0)
+		errors++;
+}
+
+/* Close the file as soon as it is opened. */
+static void close_opened(void *cb_arg, int result)
+{
+	int rc;
+
+	if (result < 0) {
+		errors++;
+		return;
+	}
+
+	rc = lus_async_close(ctx, result, count_error, NULL);
+	if (rc)
+		errors++;
+}
+
+static void run_async(struct lus_fs_handle *lfsh, unsigned int depth,
+		      unsigned int flags, const lustre_fid *fids,
+		      size_t count, struct statx *stxs)
+{
+	char name[64];
+	double start;
+	size_t i;
+	int rc;
+
+	rc = lus_async_ctx_create(lfsh, depth, flags, &ctx);
+	if (rc) {
+		fprintf(stderr, "cannot create async context: %s\n",
+			strerror(-rc));
+		return;
+	}
+
+	errors = 0;
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		rc = lus_async_statx_by_fid(ctx, &fids[i], STATX_BASIC_STATS,
+					    &stxs[i], count_error, NULL);
+		if (rc)
+			errors++;
+	}
+	lus_async_poll(ctx, UINT_MAX);
+	snprintf(name, sizeof(name), "async statx (%s)",
+		 lus_async_backend(ctx));
+	bench_report(name, count, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		rc = lus_async_open_by_fid(ctx, &fids[i], O_RDONLY,
+					   close_opened, NULL);
+		if (rc)
+			errors++;
+	}
+	while (lus_async_inflight(ctx) > 0)
+		lus_async_poll(ctx, UINT_MAX);
+	snprintf(name, sizeof(name), "async open+close (%s)",
+		 lus_async_backend(ctx));
+	bench_report(name, count, bench_now() - start);
+
+	if (errors)
+		fprintf(stderr, "%u requests failed\n", errors);
+
+	lus_async_ctx_destroy(ctx);
+	ctx = NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *lustre_dir = "/mnt/lustre";
+	struct lus_fs_handle *lfsh;
+	unsigned int depth = 256;
+	size_t count = 10000;
+	char dir[PATH_MAX];
+	char fname[PATH_MAX];
+	struct statx *stxs;
+	lustre_fid *fids;
+	double start;
+	size_t i;
+	int opt;
+	int fd;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "d:n:q:")) != -1) {
+		switch (opt) {
+		case 'd':
+			lustre_dir = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d lustre_dir] [-n files] [-q depth]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	if (rc) {
+		fprintf(stderr, "cannot open '%s': %s\n",
+			lustre_dir, strerror(-rc));
+		return EXIT_FAILURE;
+	}
+
+	fids = calloc(count, sizeof(*fids));
+	stxs = calloc(count, sizeof(*stxs));
+	if (fids == NULL || stxs == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/async_bench.%d",
+		 lustre_dir, getpid());
+	if (mkdir(dir, 0700) == -1) {
+		fprintf(stderr, "cannot create '%s': %s\n",
+			dir, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < count; i++) {
+		snprintf(fname, sizeof(fname), "%s/f%zu", dir, i);
+		fd = open(fname, O_CREAT | O_WRONLY, 0600);
+		if (fd == -1) {
+			fprintf(stderr, "cannot create '%s': %s\n",
+				fname, strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		rc = lus_fd2fid(fd, &fids[i]);
+		close(fd);
+		if (rc) {
+			fprintf(stderr, "cannot get FID of '%s': %s\n",
+				fname, strerror(-rc));
+			return EXIT_FAILURE;
+		}
+	}
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		rc = lus_statx_by_fid(lfsh, &fids[i], STATX_BASIC_STATS,
+				      &stxs[i]);
+		if (rc)
+			fprintf(stderr, "statx failed: %s\n", strerror(-rc));
+	}
+	bench_report("lus_statx_by_fid loop", count, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		fd = lus_open_by_fid(lfsh, &fids[i], O_RDONLY);
+		if (fd < 0)
+			fprintf(stderr, "open failed: %s\n", strerror(-fd));
+		else
+			close(fd);
+	}
+	bench_report("lus_open_by_fid+close loop", count,
+		     bench_now() - start);
+
+	run_async(lfsh, depth, LUS_ASYNC_THREADS, fids, count, stxs);
+	run_async(lfsh, depth, 0, fids, count, stxs);
+
+	for (i = 0; i < count; i++) {
+		snprintf(fname, sizeof(fname), "%s/f%zu", dir, i);
+		unlink(fname);
+	}
+	rmdir(dir);
+
+	free(stxs);
+	free(fids);
+	lus_close_fs(lfsh);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+/* Helpers for the benchmark programs. */
+
+#include <time.h>
+
+/* Return the current time, in seconds. */
+static inline double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Print one result line. */
+static inline void bench_report(const char *name, size_t count,
+				double elapsed)
+{
+	printf("%-30s %10zu ops %10.3f s %12.0f ops/s\n",
+	       name, count, elapsed, elapsed > 0 ? count / elapsed : 0);
+}
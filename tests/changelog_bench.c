@@ -0,0 +1,285 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Replay a synthetic changelog, and compare processing the records
+ * one by one with lus_changelog_dispatch() and an increasing number
+ * of workers.
+ *
+ * The records are written to a temporary file in the format sent by
+ * the MDT, then read back with lus_changelog_open_fd(); no Lustre
+ * filesystem is needed. Processing a record is simulated by spinning,
+ * or by sleeping with -S, which is closer to a consumer waiting on a
+ * database. The per-FID ordering is checked for every run.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+/* Kernel to user message header, as sent by the MDT for each
+ * record. */
+struct cl_msg_hdr {
+	__u16 magic;
+	__u8  transport;
+	__u8  flags;
+	__u16 msgtype;
+	__u16 msglen;
+} __attribute__((aligned(sizeof(__u64))));
+
+#define CL_MSG_MAGIC 0x191C
+#define CL_MSG_TRANSPORT 3
+#define CL_MSG_RECORD 10
+#define CL_MSG_EOF 11
+
+static unsigned long num_records = 1000000;
+static unsigned int num_fids = 10000;
+static unsigned int work_us = 5;
+static bool do_sleep;
+
+/* Last record seen for each FID, and number of records seen out of
+ * order. */
+static __u64 *last_index;
+static unsigned long disorders;
+
+static int make_stream(FILE *f)
+{
+	char buf[sizeof(struct cl_msg_hdr) + 512];
+	struct cl_msg_hdr *hdr = (struct cl_msg_hdr *)buf;
+	struct changelog_rec *rec = (struct changelog_rec *)(hdr + 1);
+	unsigned long i;
+	char *name;
+
+	for (i = 0; i < num_records; i++) {
+		memset(buf, 0, sizeof(buf));
+
+		rec->cr_index = i + 1;
+		rec->cr_type = i % 4 == 0 ? CL_CREATE : CL_MTIME;
+		rec->cr_flags = CLF_VERSION | CLF_RENAME;
+		rec->cr_tfid.f_seq = 0x200000400;
+		rec->cr_tfid.f_oid = (i * 7919) % num_fids;
+		rec->cr_pfid.f_seq = 0x200000400;
+		rec->cr_pfid.f_oid = num_fids;
+
+		name = changelog_rec_name(rec);
+		rec->cr_namelen = snprintf(name, 64, "file.%u",
+					   rec->cr_tfid.f_oid);
+
+		hdr->magic = CL_MSG_MAGIC;
+		hdr->transport = CL_MSG_TRANSPORT;
+		hdr->msgtype = CL_MSG_RECORD;
+		hdr->msglen = sizeof(*hdr) + changelog_rec_size(rec);
+
+		if (fwrite(buf, hdr->msglen, 1, f) != 1)
+			return -EIO;
+	}
+
+	memset(buf, 0, sizeof(*hdr));
+	hdr->magic = CL_MSG_MAGIC;
+	hdr->transport = CL_MSG_TRANSPORT;
+	hdr->msgtype = CL_MSG_EOF;
+	hdr->msglen = sizeof(*hdr);
+	if (fwrite(buf, sizeof(*hdr), 1, f) != 1)
+		return -EIO;
+
+	return fflush(f) ? -errno : 0;
+}
+
+static void do_work(void)
+{
+	struct timespec ts = { .tv_nsec = work_us * 1000 };
+	double end;
+
+	if (work_us == 0)
+		return;
+
+	if (do_sleep) {
+		nanosleep(&ts, NULL);
+		return;
+	}
+
+	end = bench_now() + work_us / 1e6;
+	while (bench_now() < end)
+		;
+}
+
+static int process_record(const struct changelog_rec *rec, void *cb_arg)
+{
+	__u64 *last = &last_index[rec->cr_tfid.f_oid];
+
+	if (rec->cr_index <= *last)
+		__atomic_add_fetch(&disorders, 1, __ATOMIC_RELAXED);
+	*last = rec->cr_index;
+
+	do_work();
+
+	return 0;
+}
+
+/* Open the recorded stream from its start. */
+static struct lus_changelog *open_stream(FILE *f)
+{
+	struct lus_changelog *cl;
+	int rc;
+
+	if (fseek(f, 0, SEEK_SET) == -1)
+		return NULL;
+
+	rc = lus_changelog_open_fd(fileno(f), &cl);
+	if (rc) {
+		fprintf(stderr, "cannot open the changelog: %s\n",
+			strerror(-rc));
+		return NULL;
+	}
+
+	memset(last_index, 0, num_fids * sizeof(*last_index));
+	disorders = 0;
+
+	return cl;
+}
+
+/* Read the records with lus_changelog_recv(), and process them or
+ * not. */
+static int run_serial(FILE *f, bool process)
+{
+	const struct changelog_rec *rec;
+	struct lus_changelog *cl;
+	unsigned long count = 0;
+	double start;
+	int rc;
+
+	cl = open_stream(f);
+	if (cl == NULL)
+		return -EIO;
+
+	start = bench_now();
+	while ((rc = lus_changelog_recv(cl, &rec)) == 0) {
+		if (process)
+			process_record(rec, NULL);
+		lus_changelog_clear(cl, rec->cr_index);
+		count++;
+	}
+	lus_changelog_close(cl);
+
+	bench_report(process ? "serial" : "read only", count,
+		     bench_now() - start);
+
+	return rc == 1 ? 0 : rc;
+}
+
+static int run_dispatch(FILE *f, unsigned int workers)
+{
+	struct lus_changelog *cl;
+	char name[64];
+	double start;
+	int rc;
+
+	cl = open_stream(f);
+	if (cl == NULL)
+		return -EIO;
+
+	start = bench_now();
+	rc = lus_changelog_dispatch(cl, workers, process_record, NULL);
+	lus_changelog_close(cl);
+
+	snprintf(name, sizeof(name), "dispatch, %u workers", workers);
+	bench_report(name, num_records, bench_now() - start);
+
+	if (disorders)
+		fprintf(stderr, "%lu records processed out of order\n",
+			disorders);
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int max_workers = 16;
+	unsigned int workers;
+	double start;
+	FILE *f;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "f:n:St:w:")) != -1) {
+		switch (opt) {
+		case 'f':
+			num_fids = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			num_records = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			do_sleep = true;
+			break;
+		case 't':
+			max_workers = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			work_us = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n records] [-f fids] [-w work_us] [-S] [-t max_workers]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (num_fids == 0 || max_workers == 0 || max_workers > 256) {
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	last_index = calloc(num_fids, sizeof(*last_index));
+	f = tmpfile();
+	if (last_index == NULL || f == NULL) {
+		fprintf(stderr, "cannot allocate\n");
+		return EXIT_FAILURE;
+	}
+
+	start = bench_now();
+	rc = make_stream(f);
+	if (rc) {
+		fprintf(stderr, "cannot write the records: %s\n",
+			strerror(-rc));
+		return EXIT_FAILURE;
+	}
+	printf("%lu records for %u FIDs written in %.3f s, %u us of %s per record\n\n",
+	       num_records, num_fids, bench_now() - start, work_us,
+	       do_sleep ? "sleep" : "work");
+
+	rc = run_serial(f, false);
+	if (rc == 0)
+		rc = run_serial(f, true);
+
+	for (workers = 1; rc == 0 && workers <= max_workers; workers *= 2)
+		rc = run_dispatch(f, workers);
+
+	if (rc)
+		fprintf(stderr, "replay failed: %s\n", strerror(-rc));
+
+	fclose(f);
+	free(last_index);
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
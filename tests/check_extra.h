@@ -31,4 +31,5 @@
 #define ck_assert_int_gt(X, Y) _ck_assert_int(X, >, Y)
 #define ck_assert_int_ge(X, Y) _ck_assert_int(X, >=, Y)
 #define ck_assert_int_lt(X, Y) _ck_assert_int(X, <, Y)
+#define ck_assert_int_le(X, Y) _ck_assert_int(X, <=, Y)
 #endif
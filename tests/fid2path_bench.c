@@ -0,0 +1,158 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Compare lus_fid2path() called in a loop with lus_fid2path_batch().
+ *
+ * Creates a directory with some files on Lustre, retrieves their
+ * FIDs, and resolve them back to paths with both methods.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+int main(int argc, char *argv[])
+{
+	const char *lustre_dir = "/mnt/lustre";
+	struct lus_fs_handle *lfsh;
+	unsigned int threads = 0;
+	size_t count = 10000;
+	char dir[PATH_MAX];
+	char fname[PATH_MAX];
+	char path[PATH_MAX];
+	lustre_fid *fids;
+	size_t *offsets;
+	int *errors;
+	char *arena;
+	size_t arena_len;
+	double start;
+	ssize_t found;
+	size_t i;
+	int opt;
+	int fd;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "d:n:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			lustre_dir = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d lustre_dir] [-n files] [-t threads]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	if (rc) {
+		fprintf(stderr, "cannot open '%s': %s\n",
+			lustre_dir, strerror(-rc));
+		return EXIT_FAILURE;
+	}
+
+	if (threads) {
+		rc = lus_set_thread_count(lfsh, threads);
+		if (rc) {
+			fprintf(stderr, "cannot set thread count: %s\n",
+				strerror(-rc));
+			return EXIT_FAILURE;
+		}
+	}
+
+	fids = calloc(count, sizeof(*fids));
+	offsets = calloc(count, sizeof(*offsets));
+	errors = calloc(count, sizeof(*errors));
+	arena_len = count * 64;
+	arena = malloc(arena_len);
+	if (fids == NULL || offsets == NULL || errors == NULL ||
+	    arena == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/fid2path_bench.%d",
+		 lustre_dir, getpid());
+	if (mkdir(dir, 0700) == -1) {
+		fprintf(stderr, "cannot create '%s': %s\n",
+			dir, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < count; i++) {
+		snprintf(fname, sizeof(fname), "%s/f%zu", dir, i);
+		fd = open(fname, O_CREAT | O_WRONLY, 0600);
+		if (fd == -1) {
+			fprintf(stderr, "cannot create '%s': %s\n",
+				fname, strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		rc = lus_fd2fid(fd, &fids[i]);
+		close(fd);
+		if (rc) {
+			fprintf(stderr, "cannot get FID of '%s': %s\n",
+				fname, strerror(-rc));
+			return EXIT_FAILURE;
+		}
+	}
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		rc = lus_fid2path(lfsh, &fids[i], path, sizeof(path),
+				  NULL, NULL);
+		if (rc)
+			fprintf(stderr, "fid2path failed: %s\n",
+				strerror(-rc));
+	}
+	bench_report("lus_fid2path loop", count, bench_now() - start);
+
+	start = bench_now();
+	found = lus_fid2path_batch(lfsh, fids, count, arena, arena_len,
+				   offsets, errors);
+	bench_report("lus_fid2path_batch", count, bench_now() - start);
+	if (found != count)
+		fprintf(stderr, "only %zd of %zu paths found\n", found, count);
+
+	for (i = 0; i < count; i++) {
+		snprintf(fname, sizeof(fname), "%s/f%zu", dir, i);
+		unlink(fname);
+	}
+	rmdir(dir);
+
+	free(arena);
+	free(errors);
+	free(offsets);
+	free(fids);
+	lus_close_fs(lfsh);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Compare snprintf(DFID_NOBRACE) and sscanf(SFID) with
+ * lus_fid_format(), lus_fid_parse() and lus_fid_parse_list().
+ *
+ * Doesn't need a Lustre filesystem.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+int main(int argc, char *argv[])
+{
+	size_t count = 1000000;
+	char (*strs)[FID_NOBRACE_LEN + 1];
+	lustre_fid *fids;
+	lustre_fid *fids2;
+	char *list;
+	char *p;
+	double start;
+	ssize_t parsed;
+	size_t i;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n fids]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	fids = calloc(count, sizeof(*fids));
+	fids2 = calloc(count, sizeof(*fids2));
+	strs = calloc(count, sizeof(*strs));
+	list = malloc(count * (FID_NOBRACE_LEN + 1));
+	if (fids == NULL || fids2 == NULL || strs == NULL || list == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	/* FIDs similar to the ones of regular files. */
+	for (i = 0; i < count; i++) {
+		fids[i].f_seq = 0x200000400 + random() % 0x10000;
+		fids[i].f_oid = random() % 0x20000 + 1;
+		fids[i].f_ver = 0;
+	}
+
+	start = bench_now();
+	for (i = 0; i < count; i++)
+		snprintf(strs[i], sizeof(strs[i]), DFID_NOBRACE,
+			 PFID(&fids[i]));
+	bench_report("snprintf", count, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < count; i++)
+		lus_fid_format(&fids[i], strs[i], sizeof(strs[i]));
+	bench_report("lus_fid_format", count, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		/* Same as SFID, without the brackets. */
+		if (sscanf(strs[i], "%llx:%x:%x", RFID(&fids2[i])) != 3) {
+			fprintf(stderr, "sscanf failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	bench_report("sscanf", count, bench_now() - start);
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		rc = lus_fid_parse(strs[i], &fids2[i], NULL);
+		if (rc) {
+			fprintf(stderr, "lus_fid_parse failed\n");
+			return EXIT_FAILURE;
+		}
+	}
+	bench_report("lus_fid_parse", count, bench_now() - start);
+
+	/* One FID per line, as in a file read in memory. */
+	p = list;
+	for (i = 0; i < count; i++) {
+		p = stpcpy(p, strs[i]);
+		*p++ = '\n';
+	}
+
+	start = bench_now();
+	parsed = lus_fid_parse_list(list, p - list, fids2, count, NULL);
+	bench_report("lus_fid_parse_list", count, bench_now() - start);
+	if (parsed != count) {
+		fprintf(stderr, "lus_fid_parse_list failed: %zd\n", parsed);
+		return EXIT_FAILURE;
+	}
+
+	if (memcmp(fids, fids2, count * sizeof(*fids)) != 0) {
+		fprintf(stderr, "FIDs differ after a round trip\n");
+		return EXIT_FAILURE;
+	}
+
+	free(list);
+	free(strs);
+	free(fids2);
+	free(fids);
+
+	return EXIT_SUCCESS;
+}
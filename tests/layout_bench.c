@@ -0,0 +1,217 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Compare getting the stripe count and size of a file through a
+ * struct lus_layout and through a layout view, in time and number of
+ * allocations per call.
+ *
+ * A synthetic lustre.lov attribute is always decoded. With -f, the
+ * layout of a file on Lustre is also read from the filesystem.
+ *
+ * The allocations are counted by overriding malloc() and calloc(),
+ * which also catches the ones made in liblustre. This relies on
+ * glibc.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+#define LOV_PATTERN_RAID0 0x001
+
+static unsigned long iterations = 1000000;
+static unsigned long allocs;
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+static void report(const char *name, double elapsed, unsigned long count)
+{
+	bench_report(name, iterations, elapsed);
+	printf("%-30s %10.0f ns/call %6.2f allocations/call\n", "",
+	       elapsed * 1e9 / iterations, (double)count / iterations);
+}
+
+/* Sum of the attributes, so they are not optimized away. */
+static uint64_t sink;
+
+static int run_xattr(unsigned int stripe_count)
+{
+	struct lov_user_md *lum;
+	struct lus_layout_view view;
+	struct lus_layout *layout;
+	size_t lum_len;
+	unsigned long start_allocs;
+	unsigned long i;
+	double start;
+	int rc;
+
+	lum_len = sizeof(*lum) + stripe_count * sizeof(lum->lmm_objects[0]);
+	lum = calloc(1, lum_len);
+	if (lum == NULL)
+		return -ENOMEM;
+
+	lum->lmm_magic = LOV_USER_MAGIC_V1;
+	lum->lmm_pattern = LOV_PATTERN_RAID0;
+	lum->lmm_stripe_size = 1024 * 1024;
+	lum->lmm_stripe_count = stripe_count;
+
+	printf("Decoding a %u stripes attribute\n", stripe_count);
+
+	start_allocs = allocs;
+	start = bench_now();
+	for (i = 0; i < iterations; i++) {
+		rc = lus_lovxattr_to_layout(lum, lum_len, &layout);
+		if (rc)
+			goto out;
+		sink += lus_layout_stripe_get_count(layout) +
+			lus_layout_stripe_get_size(layout);
+		lus_layout_free(layout);
+	}
+	report("lus_lovxattr_to_layout", bench_now() - start,
+	       allocs - start_allocs);
+
+	start_allocs = allocs;
+	start = bench_now();
+	for (i = 0; i < iterations; i++) {
+		rc = lus_layout_view_init(&view, lum, lum_len);
+		if (rc)
+			goto out;
+		sink += lus_layout_view_stripe_get_count(&view) +
+			lus_layout_view_stripe_get_size(&view);
+	}
+	report("lus_layout_view_init", bench_now() - start,
+	       allocs - start_allocs);
+
+out:
+	free(lum);
+
+	return rc;
+}
+
+static int run_file(const char *path)
+{
+	struct lus_layout_view view;
+	struct lus_layout *layout;
+	unsigned long start_allocs;
+	unsigned long i;
+	double start;
+	int rc = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -errno;
+
+	printf("\nReading the layout of %s\n", path);
+
+	/* Let the per-thread buffer be allocated. */
+	rc = lus_layout_view_get_by_fd(fd, NULL, 0, &view);
+	if (rc)
+		goto out;
+
+	start_allocs = allocs;
+	start = bench_now();
+	for (i = 0; i < iterations; i++) {
+		rc = lus_layout_get_by_fd(fd, &layout);
+		if (rc)
+			goto out;
+		sink += lus_layout_stripe_get_count(layout) +
+			lus_layout_stripe_get_size(layout);
+		lus_layout_free(layout);
+	}
+	report("lus_layout_get_by_fd", bench_now() - start,
+	       allocs - start_allocs);
+
+	start_allocs = allocs;
+	start = bench_now();
+	for (i = 0; i < iterations; i++) {
+		rc = lus_layout_view_get_by_fd(fd, NULL, 0, &view);
+		if (rc)
+			goto out;
+		sink += lus_layout_view_stripe_get_count(&view) +
+			lus_layout_view_stripe_get_size(&view);
+	}
+	report("lus_layout_view_get_by_fd", bench_now() - start,
+	       allocs - start_allocs);
+
+out:
+	close(fd);
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int stripe_count = 4;
+	const char *path = NULL;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "c:f:n:")) != -1) {
+		switch (opt) {
+		case 'c':
+			stripe_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			path = optarg;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n iterations] [-c stripe_count] [-f lustre_file]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (iterations == 0 || stripe_count == 0 || stripe_count > 2000) {
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	rc = run_xattr(stripe_count);
+	if (rc == 0 && path != NULL)
+		rc = run_file(path);
+
+	if (rc) {
+		fprintf(stderr, "benchmark failed: %s\n", strerror(-rc));
+		return EXIT_FAILURE;
+	}
+
+	return sink != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
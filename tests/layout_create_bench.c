@@ -0,0 +1,215 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Compare the creation of files with a given layout by a loop of
+ * lus_layout_file_openat(), which encodes the layout for every file,
+ * with lus_layout_create_many() and a prepared layout, for an
+ * increasing number of threads.
+ *
+ * Creates a directory on Lustre, and the files in it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+static size_t count = 10000;
+static char **names;
+
+/* Remove the files created by a run. */
+static void remove_files(int dir_fd)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		unlinkat(dir_fd, names[i], 0);
+}
+
+static int run_loop(int dir_fd, const struct lus_layout *layout)
+{
+	double start;
+	size_t i;
+	int fd;
+
+	start = bench_now();
+	for (i = 0; i < count; i++) {
+		fd = lus_layout_file_openat(dir_fd, names[i],
+					    O_WRONLY | O_CREAT | O_EXCL,
+					    0600, layout);
+		if (fd < 0) {
+			remove_files(dir_fd);
+			return fd;
+		}
+		close(fd);
+	}
+	bench_report("lus_layout_file_openat loop", count,
+		     bench_now() - start);
+
+	remove_files(dir_fd);
+
+	return 0;
+}
+
+static int run_many(struct lus_fs_handle *lfsh, int dir_fd,
+		    const struct lus_layout_prepared *prepared,
+		    unsigned int threads, int *errors)
+{
+	char name[64];
+	double start;
+	ssize_t created;
+	int rc;
+
+	rc = lus_set_thread_count(lfsh, threads);
+	if (rc)
+		return rc;
+
+	start = bench_now();
+	created = lus_layout_create_many(lfsh, dir_fd,
+					 (const char * const *)names, count,
+					 prepared, 0600, errors);
+	snprintf(name, sizeof(name), "create_many, %u threads", threads);
+	bench_report(name, count, bench_now() - start);
+
+	remove_files(dir_fd);
+
+	if (created < 0)
+		return created;
+	if ((size_t)created != count)
+		return errors[0] ? errors[0] : -EIO;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *lustre_dir = "/mnt/lustre";
+	struct lus_layout_prepared *prepared = NULL;
+	unsigned int max_threads = 16;
+	unsigned int stripe_count = 1;
+	struct lus_layout *layout = NULL;
+	struct lus_fs_handle *lfsh;
+	unsigned int threads;
+	char dir[PATH_MAX];
+	int *errors;
+	size_t i;
+	int dir_fd;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "c:d:n:t:")) != -1) {
+		switch (opt) {
+		case 'c':
+			stripe_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			lustre_dir = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d lustre_dir] [-n files] [-c stripe_count]\n"
+				"          [-t max_threads]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (count == 0 || stripe_count == 0 || max_threads == 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	if (rc) {
+		fprintf(stderr, "cannot open '%s': %s\n",
+			lustre_dir, strerror(-rc));
+		return EXIT_FAILURE;
+	}
+
+	names = calloc(count, sizeof(*names));
+	errors = calloc(count, sizeof(*errors));
+	if (names == NULL || errors == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (asprintf(&names[i], "f%zu", i) == -1) {
+			fprintf(stderr, "out of memory\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	snprintf(dir, sizeof(dir), "%s/layout_create_bench.%d",
+		 lustre_dir, getpid());
+	if (mkdir(dir, 0700) == -1) {
+		fprintf(stderr, "cannot create '%s': %s\n",
+			dir, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (dir_fd == -1) {
+		rc = -errno;
+		goto out;
+	}
+
+	rc = lus_layout_alloc(0, &layout);
+	if (rc == 0)
+		rc = lus_layout_stripe_set_count(layout, stripe_count);
+	if (rc == 0)
+		rc = lus_layout_prepare(layout, &prepared);
+
+	printf("%zu files of %u stripes\n", count, stripe_count);
+
+	if (rc == 0)
+		rc = run_loop(dir_fd, layout);
+
+	for (threads = 1; rc == 0 && threads <= max_threads; threads *= 2)
+		rc = run_many(lfsh, dir_fd, prepared, threads, errors);
+
+	close(dir_fd);
+
+out:
+	if (rc)
+		fprintf(stderr, "benchmark failed: %s\n", strerror(-rc));
+
+	rmdir(dir);
+	lus_layout_prepared_free(prepared);
+	lus_layout_free(layout);
+	lus_close_fs(lfsh);
+
+	for (i = 0; i < count; i++)
+		free(names[i]);
+	free(names);
+	free(errors);
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Compare the memory needed to keep the layout of every file found
+ * by a scan, with one struct lus_layout per file or with interned
+ * layouts.
+ *
+ * The files are synthetic. Their lustre.lov attributes are made from
+ * a few distinct stripe sizes and counts, with different object IDs
+ * and, with -o, different OSTs. Each attribute is decoded, as a scan
+ * would, then interned. Holding all the per-file layouts at once
+ * would not fit in memory for 10 million files, so their size is
+ * only added up, with malloc_usable_size(), which relies on glibc.
+ */
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+#define LOV_PATTERN_RAID0 0x001
+
+/* The layout of a file with up to MAX_STRIPES stripes. */
+#define MAX_STRIPES 64
+struct test_lum {
+	struct lov_user_md_v1 lum;
+	struct lov_user_ost_data_v1 objects[MAX_STRIPES];
+} __attribute__((packed));
+
+static unsigned long num_files = 10000000;
+static unsigned int num_layouts = 40;
+static unsigned int num_osts;
+
+/* Make up the lustre.lov attribute of file number n. Return its
+ * size. */
+static size_t make_lum(struct test_lum *xattr, unsigned long n)
+{
+	unsigned int layout = n % num_layouts;
+	unsigned int stripe_count = 1U << (layout % 7);
+	unsigned int i;
+
+	xattr->lum.lmm_magic = LOV_USER_MAGIC_V1;
+	xattr->lum.lmm_pattern = LOV_PATTERN_RAID0;
+	xattr->lum.lmm_stripe_size = (layout / 7 + 1) << 20;
+	xattr->lum.lmm_stripe_count = stripe_count;
+
+	for (i = 0; i < stripe_count; i++) {
+		xattr->objects[i].l_ost_oi.oi.oi_id = n * MAX_STRIPES + i;
+		xattr->objects[i].l_ost_idx =
+			num_osts ? (n / num_layouts + i) % num_osts : i;
+	}
+
+	return sizeof(xattr->lum) + stripe_count * sizeof(xattr->objects[0]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct lus_layout_table_stats stats;
+	const struct lus_layout **shared;
+	struct lus_layout_table *table = NULL;
+	struct lus_layout *layout;
+	struct test_lum xattr;
+	unsigned int flags = 0;
+	size_t per_file = 0;
+	size_t interned;
+	unsigned long i;
+	size_t lum_len;
+	double start;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "d:n:o:")) != -1) {
+		switch (opt) {
+		case 'd':
+			num_layouts = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			num_files = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			num_osts = strtoul(optarg, NULL, 0);
+			flags = LUS_LAYOUT_CMP_OSTS;
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-n files] [-d distinct_layouts] [-o osts]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (num_files == 0 || num_layouts == 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	shared = calloc(num_files, sizeof(*shared));
+	if (shared == NULL) {
+		fprintf(stderr, "cannot allocate %lu pointers\n", num_files);
+		return EXIT_FAILURE;
+	}
+
+	rc = lus_layout_table_create(flags, &table);
+	if (rc)
+		goto out;
+
+	memset(&xattr, 0, sizeof(xattr));
+
+	start = bench_now();
+	for (i = 0; i < num_files; i++) {
+		lum_len = make_lum(&xattr, i);
+
+		rc = lus_lovxattr_to_layout(&xattr.lum, lum_len, &layout);
+		if (rc)
+			goto out;
+
+		rc = lus_layout_intern(table, layout, &shared[i]);
+		per_file += malloc_usable_size(layout);
+		lus_layout_free(layout);
+		if (rc)
+			goto out;
+	}
+	bench_report("decode + lus_layout_intern", num_files,
+		     bench_now() - start);
+
+	lus_layout_table_get_stats(table, &stats);
+	interned = stats.lts_bytes + num_files * sizeof(*shared);
+	per_file += num_files * sizeof(*shared);
+
+	printf("%lu files, %zu distinct layouts%s\n", num_files,
+	       stats.lts_layouts, flags ? " (with the OSTs)" : "");
+	printf("%-30s %12.1f MiB %8.1f bytes/file\n", "one layout per file",
+	       per_file / 1048576.0, (double)per_file / num_files);
+	printf("%-30s %12.1f MiB %8.1f bytes/file\n", "interned layouts",
+	       interned / 1048576.0, (double)interned / num_files);
+
+	start = bench_now();
+	for (i = 0; i < num_files; i++)
+		lus_layout_release(table, shared[i]);
+	bench_report("lus_layout_release", num_files, bench_now() - start);
+
+out:
+	lus_layout_table_destroy(table);
+	free(shared);
+
+	if (rc) {
+		fprintf(stderr, "benchmark failed: %s\n", strerror(-rc));
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
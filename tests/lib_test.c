@@ -26,6 +26,7 @@ char *lustre_dir;               /* Lustre mountpoint */
 
 START_TEST(ost1) { unittest_ost1(); } END_TEST
 START_TEST(ost2) { unittest_ost2(); } END_TEST
+START_TEST(ost3) { unittest_ost3(); } END_TEST
 START_TEST(fid1) { unittest_fid1(); } END_TEST
 START_TEST(fid2) { unittest_fid2(); } END_TEST
 START_TEST(chomp) { unittest_chomp(); } END_TEST
@@ -36,7 +37,43 @@ START_TEST(parse_size) { unittest_lus_parse_size(); } END_TEST
 START_TEST(t_strscpy) { unittest_strscpy(); } END_TEST
 START_TEST(t_strscat) { unittest_strscat(); } END_TEST
 START_TEST(fid2path) { unittest_lus_fid2path(); } END_TEST
+START_TEST(fid2path_batch) { unittest_lus_fid2path_batch(); } END_TEST
+START_TEST(fid_format) { unittest_fid_format(); } END_TEST
+START_TEST(fid_parse) { unittest_fid_parse(); } END_TEST
+START_TEST(fid_parse_list) { unittest_fid_parse_list(); } END_TEST
+START_TEST(fid_cache) { unittest_fid_cache(); } END_TEST
+START_TEST(fid_cache_ttl) { unittest_fid_cache_ttl(); } END_TEST
+START_TEST(fid_cache_concurrent) { unittest_fid_cache_concurrent(); } END_TEST
+START_TEST(fid_cache_toggle) { unittest_fid_cache_toggle(); } END_TEST
 START_TEST(data_version_by_fd) { unittest_lus_data_version_by_fd(); } END_TEST
+START_TEST(data_version_by_fid_many) { unittest_lus_data_version_by_fid_many(); } END_TEST
+START_TEST(t_stat_to_statx) { unittest_stat_to_statx(); } END_TEST
+START_TEST(statx_by_fid) { unittest_lus_statx_by_fid(); } END_TEST
+START_TEST(async_threads) { unittest_async_threads(); } END_TEST
+START_TEST(async_uring) { unittest_async_uring(); } END_TEST
+START_TEST(mount_index) { unittest_mount_index(); } END_TEST
+START_TEST(open_fs_for_path) { unittest_open_fs_for_path(); } END_TEST
+START_TEST(open_fs_fd) { unittest_open_fs_fd(); } END_TEST
+START_TEST(scan) { unittest_scan(); } END_TEST
+START_TEST(scan_lustre) { unittest_scan_lustre(); } END_TEST
+START_TEST(changelog_pipe) { unittest_changelog_pipe(); } END_TEST
+START_TEST(changelog_file) { unittest_changelog_file(); } END_TEST
+START_TEST(changelog_dispatch) { unittest_changelog_dispatch(); } END_TEST
+START_TEST(volatile_pool) { unittest_volatile_pool(); } END_TEST
+START_TEST(pario) { unittest_pario(); } END_TEST
+START_TEST(pario_lustre) { unittest_pario_lustre(); } END_TEST
+START_TEST(t_pario_copy) { unittest_pario_copy(); } END_TEST
+START_TEST(layout_map) { unittest_layout_map(); } END_TEST
+START_TEST(layout_view) { unittest_layout_view(); } END_TEST
+START_TEST(layout_table) { unittest_layout_table(); } END_TEST
+START_TEST(dir_layout_cache) { unittest_dir_layout_cache(); } END_TEST
+START_TEST(expected_lustre) { unittest_expected_lustre(); } END_TEST
+START_TEST(layout_prepare) { unittest_layout_prepare(); } END_TEST
+START_TEST(create_many_lustre) { unittest_create_many_lustre(); } END_TEST
+START_TEST(layout_specific) { unittest_layout_specific(); } END_TEST
+START_TEST(layout_composite) { unittest_layout_composite(); } END_TEST
+START_TEST(layout_mirror) { unittest_layout_mirror(); } END_TEST
+START_TEST(migrate_lustre) { unittest_migrate_lustre(); } END_TEST
 
 static Suite *ost_suite(void)
 {
@@ -47,12 +84,21 @@ static Suite *ost_suite(void)
 	tc = tcase_create("OSTS");
 	tcase_add_test(tc, ost1);
 	tcase_add_test(tc, ost2);
+	tcase_add_test(tc, ost3);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("FID");
 	tcase_add_test(tc, fid1);
 	tcase_add_test(tc, fid2);
 	tcase_add_test(tc, fid2path);
+	tcase_add_test(tc, fid2path_batch);
+	tcase_add_test(tc, fid_format);
+	tcase_add_test(tc, fid_parse);
+	tcase_add_test(tc, fid_parse_list);
+	tcase_add_test(tc, fid_cache);
+	tcase_add_test(tc, fid_cache_ttl);
+	tcase_add_test(tc, fid_cache_concurrent);
+	tcase_add_test(tc, fid_cache_toggle);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("MISC");
@@ -64,6 +110,58 @@ static Suite *ost_suite(void)
 	tcase_add_test(tc, read_procfs_value);
 	tcase_add_test(tc, parse_size);
 	tcase_add_test(tc, data_version_by_fd);
+	tcase_add_test(tc, data_version_by_fid_many);
+	tcase_add_test(tc, t_stat_to_statx);
+	tcase_add_test(tc, statx_by_fid);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("ASYNC");
+	tcase_add_test(tc, async_threads);
+	tcase_add_test(tc, async_uring);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("MOUNTS");
+	tcase_add_test(tc, mount_index);
+	tcase_add_test(tc, open_fs_for_path);
+	tcase_add_test(tc, open_fs_fd);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("SCAN");
+	tcase_add_test(tc, scan);
+	tcase_add_test(tc, scan_lustre);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("CHANGELOG");
+	tcase_add_test(tc, changelog_pipe);
+	tcase_add_test(tc, changelog_file);
+	tcase_add_test(tc, changelog_dispatch);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("PARIO");
+	tcase_add_test(tc, pario);
+	tcase_add_test(tc, pario_lustre);
+	tcase_add_test(tc, t_pario_copy);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("LAYOUT");
+	tcase_add_test(tc, layout_map);
+	tcase_add_test(tc, layout_view);
+	tcase_add_test(tc, layout_table);
+	tcase_add_test(tc, dir_layout_cache);
+	tcase_add_test(tc, expected_lustre);
+	tcase_add_test(tc, layout_prepare);
+	tcase_add_test(tc, create_many_lustre);
+	tcase_add_test(tc, layout_specific);
+	tcase_add_test(tc, layout_composite);
+	tcase_add_test(tc, layout_mirror);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("MIGRATE");
+	tcase_add_test(tc, migrate_lustre);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("HSM");
+	tcase_add_test(tc, volatile_pool);
 	suite_add_tcase(s, tc);
 
 	return s;
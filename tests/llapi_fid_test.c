@@ -629,6 +629,140 @@ START_TEST(test42)
 }
 END_TEST
 
+/* Test lus_fid_links. Create sub directories, and put a link to the
+ * original file in them. */
+START_TEST(test43)
+{
+	const int num_links = 100;
+	struct {
+		char subdir[PATH_MAX];
+		lustre_fid subdir_fid;
+		char filename[PATH_MAX];
+		bool seen;
+	} links[num_links];
+	const struct lus_fid_link *fl;
+	char link0[PATH_MAX];
+	char buf[PATH_MAX];
+	char *lbuf;
+	size_t lbuf_len;
+	lustre_fid fid;
+	ssize_t count;
+	int rc;
+	int i;
+	int j;
+	int fd;
+
+	/* Create the containing directory. */
+	rc = mkdir(mainpath, S_IRWXU);
+	ck_assert_int_eq(rc, 0);
+
+	for (i = 0; i < num_links; i++) {
+		rc = snprintf(links[i].subdir, sizeof(links[i].subdir),
+			      "%s/sub%04d", mainpath, i);
+		ck_assert(rc > 0 && rc < sizeof(links[i].subdir));
+
+		rc = snprintf(links[i].filename, sizeof(links[i].filename),
+			      "link%04d", i);
+		ck_assert(rc > 0 && rc < sizeof(links[i].filename));
+
+		links[i].seen = false;
+
+		rc = mkdir(links[i].subdir, S_IRWXU);
+		ck_assert_int_eq(rc, 0);
+
+		rc = lus_path2fid(links[i].subdir, &links[i].subdir_fid);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	rc = snprintf(link0, sizeof(link0), "%s/%s",
+		      links[0].subdir, links[0].filename);
+	ck_assert(rc > 0 && rc < sizeof(link0));
+
+	fd = creat(link0, 0);
+	ck_assert_int_ge(fd, 0);
+
+	rc = lus_fd2fid(fd, &fid);
+	ck_assert_int_eq(rc, 0);
+	close(fd);
+
+	/* A single link */
+	lbuf_len = 64 * num_links;
+	lbuf = malloc(lbuf_len);
+	ck_assert_ptr_ne(lbuf, NULL);
+
+	count = lus_fid_links(lfsh, &fid, lbuf, lbuf_len);
+	ck_assert_int_eq(count, 1);
+	fl = (const struct lus_fid_link *)lbuf;
+	ck_assert_str_eq(fl->lfl_name, links[0].filename);
+	ck_assert_int_eq(memcmp(&fl->lfl_parent_fid, &links[0].subdir_fid,
+				sizeof(lustre_fid)), 0);
+
+	for (i = 1; i < num_links; i++) {
+		rc = snprintf(buf, sizeof(buf), "%s/%s",
+			      links[i].subdir, links[i].filename);
+		ck_assert(rc > 0 && rc < sizeof(buf));
+
+		rc = link(link0, buf);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	count = lus_fid_links(lfsh, &fid, lbuf, lbuf_len);
+	if (lus_get_client_version(lfsh) < 20700) {
+		/* Only the first link can be relied upon. */
+		ck_assert_int_ge(count, 1);
+		free(lbuf);
+		return;
+	}
+	ck_assert_int_eq(count, num_links);
+
+	/* Every link must be found once. */
+	fl = (const struct lus_fid_link *)lbuf;
+	for (j = 0; j < count; j++) {
+		bool found = false;
+
+		ck_assert_int_eq(fl->lfl_linkno, j);
+		ck_assert_int_eq(fl->lfl_reclen, 40);
+
+		for (i = 0; i < num_links; i++) {
+			if (memcmp(&fl->lfl_parent_fid, &links[i].subdir_fid,
+				   sizeof(lustre_fid)) != 0)
+				continue;
+
+			ck_assert_str_eq(links[i].filename, fl->lfl_name);
+			ck_assert_int_eq(links[i].seen, false);
+
+			links[i].seen = true;
+			found = true;
+			break;
+		}
+		ck_assert_int_eq(found, true);
+
+		fl = lus_fid_link_next(fl);
+	}
+	ck_assert_ptr_eq((void *)fl, lbuf + 40 * num_links);
+
+	/* The last record doesn't need its padding. */
+	count = lus_fid_links(lfsh, &fid, lbuf, 40 * (num_links - 1) + 33);
+	ck_assert_int_eq(count, num_links);
+
+	count = lus_fid_links(lfsh, &fid, lbuf, 40 * (num_links - 1) + 32);
+	ck_assert_int_eq(count, -ENOSPC);
+
+	count = lus_fid_links(lfsh, &fid, lbuf, 0);
+	ck_assert_int_eq(count, -ENOSPC);
+
+	/* Same with the fd */
+	fd = open(link0, O_RDONLY);
+	ck_assert_int_ge(fd, 0);
+
+	count = lus_fd_links(fd, lbuf, lbuf_len);
+	ck_assert_int_eq(count, num_links);
+	close(fd);
+
+	free(lbuf);
+}
+END_TEST
+
 static Suite *ost_suite(void)
 {
 	TCase *tc;
@@ -650,6 +784,7 @@ static Suite *ost_suite(void)
 	tcase_add_test(tc, test40b);
 	tcase_add_test(tc, test41);
 	tcase_add_test(tc, test42);
+	tcase_add_test(tc, test43);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("FIDS_LONG");
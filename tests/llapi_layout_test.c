@@ -478,7 +478,7 @@ START_TEST(test13)
 	rc = lus_layout_alloc(0, &layout);
 	ck_assert_msg(layout != NULL, "rc = %d", rc);
 
-	/* Only setting OST index for stripe 0 is supported for now. */
+	/* A layout without stripes has no room for the OST of stripe 1. */
 	rc = lus_layout_set_ost_index(layout, 1, 1);
 	ck_assert_msg(rc == -EOPNOTSUPP, "rc = %d", rc);
 
@@ -1120,6 +1120,212 @@ START_TEST(test28)
 }
 END_TEST
 
+/* lus_getfileinfo_by_fid returns the same attributes and layout as
+ * fstat and lus_layout_get_by_fd. */
+#define T29FILE		"t29"
+#define T29DIR		"d29"
+#define T29_STRIPE_SIZE	(1048576 * 2)
+#define T29_DESC	"lus_getfileinfo_by_fid matches stat and layout"
+START_TEST(test29)
+{
+	struct lus_layout *layout1;
+	struct lus_layout *layout2;
+	char path[PATH_MAX];
+	struct stat st1;
+	struct stat st2;
+	lustre_fid fid;
+	uint64_t count;
+	uint64_t idx1;
+	uint64_t idx2;
+	int fd;
+	int rc;
+	int i;
+
+	snprintf(path, sizeof(path), "%s/%s", lustre_dir, T29FILE);
+
+	rc = unlink(path);
+	ck_assert_msg(rc == 0 || errno == ENOENT, "errno = %d", errno);
+
+	rc = lus_layout_alloc(num_osts, &layout1);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+	rc = lus_layout_stripe_set_count(layout1, num_osts);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+	rc = lus_layout_stripe_set_size(layout1, T29_STRIPE_SIZE);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+
+	fd = lus_layout_file_create(path, 0, 0640, layout1);
+	ck_assert_msg(fd >= 0, "fd = %d", fd);
+	lus_layout_free(layout1);
+
+	rc = fstat(fd, &st1);
+	ck_assert_msg(rc == 0, "errno = %d", errno);
+	rc = lus_fd2fid(fd, &fid);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+	rc = lus_layout_get_by_fd(fd, &layout1);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+	close(fd);
+
+	rc = lus_getfileinfo_by_fid(lfsh, &fid, &st2, &layout2);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+
+	ck_assert_int_eq(st1.st_ino, st2.st_ino);
+	ck_assert_int_eq(st1.st_mode, st2.st_mode);
+	ck_assert_int_eq(st1.st_uid, st2.st_uid);
+	ck_assert_int_eq(st1.st_gid, st2.st_gid);
+
+	count = lus_layout_stripe_get_count(layout2);
+	ck_assert_msg(count == num_osts, "%"PRIu64" != %d", count, num_osts);
+	ck_assert_int_eq(lus_layout_stripe_get_size(layout2),
+			 T29_STRIPE_SIZE);
+
+	for (i = 0; i < num_osts; i++) {
+		rc = lus_layout_get_ost_index(layout1, i, &idx1);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+		rc = lus_layout_get_ost_index(layout2, i, &idx2);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+		ck_assert_int_eq(idx1, idx2);
+	}
+
+	lus_layout_free(layout1);
+	lus_layout_free(layout2);
+
+	/* A directory without a default layout */
+	snprintf(path, sizeof(path), "%s/%s", lustre_dir, T29DIR);
+
+	rc = rmdir(path);
+	ck_assert_msg(rc == 0 || errno == ENOENT, "errno = %d", errno);
+	rc = mkdir(path, 0750);
+	ck_assert_msg(rc == 0, "errno = %d", errno);
+
+	rc = lus_path2fid(path, &fid);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+
+	rc = lus_getfileinfo_by_fid(lfsh, &fid, &st2, &layout2);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+	ck_assert(S_ISDIR(st2.st_mode));
+
+	rc = lus_layout_get_by_path(path, 0, &layout1);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+	ck_assert_int_eq(lus_layout_stripe_get_count(layout1),
+			 lus_layout_stripe_get_count(layout2));
+	ck_assert_int_eq(lus_layout_stripe_get_size(layout1),
+			 lus_layout_stripe_get_size(layout2));
+
+	lus_layout_free(layout1);
+	lus_layout_free(layout2);
+}
+END_TEST
+
+/* lus_layout_get_by_name returns the same layout as
+ * lus_layout_get_by_path, for files and directories. */
+#define T30DIR		"d30"
+#define T30FILE		"t30"
+#define T30SUBDIR	"s30"
+#define T30_STRIPE_SIZE	(1048576 * 3)
+#define T30_DESC	"lus_layout_get_by_name matches lus_layout_get_by_path"
+START_TEST(test30)
+{
+	struct lus_layout *layout1;
+	struct lus_layout *layout2;
+	char dirpath[PATH_MAX];
+	char path[PATH_MAX];
+	char name[NAME_MAX + 1];
+	const char *lfs = getenv("LFS");
+	char cmd[4096];
+	uint64_t idx1;
+	uint64_t idx2;
+	int dir_fd;
+	int fd;
+	int rc;
+	int i;
+
+	snprintf(dirpath, sizeof(dirpath), "%s/%s", lustre_dir, T30DIR);
+	rc = mkdir(dirpath, 0750);
+	ck_assert_msg(rc == 0 || errno == EEXIST, "errno = %d", errno);
+
+	dir_fd = open(dirpath, O_RDONLY | O_DIRECTORY);
+	ck_assert_msg(dir_fd >= 0, "errno = %d", errno);
+
+	/* A striped file, with a short then a long name, as the name
+	 * shares the buffer with the reply. */
+	for (i = 0; i < 2; i++) {
+		if (i == 0)
+			snprintf(name, sizeof(name), "%s", T30FILE);
+		else
+			snprintf(name, sizeof(name), "%s-%0200d", T30FILE, 0);
+
+		snprintf(path, sizeof(path), "%s/%s", dirpath, name);
+		rc = unlink(path);
+		ck_assert_msg(rc == 0 || errno == ENOENT, "errno = %d", errno);
+
+		rc = lus_layout_alloc(num_osts, &layout1);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+		rc = lus_layout_stripe_set_count(layout1, num_osts);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+		rc = lus_layout_stripe_set_size(layout1, T30_STRIPE_SIZE);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+
+		fd = lus_layout_file_create(path, 0, 0640, layout1);
+		ck_assert_msg(fd >= 0, "fd = %d", fd);
+		close(fd);
+		lus_layout_free(layout1);
+
+		rc = lus_layout_get_by_path(path, 0, &layout1);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+		rc = lus_layout_get_by_name(dir_fd, name, &layout2);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+
+		ck_assert_int_eq(lus_layout_stripe_get_count(layout2),
+				 num_osts);
+		ck_assert_int_eq(lus_layout_stripe_get_size(layout2),
+				 T30_STRIPE_SIZE);
+
+		rc = lus_layout_get_ost_index(layout1, 0, &idx1);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+		rc = lus_layout_get_ost_index(layout2, 0, &idx2);
+		ck_assert_msg(rc == 0, "rc = %d", rc);
+		ck_assert_int_eq(idx1, idx2);
+
+		lus_layout_free(layout1);
+		lus_layout_free(layout2);
+	}
+
+	/* A directory with a default layout has no object. */
+	snprintf(path, sizeof(path), "%s/%s", dirpath, T30SUBDIR);
+	rc = rmdir(path);
+	ck_assert_msg(rc == 0 || errno == ENOENT, "errno = %d", errno);
+
+	rc = mkdir(path, 0750);
+	ck_assert_msg(rc == 0, "errno = %d", errno);
+
+	if (lfs == NULL)
+		lfs = "/usr/bin/lfs";
+
+	snprintf(cmd, sizeof(cmd), "%s setstripe -c %d %s", lfs, num_osts,
+		 path);
+	rc = system(cmd);
+	ck_assert_msg(rc == 0, "system(%s): exit status %d", cmd,
+		      WEXITSTATUS(rc));
+
+	rc = lus_layout_get_by_name(dir_fd, T30SUBDIR, &layout2);
+	ck_assert_msg(rc == 0, "rc = %d", rc);
+	ck_assert_int_eq(lus_layout_stripe_get_count(layout2), num_osts);
+	rc = lus_layout_get_ost_index(layout2, 0, &idx2);
+	ck_assert_int_eq(rc, -EINVAL);
+	lus_layout_free(layout2);
+
+	/* Errors */
+	rc = lus_layout_get_by_name(dir_fd, "does-not-exist", &layout2);
+	ck_assert_int_eq(rc, -ENOENT);
+	ck_assert_ptr_eq(layout2, NULL);
+
+	rc = lus_layout_get_by_name(dir_fd, T30SUBDIR "/x", &layout2);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	close(dir_fd);
+}
+END_TEST
+
 /*
  * Test lus_lovxattr_to_layout.
  *
@@ -1279,6 +1485,8 @@ int main(int argc, char *argv[])
 	ADD_TEST(test27);
 #endif
 	ADD_TEST(test28);
+	ADD_TEST(test29);
+	ADD_TEST(test30);
 	ADD_TEST(test100);
 
 	sr = srunner_create(s);
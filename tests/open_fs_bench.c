@@ -0,0 +1,248 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Measure the cost of opening a filesystem handle, in time and in
+ * system calls.
+ *
+ * Each way of opening a handle is timed, then run again in a child
+ * traced with ptrace, which counts the system calls it makes. The
+ * child separates the runs by calling getppid(), which is not used by
+ * the library. The lus_open_fs_fd() runs include opening and closing
+ * the directory.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+static const char *lustre_dir = "/mnt/lustre";
+static size_t count = 1000;
+static unsigned int errors;
+
+/* Ways to open a handle. The kept handle, if any, makes the next
+ * opens find an existing one. */
+struct open_mode {
+	const char *name;
+	bool keep_handle;
+	int (*open_fs)(struct lus_fs_handle **lfsh);
+};
+
+static int open_path(struct lus_fs_handle **lfsh)
+{
+	return lus_open_fs(lustre_dir, lfsh);
+}
+
+static int open_fd(struct lus_fs_handle **lfsh)
+{
+	int fd;
+	int rc;
+
+	fd = open(lustre_dir, O_RDONLY | O_DIRECTORY);
+	if (fd == -1)
+		return -errno;
+
+	rc = lus_open_fs_fd(fd, lfsh);
+	close(fd);
+
+	return rc;
+}
+
+static int open_for_path(struct lus_fs_handle **lfsh)
+{
+	return lus_open_fs_for_path(lustre_dir, lfsh);
+}
+
+static const struct open_mode modes[] = {
+	{ "lus_open_fs", false, open_path },
+	{ "lus_open_fs_fd", false, open_fd },
+	{ "lus_open_fs_for_path", false, open_for_path },
+	{ "lus_open_fs (shared)", true, open_path },
+	{ "lus_open_fs_fd (shared)", true, open_fd },
+	{ "lus_open_fs_for_path (shared)", true, open_for_path },
+};
+
+#define NUM_MODES (sizeof(modes) / sizeof(modes[0]))
+
+static void run_mode(const struct open_mode *mode, size_t n)
+{
+	struct lus_fs_handle *kept = NULL;
+	struct lus_fs_handle *lfsh;
+	size_t i;
+	int rc;
+
+	if (mode->keep_handle) {
+		rc = mode->open_fs(&kept);
+		if (rc)
+			errors++;
+	}
+
+	for (i = 0; i < n; i++) {
+		rc = mode->open_fs(&lfsh);
+		if (rc) {
+			errors++;
+			continue;
+		}
+
+		lus_close_fs(lfsh);
+	}
+
+	lus_close_fs(kept);
+}
+
+/* Traced child. Only the opens are between two markers. */
+static void traced_child(void)
+{
+	struct lus_fs_handle *lfsh;
+	size_t i;
+
+	if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1)
+		_exit(EXIT_FAILURE);
+	raise(SIGSTOP);
+
+	for (i = 0; i < NUM_MODES; i++) {
+		struct lus_fs_handle *kept = NULL;
+
+		if (modes[i].keep_handle)
+			modes[i].open_fs(&kept);
+
+		syscall(SYS_getppid);
+		if (modes[i].open_fs(&lfsh) == 0)
+			lus_close_fs(lfsh);
+		syscall(SYS_getppid);
+
+		lus_close_fs(kept);
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+/* Count the system calls made between the markers of the child. */
+static int count_syscalls(unsigned long *counts)
+{
+	struct __ptrace_syscall_info info;
+	unsigned int mode = 0;
+	bool inside = false;
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid == -1)
+		return -errno;
+	if (pid == 0)
+		traced_child();
+
+	if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status))
+		return -ECHILD;
+
+	ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD);
+
+	while (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) == 0) {
+		if (waitpid(pid, &status, 0) == -1 || WIFEXITED(status))
+			break;
+
+		/* Only the system call stops */
+		if (!WIFSTOPPED(status) ||
+		    WSTOPSIG(status) != (SIGTRAP | 0x80))
+			continue;
+
+		if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info),
+			   &info) == -1)
+			return -errno;
+
+		if (info.op != PTRACE_SYSCALL_INFO_ENTRY)
+			continue;
+
+		if (info.entry.nr == SYS_getppid) {
+			if (inside)
+				mode++;
+			inside = !inside;
+		} else if (inside && mode < NUM_MODES) {
+			counts[mode]++;
+		}
+	}
+
+	waitpid(pid, &status, 0);
+
+	return mode == NUM_MODES ? 0 : -EIO;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long counts[NUM_MODES] = { 0 };
+	struct lus_fs_handle *lfsh;
+	double start;
+	size_t i;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+		switch (opt) {
+		case 'd':
+			lustre_dir = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-d lustre_dir] [-n opens]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* Also warms up the one time initializations. */
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	if (rc) {
+		fprintf(stderr, "cannot open '%s': %s\n",
+			lustre_dir, strerror(-rc));
+		return EXIT_FAILURE;
+	}
+	lus_close_fs(lfsh);
+
+	for (i = 0; i < NUM_MODES; i++) {
+		start = bench_now();
+		run_mode(&modes[i], count);
+		bench_report(modes[i].name, count, bench_now() - start);
+	}
+
+	if (errors)
+		fprintf(stderr, "%u opens failed\n", errors);
+
+	rc = count_syscalls(counts);
+	if (rc) {
+		fprintf(stderr, "cannot count the system calls: %s\n",
+			strerror(-rc));
+		return EXIT_FAILURE;
+	}
+
+	printf("\n%-30s %10s\n", "system calls per open+close", "");
+	for (i = 0; i < NUM_MODES; i++)
+		printf("%-30s %10lu\n", modes[i].name, counts[i]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Measure the throughput of lus_parallel_write() and
+ * lus_parallel_read() for an increasing stripe count and number of
+ * threads, compared to a single pwrite/pread.
+ *
+ * On Lustre, the files are created with the requested striping and
+ * written under a group lock. Elsewhere, such as the default tmpfs
+ * directory, a layout is made up and no lock is taken, which only
+ * measures the cost of splitting the I/Os.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+static size_t size = 256;		/* MiB */
+static uint64_t stripe_size = 1;	/* MiB */
+
+static void report(const char *name, double elapsed)
+{
+	printf("%-30s %10zu MiB %10.3f s %12.0f MiB/s\n",
+	       name, size, elapsed, elapsed > 0 ? size / elapsed : 0);
+}
+
+/* Create a file striped over stripe_count OSTs. Return its descriptor
+ * and layout, and whether it is on Lustre. */
+static int create_file(const char *path, unsigned int stripe_count,
+		       struct lus_layout **layout, bool *lustre)
+{
+	int fd;
+	int rc;
+
+	*lustre = false;
+
+	rc = lus_layout_alloc(0, layout);
+	if (rc)
+		return rc;
+
+	lus_layout_stripe_set_count(*layout, stripe_count);
+	lus_layout_stripe_set_size(*layout, stripe_size << 20);
+
+	unlink(path);
+	fd = lus_layout_file_create(path, O_RDWR, 0600, *layout);
+	if (fd >= 0) {
+		/* There may be fewer OSTs than requested. */
+		lus_layout_free(*layout);
+		rc = lus_layout_get_by_fd(fd, layout);
+		if (rc) {
+			close(fd);
+			return rc;
+		}
+
+		*lustre = true;
+		return fd;
+	}
+
+	unlink(path);
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1) {
+		lus_layout_free(*layout);
+		return -errno;
+	}
+
+	return fd;
+}
+
+static int run_serial(int fd, char *buf)
+{
+	double start;
+	ssize_t rc;
+
+	start = bench_now();
+	rc = pwrite(fd, buf, size << 20, 0);
+	if (rc != size << 20)
+		return rc == -1 ? -errno : -EIO;
+	fsync(fd);
+	report("pwrite", bench_now() - start);
+
+	start = bench_now();
+	rc = pread(fd, buf, size << 20, 0);
+	if (rc != size << 20)
+		return rc == -1 ? -errno : -EIO;
+	report("pread", bench_now() - start);
+
+	return 0;
+}
+
+static int run_parallel(int fd, char *buf, const struct lus_layout *layout,
+			unsigned int threads, uint64_t gid)
+{
+	char name[64];
+	double start;
+	ssize_t rc;
+
+	start = bench_now();
+	rc = lus_parallel_write(fd, layout, buf, size << 20, 0, threads, gid);
+	if (rc != size << 20)
+		return rc < 0 ? rc : -EIO;
+	fsync(fd);
+	snprintf(name, sizeof(name), "parallel write, %u threads", threads);
+	report(name, bench_now() - start);
+
+	start = bench_now();
+	rc = lus_parallel_read(fd, layout, buf, size << 20, 0, threads, gid);
+	if (rc != size << 20)
+		return rc < 0 ? rc : -EIO;
+	snprintf(name, sizeof(name), "parallel read, %u threads", threads);
+	report(name, bench_now() - start);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = "/dev/shm";
+	unsigned int max_stripes = 8;
+	unsigned int max_threads = 16;
+	unsigned int stripe_count;
+	unsigned int threads;
+	struct lus_layout *layout;
+	char path[PATH_MAX];
+	uint64_t gid;
+	bool lustre;
+	char *buf;
+	int opt;
+	int fd;
+	int rc = 0;
+
+	while ((opt = getopt(argc, argv, "c:d:s:S:t:")) != -1) {
+		switch (opt) {
+		case 'c':
+			max_stripes = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			stripe_size = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d dir] [-s size_MiB] [-S stripe_size_MiB]\n"
+				"          [-c max_stripe_count] [-t max_threads]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (size == 0 || stripe_size == 0 || max_stripes == 0 ||
+	    max_threads == 0 || max_threads > 256) {
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	buf = malloc(size << 20);
+	if (buf == NULL) {
+		fprintf(stderr, "cannot allocate %zu MiB\n", size);
+		return EXIT_FAILURE;
+	}
+	memset(buf, 0x5a, size << 20);
+
+	snprintf(path, sizeof(path), "%s/pario_bench.%d", dir, getpid());
+
+	for (stripe_count = 1; rc == 0 && stripe_count <= max_stripes;
+	     stripe_count *= 2) {
+		fd = create_file(path, stripe_count, &layout, &lustre);
+		if (fd < 0) {
+			rc = fd;
+			break;
+		}
+
+		gid = 0;
+		if (lustre)
+			rc = lus_group_lock_gid(fd, &gid);
+
+		printf("\n%llu stripes of %llu MiB%s\n",
+		       (unsigned long long)lus_layout_stripe_get_count(layout),
+		       (unsigned long long)stripe_size,
+		       lustre ? "" : " (not on Lustre)");
+
+		if (rc == 0)
+			rc = run_serial(fd, buf);
+
+		for (threads = 1; rc == 0 && threads <= max_threads &&
+			     threads <= stripe_count; threads *= 2)
+			rc = run_parallel(fd, buf, layout, threads, gid);
+
+		close(fd);
+		unlink(path);
+		lus_layout_free(layout);
+	}
+
+	if (rc)
+		fprintf(stderr, "benchmark failed: %s\n", strerror(-rc));
+
+	free(buf);
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
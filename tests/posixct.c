@@ -124,6 +124,7 @@ struct options {
 	int			 o_archive_cnt;
 	int			 o_archive_id[LL_HSM_MAX_ARCHIVE];
 	int			 o_report_int;
+	int			 o_mirror_id;
 	unsigned long long	 o_bandwidth;
 	size_t			 o_chunk_size;
 	enum ct_action		 o_action;
@@ -245,6 +246,8 @@ static void usage(const char *name, int rc)
 	"   --dry-run                 Don't run, just show what would be done\n"
 	"   -c, --chunk-size <sz>     I/O size used during data copy\n"
 	"                             (unit can be used, default is MB)\n"
+	"   -m, --mirror <id>         Mirror to archive mirrored files from,\n"
+	"                             if it is up to date\n"
 	"   -p, --hsm-root <path>     Target HSM mount point\n"
 	"   -q, --quiet               Produce less verbose output\n"
 	"   -u, --update-interval <s> Interval between progress reports sent\n"
@@ -272,6 +275,7 @@ static int ct_parseopts(int argc, char * const *argv)
 		{"import",	   no_argument,	      NULL,		   'i'},
 		{"max-sequence",   no_argument,	      NULL,		   'M'},
 		{"max_sequence",   no_argument,	      NULL,		   'M'},
+		{"mirror",	   required_argument, NULL,		   'm'},
 		{"no-attr",	   no_argument,	      &opt.o_copy_attrs,    0},
 		{"no_attr",	   no_argument,	      &opt.o_copy_attrs,    0},
 		{"no-shadow",	   no_argument,	      &opt.o_shadow_tree,   0},
@@ -290,7 +294,7 @@ static int ct_parseopts(int argc, char * const *argv)
 	unsigned long long	 unit;
 
 	optind = 0;
-	while ((c = getopt_long(argc, argv, "A:b:c:hiMp:qru:v",
+	while ((c = getopt_long(argc, argv, "A:b:c:hiMm:p:qru:v",
 				long_opts, NULL)) != -1) {
 		switch (c) {
 		case 'A':
@@ -326,6 +330,16 @@ static int ct_parseopts(int argc, char * const *argv)
 		case 'M':
 			opt.o_action = CA_MAXSEQ;
 			break;
+		case 'm':
+			opt.o_mirror_id = atoi(optarg);
+			if (opt.o_mirror_id <= 0 ||
+			    opt.o_mirror_id > UINT16_MAX) {
+				rc = -EINVAL;
+				CT_ERROR(rc, "bad value for -%c '%s'", c,
+					 optarg);
+				return rc;
+			}
+			break;
 		case 'p':
 			opt.o_hsm_root = optarg;
 			break;
@@ -565,8 +579,11 @@ static int ct_copy_data(struct lus_hsm_action_handle *hcp, const char *src,
 	struct stat		 src_st;
 	struct stat		 dst_st;
 	char			*buf = NULL;
+	size_t			 buf_size = opt.o_chunk_size;
+	bool			 direct;
 	__u64			 write_total = 0;
 	__u64			 length;
+	int			 flags;
 	time_t			 last_report_time;
 	int			 rc = 0;
 	double			 start_ct_now = ct_now();
@@ -627,7 +644,19 @@ static int ct_copy_data(struct lus_hsm_action_handle *hcp, const char *src,
 
 	errno = 0;
 
-	buf = malloc(opt.o_chunk_size);
+	/* Direct I/O, used to read from a mirror, needs an aligned
+	 * buffer and read size. */
+	flags = fcntl(src_fd, F_GETFL);
+	direct = flags != -1 && (flags & O_DIRECT);
+	if (direct) {
+		long page_size = sysconf(_SC_PAGESIZE);
+
+		buf_size = (buf_size + page_size - 1) / page_size * page_size;
+		if (posix_memalign((void **)&buf, page_size, buf_size))
+			buf = NULL;
+	} else {
+		buf = malloc(buf_size);
+	}
 	if (buf == NULL) {
 		rc = -ENOMEM;
 		goto out;
@@ -642,7 +671,7 @@ static int ct_copy_data(struct lus_hsm_action_handle *hcp, const char *src,
 		int	chunk = (length - write_total > opt.o_chunk_size) ?
 				 opt.o_chunk_size : length - write_total;
 
-		rsize = pread(src_fd, buf, chunk, offset);
+		rsize = pread(src_fd, buf, direct ? buf_size : chunk, offset);
 		if (rsize == 0)
 			/* EOF */
 			break;
@@ -653,6 +682,9 @@ static int ct_copy_data(struct lus_hsm_action_handle *hcp, const char *src,
 			break;
 		}
 
+		if (rsize > chunk)
+			rsize = chunk;
+
 		wsize = pwrite(dst_fd, buf, rsize, offset);
 		if (wsize < 0) {
 			rc = -errno;
@@ -909,6 +941,56 @@ static int ct_fini(struct lus_hsm_action_handle **phcp,
 	return rc;
 }
 
+/* Read a mirrored file from the mirror given on the command line if
+ * it is up to date, or else the one the library chooses. Lustre only
+ * reads from a given mirror with direct I/O, which ct_copy_data() then
+ * uses. */
+static int ct_select_mirror(int src_fd, const char *src,
+			    const struct hsm_action_item *hai)
+{
+	struct lus_mirror_hint hint = { .mh_preferred = opt.o_mirror_id };
+	struct lus_layout_composite *composite;
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned int mirror_count;
+	uint16_t mirror_id;
+	int flags;
+	int rc = 0;
+
+	/* Direct I/O needs aligned offsets. */
+	if (hai->hai_extent.offset % page_size != 0 ||
+	    opt.o_chunk_size % page_size != 0)
+		return 0;
+
+	rc = lus_layout_composite_get_by_fd(src_fd, &composite);
+	if (rc < 0)
+		return rc;
+
+	mirror_count = lus_layout_composite_mirror_count(composite);
+	if (mirror_count > 1)
+		rc = lus_layout_composite_pick_mirror(composite,
+						      hai->hai_extent.offset,
+						      hai->hai_extent.length,
+						      &hint, &mirror_id);
+	lus_layout_composite_free(composite);
+	if (mirror_count <= 1 || rc < 0)
+		return rc;
+
+	flags = fcntl(src_fd, F_GETFL);
+	if (flags == -1 || fcntl(src_fd, F_SETFL, flags | O_DIRECT) == -1)
+		return -errno;
+
+	rc = lus_mirror_set_read(src_fd, mirror_id);
+	if (rc < 0) {
+		fcntl(src_fd, F_SETFL, flags);
+		return rc;
+	}
+
+	CT_TRACE("reading '%s' from mirror %u of %u", src, mirror_id,
+		 mirror_count);
+
+	return 0;
+}
+
 static int ct_archive(const struct hsm_action_item *hai, const long hal_flags)
 {
 	struct lus_hsm_action_handle	*hcp = NULL;
@@ -978,6 +1060,12 @@ static int ct_archive(const struct hsm_action_item *hai, const long hal_flags)
 		CT_ERROR(rc, "cannot save file striping info of '%s' in '%s'",
 			 src, dst);
 
+	/* nor is reading from a given mirror */
+	rc = ct_select_mirror(src_fd, src, hai);
+	if (rc < 0)
+		CT_ERROR(rc, "cannot select a mirror of '%s' to read from",
+			 src);
+
 	rc = ct_copy_data(hcp, src, dst, src_fd, dst_fd, hai, hal_flags);
 	if (rc < 0) {
 		CT_ERROR(rc, "data copy failed from '%s' to '%s'", src, dst);
@@ -1532,10 +1620,9 @@ static int ct_import_recurse(const char *relpath)
 	if (relpath == NULL)
 		return -EINVAL;
 
-	/* Is relpath a FID? In which case SFID should expand to three
-	 * elements. */
-	rc = sscanf(relpath, SFID, RFID(&import_fid));
-	if (rc == 3)
+	/* Is relpath a FID? */
+	rc = lus_fid_parse(relpath, &import_fid, NULL);
+	if (rc == 0)
 		return ct_import_fid(&import_fid);
 
 	srcpath = path_concat(opt.o_hsm_root, relpath);
@@ -1690,6 +1777,7 @@ static int ct_rebind_list(const char *list)
 	while ((r = getline(&line, &line_size, filp)) != -1) {
 		lustre_fid	old_fid;
 		lustre_fid	new_fid;
+		const char	*p;
 
 		/* Ignore empty and commented out ('#...') lines. */
 		if (should_ignore_line(line))
@@ -1697,8 +1785,12 @@ static int ct_rebind_list(const char *list)
 
 		nl++;
 
-		rc = sscanf(line, SFID" "SFID, RFID(&old_fid), RFID(&new_fid));
-		if (rc != 6 || !fid_is_file(&old_fid) ||
+		rc = lus_fid_parse(line, &old_fid, &p);
+		if (rc == 0) {
+			p += strspn(p, " \t");
+			rc = lus_fid_parse(p, &new_fid, NULL);
+		}
+		if (rc != 0 || !fid_is_file(&old_fid) ||
 		    !fid_is_file(&new_fid)) {
 			CT_ERROR(EINVAL,
 				 "'%s' FID expected near '%s', line %u",
@@ -1732,14 +1824,14 @@ static int ct_rebind(void)
 		lustre_fid	old_fid;
 		lustre_fid	new_fid;
 
-		if (sscanf(opt.o_src, SFID, RFID(&old_fid)) != 3 ||
+		if (lus_fid_parse(opt.o_src, &old_fid, NULL) != 0 ||
 		    !fid_is_file(&old_fid)) {
 			rc = -EINVAL;
 			CT_ERROR(rc, "'%s' invalid FID format", opt.o_src);
 			return rc;
 		}
 
-		if (sscanf(opt.o_dst, SFID, RFID(&new_fid)) != 3 ||
+		if (lus_fid_parse(opt.o_dst, &new_fid, NULL) != 0 ||
 		    !fid_is_file(&new_fid)) {
 			rc = -EINVAL;
 			CT_ERROR(rc, "'%s' invalid FID format", opt.o_dst);
@@ -0,0 +1,297 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Compare a recursive readdir walk, like posixct does for imports,
+ * with lus_scan() using an increasing number of threads.
+ *
+ * A synthetic tree is created under a tmpfs directory (/dev/shm by
+ * default) and removed at the end; it doesn't need a Lustre
+ * filesystem. Every entry is stat'ed, as most walkers do. The tree
+ * has width directories per level, depth levels, and files in each
+ * directory. A directory with a large number of files can be added
+ * with -b.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lustre/lustre.h>
+
+#include "bench.h"
+
+static unsigned int width = 8;
+static unsigned int depth = 3;
+static unsigned int files = 100;
+static unsigned int big_files;
+
+static int make_tree(const char *path, unsigned int level)
+{
+	char name[PATH_MAX];
+	unsigned int i;
+	int fd;
+
+	if (mkdir(path, 0700) == -1)
+		return -errno;
+
+	for (i = 0; i < files; i++) {
+		snprintf(name, sizeof(name), "%s/file.%u", path, i);
+		fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		if (fd == -1)
+			return -errno;
+		close(fd);
+	}
+
+	if (level == depth)
+		return 0;
+
+	for (i = 0; i < width; i++) {
+		snprintf(name, sizeof(name), "%s/dir.%u", path, i);
+		if (make_tree(name, level + 1))
+			return -errno;
+	}
+
+	return 0;
+}
+
+static int make_big_dir(const char *path)
+{
+	char name[32];
+	unsigned int i;
+	int dir_fd;
+	int fd;
+
+	if (mkdir(path, 0700) == -1)
+		return -errno;
+
+	dir_fd = open(path, O_RDONLY | O_DIRECTORY);
+	if (dir_fd == -1)
+		return -errno;
+
+	for (i = 0; i < big_files; i++) {
+		snprintf(name, sizeof(name), "file.%u", i);
+		fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_EXCL, 0600);
+		if (fd == -1)
+			break;
+		close(fd);
+	}
+
+	close(dir_fd);
+
+	return i == big_files ? 0 : -errno;
+}
+
+/* Single threaded walk with opendir/readdir and fstatat. */
+static size_t readdir_walk(int dir_fd)
+{
+	struct dirent *d;
+	struct stat st;
+	size_t count = 0;
+	DIR *dir;
+	int fd;
+
+	dir = fdopendir(dir_fd);
+	if (dir == NULL) {
+		close(dir_fd);
+		return 0;
+	}
+
+	while ((d = readdir(dir)) != NULL) {
+		if (strcmp(d->d_name, ".") == 0 ||
+		    strcmp(d->d_name, "..") == 0)
+			continue;
+
+		if (fstatat(dirfd(dir), d->d_name, &st,
+			    AT_SYMLINK_NOFOLLOW) == -1)
+			continue;
+
+		count++;
+
+		if (!S_ISDIR(st.st_mode))
+			continue;
+
+		fd = openat(dirfd(dir), d->d_name,
+			    O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		if (fd != -1)
+			count += readdir_walk(fd);
+	}
+
+	closedir(dir);
+
+	return count;
+}
+
+static int count_cb(const struct lus_scan_entry *entry, void *cb_arg)
+{
+	size_t *count = cb_arg;
+
+	__atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static int remove_cb(const struct lus_scan_entry *entry, void *cb_arg)
+{
+	if (entry->type != DT_DIR)
+		unlinkat(entry->dir_fd, entry->name, 0);
+
+	return 0;
+}
+
+/* Remove the directories, deepest first, once remove_cb() has
+ * removed everything else. */
+static void remove_dirs(const char *path)
+{
+	char name[PATH_MAX];
+	struct dirent *d;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (dir == NULL)
+		return;
+
+	while ((d = readdir(dir)) != NULL) {
+		if (d->d_type != DT_DIR || strcmp(d->d_name, ".") == 0 ||
+		    strcmp(d->d_name, "..") == 0)
+			continue;
+
+		snprintf(name, sizeof(name), "%s/%s", path, d->d_name);
+		remove_dirs(name);
+	}
+
+	closedir(dir);
+	rmdir(path);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *base = "/dev/shm";
+	unsigned int max_threads;
+	char root[PATH_MAX];
+	char path[PATH_MAX];
+	char name[64];
+	unsigned int threads;
+	size_t expected;
+	size_t count;
+	double start;
+	int fd;
+	int opt;
+	int rc;
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "b:d:D:n:t:w:")) != -1) {
+		switch (opt) {
+		case 'b':
+			big_files = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			base = optarg;
+			break;
+		case 'D':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			files = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			max_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			width = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d tmpfs_dir] [-w width] [-D depth] [-n files]\n"
+				"          [-b big_dir_files] [-t max_threads]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (max_threads == 0 || max_threads > 256)
+		max_threads = 256;
+
+	snprintf(root, sizeof(root), "%s/scan_bench.%d", base, getpid());
+	snprintf(path, sizeof(path), "%s/scan_bench.%d/tree", base, getpid());
+
+	if (mkdir(root, 0700) == -1) {
+		fprintf(stderr, "cannot create '%s': %s\n", root,
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	start = bench_now();
+	rc = make_tree(path, 0);
+	if (rc == 0 && big_files) {
+		snprintf(path, sizeof(path), "%s/scan_bench.%d/big", base,
+			 getpid());
+		rc = make_big_dir(path);
+	}
+	if (rc) {
+		fprintf(stderr, "cannot create the tree: %s\n", strerror(-rc));
+		goto out;
+	}
+
+	fd = open(root, O_RDONLY | O_DIRECTORY);
+	if (fd == -1) {
+		rc = -errno;
+		goto out;
+	}
+	expected = readdir_walk(fd);
+	printf("tree of %zu entries created in %.3f s\n\n",
+	       expected, bench_now() - start);
+
+	start = bench_now();
+	fd = open(root, O_RDONLY | O_DIRECTORY);
+	if (fd == -1) {
+		rc = -errno;
+		goto out;
+	}
+	count = readdir_walk(fd);
+	bench_report("readdir walk", count, bench_now() - start);
+
+	for (threads = 1; threads <= max_threads; threads *= 2) {
+		count = 0;
+		start = bench_now();
+		rc = lus_scan(NULL, root, LUS_SCAN_STAT, threads,
+			      count_cb, &count);
+		if (rc) {
+			fprintf(stderr, "lus_scan failed: %s\n",
+				strerror(-rc));
+			goto out;
+		}
+
+		snprintf(name, sizeof(name), "lus_scan, %u threads", threads);
+		bench_report(name, count, bench_now() - start);
+
+		if (count != expected)
+			fprintf(stderr, "found %zu entries instead of %zu\n",
+				count, expected);
+	}
+
+out:
+	lus_scan(NULL, root, 0, max_threads, remove_cb, NULL);
+	remove_dirs(root);
+
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the asynchronous requests. No Lustre filesystem is needed: a
+ * temporary directory, holding files named after FIDs, stands in for
+ * the .lustre/fid directory.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/async.c"
+
+#define NUM_FILES 50
+
+static unsigned int callbacks;
+
+static void store_result(void *cb_arg, int result)
+{
+	*(int *)cb_arg = result;
+	callbacks++;
+}
+
+static void make_fid(lustre_fid *fid, unsigned int oid)
+{
+	fid->f_seq = 0x200000401;
+	fid->f_oid = oid;
+	fid->f_ver = 0;
+}
+
+/* Submit open, statx, getxattr and close requests for NUM_FILES files,
+ * with fewer slots than files, and check the results. */
+static void async_test(unsigned int flags)
+{
+	struct lus_fs_handle lfsh = { .pool = NULL };
+	char dir[] = "/tmp/unittest_async.XXXXXX";
+	char fidstr[FID_NOBRACE_LEN + 1];
+	struct statx stx[NUM_FILES];
+	int results[NUM_FILES];
+	int fds[NUM_FILES];
+	struct lus_async_ctx *ctx;
+	lustre_fid fid;
+	bool has_xattr;
+	char value[10];
+	unsigned int i;
+	int rc;
+	int fd;
+
+	ck_assert_ptr_ne(mkdtemp(dir), NULL);
+	lfsh.fid_fd = open(dir, O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(lfsh.fid_fd, 0);
+
+	has_xattr = true;
+	for (i = 0; i < NUM_FILES; i++) {
+		make_fid(&fid, i + 1);
+		lus_fid_format(&fid, fidstr, sizeof(fidstr));
+		fd = openat(lfsh.fid_fd, fidstr, O_CREAT | O_WRONLY, 0600);
+		ck_assert_int_ge(fd, 0);
+		rc = ftruncate(fd, i);
+		ck_assert_int_eq(rc, 0);
+		if (fsetxattr(fd, "user.test", "liblustre", 9, 0) == -1)
+			has_xattr = false;
+		close(fd);
+	}
+
+	rc = lus_async_ctx_create(&lfsh, 0, flags, &ctx);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	rc = lus_async_ctx_create(&lfsh, 8, flags, &ctx);
+	ck_assert_int_eq(rc, 0);
+	if (flags & LUS_ASYNC_THREADS)
+		ck_assert_str_eq(lus_async_backend(ctx), "threads");
+
+	/* Open. The submissions wait for free slots. */
+	callbacks = 0;
+	for (i = 0; i < NUM_FILES; i++) {
+		make_fid(&fid, i + 1);
+		rc = lus_async_open_by_fid(ctx, &fid, O_RDONLY,
+					   store_result, &fds[i]);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_le(lus_async_inflight(ctx), 8);
+	}
+
+	while (lus_async_inflight(ctx) > 0) {
+		rc = lus_async_poll(ctx, 1);
+		ck_assert_int_ge(rc, 1);
+	}
+	ck_assert_int_eq(callbacks, NUM_FILES);
+
+	for (i = 0; i < NUM_FILES; i++)
+		ck_assert_int_ge(fds[i], 0);
+
+	/* Stat, including a non existent FID */
+	callbacks = 0;
+	for (i = 0; i < NUM_FILES; i++) {
+		make_fid(&fid, i + 1);
+		rc = lus_async_statx_by_fid(ctx, &fid, STATX_SIZE, &stx[i],
+					    store_result, &results[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	make_fid(&fid, NUM_FILES + 1);
+	rc = lus_async_statx_by_fid(ctx, &fid, STATX_SIZE, &stx[0],
+				    store_result, &results[0]);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_async_poll(ctx, UINT_MAX);
+	ck_assert_int_ge(rc, 1);
+	ck_assert_int_eq(lus_async_inflight(ctx), 0);
+	ck_assert_int_eq(callbacks, NUM_FILES + 1);
+
+	ck_assert_int_eq(results[0], -ENOENT);
+	for (i = 1; i < NUM_FILES; i++) {
+		ck_assert_int_eq(results[i], 0);
+		ck_assert(stx[i].stx_mask & STATX_SIZE);
+		ck_assert_int_eq(stx[i].stx_size, i);
+	}
+
+	/* Extended attribute */
+	memset(value, 0, sizeof(value));
+	rc = lus_async_fgetxattr(ctx, fds[1], "user.test", value,
+				 sizeof(value), store_result, &results[0]);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_async_fgetxattr(ctx, fds[1], "user.nonexistent", value,
+				 sizeof(value), store_result, &results[1]);
+	ck_assert_int_eq(rc, 0);
+
+	lus_async_poll(ctx, 2);
+	ck_assert_int_eq(lus_async_inflight(ctx), 0);
+
+	if (has_xattr) {
+		ck_assert_int_eq(results[0], 9);
+		ck_assert_str_eq(value, "liblustre");
+		ck_assert_int_eq(results[1], -ENODATA);
+	}
+
+	/* Close */
+	callbacks = 0;
+	for (i = 0; i < NUM_FILES; i++) {
+		rc = lus_async_close(ctx, fds[i], store_result, &results[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	lus_async_poll(ctx, UINT_MAX);
+	ck_assert_int_eq(callbacks, NUM_FILES);
+	for (i = 0; i < NUM_FILES; i++)
+		ck_assert_int_eq(results[i], 0);
+
+	/* Closing again fails */
+	rc = lus_async_close(ctx, fds[0], store_result, &results[0]);
+	ck_assert_int_eq(rc, 0);
+	lus_async_poll(ctx, 1);
+	ck_assert_int_eq(results[0], -EBADF);
+
+	/* Destroying with requests in flight */
+	make_fid(&fid, 1);
+	rc = lus_async_statx_by_fid(ctx, &fid, STATX_SIZE, &stx[0],
+				    store_result, &results[0]);
+	ck_assert_int_eq(rc, 0);
+
+	lus_async_ctx_destroy(ctx);
+
+	for (i = 0; i < NUM_FILES; i++) {
+		make_fid(&fid, i + 1);
+		lus_fid_format(&fid, fidstr, sizeof(fidstr));
+		unlinkat(lfsh.fid_fd, fidstr, 0);
+	}
+	close(lfsh.fid_fd);
+	rmdir(dir);
+}
+
+/* Number of descriptors opened by the process. */
+static unsigned int count_fds(void)
+{
+	unsigned int count = 0;
+	struct dirent *d;
+	DIR *dir;
+
+	dir = opendir("/proc/self/fd");
+	ck_assert_ptr_ne(dir, NULL);
+
+	while ((d = readdir(dir)) != NULL) {
+		if (d->d_name[0] != '.')
+			count++;
+	}
+
+	closedir(dir);
+
+	return count;
+}
+
+/* Destroy a context with open and close requests still queued. The
+ * closes are executed, and the opened files are closed. */
+static void async_destroy_test(unsigned int flags)
+{
+	struct lus_fs_handle lfsh = { .pool = NULL };
+	char dir[] = "/tmp/unittest_async.XXXXXX";
+	char fidstr[FID_NOBRACE_LEN + 1];
+	int results[NUM_FILES];
+	struct lus_async_ctx *ctx;
+	unsigned int before;
+	lustre_fid fid;
+	unsigned int i;
+	int rc;
+	int fd;
+
+	ck_assert_ptr_ne(mkdtemp(dir), NULL);
+	lfsh.fid_fd = open(dir, O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(lfsh.fid_fd, 0);
+
+	make_fid(&fid, 1);
+	lus_fid_format(&fid, fidstr, sizeof(fidstr));
+	fd = openat(lfsh.fid_fd, fidstr, O_CREAT | O_WRONLY, 0600);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+
+	before = count_fds();
+
+	rc = lus_async_ctx_create(&lfsh, NUM_FILES, flags, &ctx);
+	ck_assert_int_eq(rc, 0);
+
+	for (i = 0; i < NUM_FILES / 2; i++) {
+		fd = openat(lfsh.fid_fd, fidstr, O_RDONLY);
+		ck_assert_int_ge(fd, 0);
+		rc = lus_async_close(ctx, fd, store_result, &results[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	for (; i < NUM_FILES; i++) {
+		rc = lus_async_open_by_fid(ctx, &fid, O_RDONLY,
+					   store_result, &results[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	callbacks = 0;
+	lus_async_ctx_destroy(ctx);
+	ck_assert_int_eq(callbacks, 0);
+
+	ck_assert_int_eq(count_fds(), before);
+
+	unlinkat(lfsh.fid_fd, fidstr, 0);
+	close(lfsh.fid_fd);
+	rmdir(dir);
+}
+
+void unittest_async_threads(void)
+{
+	async_test(LUS_ASYNC_THREADS);
+	async_destroy_test(LUS_ASYNC_THREADS);
+}
+
+/* Falls back to the threads if the kernel has no io_uring. */
+void unittest_async_uring(void)
+{
+	async_test(0);
+	async_destroy_test(0);
+}
@@ -0,0 +1,402 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the changelog reader with recorded streams, fed through a
+ * pipe or a file instead of the kernel.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/changelog.c"
+#include "lib_test.h"
+
+#define NUM_RECORDS 10000
+#define FIRST_RECORD 1000
+
+struct stream {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+struct writer {
+	const struct stream *stream;
+	int fd;
+	size_t chunk;
+};
+
+static void stream_append(struct stream *stream, unsigned int transport,
+			  unsigned int msgtype, const void *data, size_t len)
+{
+	struct kuc_hdr hdr = {
+		.kuc_magic = KUC_MAGIC,
+		.kuc_transport = transport,
+		.kuc_msgtype = msgtype,
+		.kuc_msglen = sizeof(hdr) + len,
+	};
+
+	if (stream->len + sizeof(hdr) + len > stream->size) {
+		stream->size = 2 * stream->size + sizeof(hdr) + len;
+		stream->buf = realloc(stream->buf, stream->size);
+		ck_assert_ptr_ne(stream->buf, NULL);
+	}
+
+	memcpy(&stream->buf[stream->len], &hdr, sizeof(hdr));
+	memcpy(&stream->buf[stream->len + sizeof(hdr)], data, len);
+	stream->len += sizeof(hdr) + len;
+}
+
+/* Record i has a name of i % 200 characters, all set to 'a' + i % 26.
+ * Every 3rd record has the rename extension, and every 5th a job
+ * ID. The target FIDs cycle over nfids FIDs. */
+static void make_stream(struct stream *stream, bool eof, unsigned int nfids)
+{
+	char data[1024];
+	struct changelog_rec *rec = (struct changelog_rec *)data;
+	unsigned int i;
+
+	memset(stream, 0, sizeof(*stream));
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		memset(data, 0, sizeof(data));
+		rec->cr_index = FIRST_RECORD + i;
+		rec->cr_type = CL_CREATE;
+		rec->cr_tfid.f_seq = 0x200000400;
+		rec->cr_tfid.f_oid = i % nfids;
+		rec->cr_pfid.f_oid = i;
+		rec->cr_flags = CLF_VERSION;
+		if (i % 3 == 0)
+			rec->cr_flags |= CLF_RENAME;
+		if (i % 5 == 0)
+			rec->cr_flags |= CLF_JOBID;
+		rec->cr_namelen = i % 200;
+
+		if (rec->cr_flags & CLF_RENAME)
+			changelog_rec_rename(rec)->cr_sfid.f_oid = i;
+		if (rec->cr_flags & CLF_JOBID)
+			snprintf(changelog_rec_jobid(rec)->cr_jobid,
+				 LUSTRE_JOBID_SIZE, "job.%u", i);
+		memset(changelog_rec_name(rec), 'a' + i % 26,
+		       rec->cr_namelen);
+
+		stream_append(stream, KUC_TRANSPORT_CHANGELOG, CL_RECORD,
+			      rec, changelog_rec_size(rec));
+
+		/* Messages for somebody else are ignored. */
+		if (i % 1000 == 0)
+			stream_append(stream, KUC_TRANSPORT_HSM, 100, data, 27);
+	}
+
+	if (eof)
+		stream_append(stream, KUC_TRANSPORT_CHANGELOG, CL_EOF,
+			      data, 0);
+}
+
+static void check_record(const struct changelog_rec *rec, unsigned int i)
+{
+	const char *name;
+	char jobid[LUSTRE_JOBID_SIZE];
+	unsigned int j;
+
+	ck_assert_int_eq(rec->cr_index, FIRST_RECORD + i);
+	ck_assert_int_eq(rec->cr_type, CL_CREATE);
+	ck_assert_int_eq(rec->cr_pfid.f_oid, i);
+	ck_assert_int_eq(rec->cr_namelen, i % 200);
+	ck_assert_int_eq(!!(rec->cr_flags & CLF_RENAME), i % 3 == 0);
+	ck_assert_int_eq(!!(rec->cr_flags & CLF_JOBID), i % 5 == 0);
+
+	if (rec->cr_flags & CLF_RENAME)
+		ck_assert_int_eq(changelog_rec_rename(rec)->cr_sfid.f_oid, i);
+
+	if (rec->cr_flags & CLF_JOBID) {
+		snprintf(jobid, sizeof(jobid), "job.%u", i);
+		ck_assert_str_eq(changelog_rec_jobid(rec)->cr_jobid, jobid);
+	}
+
+	name = changelog_rec_name(rec);
+	for (j = 0; j < rec->cr_namelen; j++)
+		ck_assert_int_eq(name[j], 'a' + i % 26);
+}
+
+/* Write the stream in small chunks, which splits the messages. */
+static void *writer_thread(void *arg)
+{
+	struct writer *writer = arg;
+	const struct stream *stream = writer->stream;
+	size_t pos;
+	size_t len;
+	ssize_t rc;
+
+	for (pos = 0; pos < stream->len; pos += rc) {
+		len = stream->len - pos;
+		if (len > writer->chunk)
+			len = writer->chunk;
+
+		rc = write(writer->fd, &stream->buf[pos], len);
+		if (rc <= 0)
+			break;
+	}
+
+	close(writer->fd);
+
+	return NULL;
+}
+
+/* Read all the records of a stream, and clear them as we go. */
+static int read_stream(struct lus_changelog *cl, unsigned int *count)
+{
+	const struct changelog_rec *rec;
+	int rc;
+
+	*count = 0;
+
+	while ((rc = lus_changelog_recv(cl, &rec)) == 0) {
+		ck_assert_int_eq((uintptr_t)rec % sizeof(__u64), 0);
+		check_record(rec, *count);
+		ck_assert_int_eq(lus_changelog_clear(cl, rec->cr_index), 0);
+		(*count)++;
+	}
+
+	return rc;
+}
+
+/* Records split across reads of a pipe */
+void unittest_changelog_pipe(void)
+{
+	static const size_t chunks[] = { 1, 777, 4096, 100000 };
+	struct lus_changelog *cl;
+	struct stream stream;
+	struct writer writer;
+	pthread_t thread;
+	unsigned int count;
+	unsigned int i;
+	int pipefd[2];
+	int rc;
+
+	make_stream(&stream, true, NUM_RECORDS);
+
+	for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+		ck_assert_int_eq(pipe(pipefd), 0);
+
+		writer.stream = &stream;
+		writer.fd = pipefd[1];
+		writer.chunk = chunks[i];
+		ck_assert_int_eq(pthread_create(&thread, NULL, writer_thread,
+						&writer), 0);
+
+		rc = lus_changelog_open_fd(pipefd[0], &cl);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(lus_changelog_get_fd(cl), pipefd[0]);
+
+		rc = read_stream(cl, &count);
+		ck_assert_int_eq(rc, 1);
+		ck_assert_int_eq(count, NUM_RECORDS);
+		ck_assert_int_eq(cl->cleared, FIRST_RECORD + NUM_RECORDS - 1);
+
+		/* Still at the end */
+		rc = read_stream(cl, &count);
+		ck_assert_int_eq(rc, 1);
+
+		ck_assert_int_eq(lus_changelog_close(cl), 0);
+		pthread_join(thread, NULL);
+		close(pipefd[0]);
+	}
+
+	free(stream.buf);
+}
+
+/* Recorded stream in a file. The clears are coalesced. */
+void unittest_changelog_file(void)
+{
+	const struct changelog_rec *rec;
+	struct lus_changelog *cl;
+	struct stream stream;
+	unsigned int count;
+	int pipefd[2];
+	FILE *f;
+	int rc;
+
+	/* No CL_EOF; the end of the file is enough. */
+	make_stream(&stream, false, NUM_RECORDS);
+
+	f = tmpfile();
+	ck_assert_ptr_ne(f, NULL);
+	ck_assert_int_eq(fwrite(stream.buf, stream.len, 1, f), 1);
+	ck_assert_int_eq(fflush(f), 0);
+
+	rewind(f);
+	rc = lus_changelog_open_fd(fileno(f), &cl);
+	ck_assert_int_eq(rc, 0);
+
+	rc = read_stream(cl, &count);
+	ck_assert_int_eq(rc, 1);
+	ck_assert_int_eq(count, NUM_RECORDS);
+
+	/* One clear every CL_CLEAR_INTERVAL records, and one each
+	 * time the buffer was empty. */
+	ck_assert_int_le(cl->clear_count,
+			 NUM_RECORDS / CL_CLEAR_INTERVAL +
+			 stream.len / CL_BUF_SIZE + 2);
+	ck_assert_int_eq(cl->cleared, FIRST_RECORD + NUM_RECORDS - 1);
+
+	/* Older records are ignored. */
+	ck_assert_int_eq(lus_changelog_clear(cl, FIRST_RECORD), 0);
+	ck_assert_int_eq(cl->clear_pending, FIRST_RECORD + NUM_RECORDS - 1);
+
+	ck_assert_int_eq(lus_changelog_close(cl), 0);
+
+	/* Truncated in the middle of a record */
+	rewind(f);
+	ck_assert_int_eq(ftruncate(fileno(f), stream.len - 10), 0);
+	rc = lus_changelog_open_fd(fileno(f), &cl);
+	ck_assert_int_eq(rc, 0);
+
+	rc = read_stream(cl, &count);
+	ck_assert_int_eq(rc, -EPROTO);
+	ck_assert_int_eq(count, NUM_RECORDS - 1);
+	lus_changelog_close(cl);
+
+	/* Corrupted header */
+	rewind(f);
+	stream.buf[0] ^= 0xff;
+	ck_assert_int_eq(fwrite(stream.buf, stream.len, 1, f), 1);
+	ck_assert_int_eq(fflush(f), 0);
+	rewind(f);
+
+	rc = lus_changelog_open_fd(fileno(f), &cl);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_changelog_recv(cl, &rec);
+	ck_assert_int_eq(rc, -EPROTO);
+	lus_changelog_close(cl);
+
+	fclose(f);
+	free(stream.buf);
+
+	/* Non-blocking stream with nothing to read */
+	ck_assert_int_eq(pipe2(pipefd, O_NONBLOCK), 0);
+	rc = lus_changelog_open_fd(pipefd[0], &cl);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_changelog_recv(cl, &rec);
+	ck_assert_int_eq(rc, -EAGAIN);
+
+	close(pipefd[1]);
+	rc = lus_changelog_recv(cl, &rec);
+	ck_assert_int_eq(rc, 1);
+
+	lus_changelog_close(cl);
+	close(pipefd[0]);
+
+	rc = lus_changelog_open_fd(-1, &cl);
+	ck_assert_int_eq(rc, -EBADF);
+	ck_assert_ptr_eq(cl, NULL);
+}
+
+#define DISPATCH_FIDS 37
+
+struct dispatch_state {
+	__u64 last[DISPATCH_FIDS];	/* last record seen for each FID */
+	unsigned long count;
+	__u64 fail_at;
+};
+
+static int dispatch_cb(const struct changelog_rec *rec, void *cb_arg)
+{
+	struct dispatch_state *state = cb_arg;
+	__u64 *last = &state->last[rec->cr_tfid.f_oid];
+
+	check_record(rec, rec->cr_index - FIRST_RECORD);
+
+	/* Records of a FID are processed in order, by one thread. */
+	ck_assert_int_lt(*last, rec->cr_index);
+	*last = rec->cr_index;
+
+	if (rec->cr_index == state->fail_at)
+		return -EIO;
+
+	/* Let the other workers get ahead. */
+	if (rec->cr_index % 97 == 0)
+		usleep(100);
+
+	__atomic_add_fetch(&state->count, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/* Parallel dispatch of a recorded stream */
+void unittest_changelog_dispatch(void)
+{
+	static const unsigned int workers[] = { 1, 3, 8 };
+	struct dispatch_state state;
+	struct lus_changelog *cl;
+	struct stream stream;
+	unsigned int i;
+	FILE *f;
+	int rc;
+
+	make_stream(&stream, true, DISPATCH_FIDS);
+
+	f = tmpfile();
+	ck_assert_ptr_ne(f, NULL);
+	ck_assert_int_eq(fwrite(stream.buf, stream.len, 1, f), 1);
+	ck_assert_int_eq(fflush(f), 0);
+
+	for (i = 0; i < sizeof(workers) / sizeof(workers[0]); i++) {
+		memset(&state, 0, sizeof(state));
+		rewind(f);
+
+		rc = lus_changelog_open_fd(fileno(f), &cl);
+		ck_assert_int_eq(rc, 0);
+
+		rc = lus_changelog_dispatch(cl, workers[i], dispatch_cb,
+					    &state);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(state.count, NUM_RECORDS);
+		ck_assert_int_eq(cl->clear_pending,
+				 FIRST_RECORD + NUM_RECORDS - 1);
+
+		ck_assert_int_eq(lus_changelog_close(cl), 0);
+	}
+
+	/* A failure stops the dispatch, and the failed record is not
+	 * cleared. */
+	memset(&state, 0, sizeof(state));
+	state.fail_at = FIRST_RECORD + 5000;
+	rewind(f);
+
+	rc = lus_changelog_open_fd(fileno(f), &cl);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_changelog_dispatch(cl, 4, dispatch_cb, &state);
+	ck_assert_int_eq(rc, -EIO);
+	ck_assert_int_lt(cl->clear_pending, state.fail_at);
+	ck_assert_int_lt(state.count, NUM_RECORDS);
+
+	rc = lus_changelog_dispatch(cl, 0, dispatch_cb, &state);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	ck_assert_int_eq(lus_changelog_close(cl), 0);
+
+	fclose(f);
+	free(stream.buf);
+}
@@ -0,0 +1,201 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the cache of directory layouts, and the resolution of the
+ * expected layouts that uses it.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/dir_layout_cache.c"
+#include "lib_test.h"
+
+static struct lus_layout *make_layout(unsigned int stripe_count)
+{
+	struct lus_layout *layout;
+	int rc;
+
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_stripe_set_count(layout, stripe_count);
+	ck_assert_int_eq(rc, 0);
+
+	return layout;
+}
+
+/* Check that a FID is cached with the given stripe count, or not
+ * cached if stripe_count is 0. */
+static void check_cached(struct dir_layout_cache *cache,
+			 const lustre_fid *fid, unsigned int stripe_count)
+{
+	struct lus_layout *layout;
+
+	layout = dir_layout_cache_get(cache, fid);
+	if (stripe_count == 0) {
+		ck_assert_ptr_eq(layout, NULL);
+		return;
+	}
+
+	ck_assert_ptr_ne(layout, NULL);
+	ck_assert_int_eq(lus_layout_stripe_get_count(layout), stripe_count);
+	lus_layout_free(layout);
+}
+
+void unittest_dir_layout_cache(void)
+{
+	struct lus_fs_handle lfsh = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	struct dir_layout_cache *cache;
+	lustre_fid fid1 = { 0x200000401, 1, 0 };
+	lustre_fid fid2 = { 0x200000401, 2, 0 };
+	struct lus_layout *layout1 = make_layout(1);
+	struct lus_layout *layout2 = make_layout(2);
+	int rc;
+
+	rc = dir_layout_cache_create(0, 0, &cache);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* No cache. */
+	dir_layout_cache_put(NULL, &fid1, layout1);
+	check_cached(NULL, &fid1, 0);
+	lus_dir_layout_cache_flush(&lfsh);
+	lus_dir_layout_cache_invalidate(&lfsh, &fid1);
+
+	rc = lus_dir_layout_cache_enable(&lfsh, 16, 0);
+	ck_assert_int_eq(rc, 0);
+	cache = lfsh.dir_layout_cache;
+
+	check_cached(cache, &fid1, 0);
+	dir_layout_cache_put(cache, &fid1, layout1);
+	dir_layout_cache_put(cache, &fid2, layout2);
+	check_cached(cache, &fid1, 1);
+	check_cached(cache, &fid2, 2);
+
+	/* Replace an entry. */
+	dir_layout_cache_put(cache, &fid1, layout2);
+	check_cached(cache, &fid1, 2);
+
+	lus_dir_layout_cache_invalidate(&lfsh, &fid1);
+	check_cached(cache, &fid1, 0);
+	check_cached(cache, &fid2, 2);
+
+	/* A flush starts a new generation. */
+	dir_layout_cache_put(cache, &fid1, layout1);
+	lus_dir_layout_cache_flush(&lfsh);
+	check_cached(cache, &fid1, 0);
+	check_cached(cache, &fid2, 0);
+	dir_layout_cache_put(cache, &fid1, layout1);
+	check_cached(cache, &fid1, 1);
+
+	/* A single slot only keeps the last directory. */
+	rc = lus_dir_layout_cache_enable(&lfsh, 1, 0);
+	ck_assert_int_eq(rc, 0);
+	cache = lfsh.dir_layout_cache;
+	check_cached(cache, &fid1, 0);
+	dir_layout_cache_put(cache, &fid1, layout1);
+	dir_layout_cache_put(cache, &fid2, layout2);
+	check_cached(cache, &fid1, 0);
+	check_cached(cache, &fid2, 2);
+
+	/* Expiration. */
+	rc = lus_dir_layout_cache_enable(&lfsh, 16, 10);
+	ck_assert_int_eq(rc, 0);
+	cache = lfsh.dir_layout_cache;
+	dir_layout_cache_put(cache, &fid1, layout1);
+	check_cached(cache, &fid1, 1);
+	usleep(20000);
+	check_cached(cache, &fid1, 0);
+
+	lus_dir_layout_cache_disable(&lfsh);
+	ck_assert_ptr_eq(lfsh.dir_layout_cache, NULL);
+
+	lus_layout_free(layout1);
+	lus_layout_free(layout2);
+}
+
+/* Compare lus_layout_get_expected() and lus_layout_expected_many() to
+ * lus_layout_get_by_path(), with and without the cache. */
+void unittest_expected_lustre(void)
+{
+	char paths[3][PATH_MAX];
+	const char *path_list[3];
+	struct lus_layout *expected[3];
+	struct lus_layout *layouts[3];
+	struct lus_fs_handle *lfsh;
+	struct lus_layout *layout;
+	int errors[3];
+	ssize_t found;
+	int pass;
+	int rc;
+	int i;
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	ck_assert_int_eq(rc, 0);
+
+	/* A new file, an existing directory, and a file in a
+	 * directory that doesn't exist. */
+	snprintf(paths[0], sizeof(paths[0]), "%s/unittest_expected",
+		 lustre_dir);
+	unlink(paths[0]);
+	snprintf(paths[1], sizeof(paths[1]), "%s", lustre_dir);
+	snprintf(paths[2], sizeof(paths[2]), "%s/no_such_dir/file",
+		 lustre_dir);
+
+	for (i = 0; i < 3; i++) {
+		path_list[i] = paths[i];
+		rc = lus_layout_get_by_path(paths[i], LAYOUT_GET_EXPECTED,
+					    &expected[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	for (pass = 0; pass < 3; pass++) {
+		/* No cache, an empty cache, then a filled one. */
+		if (pass == 1) {
+			rc = lus_dir_layout_cache_enable(lfsh, 16, 0);
+			ck_assert_int_eq(rc, 0);
+		}
+
+		for (i = 0; i < 3; i++) {
+			rc = lus_layout_get_expected(lfsh, paths[i], &layout);
+			ck_assert_int_eq(rc, 0);
+			ck_assert(lus_layout_equal(layout, expected[i], 0));
+			lus_layout_free(layout);
+		}
+
+		found = lus_layout_expected_many(lfsh, path_list, 3, layouts,
+						 errors);
+		ck_assert_int_eq(found, 3);
+		for (i = 0; i < 3; i++) {
+			ck_assert_int_eq(errors[i], 0);
+			ck_assert(lus_layout_equal(layouts[i], expected[i], 0));
+			lus_layout_free(layouts[i]);
+		}
+	}
+
+	found = lus_layout_expected_many(lfsh, NULL, 3, layouts, errors);
+	ck_assert_int_eq(found, -EINVAL);
+
+	for (i = 0; i < 3; i++)
+		lus_layout_free(expected[i]);
+
+	lus_dir_layout_cache_disable(lfsh);
+	lus_close_fs(lfsh);
+}
@@ -0,0 +1,195 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the FID to text conversions.
+ */
+
+#include <stdlib.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/fid.c"
+
+/* Compare lus_fid_format() and lus_fid_parse() with snprintf() and
+ * sscanf() on a set of random FIDs. */
+void unittest_fid_format(void)
+{
+	char buf[FID_NOBRACE_LEN + 1];
+	char ref[FID_NOBRACE_LEN + 1];
+	lustre_fid fid;
+	lustre_fid fid2;
+	const char *end;
+	int rc;
+	int i;
+
+	srandom(1234);
+
+	for (i = 0; i < 100000; i++) {
+		fid.f_seq = ((uint64_t)random() << 33) ^ random();
+		fid.f_oid = random() * 2;
+		fid.f_ver = random() & 0xff;
+
+		/* Also exercise the short values */
+		if (i % 7 == 0)
+			fid.f_seq >>= random() % 64;
+		if (i % 11 == 0)
+			fid.f_oid >>= random() % 32;
+		if (i % 13 == 0)
+			fid.f_seq = 0;
+
+		snprintf(ref, sizeof(ref), DFID_NOBRACE, PFID(&fid));
+		rc = lus_fid_format(&fid, buf, sizeof(buf));
+		ck_assert_int_eq(rc, strlen(ref));
+		ck_assert_str_eq(buf, ref);
+
+		rc = lus_fid_parse(buf, &fid2, &end);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_ptr_eq(end, buf + strlen(buf));
+		ck_assert(memcmp(&fid, &fid2, sizeof(fid)) == 0);
+	}
+
+	/* Buffer too small */
+	fid.f_seq = 0x200000401;
+	fid.f_oid = 0x1;
+	fid.f_ver = 0;
+	memset(buf, 'x', sizeof(buf));
+	rc = lus_fid_format(&fid, buf, strlen("0x200000401:0x1:0x0"));
+	ck_assert_int_eq(rc, -ENOSPC);
+	ck_assert_int_eq(buf[0], 'x');
+
+	rc = lus_fid_format(&fid, buf, strlen("0x200000401:0x1:0x0") + 1);
+	ck_assert_int_eq(rc, strlen("0x200000401:0x1:0x0"));
+	ck_assert_str_eq(buf, "0x200000401:0x1:0x0");
+
+	/* Largest FID */
+	fid.f_seq = UINT64_MAX;
+	fid.f_oid = UINT32_MAX;
+	fid.f_ver = UINT32_MAX;
+	rc = lus_fid_format(&fid, buf, sizeof(buf));
+	ck_assert_int_eq(rc, FID_NOBRACE_LEN);
+	ck_assert_str_eq(buf, "0xffffffffffffffff:0xffffffff:0xffffffff");
+}
+
+void unittest_fid_parse(void)
+{
+	static const char * const good[] = {
+		"[0x200000401:0x1:0x0]",
+		"0x200000401:0x1:0x0",
+		"200000401:1:0",
+		"[0x200000401:0x1:0x0]/some/path",
+		"0X200000401:0X1:0X0",
+		"0x0000000200000401:0x00000001:0x00000000",
+		"0x200000401:0x1:0x0 0x200000402:0x2:0x0",
+	};
+	static const char * const bad[] = {
+		"",
+		"[",
+		"[0x200000401:0x1:0x0",
+		"[0x200000401:0x1]",
+		"0x200000401::0x0",
+		"0x:0x1:0x0",
+		"x200000401:0x1:0x0",
+		" 0x200000401:0x1:0x0",
+		"0x200000401:0x100000000:0x0",
+		"0x10000000000000000:0x1:0x0",
+		"0x200000401:0x1:0x123456789",
+		"hello",
+	};
+	lustre_fid fid;
+	const char *end;
+	int rc;
+	int i;
+
+	for (i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+		memset(&fid, 0, sizeof(fid));
+		rc = lus_fid_parse(good[i], &fid, &end);
+		ck_assert_msg(rc == 0, "'%s' not parsed", good[i]);
+		ck_assert_int_eq(fid.f_seq, 0x200000401);
+		ck_assert_int_eq(fid.f_oid, 1);
+		ck_assert_int_eq(fid.f_ver, 0);
+	}
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		rc = lus_fid_parse(bad[i], &fid, NULL);
+		ck_assert_msg(rc == -EINVAL, "'%s' parsed", bad[i]);
+	}
+
+	/* end points after the FID */
+	rc = lus_fid_parse("[0x200000401:0x1:0x0]/some/path", &fid, &end);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_str_eq(end, "/some/path");
+
+	/* end is not modified on error */
+	end = NULL;
+	rc = lus_fid_parse("[0x200000401", &fid, &end);
+	ck_assert_int_eq(rc, -EINVAL);
+	ck_assert_ptr_eq(end, NULL);
+}
+
+void unittest_fid_parse_list(void)
+{
+	const char *list =
+		"[0x200000401:0x1:0x0]\n"
+		"\n"
+		"  0x200000401:0x2:0x0 \t\r\n"
+		"0x200000401:0x3:0x0\n"
+		"[0x200000401:0x4:0x0]";
+	const char *bad_list =
+		"[0x200000401:0x1:0x0]\n"
+		"[0x200000401:0x2:0x0] garbage\n"
+		"[0x200000401:0x3:0x0]\n";
+	lustre_fid fids[10];
+	size_t consumed;
+	ssize_t rc;
+	int i;
+
+	rc = lus_fid_parse_list(list, strlen(list), fids, 10, &consumed);
+	ck_assert_int_eq(rc, 4);
+	ck_assert_int_eq(consumed, strlen(list));
+	for (i = 0; i < 4; i++) {
+		ck_assert_int_eq(fids[i].f_seq, 0x200000401);
+		ck_assert_int_eq(fids[i].f_oid, i + 1);
+		ck_assert_int_eq(fids[i].f_ver, 0);
+	}
+
+	/* The list is not NUL terminated. Stop in the middle of the
+	 * last FID. */
+	rc = lus_fid_parse_list(list, strlen(list) - 5, fids, 10, &consumed);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* Array too small. Restart where it stopped. */
+	rc = lus_fid_parse_list(list, strlen(list), fids, 2, &consumed);
+	ck_assert_int_eq(rc, 2);
+	ck_assert_int_eq(fids[1].f_oid, 2);
+
+	rc = lus_fid_parse_list(list + consumed, strlen(list) - consumed,
+				fids, 10, NULL);
+	ck_assert_int_eq(rc, 2);
+	ck_assert_int_eq(fids[0].f_oid, 3);
+	ck_assert_int_eq(fids[1].f_oid, 4);
+
+	/* Empty list */
+	rc = lus_fid_parse_list("", 0, fids, 10, &consumed);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(consumed, 0);
+
+	/* Invalid line */
+	rc = lus_fid_parse_list(bad_list, strlen(bad_list), fids, 10,
+				&consumed);
+	ck_assert_int_eq(rc, -EINVAL);
+	ck_assert_int_eq(consumed, strlen("[0x200000401:0x1:0x0]\n"));
+}
@@ -0,0 +1,326 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the FID attribute cache. No Lustre filesystem is needed.
+ */
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/fid_cache.c"
+
+static void make_fid(lustre_fid *fid, unsigned int oid)
+{
+	fid->f_seq = 0x200000401;
+	fid->f_oid = oid;
+	fid->f_ver = 0;
+}
+
+/* Basic operations and statistics. */
+void unittest_fid_cache(void)
+{
+	struct lus_fs_handle lfsh = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	struct lus_fid_cache_stats stats;
+	struct hsm_user_state hus;
+	struct lus_layout *layout;
+	struct lus_layout *layout2;
+	struct stat st;
+	lustre_fid fid;
+	unsigned int i;
+	int rc;
+
+	/* Disabled cache */
+	make_fid(&fid, 1);
+	ck_assert(!fid_cache_get_stat(&lfsh, &fid, &st));
+	lus_fid_cache_invalidate(&lfsh, &fid);
+	lus_fid_cache_get_stats(&lfsh, &stats);
+	ck_assert_int_eq(stats.capacity, 0);
+
+	rc = lus_fid_cache_enable(&lfsh, 0, 1000);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	rc = lus_fid_cache_enable(&lfsh, 100, 0);
+	ck_assert_int_eq(rc, 0);
+	lus_fid_cache_get_stats(&lfsh, &stats);
+	ck_assert_int_eq(stats.capacity, 128);
+
+	/* Miss, then hit */
+	ck_assert(!fid_cache_get_stat(&lfsh, &fid, &st));
+
+	memset(&st, 0, sizeof(st));
+	st.st_size = 1234;
+	fid_cache_put_stat(&lfsh, &fid, &st);
+
+	memset(&st, 0, sizeof(st));
+	ck_assert(fid_cache_get_stat(&lfsh, &fid, &st));
+	ck_assert_int_eq(st.st_size, 1234);
+
+	/* Only the stat is cached */
+	ck_assert(!fid_cache_get_hsm(&lfsh, &fid, &hus));
+	ck_assert_ptr_eq(fid_cache_get_layout(&lfsh, &fid), NULL);
+
+	memset(&hus, 0, sizeof(hus));
+	hus.hus_states = HS_EXISTS | HS_ARCHIVED;
+	hus.hus_archive_id = 3;
+	fid_cache_put_hsm(&lfsh, &fid, &hus);
+
+	memset(&hus, 0, sizeof(hus));
+	ck_assert(fid_cache_get_hsm(&lfsh, &fid, &hus));
+	ck_assert_int_eq(hus.hus_states, HS_EXISTS | HS_ARCHIVED);
+	ck_assert_int_eq(hus.hus_archive_id, 3);
+
+	/* Layouts */
+	rc = lus_layout_alloc(4, &layout);
+	ck_assert_int_eq(rc, 0);
+	lus_layout_stripe_set_size(layout, 1048576);
+	lus_layout_set_pool_name(layout, "mypool");
+	fid_cache_put_layout(&lfsh, &fid, layout);
+
+	layout2 = fid_cache_get_layout(&lfsh, &fid);
+	ck_assert_ptr_ne(layout2, NULL);
+	ck_assert_int_eq(layout_size(layout2), layout_size(layout));
+	ck_assert(memcmp(layout, layout2, layout_size(layout)) == 0);
+	lus_layout_free(layout2);
+	lus_layout_free(layout);
+
+	/* Too many stripes to be cached */
+	make_fid(&fid, 2);
+	rc = lus_layout_alloc(100, &layout);
+	ck_assert_int_eq(rc, 0);
+	fid_cache_put_layout(&lfsh, &fid, layout);
+	ck_assert_ptr_eq(fid_cache_get_layout(&lfsh, &fid), NULL);
+	lus_layout_free(layout);
+
+	lus_fid_cache_get_stats(&lfsh, &stats);
+	ck_assert_int_eq(stats.hits, 3);
+	ck_assert_int_eq(stats.misses, 4);
+	ck_assert_int_eq(stats.entries, 1);
+
+	/* Invalidation */
+	make_fid(&fid, 1);
+	lus_fid_cache_invalidate(&lfsh, &fid);
+	ck_assert(!fid_cache_get_stat(&lfsh, &fid, &st));
+	ck_assert(!fid_cache_get_hsm(&lfsh, &fid, &hus));
+
+	lus_fid_cache_get_stats(&lfsh, &stats);
+	ck_assert_int_eq(stats.entries, 0);
+	ck_assert_int_eq(stats.invalidations, 1);
+
+	/* Fill more than the capacity. The cache doesn't grow. */
+	for (i = 0; i < 1000; i++) {
+		make_fid(&fid, i);
+		st.st_size = i;
+		fid_cache_put_stat(&lfsh, &fid, &st);
+	}
+
+	lus_fid_cache_get_stats(&lfsh, &stats);
+	ck_assert_int_le(stats.entries, 128);
+	ck_assert_int_eq(stats.entries + stats.evictions, 1000);
+
+	/* The last one is always there, and consistent. */
+	ck_assert(fid_cache_get_stat(&lfsh, &fid, &st));
+	ck_assert_int_eq(st.st_size, 999);
+
+	for (i = 0; i < 1000; i++) {
+		make_fid(&fid, i);
+		if (fid_cache_get_stat(&lfsh, &fid, &st))
+			ck_assert_int_eq(st.st_size, i);
+	}
+
+	lus_fid_cache_flush(&lfsh);
+	lus_fid_cache_get_stats(&lfsh, &stats);
+	ck_assert_int_eq(stats.entries, 0);
+	ck_assert(!fid_cache_get_stat(&lfsh, &fid, &st));
+
+	/* Data version revalidation. The first check only records
+	 * it. */
+	make_fid(&fid, 1);
+	fid_cache_put_stat(&lfsh, &fid, &st);
+	ck_assert(!fid_cache_check_dv(lfsh.fid_cache, &fid, 10));
+	ck_assert(!fid_cache_get_stat(&lfsh, &fid, &st));
+
+	fid_cache_put_stat(&lfsh, &fid, &st);
+	ck_assert(fid_cache_check_dv(lfsh.fid_cache, &fid, 10));
+	ck_assert(fid_cache_get_stat(&lfsh, &fid, &st));
+
+	ck_assert(!fid_cache_check_dv(lfsh.fid_cache, &fid, 11));
+	ck_assert(!fid_cache_get_stat(&lfsh, &fid, &st));
+
+	lus_fid_cache_disable(&lfsh);
+	ck_assert_ptr_eq(lfsh.fid_cache, NULL);
+}
+
+/* Entries expire. */
+void unittest_fid_cache_ttl(void)
+{
+	struct lus_fs_handle lfsh = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	struct lus_fid_cache_stats stats;
+	struct stat st;
+	lustre_fid fid;
+	int rc;
+
+	rc = lus_fid_cache_enable(&lfsh, 16, 100);
+	ck_assert_int_eq(rc, 0);
+
+	make_fid(&fid, 1);
+	memset(&st, 0, sizeof(st));
+	fid_cache_put_stat(&lfsh, &fid, &st);
+	ck_assert(fid_cache_get_stat(&lfsh, &fid, &st));
+
+	usleep(200000);
+	ck_assert(!fid_cache_get_stat(&lfsh, &fid, &st));
+
+	/* A new item restarts the entry, which is still counted
+	 * once. */
+	fid_cache_put_stat(&lfsh, &fid, &st);
+	ck_assert(fid_cache_get_stat(&lfsh, &fid, &st));
+	usleep(200000);
+	fid_cache_put_stat(&lfsh, &fid, &st);
+	lus_fid_cache_get_stats(&lfsh, &stats);
+	ck_assert_int_eq(stats.entries, 1);
+
+	lus_fid_cache_disable(&lfsh);
+}
+
+struct cache_thread_arg {
+	struct lus_fs_handle *lfsh;
+	bool stop;
+	unsigned long reads;
+};
+
+static void *cache_reader(void *arg)
+{
+	struct cache_thread_arg *cta = arg;
+	struct stat st;
+	lustre_fid fid;
+	unsigned int i = 0;
+
+	while (!__atomic_load_n(&cta->stop, __ATOMIC_RELAXED)) {
+		make_fid(&fid, i++ % 64);
+		if (fid_cache_get_stat(cta->lfsh, &fid, &st)) {
+			/* The writer always sets all three to the same
+			 * value. */
+			ck_assert_int_eq(st.st_size, st.st_ino);
+			ck_assert_int_eq(st.st_size, st.st_blocks);
+			ck_assert_int_eq(st.st_size % 64, fid.f_oid);
+			cta->reads++;
+		}
+	}
+
+	return NULL;
+}
+
+/* Readers never see a partially written entry, nor a freed cache
+ * when it is replaced. */
+void unittest_fid_cache_concurrent(void)
+{
+	struct lus_fs_handle lfsh = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	struct cache_thread_arg cta[4];
+	pthread_t threads[4];
+	struct stat st;
+	lustre_fid fid;
+	unsigned int i;
+	int rc;
+
+	/* Smaller than the working set, to also have evictions. */
+	rc = lus_fid_cache_enable(&lfsh, 32, 0);
+	ck_assert_int_eq(rc, 0);
+
+	for (i = 0; i < 4; i++) {
+		cta[i].lfsh = &lfsh;
+		cta[i].stop = false;
+		cta[i].reads = 0;
+		rc = pthread_create(&threads[i], NULL, cache_reader, &cta[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	memset(&st, 0, sizeof(st));
+	for (i = 0; i < 200000; i++) {
+		make_fid(&fid, i % 64);
+		st.st_size = i;
+		st.st_ino = i;
+		st.st_blocks = i;
+		fid_cache_put_stat(&lfsh, &fid, &st);
+
+		if (i % 50000 == 0) {
+			rc = lus_fid_cache_enable(&lfsh, 32, 0);
+			ck_assert_int_eq(rc, 0);
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		__atomic_store_n(&cta[i].stop, true, __ATOMIC_RELAXED);
+		pthread_join(threads[i], NULL);
+	}
+
+	lus_fid_cache_disable(&lfsh);
+}
+
+/* Bytes allocated with malloc, including the large blocks. */
+static size_t allocated_bytes(void)
+{
+	struct mallinfo2 mi = mallinfo2();
+
+	return mi.uordblks + mi.hblkhd;
+}
+
+/* Replacing or disabling the cache frees it, even while other
+ * threads are looking it up. */
+void unittest_fid_cache_toggle(void)
+{
+	struct lus_fs_handle lfsh = { .lock = PTHREAD_MUTEX_INITIALIZER };
+	struct cache_thread_arg cta[4];
+	pthread_t threads[4];
+	size_t before;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < 4; i++) {
+		cta[i].lfsh = &lfsh;
+		cta[i].stop = false;
+		cta[i].reads = 0;
+		rc = pthread_create(&threads[i], NULL, cache_reader, &cta[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	rc = lus_fid_cache_enable(&lfsh, 16384, 0);
+	ck_assert_int_eq(rc, 0);
+	before = allocated_bytes();
+
+	for (i = 0; i < 100; i++) {
+		rc = lus_fid_cache_enable(&lfsh, 16384, 0);
+		ck_assert_int_eq(rc, 0);
+
+		lus_fid_cache_disable(&lfsh);
+		ck_assert_ptr_eq(lfsh.fid_cache, NULL);
+
+		rc = lus_fid_cache_enable(&lfsh, 16384, 0);
+		ck_assert_int_eq(rc, 0);
+	}
+
+	/* Only the current cache is left. */
+	ck_assert_int_le(allocated_bytes(), before + 1024 * 1024);
+
+	for (i = 0; i < 4; i++) {
+		__atomic_store_n(&cta[i].stop, true, __ATOMIC_RELAXED);
+		pthread_join(threads[i], NULL);
+	}
+
+	lus_fid_cache_disable(&lfsh);
+}
@@ -259,6 +259,86 @@ void unittest_lus_fid2path(void)
 	lus_close_fs(lfsh);
 }
 
+/* Test lus_fid2path_batch. */
+void unittest_lus_fid2path_batch(void)
+{
+	struct lus_fs_handle *lfsh;
+	lustre_fid fids[4];
+	size_t offsets[4];
+	int errors[4];
+	char arena[100];
+	char path[PATH_MAX];
+	char fname[PATH_MAX];
+	ssize_t found;
+	int fd;
+	int rc;
+	int i;
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	ck_assert_int_eq(rc, 0);
+
+	/* The mountpoint, a file, a non existent FID, and the file
+	 * again. */
+	rc = lus_path2fid(lus_get_mountpoint(lfsh), &fids[0]);
+	ck_assert_int_eq(rc, 0);
+
+	rc = snprintf(fname, sizeof(fname), "%s/unittest_fid", lustre_dir);
+	ck_assert_msg(rc > 0 && rc < sizeof(fname), "snprintf failed: %d", rc);
+
+	fd = open(fname, O_CREAT | O_TRUNC, S_IRWXU);
+	ck_assert_int_gt(fd, 0);
+
+	rc = lus_fd2fid(fd, &fids[1]);
+	ck_assert_int_eq(rc, 0);
+	close(fd);
+
+	fids[2] = fids[1];
+	fids[2].f_seq += 100;
+	fids[3] = fids[1];
+
+	found = lus_fid2path_batch(lfsh, fids, 4, arena, sizeof(arena),
+				   offsets, errors);
+	ck_assert_int_eq(found, 3);
+	ck_assert_int_eq(errors[0], 0);
+	ck_assert_int_eq(errors[1], 0);
+	ck_assert_int_ne(errors[2], 0);
+	ck_assert_int_eq(errors[3], 0);
+
+	/* The results must be the same as lus_fid2path. */
+	for (i = 0; i < 4; i++) {
+		if (errors[i])
+			continue;
+
+		rc = lus_fid2path(lfsh, &fids[i], path, sizeof(path),
+				  NULL, NULL);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_str_eq(&arena[offsets[i]], path);
+	}
+
+	/* Arena too small for the file name. */
+	found = lus_fid2path_batch(lfsh, &fids[1], 1, arena, 5,
+				   offsets, errors);
+	ck_assert_int_eq(found, 0);
+	ck_assert_int_eq(errors[0], -ENOSPC);
+
+	/* Same with only the caller's thread. */
+	rc = lus_set_thread_count(lfsh, 1);
+	ck_assert_int_eq(rc, 0);
+
+	found = lus_fid2path_batch(lfsh, fids, 4, arena, sizeof(arena),
+				   offsets, errors);
+	ck_assert_int_eq(found, 3);
+	ck_assert_str_eq(&arena[offsets[1]], "unittest_fid");
+
+	rc = lus_set_thread_count(lfsh, 0);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	rc = unlink(fname);
+	ck_assert(rc == 0);
+
+	lus_close_fs(lfsh);
+}
+
 /* Test lus_get_mdt_index_by_fid */
 void unittest_mdt_index(void)
 {
@@ -350,6 +430,76 @@ void unittest_lus_data_version_by_fd(void)
 	close(fd);
 }
 
+/* Test lus_data_version_by_fid_many */
+void unittest_lus_data_version_by_fid_many(void)
+{
+	struct lus_data_version_req reqs[4];
+	struct lus_fs_handle *lfsh;
+	char fname[PATH_MAX];
+	char buf[10] = { 0, };
+	uint64_t dv;
+	ssize_t found;
+	int fd;
+	int rc;
+
+	rc = snprintf(fname, sizeof(fname), "%s/unittest_dv_many",
+		      lustre_dir);
+	ck_assert_msg(rc > 0 && rc < sizeof(fname), "snprintf failed: %d", rc);
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	ck_assert_int_eq(rc, 0);
+
+	fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY, S_IRWXU);
+	ck_assert_int_gt(fd, 0);
+
+	rc = write(fd, buf, sizeof(buf));
+	ck_assert_int_eq(rc, sizeof(buf));
+	fsync(fd);
+
+	rc = lus_data_version_by_fd(fd, 0, &dv);
+	ck_assert_int_eq(rc, 0);
+
+	memset(reqs, 0, sizeof(reqs));
+	rc = lus_fd2fid(fd, &reqs[0].fid);
+	ck_assert_int_eq(rc, 0);
+	close(fd);
+
+	/* Same file with each flush policy, a non existent FID, and
+	 * an invalid flag. */
+	reqs[1].fid = reqs[0].fid;
+	reqs[1].flags = LL_DV_WR_FLUSH;
+	reqs[2].fid = reqs[0].fid;
+	reqs[2].fid.f_seq += 100;
+	reqs[3].fid = reqs[0].fid;
+	reqs[3].flags = 0x100;
+
+	found = lus_data_version_by_fid_many(lfsh, reqs, 4);
+	ck_assert_int_eq(found, 2);
+	ck_assert_int_eq(reqs[0].rc, 0);
+	ck_assert_int_eq(reqs[0].dv, dv);
+	ck_assert_int_eq(reqs[1].rc, 0);
+	ck_assert_int_eq(reqs[1].dv, dv);
+	ck_assert_int_eq(reqs[2].rc, -ENOENT);
+	ck_assert_int_eq(reqs[3].rc, -EINVAL);
+
+	/* Several threads */
+	rc = lus_set_thread_count(lfsh, 4);
+	ck_assert_int_eq(rc, 0);
+
+	found = lus_data_version_by_fid_many(lfsh, reqs, 4);
+	ck_assert_int_eq(found, 2);
+	ck_assert_int_eq(reqs[1].dv, dv);
+
+	found = lus_data_version_by_fid_many(lfsh, reqs, 0);
+	ck_assert_int_eq(found, 0);
+
+	found = lus_data_version_by_fid_many(lfsh, NULL, 4);
+	ck_assert_int_eq(found, -EINVAL);
+
+	unlink(fname);
+	lus_close_fs(lfsh);
+}
+
 /* Test lus_mdt_stat_by_fid */
 void unittest_lus_mdt_stat_by_fid(void)
 {
@@ -398,3 +548,110 @@ void unittest_lus_mdt_stat_by_fid(void)
 	ck_assert_int_eq(buf1.st_uid, buf2.st_uid);
 	ck_assert_int_eq(buf1.st_gid, buf2.st_gid);
 }
+
+/* Only the requested fields are converted. */
+void unittest_stat_to_statx(void)
+{
+	struct statx stx;
+	struct stat st;
+
+	memset(&st, 0, sizeof(st));
+	st.st_mode = S_IFREG | 0640;
+	st.st_nlink = 2;
+	st.st_uid = 500;
+	st.st_gid = 501;
+	st.st_ino = 12345;
+	st.st_size = 1000;
+	st.st_blocks = 8;
+	st.st_mtim.tv_sec = 1400000000;
+	st.st_mtim.tv_nsec = 1234;
+
+	stat_to_statx(&st, STATX_BASIC_STATS, &stx);
+	ck_assert_int_eq(stx.stx_mask, STATX_BASIC_STATS);
+	ck_assert_int_eq(stx.stx_mode, S_IFREG | 0640);
+	ck_assert_int_eq(stx.stx_nlink, 2);
+	ck_assert_int_eq(stx.stx_uid, 500);
+	ck_assert_int_eq(stx.stx_gid, 501);
+	ck_assert_int_eq(stx.stx_ino, 12345);
+	ck_assert_int_eq(stx.stx_size, 1000);
+	ck_assert_int_eq(stx.stx_blocks, 8);
+	ck_assert_int_eq(stx.stx_mtime.tv_sec, 1400000000);
+	ck_assert_int_eq(stx.stx_mtime.tv_nsec, 1234);
+
+	stat_to_statx(&st, LUS_STATX_MDT_MASK, &stx);
+	ck_assert_int_eq(stx.stx_mask, LUS_STATX_MDT_MASK);
+	ck_assert_int_eq(stx.stx_mode, S_IFREG | 0640);
+	ck_assert_int_eq(stx.stx_size, 0);
+	ck_assert_int_eq(stx.stx_blocks, 0);
+	ck_assert_int_eq(stx.stx_mtime.tv_sec, 1400000000);
+}
+
+void unittest_lus_statx_by_fid(void)
+{
+	struct lus_fs_handle *lfsh;
+	char fname[PATH_MAX];
+	struct statx stx[3];
+	lustre_fid fids[3];
+	int errors[3];
+	struct stat st;
+	ssize_t found;
+	int fd;
+	int rc;
+
+	rc = snprintf(fname, sizeof(fname), "%s/unittest_statx", lustre_dir);
+	ck_assert_msg(rc > 0 && rc < sizeof(fname), "snprintf failed: %d", rc);
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	ck_assert_int_eq(rc, 0);
+
+	fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY, S_IRWXU);
+	ck_assert_int_gt(fd, 0);
+
+	rc = write(fd, fname, 100);
+	ck_assert_int_eq(rc, 100);
+
+	rc = lus_fd2fid(fd, &fids[0]);
+	ck_assert_int_eq(rc, 0);
+
+	rc = fstat(fd, &st);
+	ck_assert_int_eq(rc, 0);
+
+	fsync(fd);
+	close(fd);
+
+	/* MDT only */
+	rc = lus_statx_by_fid(lfsh, &fids[0], STATX_MODE | STATX_UID,
+			      &stx[0]);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(stx[0].stx_mask, LUS_STATX_MDT_MASK);
+	ck_assert_int_eq(stx[0].stx_mode, st.st_mode);
+	ck_assert_int_eq(stx[0].stx_uid, st.st_uid);
+	ck_assert_int_eq(stx[0].stx_ino, st.st_ino);
+
+	/* Full stat */
+	rc = lus_statx_by_fid(lfsh, &fids[0], STATX_SIZE, &stx[0]);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(stx[0].stx_mask, STATX_BASIC_STATS);
+	ck_assert_int_eq(stx[0].stx_size, 100);
+
+	/* Batch, with a non existent FID */
+	fids[1] = fids[0];
+	fids[1].f_seq += 100;
+	fids[2] = fids[0];
+
+	found = lus_statx_by_fid_batch(lfsh, fids, 3, STATX_MTIME, stx,
+				       errors);
+	ck_assert_int_eq(found, 2);
+	ck_assert_int_eq(errors[0], 0);
+	ck_assert_int_eq(errors[1], -ENOENT);
+	ck_assert_int_eq(errors[2], 0);
+	ck_assert_int_eq(stx[0].stx_ino, st.st_ino);
+	ck_assert_int_eq(stx[2].stx_ino, st.st_ino);
+
+	found = lus_statx_by_fid_batch(lfsh, fids, 3, STATX_MTIME, NULL,
+				       errors);
+	ck_assert_int_eq(found, -EINVAL);
+
+	unlink(fname);
+	lus_close_fs(lfsh);
+}
@@ -0,0 +1,1083 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the mapping of file offsets to the stripes, the views and
+ * the prepared layouts, on made up layouts; only the creation of
+ * files needs a Lustre filesystem. liblustreapi_layout.c is already
+ * part of the test library, so only its API is used.
+ */
+
+#include <byteswap.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include <lustre/lustre.h>
+
+#include "../lib/internal.h"
+#include "lib_test.h"
+
+static struct lus_layout *make_layout(uint64_t stripe_size,
+				      unsigned int stripe_count)
+{
+	struct lus_layout *layout;
+	int rc;
+
+	rc = lus_layout_alloc(stripe_count, &layout);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_pattern_set(layout, LLAPI_LAYOUT_RAID0);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_stripe_set_size(layout, stripe_size);
+	ck_assert_int_eq(rc, 0);
+
+	return layout;
+}
+
+/* Map an offset by dealing the stripe units one at a time. */
+static void slow_map(uint64_t stripe_size, uint64_t stripe_count,
+		     uint64_t offset, struct lus_layout_extent *extent)
+{
+	uint64_t object_offset = 0;
+	uint64_t start = 0;
+	uint64_t stripe = 0;
+
+	while (start + stripe_size <= offset) {
+		start += stripe_size;
+		stripe++;
+		if (stripe == stripe_count) {
+			stripe = 0;
+			object_offset += stripe_size;
+		}
+	}
+
+	extent->offset = offset;
+	extent->length = start + stripe_size - offset;
+	extent->stripe = stripe;
+	extent->object_offset = object_offset + offset - start;
+}
+
+static void check_offsets(uint64_t stripe_size, unsigned int stripe_count)
+{
+	struct lus_layout_extent extents[64];
+	struct lus_layout_extent expected;
+	struct lus_layout_extent extent;
+	struct lus_layout *layout;
+	uint64_t offsets[64];
+	unsigned int i;
+	int rc;
+
+	layout = make_layout(stripe_size, stripe_count);
+
+	for (i = 0; i < 64; i++) {
+		if (i < 4)
+			offsets[i] = i * stripe_size - (i > 0);
+		else
+			offsets[i] = random() % (stripe_size * 40);
+	}
+
+	rc = lus_layout_map_offsets(layout, offsets, 64, extents);
+	ck_assert_int_eq(rc, 0);
+
+	for (i = 0; i < 64; i++) {
+		slow_map(stripe_size, stripe_count, offsets[i], &expected);
+
+		ck_assert_int_eq(extents[i].offset, expected.offset);
+		ck_assert_int_eq(extents[i].length, expected.length);
+		ck_assert_int_eq(extents[i].stripe, expected.stripe);
+		ck_assert_int_eq(extents[i].object_offset,
+				 expected.object_offset);
+		ck_assert(extents[i].ost_index == LLAPI_LAYOUT_DEFAULT);
+
+		/* Same as a range going past the stripe unit. */
+		rc = lus_layout_map_extent(layout, offsets[i],
+					   stripe_size * 2, &extent);
+		ck_assert_int_eq(rc, 0);
+		ck_assert(memcmp(&extent, &extents[i], sizeof(extent)) == 0);
+
+		/* And within it. */
+		rc = lus_layout_map_extent(layout, offsets[i], 1, &extent);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(extent.length, 1);
+		ck_assert_int_eq(extent.object_offset,
+				 expected.object_offset);
+	}
+
+	lus_layout_free(layout);
+}
+
+/* Check that the iterator covers a range exactly, one stripe unit at
+ * a time. */
+static void check_iter(uint64_t stripe_size, unsigned int stripe_count,
+		       uint64_t offset, uint64_t length)
+{
+	struct lus_layout_extent_iter iter;
+	struct lus_layout_extent expected;
+	struct lus_layout_extent extent;
+	struct lus_layout *layout;
+	uint64_t next = offset;
+	unsigned int count = 0;
+	int rc;
+
+	layout = make_layout(stripe_size, stripe_count);
+
+	rc = lus_layout_extent_iter_init(&iter, layout, offset, length);
+	ck_assert_int_eq(rc, 0);
+
+	while (lus_layout_extent_iter_next(&iter, &extent)) {
+		slow_map(stripe_size, stripe_count, next, &expected);
+		if (expected.length > offset + length - next)
+			expected.length = offset + length - next;
+
+		ck_assert_int_eq(extent.offset, next);
+		ck_assert_int_eq(extent.length, expected.length);
+		ck_assert_int_ne(extent.length, 0);
+		ck_assert_int_eq(extent.stripe, expected.stripe);
+		ck_assert_int_eq(extent.object_offset,
+				 expected.object_offset);
+
+		next += extent.length;
+		count++;
+	}
+
+	ck_assert_int_eq(next, offset + length);
+	if (length == 0)
+		ck_assert_int_eq(count, 0);
+	else
+		ck_assert_int_eq(count, (offset + length - 1) / stripe_size -
+				 offset / stripe_size + 1);
+
+	/* Stays at the end. */
+	ck_assert(!lus_layout_extent_iter_next(&iter, &extent));
+
+	lus_layout_free(layout);
+}
+
+/* The OST indexes come from the objects of the layout. */
+static void check_ost_index(void)
+{
+	struct {
+		struct lov_user_md_v1 lum;
+		struct lov_user_ost_data_v1 objects[3];
+	} __attribute__((packed)) xattr;
+	struct lus_layout_extent extents[4];
+	const uint64_t offsets[4] = { 0, 65536, 2 * 65536, 3 * 65536 };
+	struct lus_layout *layout;
+	int rc;
+
+	memset(&xattr, 0, sizeof(xattr));
+	xattr.lum.lmm_magic = LOV_USER_MAGIC_V1;
+	xattr.lum.lmm_pattern = LOV_PATTERN_RAID0;
+	xattr.lum.lmm_stripe_size = 65536;
+	xattr.lum.lmm_stripe_count = 3;
+	xattr.objects[0].l_ost_idx = 7;
+	xattr.objects[1].l_ost_idx = 2;
+	xattr.objects[2].l_ost_idx = -1;
+
+	rc = lus_lovxattr_to_layout(&xattr.lum, sizeof(xattr), &layout);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_map_offsets(layout, offsets, 4, extents);
+	ck_assert_int_eq(rc, 0);
+
+	ck_assert_int_eq(extents[0].ost_index, 7);
+	ck_assert_int_eq(extents[1].ost_index, 2);
+	ck_assert(extents[2].ost_index == LLAPI_LAYOUT_DEFAULT);
+	ck_assert_int_eq(extents[3].ost_index, 7);
+	ck_assert_int_eq(extents[3].object_offset, 65536);
+
+	lus_layout_free(layout);
+}
+
+void unittest_layout_map(void)
+{
+	struct lus_layout_extent_iter iter;
+	struct lus_layout_extent extent;
+	struct lus_layout *layout;
+	uint64_t offset = 0;
+	int rc;
+
+	/* Powers of 2, then not. */
+	check_offsets(65536, 1);
+	check_offsets(65536, 4);
+	check_offsets(1 << 20, 8);
+	check_offsets(3 * 65536, 4);
+	check_offsets(65536, 3);
+	check_offsets(5 * 65536, 7);
+
+	check_iter(65536, 1, 0, 65536);
+	check_iter(65536, 4, 0, 0);
+	check_iter(65536, 4, 100, 1);
+	check_iter(65536, 4, 65535, 2);
+	check_iter(65536, 4, 12345, 10 * 65536);
+	check_iter(3 * 65536, 5, 65536, 40 * 65536 + 17);
+
+	check_ost_index();
+
+	/* The striping of a default layout is not known. */
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_map_extent(layout, 0, 1, &extent);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_extent_iter_init(&iter, layout, 0, 1);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_map_offsets(layout, &offset, 1, &extent);
+	ck_assert_int_eq(rc, -EINVAL);
+	lus_layout_free(layout);
+
+	/* Empty and wrapping ranges */
+	layout = make_layout(65536, 2);
+	rc = lus_layout_map_extent(layout, 0, 0, &extent);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_map_extent(layout, UINT64_MAX, 2, &extent);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_extent_iter_init(&iter, layout, 2, UINT64_MAX);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* The end of the address space */
+	rc = lus_layout_map_extent(layout, UINT64_MAX - 1, 1, &extent);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(extent.length, 1);
+	ck_assert_int_eq(extent.stripe, 1);
+	lus_layout_free(layout);
+}
+
+/* A V3 layout as returned by the kernel. */
+struct test_lum {
+	struct lov_user_md_v3 lum;
+	struct lov_user_ost_data_v1 objects[4];
+} __attribute__((packed));
+
+static void make_lum(struct test_lum *xattr, bool swab)
+{
+	unsigned int i;
+
+	memset(xattr, 0, sizeof(*xattr));
+	xattr->lum.lmm_magic = LOV_USER_MAGIC_V3;
+	xattr->lum.lmm_pattern = LOV_PATTERN_RAID0;
+	xattr->lum.lmm_stripe_size = 4 * 1024 * 1024;
+	xattr->lum.lmm_stripe_count = 4;
+	strcpy(xattr->lum.lmm_pool_name, "fast");
+	for (i = 0; i < 4; i++)
+		xattr->objects[i].l_ost_idx = 10 + i;
+	xattr->objects[3].l_ost_idx = -1;
+
+	if (!swab)
+		return;
+
+	xattr->lum.lmm_magic = __bswap_32(xattr->lum.lmm_magic);
+	xattr->lum.lmm_pattern = __bswap_32(xattr->lum.lmm_pattern);
+	xattr->lum.lmm_stripe_size = __bswap_32(xattr->lum.lmm_stripe_size);
+	xattr->lum.lmm_stripe_count = __bswap_16(xattr->lum.lmm_stripe_count);
+	for (i = 0; i < 4; i++)
+		xattr->objects[i].l_ost_idx =
+			__bswap_32(xattr->objects[i].l_ost_idx);
+}
+
+/* Check that a view agrees with a decoded layout. */
+static void check_view(const struct lus_layout_view *view,
+		       const struct lus_layout *layout)
+{
+	char pool1[LUS_POOL_NAME_LEN];
+	char pool2[LUS_POOL_NAME_LEN];
+	uint64_t idx1;
+	uint64_t idx2;
+	uint64_t i;
+	int rc1;
+	int rc2;
+
+	ck_assert(lus_layout_view_pattern_get(view) ==
+		  lus_layout_pattern_get(layout));
+	ck_assert(lus_layout_view_pattern_get_flags(view) ==
+		  lus_layout_pattern_get_flags(layout));
+	ck_assert(lus_layout_view_stripe_get_size(view) ==
+		  lus_layout_stripe_get_size(layout));
+	ck_assert(lus_layout_view_stripe_get_count(view) ==
+		  lus_layout_stripe_get_count(layout));
+
+	ck_assert_int_eq(lus_layout_view_get_pool_name(view, pool1,
+						       sizeof(pool1)), 0);
+	ck_assert_int_eq(lus_layout_get_pool_name(layout, pool2,
+						  sizeof(pool2)), 0);
+	ck_assert_str_eq(pool1, pool2);
+
+	for (i = 0; i < 5; i++) {
+		rc1 = lus_layout_view_get_ost_index(view, i, &idx1);
+		rc2 = lus_layout_get_ost_index(layout, i, &idx2);
+		ck_assert_int_eq(rc1, rc2);
+		if (rc1 == 0)
+			ck_assert(idx1 == idx2);
+	}
+}
+
+void unittest_layout_view(void)
+{
+	char fname[] = "/tmp/unittest_layout_view.XXXXXX";
+	struct lus_layout_view view;
+	struct lus_layout *layout2;
+	struct lus_layout *layout;
+	struct test_lum xattr;
+	struct test_lum copy;
+	struct test_lum dom;
+	char pool[4];
+	uint64_t idx;
+	int swab;
+	int fd;
+	int rc;
+
+	for (swab = 0; swab <= 1; swab++) {
+		make_lum(&xattr, swab);
+
+		/* The view doesn't change the attribute, unlike
+		 * lus_lovxattr_to_layout(). */
+		copy = xattr;
+		rc = lus_layout_view_init(&view, &xattr, sizeof(xattr));
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(memcmp(&copy, &xattr, sizeof(xattr)), 0);
+
+		ck_assert(lus_layout_view_pattern_get(&view) ==
+			  LLAPI_LAYOUT_RAID0);
+		ck_assert_int_eq(lus_layout_view_stripe_get_size(&view),
+				 4 * 1024 * 1024);
+		ck_assert_int_eq(lus_layout_view_stripe_get_count(&view), 4);
+		rc = lus_layout_view_get_ost_index(&view, 2, &idx);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(idx, 12);
+
+		rc = lus_lovxattr_to_layout((struct lov_user_md *)&copy,
+					    sizeof(copy), &layout);
+		ck_assert_int_eq(rc, 0);
+		check_view(&view, layout);
+
+		rc = lus_layout_view_to_layout(&view, &layout2);
+		ck_assert_int_eq(rc, 0);
+		check_view(&view, layout2);
+
+		lus_layout_free(layout2);
+		lus_layout_free(layout);
+
+		/* Data-on-MDT, as the decoded layout reports it. */
+		dom = xattr;
+		dom.lum.lmm_pattern = swab ? __bswap_32(LOV_PATTERN_MDT) :
+			LOV_PATTERN_MDT;
+		copy = dom;
+		rc = lus_layout_view_init(&view, &dom, sizeof(dom));
+		ck_assert_int_eq(rc, 0);
+		ck_assert(lus_layout_view_pattern_get(&view) ==
+			  LLAPI_LAYOUT_MDT);
+
+		rc = lus_lovxattr_to_layout((struct lov_user_md *)&copy,
+					    sizeof(copy), &layout);
+		ck_assert_int_eq(rc, 0);
+		check_view(&view, layout);
+		lus_layout_free(layout);
+
+		/* Without the objects, as for a directory. */
+		rc = lus_layout_view_init(&view, &xattr, sizeof(xattr.lum));
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(lus_layout_view_stripe_get_count(&view), 4);
+		rc = lus_layout_view_get_ost_index(&view, 0, &idx);
+		ck_assert_int_eq(rc, -EINVAL);
+	}
+
+	/* Too small a buffer for the pool name */
+	rc = lus_layout_view_get_pool_name(&view, pool, sizeof(pool));
+	ck_assert_int_eq(rc, -ENOSPC);
+
+	/* Truncated attribute, unknown magic */
+	rc = lus_layout_view_init(&view, &xattr, sizeof(xattr.lum) - 1);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_view_init(&view, &xattr, 2);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	xattr.lum.lmm_magic = 0x12345678;
+	rc = lus_layout_view_init(&view, &xattr, sizeof(xattr));
+	ck_assert_int_eq(rc, -EOPNOTSUPP);
+
+	/* Empty view */
+	memset(&view, 0, sizeof(view));
+	ck_assert(lus_layout_view_stripe_get_count(&view) ==
+		  LLAPI_LAYOUT_DEFAULT);
+	ck_assert(lus_layout_view_pattern_get(&view) == LLAPI_LAYOUT_DEFAULT);
+	rc = lus_layout_view_get_pool_name(&view, pool, sizeof(pool));
+	ck_assert_int_eq(rc, 0);
+	ck_assert_str_eq(pool, "");
+
+	rc = lus_layout_view_to_layout(&view, &layout);
+	ck_assert_int_eq(rc, 0);
+	ck_assert(lus_layout_stripe_get_count(layout) == LLAPI_LAYOUT_DEFAULT);
+	lus_layout_free(layout);
+
+	/* Not on Lustre */
+	fd = mkstemp(fname);
+	ck_assert_int_ge(fd, 0);
+	unlink(fname);
+
+	rc = lus_layout_view_get_by_fd(fd, NULL, 0, &view);
+	ck_assert_int_eq(rc, -ENOTTY);
+
+	close(fd);
+}
+
+void unittest_layout_prepare(void)
+{
+	struct lus_layout_prepared *prepared;
+	struct lov_user_md_v3 lum;
+	struct lus_layout *layout2;
+	struct lus_layout *layout;
+	const char *name = "x";
+	char pool[LUS_POOL_NAME_LEN];
+	int error;
+	int rc;
+
+	rc = lus_layout_prepare(NULL, &prepared);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* A fully specified layout comes back from its encoding. */
+	layout = make_layout(1024 * 1024, 2);
+	rc = lus_layout_set_pool_name(layout, "fast");
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(prepared->lp_lum->lmm_magic, LOV_USER_MAGIC_V3);
+	ck_assert_int_eq(prepared->lp_lum_size, sizeof(lum));
+
+	memcpy(&lum, prepared->lp_lum, sizeof(lum));
+	rc = lus_lovxattr_to_layout((struct lov_user_md *)&lum, sizeof(lum),
+				    &layout2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(lus_layout_stripe_get_size(layout2), 1024 * 1024);
+	ck_assert_int_eq(lus_layout_stripe_get_count(layout2), 2);
+	rc = lus_layout_get_pool_name(layout2, pool, sizeof(pool));
+	ck_assert_int_eq(rc, 0);
+	ck_assert_str_eq(pool, "fast");
+
+	lus_layout_free(layout2);
+	lus_layout_free(layout);
+	lus_layout_prepared_free(prepared);
+
+	/* Default values are left to the filesystem. */
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(prepared->lp_lum->lmm_magic, LOV_USER_MAGIC_V1);
+	ck_assert_int_eq(prepared->lp_lum_size, sizeof(struct lov_user_md));
+	ck_assert_int_eq(prepared->lp_lum->lmm_pattern, 0);
+	ck_assert_int_eq(prepared->lp_lum->lmm_stripe_size, 0);
+	ck_assert_int_eq(prepared->lp_lum->lmm_stripe_count, 0);
+	ck_assert_int_eq(prepared->lp_lum->lmm_stripe_offset, 0xffff);
+
+	/* Nothing to create; the handle is not used. */
+	rc = lus_layout_create_many(NULL, AT_FDCWD, &name, 0, prepared,
+				    0600, &error);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_create_many(NULL, AT_FDCWD, NULL, 1, prepared,
+				    0600, &error);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_create_many(NULL, AT_FDCWD, &name, 1, NULL,
+				    0600, &error);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	lus_layout_free(layout);
+	lus_layout_prepared_free(prepared);
+	lus_layout_prepared_free(NULL);
+}
+
+/* Create files with lus_layout_create_many(), and check their
+ * layout. */
+void unittest_create_many_lustre(void)
+{
+	struct lus_layout_prepared *prepared;
+	struct lus_fs_handle *lfsh;
+	struct lus_layout *layout;
+	char names[4][32];
+	const char *name_list[4];
+	int errors[4];
+	ssize_t created;
+	int dir_fd;
+	int rc;
+	int i;
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	ck_assert_int_eq(rc, 0);
+
+	dir_fd = open(lustre_dir, O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(dir_fd, 0);
+
+	for (i = 0; i < 4; i++) {
+		snprintf(names[i], sizeof(names[i]),
+			 "unittest_create_many.%d", i);
+		name_list[i] = names[i];
+		unlinkat(dir_fd, names[i], 0);
+	}
+
+	layout = make_layout(2 * 1024 * 1024, 1);
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, 0);
+	lus_layout_free(layout);
+
+	created = lus_layout_create_many(lfsh, dir_fd, name_list, 4,
+					 prepared, 0600, errors);
+	ck_assert_int_eq(created, 4);
+
+	for (i = 0; i < 4; i++) {
+		ck_assert_int_eq(errors[i], 0);
+		rc = lus_layout_get_by_name(dir_fd, names[i], &layout);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(lus_layout_stripe_get_size(layout),
+				 2 * 1024 * 1024);
+		ck_assert_int_eq(lus_layout_stripe_get_count(layout), 1);
+		lus_layout_free(layout);
+	}
+
+	/* The files already exist. */
+	created = lus_layout_create_many(lfsh, dir_fd, name_list, 4,
+					 prepared, 0600, errors);
+	ck_assert_int_eq(created, 0);
+	for (i = 0; i < 4; i++) {
+		ck_assert_int_eq(errors[i], -EEXIST);
+		unlinkat(dir_fd, names[i], 0);
+	}
+
+	lus_layout_prepared_free(prepared);
+	close(dir_fd);
+	lus_close_fs(lfsh);
+}
+
+/* Encoding of a layout whose OSTs are all given. */
+void unittest_layout_specific(void)
+{
+	char fname[] = "/tmp/unittest_layout_specific.XXXXXX";
+	const uint32_t osts[3] = { 5, 2, 9 };
+	struct lus_layout_prepared *prepared2;
+	struct lus_layout_prepared *prepared;
+	struct {
+		struct lov_user_md_v3 lum;
+		struct lov_user_ost_data_v1 objects[3];
+	} __attribute__((packed)) xattr;
+	struct lus_layout *layout2;
+	struct lus_layout *layout;
+	uint64_t idx;
+	int fd;
+	int rc;
+	int i;
+
+	/* No room for the stripes. */
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_set_ost_index(layout, 1, 2);
+	ck_assert_int_eq(rc, -EOPNOTSUPP);
+	rc = lus_layout_set_ost_index(layout, -1, 2);
+	ck_assert_int_eq(rc, -EINVAL);
+	lus_layout_free(layout);
+
+	layout = make_layout(1024 * 1024, 3);
+	rc = lus_layout_get_ost_index(layout, 1, &idx);
+	ck_assert_int_eq(rc, 0);
+	ck_assert(idx == LLAPI_LAYOUT_DEFAULT);
+	rc = lus_layout_set_ost_index(layout, 3, 2);
+	ck_assert_int_eq(rc, -EOPNOTSUPP);
+
+	/* Only the first OST. */
+	rc = lus_layout_set_ost_index(layout, 0, osts[0]);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(prepared->lp_lum->lmm_magic, LOV_USER_MAGIC_V1);
+	ck_assert_int_eq(prepared->lp_lum->lmm_stripe_count, 3);
+	ck_assert_int_eq(prepared->lp_lum->lmm_stripe_offset, osts[0]);
+	lus_layout_prepared_free(prepared);
+
+	/* All of them. */
+	for (i = 1; i < 3; i++) {
+		rc = lus_layout_set_ost_index(layout, i, osts[i]);
+		ck_assert_int_eq(rc, 0);
+	}
+	rc = lus_layout_set_pool_name(layout, "fast");
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(prepared->lp_lum_size, sizeof(xattr));
+	memcpy(&xattr, prepared->lp_lum, sizeof(xattr));
+	ck_assert_int_eq(xattr.lum.lmm_magic, LOV_USER_MAGIC_SPECIFIC);
+	ck_assert_int_eq(xattr.lum.lmm_stripe_count, 3);
+	ck_assert_int_eq(xattr.lum.lmm_stripe_offset, osts[0]);
+	ck_assert_str_eq(xattr.lum.lmm_pool_name, "fast");
+	for (i = 0; i < 3; i++)
+		ck_assert_int_eq(xattr.objects[i].l_ost_idx, osts[i]);
+
+	/* Decoding gives the same layout back. */
+	rc = lus_lovxattr_to_layout((struct lov_user_md *)&xattr,
+				    sizeof(xattr), &layout2);
+	ck_assert_int_eq(rc, 0);
+	for (i = 0; i < 3; i++) {
+		rc = lus_layout_get_ost_index(layout2, i, &idx);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(idx, osts[i]);
+	}
+	rc = lus_layout_prepare(layout2, &prepared2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(prepared2->lp_lum_size, prepared->lp_lum_size);
+	ck_assert_int_eq(memcmp(prepared2->lp_lum, prepared->lp_lum,
+				prepared->lp_lum_size), 0);
+	lus_layout_prepared_free(prepared2);
+	lus_layout_prepared_free(prepared);
+	lus_layout_free(layout2);
+
+	/* Fewer stripes than OSTs given. */
+	rc = lus_layout_stripe_set_count(layout, 2);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(prepared->lp_lum->lmm_stripe_count, 2);
+	ck_assert_int_eq(prepared->lp_lum_size,
+			 sizeof(xattr) - sizeof(xattr.objects[0]));
+	lus_layout_prepared_free(prepared);
+
+	/* More stripes than OSTs given. */
+	rc = lus_layout_stripe_set_count(layout, 4);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_stripe_set_count(layout, 3);
+	ck_assert_int_eq(rc, 0);
+
+	/* The same OST twice, or none. */
+	rc = lus_layout_set_ost_index(layout, 2, osts[0]);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, -EINVAL);
+	ck_assert_int_eq(lus_layout_check_osts(NULL, layout), -EINVAL);
+
+	rc = lus_layout_set_ost_index(layout, 2, LLAPI_LAYOUT_DEFAULT);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_prepare(layout, &prepared);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* An invalid layout doesn't leave a file behind. */
+	fd = mkstemp(fname);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+	unlink(fname);
+
+	fd = lus_layout_file_create(fname, O_WRONLY, 0600, layout);
+	ck_assert_int_eq(fd, -EINVAL);
+	ck_assert_int_eq(access(fname, F_OK), -1);
+
+	lus_layout_free(layout);
+}
+
+/* A composite layout of two components as returned by the kernel. */
+struct test_comp_lum {
+	struct lov_comp_md_v1 lcm;
+	struct lov_comp_md_entry_v1 entries[2];
+	struct test_lum lums[2];
+} __attribute__((packed));
+
+static void make_comp_lum(struct test_comp_lum *xattr, bool swab)
+{
+	struct lov_comp_md_entry_v1 *lcme;
+	unsigned int i;
+
+	memset(xattr, 0, sizeof(*xattr));
+	xattr->lcm.lcm_magic = LOV_USER_MAGIC_COMP_V1;
+	xattr->lcm.lcm_size = sizeof(*xattr);
+	xattr->lcm.lcm_entry_count = 2;
+
+	for (i = 0; i < 2; i++) {
+		lcme = &xattr->entries[i];
+		lcme->lcme_id = i + 1;
+		lcme->lcme_flags = LCME_FL_INIT;
+		lcme->lcme_extent.e_start = i * 4 * 1024 * 1024;
+		lcme->lcme_extent.e_end = i ? LUS_LAYOUT_EOF : 4 * 1024 * 1024;
+		lcme->lcme_offset = offsetof(struct test_comp_lum, lums[i]);
+		lcme->lcme_size = sizeof(xattr->lums[i]);
+		make_lum(&xattr->lums[i], swab);
+	}
+
+	if (!swab)
+		return;
+
+	xattr->lcm.lcm_magic = __bswap_32(xattr->lcm.lcm_magic);
+	xattr->lcm.lcm_size = __bswap_32(xattr->lcm.lcm_size);
+	xattr->lcm.lcm_entry_count = __bswap_16(xattr->lcm.lcm_entry_count);
+	for (i = 0; i < 2; i++) {
+		lcme = &xattr->entries[i];
+		lcme->lcme_id = __bswap_32(lcme->lcme_id);
+		lcme->lcme_flags = __bswap_32(lcme->lcme_flags);
+		lcme->lcme_extent.e_start =
+			__bswap_64(lcme->lcme_extent.e_start);
+		lcme->lcme_extent.e_end = __bswap_64(lcme->lcme_extent.e_end);
+		lcme->lcme_offset = __bswap_32(lcme->lcme_offset);
+		lcme->lcme_size = __bswap_32(lcme->lcme_size);
+	}
+}
+
+void unittest_layout_composite(void)
+{
+	const uint64_t mib = 1024 * 1024;
+	struct lus_layout_component component2;
+	struct lus_layout_component component;
+	struct lus_layout_composite *composite2;
+	struct lus_layout_composite *composite;
+	struct lus_layout_prepared *prepared;
+	struct lov_comp_md_entry_v1 *lcme;
+	struct test_comp_lum xattr;
+	struct lov_comp_md_v1 *lcm;
+	struct lus_layout *layout2;
+	struct lus_layout *layout;
+	struct lus_layout *dom;
+	struct lus_layout *wide;
+	unsigned int i;
+	uint64_t idx;
+	bool swab;
+	int rc;
+
+	rc = lus_layout_composite_alloc(&composite);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(lus_layout_composite_count(composite), 0);
+	rc = lus_layout_composite_prepare(composite, &prepared);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* A 1 MiB Data-on-MDT component, then 1 stripe up to 64 MiB,
+	 * then all the OSTs. */
+	rc = lus_layout_alloc(0, &dom);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_pattern_set(dom, LLAPI_LAYOUT_MDT);
+	ck_assert_int_eq(rc, 0);
+
+	layout = make_layout(mib, 1);
+	wide = make_layout(4 * mib, 0);
+	rc = lus_layout_stripe_set_count(wide, LLAPI_LAYOUT_WIDE);
+	ck_assert_int_eq(rc, 0);
+
+	/* Data-on-MDT must come first, and not extend to EOF. */
+	rc = lus_layout_composite_add(composite, LUS_LAYOUT_EOF, dom);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_composite_add(composite, 1000, dom);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_composite_add(composite, mib, dom);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_composite_add(composite, 2 * mib, dom);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* Extents not aligned on the stripe size. */
+	rc = lus_layout_composite_add(composite, 63 * mib + 65536, layout);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_composite_add(composite, 64 * mib, layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_composite_add(composite, 64 * mib, wide);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = lus_layout_composite_add(composite, LUS_LAYOUT_EOF, wide);
+	ck_assert_int_eq(rc, 0);
+
+	/* Nothing after EOF. */
+	rc = lus_layout_composite_add(composite, LUS_LAYOUT_EOF, wide);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	ck_assert_int_eq(lus_layout_composite_count(composite), 3);
+	rc = lus_layout_composite_get(composite, 3, &component);
+	ck_assert_int_eq(rc, -ENOENT);
+
+	rc = lus_layout_composite_get(composite, 0, &component);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(component.lc_start, 0);
+	ck_assert_int_eq(component.lc_end, mib);
+	ck_assert_int_eq(lus_layout_pattern_get(component.lc_layout),
+			 LLAPI_LAYOUT_MDT);
+	ck_assert_int_eq(lus_layout_stripe_get_size(component.lc_layout),
+			 mib);
+
+	rc = lus_layout_composite_find(composite, 100 * mib, &component);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(component.lc_start, 64 * mib);
+	ck_assert(component.lc_end == LUS_LAYOUT_EOF);
+	ck_assert(lus_layout_stripe_get_count(component.lc_layout) ==
+		  LLAPI_LAYOUT_WIDE);
+
+	rc = lus_layout_composite_find(composite, mib, &component);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(component.lc_start, mib);
+
+	/* Encode, and check the result. */
+	rc = lus_layout_composite_prepare(composite, &prepared);
+	ck_assert_int_eq(rc, 0);
+	lcm = (struct lov_comp_md_v1 *)prepared->lp_lum;
+	ck_assert_int_eq(lcm->lcm_magic, LOV_USER_MAGIC_COMP_V1);
+	ck_assert_int_eq(lcm->lcm_size, prepared->lp_lum_size);
+	ck_assert_int_eq(lcm->lcm_entry_count, 3);
+	ck_assert_int_eq(lcm->lcm_size,
+			 sizeof(*lcm) + 3 * sizeof(*lcme) +
+			 3 * sizeof(struct lov_user_md_v1));
+	lcme = &lcm->lcm_entries[0];
+	ck_assert_int_eq(lcme->lcme_extent.e_end, mib);
+	ck_assert_int_eq(lcme->lcme_offset, sizeof(*lcm) + 3 * sizeof(*lcme));
+	ck_assert_int_eq(((struct lov_user_md *)
+			  ((char *)lcm + lcme->lcme_offset))->lmm_pattern,
+			 LOV_PATTERN_MDT);
+	lcme = &lcm->lcm_entries[2];
+	ck_assert_int_eq(lcme->lcme_extent.e_start, 64 * mib);
+	ck_assert(lcme->lcme_extent.e_end == LUS_LAYOUT_EOF);
+
+	/* Decoding gives the same extents and stripes back. */
+	rc = lus_lovxattr_to_composite(prepared->lp_lum, prepared->lp_lum_size,
+				       &composite2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(lus_layout_composite_count(composite2), 3);
+	for (i = 0; i < 3; i++) {
+		rc = lus_layout_composite_get(composite, i, &component);
+		ck_assert_int_eq(rc, 0);
+		rc = lus_layout_composite_get(composite2, i, &component2);
+		ck_assert_int_eq(rc, 0);
+		ck_assert(component2.lc_start == component.lc_start);
+		ck_assert(component2.lc_end == component.lc_end);
+		ck_assert(lus_layout_stripe_get_size(component2.lc_layout) ==
+			  lus_layout_stripe_get_size(component.lc_layout));
+		ck_assert(lus_layout_stripe_get_count(component2.lc_layout) ==
+			  lus_layout_stripe_get_count(component.lc_layout));
+	}
+	lus_layout_composite_free(composite2);
+
+	/* A plain layout can't represent it. */
+	rc = lus_lovxattr_to_layout(prepared->lp_lum, prepared->lp_lum_size,
+				    &layout2);
+	ck_assert_int_eq(rc, -EOPNOTSUPP);
+	ck_assert_ptr_eq(layout2, NULL);
+
+	/* Truncated. */
+	rc = lus_lovxattr_to_composite(prepared->lp_lum,
+				       prepared->lp_lum_size - 1, &composite2);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* An entry pointing inside the header. */
+	lcm->lcm_entries[1].lcme_offset = 8;
+	rc = lus_lovxattr_to_composite(prepared->lp_lum, prepared->lp_lum_size,
+				       &composite2);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	lus_layout_prepared_free(prepared);
+	lus_layout_composite_free(composite);
+
+	/* An instantiated layout, in both byte orders. */
+	for (swab = false; ; swab = true) {
+		make_comp_lum(&xattr, swab);
+		rc = lus_lovxattr_to_composite((struct lov_user_md *)&xattr,
+					       sizeof(xattr), &composite);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(lus_layout_composite_count(composite), 2);
+
+		rc = lus_layout_composite_find(composite, 5 * mib,
+					       &component);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(component.lc_id, 2);
+		ck_assert_int_eq(component.lc_flags, LCME_FL_INIT);
+		ck_assert_int_eq(component.lc_start, 4 * mib);
+		ck_assert_int_eq(lus_layout_stripe_get_count(
+					 component.lc_layout), 4);
+		rc = lus_layout_get_ost_index(component.lc_layout, 1, &idx);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(idx, 11);
+
+		lus_layout_composite_free(composite);
+
+		if (swab)
+			break;
+	}
+
+	lus_layout_free(dom);
+	lus_layout_free(layout);
+	lus_layout_free(wide);
+}
+
+/* A file with 2 mirrors, each of 2 components of 2 stripes. The OSTs
+ * of component c of mirror m are 4 * (m - 1) + 2 * c and the next
+ * one. */
+struct test_mirror_lum {
+	struct lov_comp_md_v1 lcm;
+	struct lov_comp_md_entry_v1 entries[4];
+	struct {
+		struct lov_user_md_v1 lum;
+		struct lov_user_ost_data_v1 objects[2];
+	} __attribute__((packed)) lums[4];
+} __attribute__((packed));
+
+static void make_mirror_lum(struct test_mirror_lum *xattr)
+{
+	struct lov_comp_md_entry_v1 *lcme;
+	unsigned int i;
+
+	memset(xattr, 0, sizeof(*xattr));
+	xattr->lcm.lcm_magic = LOV_USER_MAGIC_COMP_V1;
+	xattr->lcm.lcm_size = sizeof(*xattr);
+	xattr->lcm.lcm_entry_count = 4;
+	xattr->lcm.lcm_mirror_count = 1;
+
+	for (i = 0; i < 4; i++) {
+		lcme = &xattr->entries[i];
+		lcme->lcme_id = ((i / 2 + 1) << MIRROR_ID_SHIFT) | (i + 1);
+		lcme->lcme_flags = LCME_FL_INIT;
+		lcme->lcme_extent.e_start = i % 2 ? 1024 * 1024 : 0;
+		lcme->lcme_extent.e_end = i % 2 ? LUS_LAYOUT_EOF : 1024 * 1024;
+		lcme->lcme_offset = offsetof(struct test_mirror_lum, lums[i]);
+		lcme->lcme_size = sizeof(xattr->lums[i]);
+
+		xattr->lums[i].lum.lmm_magic = LOV_USER_MAGIC_V1;
+		xattr->lums[i].lum.lmm_pattern = LOV_PATTERN_RAID0;
+		xattr->lums[i].lum.lmm_stripe_size = 512 * 1024;
+		xattr->lums[i].lum.lmm_stripe_count = 2;
+		xattr->lums[i].objects[0].l_ost_idx = 2 * i;
+		xattr->lums[i].objects[1].l_ost_idx = 2 * i + 1;
+	}
+}
+
+/* Pick a mirror for a range, and check the choice. */
+static void check_pick(const struct test_mirror_lum *xattr,
+		       uint64_t offset, uint64_t length,
+		       const struct lus_mirror_hint *hint, int expected)
+{
+	struct lus_layout_composite *composite;
+	struct test_mirror_lum copy = *xattr;
+	uint16_t mirror_id;
+	int rc;
+
+	rc = lus_lovxattr_to_composite((struct lov_user_md *)&copy,
+				       sizeof(copy), &composite);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_composite_pick_mirror(composite, offset, length,
+					      hint, &mirror_id);
+	if (expected < 0) {
+		ck_assert_int_eq(rc, expected);
+	} else {
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(mirror_id, expected);
+	}
+
+	lus_layout_composite_free(composite);
+}
+
+void unittest_layout_mirror(void)
+{
+	const uint64_t mib = 1024 * 1024;
+	uint64_t loads[8] = { 0 };
+	struct lus_mirror_hint hint = {
+		.mh_ost_loads = loads,
+		.mh_ost_count = 8,
+	};
+	struct lus_layout_component component;
+	struct lus_layout_composite *composite;
+	struct test_mirror_lum xattr;
+	struct lus_layout *layout;
+	uint16_t mirror_id;
+	uint64_t idx;
+	int rc;
+
+	make_mirror_lum(&xattr);
+
+	rc = lus_lovxattr_to_composite((struct lov_user_md *)&xattr,
+				       sizeof(xattr), &composite);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(lus_layout_composite_count(composite), 4);
+	ck_assert_int_eq(lus_layout_composite_mirror_count(composite), 2);
+	rc = lus_layout_composite_mirror_id(composite, 0, &mirror_id);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(mirror_id, 1);
+	rc = lus_layout_composite_mirror_id(composite, 1, &mirror_id);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(mirror_id, 2);
+	rc = lus_layout_composite_mirror_id(composite, 2, &mirror_id);
+	ck_assert_int_eq(rc, -ENOENT);
+
+	rc = lus_layout_composite_get(composite, 3, &component);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(component.lc_mirror_id, 2);
+	ck_assert_int_eq(component.lc_start, mib);
+	rc = lus_layout_get_ost_index(component.lc_layout, 1, &idx);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(idx, 7);
+
+	/* The first mirror, for a plain reader. */
+	rc = lus_layout_composite_find(composite, 0, &component);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(component.lc_mirror_id, 1);
+
+	rc = lus_layout_composite_pick_mirror(composite, 0, 0, NULL,
+					      &mirror_id);
+	ck_assert_int_eq(rc, -EINVAL);
+	lus_layout_composite_free(composite);
+
+	/* Nothing to tell the mirrors apart. */
+	check_pick(&xattr, 0, UINT64_MAX, NULL, 1);
+	check_pick(&xattr, 0, UINT64_MAX, &hint, 1);
+
+	/* The first OST of the first mirror is busy. Only the first
+	 * stripe of the range uses it. */
+	loads[0] = 10;
+	check_pick(&xattr, 0, mib, &hint, 2);
+	check_pick(&xattr, 0, 512 * 1024, &hint, 2);
+	check_pick(&xattr, 512 * 1024, 512 * 1024, &hint, 1);
+	check_pick(&xattr, mib, mib, &hint, 1);
+
+	/* Unless the caller wants it anyway. */
+	hint.mh_preferred = 1;
+	check_pick(&xattr, 0, mib, &hint, 1);
+	hint.mh_preferred = 0;
+	loads[0] = 0;
+
+	/* The administrator's preference breaks ties. */
+	xattr.entries[2].lcme_flags |= LCME_FL_PREF_RD;
+	check_pick(&xattr, 0, mib, &hint, 2);
+	check_pick(&xattr, mib, mib, &hint, 1);
+	loads[5] = 1;
+	check_pick(&xattr, 0, mib, &hint, 1);
+	loads[5] = 0;
+	xattr.entries[2].lcme_flags &= ~LCME_FL_PREF_RD;
+
+	/* A stale component can't be read, even if preferred. A
+	 * component that was never written doesn't matter. */
+	xattr.entries[1].lcme_flags |= LCME_FL_STALE;
+	xattr.entries[3].lcme_flags &= ~LCME_FL_INIT;
+	hint.mh_preferred = 1;
+	check_pick(&xattr, 0, mib, &hint, 1);
+	check_pick(&xattr, 0, 2 * mib, &hint, 2);
+	xattr.entries[2].lcme_flags |= LCME_FL_OFFLINE;
+	check_pick(&xattr, 0, 2 * mib, &hint, -ENOENT);
+
+	/* A file that is not mirrored. */
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_composite_alloc(&composite);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_composite_add(composite, LUS_LAYOUT_EOF, layout);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(lus_layout_composite_mirror_count(composite), 1);
+	rc = lus_layout_composite_pick_mirror(composite, 0, mib, NULL,
+					      &mirror_id);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(mirror_id, 0);
+	lus_layout_composite_free(composite);
+	lus_layout_free(layout);
+}
@@ -0,0 +1,197 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the hashing, comparison and interning of made up layouts; no
+ * Lustre filesystem is needed.
+ */
+
+#include <string.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/layout_table.c"
+#include "lib_test.h"
+
+/* Hash of the layout built by make_layout(1 MiB, 4, "pool1"), without
+ * the OSTs. It must never change, since it may be stored. */
+#define REF_HASH 0xbf91be926cd2f5b6ULL
+
+/* A V3 layout as returned by the kernel. */
+struct test_lum {
+	struct lov_user_md_v3 lum;
+	struct lov_user_ost_data_v1 objects[4];
+} __attribute__((packed));
+
+/* Decode the layout of a file with up to 4 stripes, stripe i being on
+ * OST first_ost + i. Every object gets a different ID. */
+static struct lus_layout *make_layout(uint32_t stripe_size,
+				      unsigned int stripe_count,
+				      const char *pool, unsigned int first_ost)
+{
+	static uint64_t object_id;
+	struct lus_layout *layout;
+	struct test_lum xattr;
+	unsigned int i;
+	int rc;
+
+	memset(&xattr, 0, sizeof(xattr));
+	xattr.lum.lmm_magic = LOV_USER_MAGIC_V3;
+	xattr.lum.lmm_pattern = LOV_PATTERN_RAID0;
+	xattr.lum.lmm_stripe_size = stripe_size;
+	xattr.lum.lmm_stripe_count = stripe_count;
+	strcpy(xattr.lum.lmm_pool_name, pool);
+	for (i = 0; i < stripe_count; i++) {
+		xattr.objects[i].l_ost_idx = first_ost + i;
+		xattr.objects[i].l_ost_oi.oi.oi_id = ++object_id;
+	}
+
+	rc = lus_lovxattr_to_layout((struct lov_user_md *)&xattr,
+				    sizeof(xattr.lum) +
+				    stripe_count * sizeof(xattr.objects[0]),
+				    &layout);
+	ck_assert_int_eq(rc, 0);
+
+	return layout;
+}
+
+static void check_hash(void)
+{
+	struct lus_layout *a = make_layout(1 << 20, 4, "pool1", 0);
+	struct lus_layout *b = make_layout(1 << 20, 4, "pool1", 0);
+	struct lus_layout *c = make_layout(1 << 20, 4, "pool1", 8);
+	struct lus_layout *d = make_layout(1 << 20, 4, "pool2", 0);
+	struct lus_layout *e = make_layout(2 << 20, 4, "pool1", 0);
+	struct lus_layout *f = make_layout(1 << 20, 2, "pool1", 0);
+
+	ck_assert_uint_eq(lus_layout_hash(a, 0), REF_HASH);
+
+	/* Different object IDs. */
+	ck_assert(lus_layout_equal(a, b, 0));
+	ck_assert(lus_layout_equal(a, b, LUS_LAYOUT_CMP_OSTS));
+	ck_assert_uint_eq(lus_layout_hash(a, 0), lus_layout_hash(b, 0));
+	ck_assert_uint_eq(lus_layout_hash(a, LUS_LAYOUT_CMP_OSTS),
+			  lus_layout_hash(b, LUS_LAYOUT_CMP_OSTS));
+
+	/* Different OSTs. */
+	ck_assert(lus_layout_equal(a, c, 0));
+	ck_assert(!lus_layout_equal(a, c, LUS_LAYOUT_CMP_OSTS));
+	ck_assert_uint_eq(lus_layout_hash(a, 0), lus_layout_hash(c, 0));
+	ck_assert_uint_ne(lus_layout_hash(a, LUS_LAYOUT_CMP_OSTS),
+			  lus_layout_hash(c, LUS_LAYOUT_CMP_OSTS));
+	ck_assert_uint_ne(lus_layout_hash(a, 0),
+			  lus_layout_hash(a, LUS_LAYOUT_CMP_OSTS));
+
+	ck_assert(!lus_layout_equal(a, d, 0));
+	ck_assert_uint_ne(lus_layout_hash(a, 0), lus_layout_hash(d, 0));
+	ck_assert(!lus_layout_equal(a, e, 0));
+	ck_assert_uint_ne(lus_layout_hash(a, 0), lus_layout_hash(e, 0));
+	ck_assert(!lus_layout_equal(a, f, 0));
+	ck_assert_uint_ne(lus_layout_hash(a, 0), lus_layout_hash(f, 0));
+
+	lus_layout_free(a);
+	lus_layout_free(b);
+	lus_layout_free(c);
+	lus_layout_free(d);
+	lus_layout_free(e);
+	lus_layout_free(f);
+}
+
+static void check_table(unsigned int flags)
+{
+	struct lus_layout_table_stats stats;
+	struct lus_layout_table *table;
+	const struct lus_layout *shared[1000];
+	const struct lus_layout *again;
+	struct lus_layout *layout;
+	uint64_t ost_idx;
+	unsigned int i;
+	int rc;
+
+	rc = lus_layout_table_create(flags, &table);
+	ck_assert_int_eq(rc, 0);
+
+	/* 1000 files, with 10 stripe sizes, each on 2 different sets
+	 * of OSTs. */
+	for (i = 0; i < 1000; i++) {
+		layout = make_layout((i % 10 + 1) << 16, 4, "pool1", i % 20);
+
+		rc = lus_layout_intern(table, layout, &shared[i]);
+		ck_assert_int_eq(rc, 0);
+		ck_assert(lus_layout_equal(shared[i], layout, flags));
+		if (i >= 20)
+			ck_assert_ptr_eq(shared[i], shared[i - 20]);
+
+		lus_layout_free(layout);
+	}
+
+	lus_layout_table_get_stats(table, &stats);
+	ck_assert_uint_eq(stats.lts_layouts, flags ? 20 : 10);
+	ck_assert_uint_eq(stats.lts_refs, 1000);
+	ck_assert_uint_gt(stats.lts_bytes, 0);
+
+	/* Only the OSTs are kept. */
+	rc = lus_layout_get_ost_index(shared[3], 0, &ost_idx);
+	if (flags) {
+		ck_assert_int_eq(rc, 0);
+		ck_assert_uint_eq(ost_idx, 3);
+	} else {
+		ck_assert_int_eq(rc, -EINVAL);
+	}
+
+	/* Interning a shared layout takes another reference. */
+	rc = lus_layout_intern(table, shared[0], &again);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_ptr_eq(again, shared[0]);
+	lus_layout_release(table, again);
+
+	/* Release all the files but the first one. */
+	for (i = 1; i < 1000; i++)
+		lus_layout_release(table, shared[i]);
+
+	lus_layout_table_get_stats(table, &stats);
+	ck_assert_uint_eq(stats.lts_layouts, 1);
+	ck_assert_uint_eq(stats.lts_refs, 1);
+	ck_assert_uint_eq(lus_layout_stripe_get_size(shared[0]), 1 << 16);
+
+	lus_layout_release(table, shared[0]);
+	lus_layout_table_get_stats(table, &stats);
+	ck_assert_uint_eq(stats.lts_layouts, 0);
+	ck_assert_uint_eq(stats.lts_refs, 0);
+
+	/* Destroying the table frees the layouts still referenced. */
+	layout = make_layout(1 << 20, 1, "", 0);
+	rc = lus_layout_intern(table, layout, &again);
+	ck_assert_int_eq(rc, 0);
+	lus_layout_free(layout);
+
+	lus_layout_table_destroy(table);
+}
+
+void unittest_layout_table(void)
+{
+	struct lus_layout_table *table;
+	int rc;
+
+	check_hash();
+	check_table(0);
+	check_table(LUS_LAYOUT_CMP_OSTS);
+
+	rc = lus_layout_table_create(2, &table);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	lus_layout_table_destroy(NULL);
+}
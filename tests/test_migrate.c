@@ -0,0 +1,123 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the migration of files to a new layout. The copy engine
+ * itself is tested without Lustre in test_pario.c.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/migrate.c"
+#include "lib_test.h"
+
+void unittest_migrate_lustre(void)
+{
+	struct lus_fs_handle *lfsh;
+	struct lus_layout *layout;
+	const size_t count = 5 * 1024 * 1024 + 1234;
+	char fname[PATH_MAX];
+	unsigned char *data;
+	unsigned char *buf;
+	struct stat st2;
+	struct stat st;
+	lustre_fid fid;
+	ssize_t rc;
+	size_t k;
+	int fd;
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	ck_assert_int_eq(rc, 0);
+
+	snprintf(fname, sizeof(fname), "%s/unittest_migrate", lustre_dir);
+	unlink(fname);
+
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_stripe_set_count(layout, 1);
+	ck_assert_int_eq(rc, 0);
+
+	fd = lus_layout_file_create(fname, O_RDWR, 0600, layout);
+	ck_assert_int_ge(fd, 0);
+	lus_layout_free(layout);
+
+	data = malloc(count);
+	buf = malloc(count);
+	ck_assert_ptr_ne(data, NULL);
+	ck_assert_ptr_ne(buf, NULL);
+
+	for (k = 0; k < count; k++)
+		data[k] = k * 5;
+
+	rc = pwrite(fd, data, count, 0);
+	ck_assert_int_eq(rc, count);
+
+	rc = lus_fd2fid(fd, &fid);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(fstat(fd, &st), 0);
+	close(fd);
+
+	/* Invalid flags */
+	rc = lus_migrate_file(lfsh, &fid, NULL, 0x100);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* Restripe over 2 OSTs, with 1 MiB stripes. */
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_stripe_set_count(layout, 2);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_stripe_set_size(layout, 1024 * 1024);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_migrate_file(lfsh, &fid, layout, LUS_MIGRATE_RETRY);
+	ck_assert_int_eq(rc, 0);
+	lus_layout_free(layout);
+
+	fd = open(fname, O_RDONLY);
+	ck_assert_int_ge(fd, 0);
+
+	rc = lus_layout_get_by_fd(fd, &layout);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(lus_layout_stripe_get_size(layout), 1024 * 1024);
+	lus_layout_free(layout);
+
+	ck_assert_int_eq(fstat(fd, &st2), 0);
+	ck_assert_int_eq(st2.st_ino, st.st_ino);
+	ck_assert_int_eq(st2.st_size, count);
+	ck_assert_int_eq(st2.st_mtime, st.st_mtime);
+
+	memset(buf, 0, count);
+	rc = pread(fd, buf, count, 0);
+	ck_assert_int_eq(rc, count);
+	ck_assert_int_eq(memcmp(buf, data, count), 0);
+
+	close(fd);
+	unlink(fname);
+
+	/* The file is gone. */
+	rc = lus_migrate_file(lfsh, &fid, NULL, 0);
+	ck_assert_int_lt(rc, 0);
+
+	lus_close_fs(lfsh);
+	free(buf);
+	free(data);
+}
@@ -0,0 +1,223 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the mount table index.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/mounts.c"
+#include "lib_test.h"
+
+static const char mountinfo[] =
+	"20 1 8:1 / / rw - ext4 /dev/sda1 rw\n"
+	"21 20 0:40 / /mnt/lustre rw shared:1 - lustre 10.0.0.1@tcp:/lustre rw\n"
+	"22 20 0:41 / /mnt/lustre-2 rw - lustre 10.0.0.1@tcp:/fs2 rw\n"
+	"23 21 0:42 / /mnt/lustre/tmp rw - tmpfs tmpfs rw\n"
+	"24 20 0:43 / /mnt/with\\040space rw - lustre 10.0.0.2@o2ib:/spc rw\n"
+	"25 20 0:44 / /mnt/over rw - lustre 10.0.0.1@tcp:/old rw\n"
+	"26 20 0:45 / /mnt/over rw - lustre 10.0.0.1@tcp:/new rw\n"
+	"this line is not valid\n"
+	"27 20 0:46 / /mnt/bad rw - lustre 10.0.0.1@tcp:/waytoolong rw\n";
+
+/* Check which mount a path resolves to. */
+static void check_mount(const struct mount_entry *entries, size_t count,
+			const char *path, const char *dir, const char *fs_name)
+{
+	const struct mount_entry *entry;
+
+	entry = search_mount(entries, count, path);
+	ck_assert_ptr_ne(entry, NULL);
+	ck_assert_str_eq(entry->dir, dir);
+	ck_assert_str_eq(entry->fs_name, fs_name);
+	ck_assert_int_eq(entry->is_lustre, fs_name[0] != '\0');
+}
+
+/* Index built from a fake mountinfo. */
+void unittest_mount_index(void)
+{
+	struct mount_entry *entries;
+	char mount_dir[PATH_MAX];
+	char fs_name[8 + 1];
+	size_t count;
+	char *buf;
+	int rc;
+
+	buf = strdup(mountinfo);
+	ck_assert_ptr_ne(buf, NULL);
+
+	rc = parse_mountinfo(buf, &entries, &count);
+	ck_assert_int_eq(rc, 0);
+
+	/* The invalid line is dropped, and the hidden mount too. */
+	ck_assert_int_eq(count, 7);
+
+	check_mount(entries, count, "/", "/", "");
+	check_mount(entries, count, "/mnt", "/", "");
+	check_mount(entries, count, "/mnt/lustre", "/mnt/lustre", "lustre");
+	check_mount(entries, count, "/mnt/lustre/a/b", "/mnt/lustre", "lustre");
+	check_mount(entries, count, "/mnt/lustre/tmpx", "/mnt/lustre",
+		    "lustre");
+	check_mount(entries, count, "/mnt/lustre/tmp/a", "/mnt/lustre/tmp", "");
+	check_mount(entries, count, "/mnt/lustre-2/a", "/mnt/lustre-2", "fs2");
+	check_mount(entries, count, "/mnt/lustrex", "/", "");
+	check_mount(entries, count, "/mnt/with space/a", "/mnt/with space",
+		    "spc");
+	check_mount(entries, count, "/mnt/over/a", "/mnt/over", "new");
+	check_mount(entries, count, "/mnt/bad", "/mnt/bad", "");
+
+	free(entries);
+	free(buf);
+
+	/* Nothing is mounted at / */
+	buf = strdup("21 20 0:40 / /mnt/lustre rw - lustre a@tcp:/lustre rw");
+	ck_assert_ptr_ne(buf, NULL);
+
+	rc = parse_mountinfo(buf, &entries, &count);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(count, 1);
+	ck_assert_ptr_eq(search_mount(entries, count, "/mnt"), NULL);
+	check_mount(entries, count, "/mnt/lustre/", "/mnt/lustre", "lustre");
+
+	free(entries);
+	free(buf);
+
+	/* The real mount table. /proc is never Lustre. */
+	rc = mount_index_lookup("/proc/self", mount_dir, sizeof(mount_dir),
+				fs_name);
+	ck_assert_int_eq(rc, -ENOENT);
+
+	rc = mount_index_get("/proc", fs_name);
+	ck_assert_int_eq(rc, -ENOENT);
+}
+
+/* Test lus_open_fs_for_path */
+void unittest_open_fs_for_path(void)
+{
+	struct lus_fs_handle *lfsh1;
+	struct lus_fs_handle *lfsh2;
+	char fname[PATH_MAX];
+	int rc;
+
+	rc = snprintf(fname, sizeof(fname), "%s/does/not/exist", lustre_dir);
+	ck_assert_msg(rc > 0 && rc < sizeof(fname), "snprintf failed: %d", rc);
+
+	/* Parent must exist */
+	rc = lus_open_fs_for_path(fname, &lfsh1);
+	ck_assert_int_eq(rc, -ENOENT);
+	ck_assert_ptr_eq(lfsh1, NULL);
+
+	rc = snprintf(fname, sizeof(fname), "%s/unittest_open_fs", lustre_dir);
+	ck_assert_msg(rc > 0 && rc < sizeof(fname), "snprintf failed: %d", rc);
+
+	rc = lus_open_fs_for_path(fname, &lfsh1);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_str_eq(lus_get_mountpoint(lfsh1), lustre_dir);
+
+	rc = lus_open_fs_for_path(lustre_dir, &lfsh2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_ptr_eq(lfsh1, lfsh2);
+	ck_assert_int_eq(lfsh1->refcount, 2);
+
+	lus_close_fs(lfsh2);
+	ck_assert_int_eq(lfsh1->refcount, 1);
+	ck_assert_str_eq(lus_get_fsname(lfsh1), lfsh1->fs_name);
+	lus_close_fs(lfsh1);
+
+	rc = lus_open_fs_for_path("/proc", &lfsh1);
+	ck_assert_int_eq(rc, -ENOENT);
+}
+
+/* Test lus_open_fs_fd */
+void unittest_open_fs_fd(void)
+{
+	struct lus_fs_handle *lfsh1;
+	struct lus_fs_handle *lfsh2;
+	int fd2;
+	int fd;
+	int rc;
+
+	fd = open(lustre_dir, O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(fd, 0);
+
+	rc = lus_open_fs_fd(fd, &lfsh1);
+	ck_assert_int_eq(rc, 0);
+	close(fd);
+
+	ck_assert_str_eq(lus_get_mountpoint(lfsh1), lustre_dir);
+
+	/* Same handle, and same name as found in the mount table */
+	rc = lus_open_fs(lustre_dir, &lfsh2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_ptr_eq(lfsh1, lfsh2);
+	ck_assert_int_eq(lfsh1->refcount, 2);
+	ck_assert_int_ge(lfsh1->mount_fd, 0);
+	ck_assert_int_ge(lfsh1->fid_fd, 0);
+
+	lus_close_fs(lfsh2);
+	lus_close_fs(lfsh1);
+
+	/* The first user is now lus_open_fs() */
+	rc = lus_open_fs(lustre_dir, &lfsh1);
+	ck_assert_int_eq(rc, 0);
+
+	fd = open(lustre_dir, O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(fd, 0);
+
+	rc = lus_open_fs_fd(fd, &lfsh2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_ptr_eq(lfsh1, lfsh2);
+	ck_assert_str_eq(lus_get_fsname(lfsh2), lfsh1->fs_name);
+	close(fd);
+
+	lus_close_fs(lfsh2);
+	lus_close_fs(lfsh1);
+
+	/* Not the root */
+	fd = open(lustre_dir, O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(fd, 0);
+	fd2 = openat(fd, ".lustre", O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(fd2, 0);
+	close(fd);
+
+	rc = lus_open_fs_fd(fd2, &lfsh1);
+	ck_assert_int_eq(rc, -ENOENT);
+	ck_assert_ptr_eq(lfsh1, NULL);
+	close(fd2);
+
+	/* Not a directory */
+	fd = open("/proc/self/status", O_RDONLY);
+	ck_assert_int_ge(fd, 0);
+
+	rc = lus_open_fs_fd(fd, &lfsh1);
+	ck_assert_int_eq(rc, -ENOTDIR);
+	close(fd);
+
+	/* Not Lustre */
+	fd = open("/proc", O_RDONLY | O_DIRECTORY);
+	ck_assert_int_ge(fd, 0);
+
+	rc = lus_open_fs_fd(fd, &lfsh1);
+	ck_assert_int_eq(rc, -EINVAL);
+	ck_assert_ptr_eq(lfsh1, NULL);
+	close(fd);
+}
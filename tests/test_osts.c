@@ -87,3 +87,27 @@ void unittest_ost2(void)
 
 	lus_close_fs(lfsh);
 }
+
+/* Test for ost_info_has_index */
+void unittest_ost3(void)
+{
+	const char *names[] = { "lustre-OST0000_UUID", "lustre-OST000a_UUID",
+				"bad_name" };
+	struct lustre_ost_info *info;
+	int i;
+
+	info = malloc(sizeof(*info) + 3 * sizeof(char *));
+	ck_assert_ptr_ne(info, NULL);
+
+	for (i = 0; i < 3; i++) {
+		info->osts[i] = strdup(names[i]);
+		ck_assert_ptr_ne(info->osts[i], NULL);
+	}
+	info->count = 3;
+
+	ck_assert(ost_info_has_index(info, 0));
+	ck_assert(ost_info_has_index(info, 10));
+	ck_assert(!ost_info_has_index(info, 1));
+
+	free_ost_info(&info);
+}
@@ -0,0 +1,366 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the parallel reads and writes. The striping only decides how
+ * the I/Os are split, so it is tested on a file in /tmp with made up
+ * layouts; no Lustre filesystem is needed.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/pario.c"
+#include "lib_test.h"
+
+#define STRIPE_SIZE (64 * 1024)
+
+static struct lus_layout *make_layout(unsigned int stripe_count)
+{
+	struct lus_layout *layout;
+	int rc;
+
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_stripe_set_count(layout, stripe_count);
+	ck_assert_int_eq(rc, 0);
+
+	rc = lus_layout_stripe_set_size(layout, STRIPE_SIZE);
+	ck_assert_int_eq(rc, 0);
+
+	return layout;
+}
+
+/* Check first_unit() against a linear search. */
+static void check_first_unit(void)
+{
+	static const uint64_t offsets[] = {
+		0, 1, STRIPE_SIZE - 1, STRIPE_SIZE, 5 * STRIPE_SIZE + 3,
+		1ULL << 40,
+	};
+	uint64_t stripe_count;
+	uint64_t expected;
+	uint64_t stripe;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+		for (stripe_count = 1; stripe_count <= 7; stripe_count++) {
+			for (stripe = 0; stripe < stripe_count; stripe++) {
+				expected = offsets[i] / STRIPE_SIZE;
+				while (expected % stripe_count != stripe)
+					expected++;
+
+				ck_assert_int_eq(first_unit(offsets[i],
+							    STRIPE_SIZE,
+							    stripe_count,
+							    stripe),
+						 expected);
+			}
+		}
+	}
+}
+
+void unittest_pario(void)
+{
+	static const unsigned int stripe_counts[] = { 1, 3, 4, 7 };
+	static const unsigned int threads[] = { 0, 1, 2, 8 };
+	char fname[] = "/tmp/unittest_pario.XXXXXX";
+	const size_t count = 20 * STRIPE_SIZE + 1234;
+	const off_t offset = 3 * STRIPE_SIZE - 100;
+	struct lus_layout *layout;
+	unsigned char *data;
+	unsigned char *buf;
+	unsigned int i;
+	unsigned int j;
+	uint64_t gid;
+	ssize_t rc;
+	size_t k;
+	int fd;
+
+	check_first_unit();
+
+	data = malloc(count);
+	buf = malloc(count);
+	ck_assert_ptr_ne(data, NULL);
+	ck_assert_ptr_ne(buf, NULL);
+
+	fd = mkstemp(fname);
+	ck_assert_int_ge(fd, 0);
+	unlink(fname);
+
+	for (i = 0; i < sizeof(stripe_counts) / sizeof(stripe_counts[0]);
+	     i++) {
+		layout = make_layout(stripe_counts[i]);
+
+		for (j = 0; j < sizeof(threads) / sizeof(threads[0]); j++) {
+			for (k = 0; k < count; k++)
+				data[k] = k * 7 + i * 13 + j;
+
+			ck_assert_int_eq(ftruncate(fd, 0), 0);
+
+			rc = lus_parallel_write(fd, layout, data, count,
+						offset, threads[j], 0);
+			ck_assert_int_eq(rc, count);
+
+			/* Serial read back */
+			memset(buf, 0, count);
+			rc = pread(fd, buf, count, offset);
+			ck_assert_int_eq(rc, count);
+			ck_assert_int_eq(memcmp(buf, data, count), 0);
+
+			/* Parallel read back */
+			memset(buf, 0, count);
+			rc = lus_parallel_read(fd, layout, buf, count, offset,
+					       threads[j], 0);
+			ck_assert_int_eq(rc, count);
+			ck_assert_int_eq(memcmp(buf, data, count), 0);
+
+			/* Past the end of the file, from the middle of
+			 * a stripe. */
+			memset(buf, 0, count);
+			rc = lus_parallel_read(fd, layout, buf, count,
+					       offset + 1000, threads[j], 0);
+			ck_assert_int_eq(rc, count - 1000);
+			ck_assert_int_eq(memcmp(buf, data + 1000, rc), 0);
+
+			/* Within a single stripe unit */
+			memset(buf, 0, count);
+			rc = lus_parallel_read(fd, layout, buf, 100,
+					       offset + 1000, threads[j], 0);
+			ck_assert_int_eq(rc, 100);
+			ck_assert_int_eq(memcmp(buf, data + 1000, 100), 0);
+
+			rc = lus_parallel_read(fd, layout, buf, count,
+					       offset + count, threads[j], 0);
+			ck_assert_int_eq(rc, 0);
+		}
+
+		lus_layout_free(layout);
+	}
+
+	layout = make_layout(2);
+
+	rc = lus_parallel_write(fd, layout, data, 0, 0, 0, 0);
+	ck_assert_int_eq(rc, 0);
+
+	/* Invalid arguments */
+	rc = lus_parallel_write(fd, layout, data, count, -1, 0, 0);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	rc = lus_parallel_write(fd, layout, data, count, 0, 257, 0);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	rc = lus_parallel_write(-1, layout, data, count, 0, 0, 0);
+	ck_assert_int_eq(rc, -EBADF);
+
+	lus_layout_free(layout);
+
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_parallel_write(fd, layout, data, count, 0, 0, 0);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* Not a Lustre file */
+	rc = lus_parallel_write(fd, NULL, data, count, 0, 0, 0);
+	ck_assert_int_lt(rc, 0);
+
+	lus_layout_free(layout);
+	layout = make_layout(2);
+
+	rc = lus_parallel_write(fd, layout, data, count, 0, 0, 1234);
+	ck_assert_int_eq(rc, -ENOTTY);
+
+	rc = lus_group_lock_gid(fd, &gid);
+	ck_assert_int_lt(rc, 0);
+
+	lus_layout_free(layout);
+	close(fd);
+	free(buf);
+	free(data);
+}
+
+/* Same thing on Lustre, with a group lock. */
+void unittest_pario_lustre(void)
+{
+	struct lus_layout *layout;
+	char fname[PATH_MAX];
+	const size_t count = 8 * 1024 * 1024 + 17;
+	unsigned char *data;
+	unsigned char *buf;
+	uint64_t gid2;
+	uint64_t gid;
+	ssize_t rc;
+	size_t k;
+	int fd;
+
+	snprintf(fname, sizeof(fname), "%s/unittest_pario", lustre_dir);
+	unlink(fname);
+
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_stripe_set_count(layout, 2);
+	ck_assert_int_eq(rc, 0);
+	rc = lus_layout_stripe_set_size(layout, 1024 * 1024);
+	ck_assert_int_eq(rc, 0);
+
+	fd = lus_layout_file_create(fname, O_RDWR, 0600, layout);
+	ck_assert_int_ge(fd, 0);
+	lus_layout_free(layout);
+
+	rc = lus_group_lock_gid(fd, &gid);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_ne(gid, 0);
+	ck_assert_int_le(gid, INT_MAX);
+
+	rc = lus_group_lock_gid(fd, &gid2);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(gid, gid2);
+
+	data = malloc(count);
+	buf = malloc(count);
+	ck_assert_ptr_ne(data, NULL);
+	ck_assert_ptr_ne(buf, NULL);
+
+	for (k = 0; k < count; k++)
+		data[k] = k * 3;
+
+	/* The layout comes from the file. */
+	rc = lus_parallel_write(fd, NULL, data, count, 4096, 0, gid);
+	ck_assert_int_eq(rc, count);
+
+	rc = lus_parallel_read(fd, NULL, buf, count, 4096, 0, gid);
+	ck_assert_int_eq(rc, count);
+	ck_assert_int_eq(memcmp(buf, data, count), 0);
+
+	close(fd);
+	unlink(fname);
+	free(buf);
+	free(data);
+}
+
+/* Copy a file into another along the stripes of the destination. */
+void unittest_pario_copy(void)
+{
+	static const unsigned int stripe_counts[] = { 1, 3, 4 };
+	char src_name[] = "/tmp/unittest_pario_src.XXXXXX";
+	char dst_name[] = "/tmp/unittest_pario_dst.XXXXXX";
+	const size_t count = 40 * STRIPE_SIZE + 4321;
+	struct thread_pool *pool;
+	struct lus_layout *layout;
+	unsigned char *data;
+	unsigned char *buf;
+	struct stat st;
+	unsigned int i;
+	ssize_t rc;
+	size_t k;
+	int src_fd;
+	int dst_fd;
+
+	data = malloc(count);
+	buf = malloc(count);
+	ck_assert_ptr_ne(data, NULL);
+	ck_assert_ptr_ne(buf, NULL);
+
+	for (k = 0; k < count; k++)
+		data[k] = k * 11;
+
+	src_fd = mkstemp(src_name);
+	ck_assert_int_ge(src_fd, 0);
+	unlink(src_name);
+
+	dst_fd = mkstemp(dst_name);
+	ck_assert_int_ge(dst_fd, 0);
+	unlink(dst_name);
+
+	rc = pwrite(src_fd, data, count, 0);
+	ck_assert_int_eq(rc, count);
+
+	rc = thread_pool_create(3, &pool);
+	ck_assert_int_eq(rc, 0);
+
+	for (i = 0; i < sizeof(stripe_counts) / sizeof(stripe_counts[0]);
+	     i++) {
+		layout = make_layout(stripe_counts[i]);
+
+		/* With and without threads */
+		ck_assert_int_eq(ftruncate(dst_fd, 0), 0);
+		rc = pario_copy(pool, src_fd, dst_fd, layout, count);
+		ck_assert_int_eq(rc, count);
+
+		memset(buf, 0, count);
+		rc = pread(dst_fd, buf, count, 0);
+		ck_assert_int_eq(rc, count);
+		ck_assert_int_eq(memcmp(buf, data, count), 0);
+
+		ck_assert_int_eq(ftruncate(dst_fd, 0), 0);
+		rc = pario_copy(NULL, src_fd, dst_fd, layout, count);
+		ck_assert_int_eq(rc, count);
+
+		memset(buf, 0, count);
+		rc = pread(dst_fd, buf, count, 0);
+		ck_assert_int_eq(rc, count);
+		ck_assert_int_eq(memcmp(buf, data, count), 0);
+
+		/* The source is shorter than expected. */
+		ck_assert_int_eq(ftruncate(dst_fd, 0), 0);
+		rc = pario_copy(pool, src_fd, dst_fd, layout,
+				count + 3 * STRIPE_SIZE);
+		ck_assert_int_eq(rc, count);
+		ck_assert_int_eq(fstat(dst_fd, &st), 0);
+		ck_assert_int_eq(st.st_size, count);
+
+		lus_layout_free(layout);
+	}
+
+	layout = make_layout(2);
+	rc = pario_copy(pool, src_fd, dst_fd, layout, 0);
+	ck_assert_int_eq(rc, 0);
+	rc = pario_copy(pool, -1, dst_fd, layout, count);
+	ck_assert_int_eq(rc, -EBADF);
+	lus_layout_free(layout);
+
+	rc = lus_layout_alloc(0, &layout);
+	ck_assert_int_eq(rc, 0);
+	rc = pario_copy(pool, src_fd, dst_fd, layout, count);
+	ck_assert_int_eq(rc, -EINVAL);
+	lus_layout_free(layout);
+
+	/* A resized pool is still usable. */
+	rc = thread_pool_resize(pool, 1);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(thread_pool_width(pool), 2);
+
+	layout = make_layout(4);
+	ck_assert_int_eq(ftruncate(dst_fd, 0), 0);
+	rc = pario_copy(pool, src_fd, dst_fd, layout, count);
+	ck_assert_int_eq(rc, count);
+	memset(buf, 0, count);
+	rc = pread(dst_fd, buf, count, 0);
+	ck_assert_int_eq(rc, count);
+	ck_assert_int_eq(memcmp(buf, data, count), 0);
+	lus_layout_free(layout);
+
+	thread_pool_destroy(pool);
+	close(src_fd);
+	close(dst_fd);
+	free(buf);
+	free(data);
+}
@@ -0,0 +1,289 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the namespace scanner. The trees are created in /tmp, so no
+ * Lustre filesystem is needed.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/scan.c"
+#include "lib_test.h"
+
+/* Enough files to need several getdents64 calls. */
+#define BIG_DIR_FILES 3000
+#define NUM_SUBDIRS 4
+#define SUBDIR_FILES 20
+#define TOTAL_FILES (BIG_DIR_FILES + 2 * NUM_SUBDIRS * SUBDIR_FILES)
+
+struct scan_counts {
+	const char *root;
+	size_t root_len;
+	unsigned long files;
+	unsigned long dirs;
+	unsigned long symlinks;
+	unsigned long with_stat;
+	unsigned int max_depth;
+	bool skip_dirs;
+	unsigned long fail_after;
+};
+
+static void make_file(const char *dir, const char *name)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+}
+
+static void make_dir(const char *dir, const char *name, char *path)
+{
+	snprintf(path, PATH_MAX, "%s/%s", dir, name);
+	ck_assert_int_eq(mkdir(path, 0700), 0);
+}
+
+/* Create the test tree:
+ *   root/big/f0..f2999
+ *   root/dN/fM, root/dN/sub/fM
+ *   root/link -> big
+ */
+static void make_tree(char *root)
+{
+	char path[PATH_MAX];
+	char sub[PATH_MAX];
+	char name[32];
+	int i;
+	int j;
+
+	ck_assert_ptr_ne(mkdtemp(root), NULL);
+
+	make_dir(root, "big", path);
+	for (i = 0; i < BIG_DIR_FILES; i++) {
+		snprintf(name, sizeof(name), "f%d", i);
+		make_file(path, name);
+	}
+
+	for (i = 0; i < NUM_SUBDIRS; i++) {
+		snprintf(name, sizeof(name), "d%d", i);
+		make_dir(root, name, path);
+		make_dir(path, "sub", sub);
+
+		for (j = 0; j < SUBDIR_FILES; j++) {
+			snprintf(name, sizeof(name), "f%d", j);
+			make_file(path, name);
+			make_file(sub, name);
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/link", root);
+	ck_assert_int_eq(symlink("big", path), 0);
+}
+
+static int remove_cb(const struct lus_scan_entry *entry, void *cb_arg)
+{
+	/* Directories are only removed once empty, by remove_tree. */
+	if (entry->type != DT_DIR)
+		ck_assert_int_eq(unlinkat(entry->dir_fd, entry->name, 0), 0);
+
+	return 0;
+}
+
+static void remove_tree(const char *root)
+{
+	char path[PATH_MAX];
+	char sub[PATH_MAX];
+	int i;
+
+	ck_assert_int_eq(lus_scan(NULL, root, 0, 1, remove_cb, NULL), 0);
+
+	for (i = 0; i < NUM_SUBDIRS; i++) {
+		snprintf(path, sizeof(path), "%s/d%d", root, i);
+		snprintf(sub, sizeof(sub), "%s/d%d/sub", root, i);
+		ck_assert_int_eq(rmdir(sub), 0);
+		ck_assert_int_eq(rmdir(path), 0);
+	}
+
+	snprintf(path, sizeof(path), "%s/big", root);
+	ck_assert_int_eq(rmdir(path), 0);
+	ck_assert_int_eq(rmdir(root), 0);
+}
+
+static int count_cb(const struct lus_scan_entry *entry, void *cb_arg)
+{
+	struct scan_counts *counts = cb_arg;
+	unsigned int depth;
+	unsigned long n;
+
+	ck_assert_int_eq(strncmp(entry->path, counts->root, counts->root_len),
+			 0);
+	ck_assert_int_eq(entry->path[counts->root_len], '/');
+	ck_assert_ptr_eq(entry->name, strrchr(entry->path, '/') + 1);
+	ck_assert_int_eq(entry->valid & ~LUS_SCAN_STAT, 0);
+
+	if (entry->valid & LUS_SCAN_STAT) {
+		ck_assert_int_eq(IFTODT(entry->st.st_mode), entry->type);
+		__atomic_add_fetch(&counts->with_stat, 1, __ATOMIC_RELAXED);
+	}
+
+	switch (entry->type) {
+	case DT_REG:
+		n = __atomic_add_fetch(&counts->files, 1, __ATOMIC_RELAXED);
+		if (counts->fail_after && n == counts->fail_after)
+			return -EUCLEAN;
+		break;
+	case DT_DIR:
+		__atomic_add_fetch(&counts->dirs, 1, __ATOMIC_RELAXED);
+		if (counts->skip_dirs)
+			return LUS_SCAN_SKIP;
+		break;
+	case DT_LNK:
+		__atomic_add_fetch(&counts->symlinks, 1, __ATOMIC_RELAXED);
+		break;
+	default:
+		ck_abort_msg("unexpected type %d", entry->type);
+	}
+
+	depth = __atomic_load_n(&counts->max_depth, __ATOMIC_RELAXED);
+	while (entry->depth > depth &&
+	       !__atomic_compare_exchange_n(&counts->max_depth, &depth,
+					    entry->depth, false,
+					    __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
+
+	return 0;
+}
+
+/* Scan a local tree with various thread counts. */
+void unittest_scan(void)
+{
+	static const unsigned int threads[] = { 1, 2, 4, 0 };
+	char root[] = "/tmp/unittest_scan.XXXXXX";
+	struct scan_counts counts;
+	char path[PATH_MAX];
+	unsigned int i;
+	int rc;
+
+	make_tree(root);
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		memset(&counts, 0, sizeof(counts));
+		counts.root = root;
+		counts.root_len = strlen(root);
+
+		rc = lus_scan(NULL, root, LUS_SCAN_STAT, threads[i],
+			      count_cb, &counts);
+		ck_assert_int_eq(rc, 0);
+		ck_assert_int_eq(counts.files, TOTAL_FILES);
+		ck_assert_int_eq(counts.dirs, 1 + 2 * NUM_SUBDIRS);
+		ck_assert_int_eq(counts.symlinks, 1);
+		ck_assert_int_eq(counts.with_stat,
+				 counts.files + counts.dirs + counts.symlinks);
+		ck_assert_int_eq(counts.max_depth, 2);
+	}
+
+	/* No information requested, trailing slashes, and skipped
+	 * directories. */
+	memset(&counts, 0, sizeof(counts));
+	counts.root = root;
+	counts.root_len = strlen(root);
+	counts.skip_dirs = true;
+	snprintf(path, sizeof(path), "%s//", root);
+
+	rc = lus_scan(NULL, path, 0, 4, count_cb, &counts);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(counts.files, 0);
+	ck_assert_int_eq(counts.dirs, 1 + NUM_SUBDIRS);
+	ck_assert_int_eq(counts.symlinks, 1);
+	ck_assert_int_eq(counts.with_stat, 0);
+	ck_assert_int_eq(counts.max_depth, 0);
+
+	/* The callback stops the scan. */
+	memset(&counts, 0, sizeof(counts));
+	counts.root = root;
+	counts.root_len = strlen(root);
+	counts.fail_after = 100;
+
+	rc = lus_scan(NULL, root, 0, 4, count_cb, &counts);
+	ck_assert_int_eq(rc, -EUCLEAN);
+	ck_assert_int_lt(counts.files, TOTAL_FILES);
+
+	/* Invalid arguments */
+	rc = lus_scan(NULL, root, 0x1000, 1, count_cb, &counts);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	rc = lus_scan(NULL, root, 0, 1000, count_cb, &counts);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	snprintf(path, sizeof(path), "%s/big/f0", root);
+	rc = lus_scan(NULL, path, 0, 1, count_cb, &counts);
+	ck_assert_int_eq(rc, -ENOTDIR);
+
+	snprintf(path, sizeof(path), "%s/none", root);
+	rc = lus_scan(NULL, path, 0, 1, count_cb, &counts);
+	ck_assert_int_eq(rc, -ENOENT);
+
+	remove_tree(root);
+}
+
+/* Scan the Lustre test directory. Every file has a FID. */
+static int fid_cb(const struct lus_scan_entry *entry, void *cb_arg)
+{
+	unsigned long *count = cb_arg;
+
+	ck_assert_int_ne(entry->valid & LUS_SCAN_FID, 0);
+	__atomic_add_fetch(count, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+void unittest_scan_lustre(void)
+{
+	struct lus_fs_handle *lfsh;
+	unsigned long count = 0;
+	char path[PATH_MAX];
+	int fd;
+	int rc;
+
+	rc = lus_open_fs(lustre_dir, &lfsh);
+	ck_assert_int_eq(rc, 0);
+
+	snprintf(path, sizeof(path), "%s/unittest_scan", lustre_dir);
+	mkdir(path, 0700);
+
+	snprintf(path, sizeof(path), "%s/unittest_scan/f1", lustre_dir);
+	fd = open(path, O_WRONLY | O_CREAT, 0600);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+
+	snprintf(path, sizeof(path), "%s/unittest_scan", lustre_dir);
+	rc = lus_scan(lfsh, path, LUS_SCAN_FID | LUS_SCAN_LAYOUT, 0,
+		      fid_cb, &count);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_ge(count, 1);
+
+	lus_close_fs(lfsh);
+}
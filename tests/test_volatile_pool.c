@@ -0,0 +1,174 @@
+/*
+ * An alternate Lustre user library.
+ * Copyright 2015 Cray Inc. All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Tests the pools of volatile files. The volatile files are replaced
+ * by anonymous files in /tmp, so no Lustre filesystem is needed.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <check.h>
+#include "check_extra.h"
+
+#include "../lib/volatile_pool.c"
+#include "lib_test.h"
+
+#define MAX_CREATED 64
+
+struct fake_volatiles {
+	unsigned int created;
+	unsigned int failures;
+	int fds[MAX_CREATED];
+};
+
+static struct fake_volatiles fake;
+
+/* Stands for volatile_create(). The FID encodes the MDT and the
+ * creation order. */
+static int fake_create(const struct lus_fs_handle *lfsh,
+		       unsigned int mdt_index, int open_flags,
+		       lustre_fid *fid)
+{
+	unsigned int n;
+	int fd;
+
+	if (__atomic_load_n(&fake.failures, __ATOMIC_RELAXED) > 0) {
+		__atomic_sub_fetch(&fake.failures, 1, __ATOMIC_RELAXED);
+		return -ENOSPC;
+	}
+
+	n = __atomic_load_n(&fake.created, __ATOMIC_RELAXED);
+	if (n == MAX_CREATED)
+		return -EMFILE;
+
+	fd = open("/tmp", O_TMPFILE | O_RDWR, S_IRUSR | S_IWUSR);
+	ck_assert_int_ge(fd, 0);
+
+	fid->f_seq = 0x200000400 + mdt_index;
+	fid->f_oid = n + 1;
+	fid->f_ver = 0;
+
+	fake.fds[n] = fd;
+	__atomic_store_n(&fake.created, n + 1, __ATOMIC_RELEASE);
+
+	return fd;
+}
+
+/* Wait for the pools to hold a number of files. */
+static void wait_available(struct volatile_pool *pool, size_t available)
+{
+	struct lus_volatile_pool_stats stats;
+	int i;
+
+	for (i = 0; i < 500; i++) {
+		volatile_pool_get_stats(pool, &stats);
+		if (stats.available == available)
+			return;
+		usleep(10000);
+	}
+
+	ck_abort_msg("pool has %zu files instead of %zu", stats.available,
+		     available);
+}
+
+void unittest_volatile_pool(void)
+{
+	struct lus_volatile_pool_stats stats;
+	struct volatile_pool *pool;
+	lustre_fid fid;
+	int claimed[4];
+	unsigned int i;
+	int fd;
+	int rc;
+
+	memset(&fake, 0, sizeof(fake));
+
+	volatile_pool_get_stats(NULL, &stats);
+	ck_assert_int_eq(stats.capacity, 0);
+	ck_assert_int_eq(volatile_pool_get(NULL, 0, 0, &fid), -ENOENT);
+	volatile_pool_destroy(NULL);
+
+	rc = volatile_pool_create(NULL, &pool);
+	ck_assert_int_eq(rc, 0);
+	pool->create = fake_create;
+
+	/* No MDT yet */
+	ck_assert_int_eq(volatile_pool_get(pool, 0, 0, &fid), -ENOENT);
+
+	/* Invalid sizes */
+	rc = volatile_pool_add_mdt(pool, 0, 0, 0);
+	ck_assert_int_eq(rc, -EINVAL);
+	rc = volatile_pool_add_mdt(pool, 0, VOLATILE_POOL_MAX_SIZE + 1, 0);
+	ck_assert_int_eq(rc, -EINVAL);
+
+	/* Two MDTs. The first creation fails, and is retried. */
+	fake.failures = 1;
+	rc = volatile_pool_add_mdt(pool, 0, 4, 0);
+	ck_assert_int_eq(rc, 0);
+	rc = volatile_pool_add_mdt(pool, 3, 2, O_NOATIME);
+	ck_assert_int_eq(rc, 0);
+	rc = volatile_pool_add_mdt(pool, 3, 2, 0);
+	ck_assert_int_eq(rc, -EEXIST);
+
+	wait_available(pool, 6);
+
+	volatile_pool_get_stats(pool, &stats);
+	ck_assert_int_eq(stats.capacity, 6);
+	ck_assert_int_eq(stats.misses, 1);
+	ck_assert_int_eq(fake.created, 6);
+
+	/* Wrong MDT or flags */
+	ck_assert_int_eq(volatile_pool_get(pool, 1, 0, &fid), -ENOENT);
+	ck_assert_int_eq(volatile_pool_get(pool, 3, 0, &fid), -ENOENT);
+
+	/* Claim all the files of the first MDT. */
+	for (i = 0; i < 4; i++) {
+		fd = volatile_pool_get(pool, 0, 0, &fid);
+		ck_assert_int_ge(fd, 0);
+		ck_assert_int_eq(fid.f_seq, 0x200000400);
+		ck_assert_int_eq(fd, fake.fds[fid.f_oid - 1]);
+		claimed[i] = fd;
+	}
+
+	fd = volatile_pool_get(pool, 3, O_NOATIME, &fid);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(fid.f_seq, 0x200000403);
+	close(fd);
+
+	/* Everything is replaced. */
+	wait_available(pool, 6);
+	ck_assert_int_eq(fake.created, 11);
+
+	volatile_pool_get_stats(pool, &stats);
+	ck_assert_int_ge(stats.hits, 5);
+
+	/* The unused files are closed, but not the claimed ones. */
+	volatile_pool_destroy(pool);
+
+	for (i = 0; i < fake.created; i++) {
+		if (fake.fds[i] == claimed[0] || fake.fds[i] == claimed[1] ||
+		    fake.fds[i] == claimed[2] || fake.fds[i] == claimed[3])
+			continue;
+
+		ck_assert_int_eq(fcntl(fake.fds[i], F_GETFD), -1);
+	}
+
+	for (i = 0; i < 4; i++) {
+		ck_assert_int_ne(fcntl(claimed[i], F_GETFD), -1);
+		close(claimed[i]);
+	}
+}